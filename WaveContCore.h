@@ -0,0 +1,2625 @@
+// Platform-neutral core of the WaveCont engine: the sample voice renderer,
+// the FX chain and the WAV helpers. WaveContV3.cpp builds it into the Pod
+// firmware and host/ builds it into an offline renderer, so nothing in here
+// may reach libDaisy, FatFS or the hardware; the profiler's cycle counter
+// is the one exception. DaisySP builds on both.
+#pragma once
+
+#include "daisysp.h"
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#if defined(WAVECONT_HOST)
+#include <chrono>
+#endif
+
+constexpr int32_t kPerformFaderCount = 4;
+constexpr int32_t kFxSatIndex = 0;
+constexpr int32_t kFxChorusIndex = 1;
+constexpr int32_t kFxDelayIndex = 2;
+constexpr int32_t kFxReverbIndex = 3;
+constexpr int32_t kBaseMidiNote = 60;
+constexpr float kSampleScale = 1.0f / 32768.0f;
+constexpr float kPi = 3.14159265f;
+constexpr float kTwoPi = 6.2831853f;
+
+constexpr float kReverbFeedback = 0.85f;
+constexpr float kReverbLpFreq = 12000.0f;
+constexpr float kReverbFeedbackMin = 0.2f;
+constexpr float kReverbFeedbackMax = 0.98f;
+constexpr float kReverbDampMinHz = 800.0f;
+constexpr float kReverbDampMaxHz = 20000.0f;
+constexpr float kReverbPreDelayMaxMs = 1000.0f;
+constexpr float kReverbDecayMinMs = 10.0f;
+constexpr float kReverbDecayMaxMs = 4000.0f;
+constexpr size_t kReverbPreDelayMaxSamples = 48000;
+constexpr float kReverbDefaultWet = 0.0f;
+constexpr float kShimmerHpHz = 900.0f;
+constexpr size_t kShimmerBufferSize = 8192;
+constexpr size_t kShimmerDelaySamples = 2048;
+constexpr float kShimmerRateUp = 2.0f;
+constexpr float kShimmerFeedback = 0.6f;
+constexpr float kChorusRateHz = 0.25f;
+constexpr float kChorusRateMinHz = 0.05f;
+constexpr float kChorusRateMaxHz = 0.9f;
+constexpr float kChorusDelayMs = 9.0f;
+constexpr float kChorusFeedback = 0.18f;
+constexpr float kChorusMaxDepth = 3.0f;
+constexpr float kChorusWidthMax = 2.2f;
+constexpr size_t kDelayMaxSamples = 96000;
+constexpr float kDelayTimeMinMs = 50.0f;
+constexpr float kDelayTimeMaxMs = 2000.0f;
+constexpr float kDelayTimeSlewMs = 180.0f;
+constexpr float kDelayParamSlewMs = 120.0f;
+constexpr float kDelayFeedbackMax = 0.98f;
+constexpr float kDelayDefaultWet = 0.0f;
+constexpr int kBitResoStepCount = 3;
+constexpr int kBitResoSteps[kBitResoStepCount] = {2, 3, 4};
+constexpr int kBitcrushMaxHold = 32;
+constexpr float kFxParamEpsilon = 1e-5f;
+// Level (|l| + |r|) below which a delay or reverb tail counts as silent.
+constexpr float kFxTailThreshold = 1e-4f;
+constexpr float kAmpEnvStep = 0.02f;
+constexpr float kAmpEnvMinMs = 5.0f;
+constexpr float kAmpEnvMaxMs = 1000.0f;
+constexpr float kAmpEnvStepMs = 20.0f;
+
+class TapeSaturator
+{
+public:
+	void Init(float sample_rate)
+	{
+		sample_rate_ = sample_rate;
+		dc_pre_.Init(sample_rate, 20.0f);
+		dc_post_.Init(sample_rate, 20.0f);
+		low_bump_lp_.Init(sample_rate, 90.0f);
+		high_emph_lp_.Init(sample_rate, 2000.0f);
+		post_lp_.Init(sample_rate, 16000.0f);
+		release_coeff_ = expf(-1.0f / (0.08f * sample_rate));
+		smooth_coeff_ = 1.0f - expf(-1.0f / (0.03f * sample_rate));
+		drive_target_ = 0.0f;
+		bias_target_ = 0.0f;
+		tone_target_ = 0.5f;
+		bump_target_ = 0.0f;
+		mix_target_ = 0.0f;
+		output_gain_target_ = 1.0f;
+		post_gain_target_ = 1.0f;
+		drive_ = 0.0f;
+		bias_ = 0.0f;
+		tone_ = 0.5f;
+		bump_ = 0.0f;
+		mix_ = 0.0f;
+		output_gain_ = 1.0f;
+		post_gain_ = 1.0f;
+		env_ = 0.0f;
+		prev_y_ = 0.0f;
+		block_frames_ = 0;
+		block_coeff_ = 0.0f;
+		UpdatePostCutoff(drive_);
+		UpdateBlockTerms();
+	}
+
+	// Smooth parameters once per audio block; Process() only reads the
+	// per-block terms this derives.
+	void Advance(size_t frames)
+	{
+		if (frames != block_frames_)
+		{
+			block_frames_ = frames;
+			block_coeff_ = 1.0f - powf(1.0f - smooth_coeff_, static_cast<float>(frames));
+		}
+		drive_ += block_coeff_ * (drive_target_ - drive_);
+		bias_ += block_coeff_ * (bias_target_ - bias_);
+		tone_ += block_coeff_ * (tone_target_ - tone_);
+		bump_ += block_coeff_ * (bump_target_ - bump_);
+		mix_ += block_coeff_ * (mix_target_ - mix_);
+		output_gain_ += block_coeff_ * (output_gain_target_ - output_gain_);
+		post_gain_ += block_coeff_ * (post_gain_target_ - post_gain_);
+		UpdateBlockTerms();
+	}
+
+	float Process(float x)
+	{
+		const float dry = x;
+
+		// 1) DC blocker.
+		x = dc_pre_.Process(x);
+
+		// 2) Pre-emphasis: low bump + gentle high lift.
+		const float low = low_bump_lp_.Process(x);
+		const float high = x - high_emph_lp_.Process(x);
+		const float mid = x - low - high;
+		const float mid_res_sample = (mid + (prev_y_ * 0.35f)) * mid_res_;
+		x = x + (low * low_gain_)
+			+ (mid * bump_mid_)
+			+ (mid_res_sample)
+			+ (high * high_amt_);
+
+		// 3) Envelope follower for mild tape compression.
+		const float abs_x = fabsf(x);
+		if (abs_x > env_)
+		{
+			env_ = abs_x;
+		}
+		else
+		{
+			env_ *= release_coeff_;
+		}
+		const float eff_drive = drive_ / (1.0f + comp_amt_ * env_);
+
+		// 4) Nonlinearity + bias + tape memory.
+		const float xb = x * (1.0f + eff_drive * drive_gain_) + bias_amt_;
+		float y = FastTanh(xb);
+		y += mem_amt_ * prev_y_;
+		prev_y_ = y;
+		y = dc_post_.Process(y);
+
+		// 5) Post-shape HF loss.
+		y = post_lp_.Process(y);
+		y *= post_gain_;
+
+		// 6) Wet/dry mix and 7) output trim.
+		float out = (mix_ * y) + (dry_mix_ * dry);
+		out *= output_gain_;
+		return out;
+	}
+
+	void SetDrive(float d01)
+	{
+		drive_target_ = Clamp(d01, 0.0f, 1.0f);
+		UpdatePostCutoff(drive_target_);
+		post_gain_target_ = DbToGain(-6.0f * drive_target_);
+	}
+
+	void SetBias(float b11)
+	{
+		bias_target_ = Clamp(b11, -1.0f, 1.0f);
+	}
+
+	void SetTone(float t01)
+	{
+		tone_target_ = Clamp(t01, 0.0f, 1.0f);
+	}
+
+	void SetBump(float b01)
+	{
+		bump_target_ = Clamp(b01, 0.0f, 1.0f);
+	}
+
+	void SetMix(float m01)
+	{
+		mix_target_ = Clamp(m01, 0.0f, 1.0f);
+	}
+
+	void SetOutput(float o01)
+	{
+		const float out = Clamp(o01, 0.0f, 1.0f);
+		const float gain_db = -12.0f + (18.0f * out);
+		output_gain_target_ = powf(10.0f, gain_db / 20.0f);
+	}
+
+private:
+	struct DcBlocker
+	{
+		float x1 = 0.0f;
+		float y1 = 0.0f;
+		float r = 0.0f;
+
+		void Init(float sample_rate, float cutoff_hz)
+		{
+			r = expf(-2.0f * kPi * cutoff_hz / sample_rate);
+			x1 = 0.0f;
+			y1 = 0.0f;
+		}
+
+		float Process(float x)
+		{
+			const float y = x - x1 + (r * y1);
+			x1 = x;
+			y1 = y;
+			return y;
+		}
+	};
+
+	struct OnePoleLp
+	{
+		float a = 0.0f;
+		float y = 0.0f;
+
+		void Init(float sample_rate, float cutoff_hz)
+		{
+			SetFreq(sample_rate, cutoff_hz);
+			y = 0.0f;
+		}
+
+		void SetFreq(float sample_rate, float cutoff_hz)
+		{
+			a = expf(-2.0f * kPi * cutoff_hz / sample_rate);
+		}
+
+		float Process(float x)
+		{
+			y = (1.0f - a) * x + (a * y);
+			return y;
+		}
+	};
+
+	static float Clamp(float v, float lo, float hi)
+	{
+		if (v < lo)
+		{
+			return lo;
+		}
+		if (v > hi)
+		{
+			return hi;
+		}
+		return v;
+	}
+
+	static float FastTanh(float x)
+	{
+		if (x > 3.0f)
+		{
+			x = 3.0f;
+		}
+		else if (x < -3.0f)
+		{
+			x = -3.0f;
+		}
+		const float x2 = x * x;
+		return x * (27.0f + x2) / (27.0f + 9.0f * x2);
+	}
+
+	static float DbToGain(float db)
+	{
+		return powf(10.0f, db / 20.0f);
+	}
+
+	void UpdateBlockTerms()
+	{
+		const float pre_emph_boost = 1.0f + drive_;
+		const float bump_curve = bump_ * bump_;
+		low_gain_ = (0.06f + 0.08f * (1.0f - tone_)) * pre_emph_boost + (bump_curve * 0.25f);
+		high_amt_ = (0.02f + 0.08f * tone_) * pre_emph_boost;
+		bump_mid_ = bump_curve * 1.6f;
+		mid_res_ = bump_curve * 1.8f;
+		comp_amt_ = 0.35f * drive_;
+		drive_gain_ = 2.5f * (1.0f + drive_) * (1.0f + drive_);
+		bias_amt_ = bias_ * 0.12f;
+		mem_amt_ = 0.05f + 0.1f * drive_;
+		dry_mix_ = 1.0f - mix_;
+	}
+
+	void UpdatePostCutoff(float drive)
+	{
+		float cutoff = 16000.0f - (drive * 8000.0f);
+		if (cutoff < 8000.0f)
+		{
+			cutoff = 8000.0f;
+		}
+		post_lp_.SetFreq(sample_rate_, cutoff);
+	}
+
+	float sample_rate_ = 48000.0f;
+	float drive_target_ = 0.0f;
+	float bias_target_ = 0.0f;
+	float tone_target_ = 0.5f;
+	float bump_target_ = 0.0f;
+	float mix_target_ = 0.0f;
+	float output_gain_target_ = 1.0f;
+	float post_gain_target_ = 1.0f;
+
+	float drive_ = 0.0f;
+	float bias_ = 0.0f;
+	float tone_ = 0.5f;
+	float bump_ = 0.0f;
+	float mix_ = 0.0f;
+	float output_gain_ = 1.0f;
+	float post_gain_ = 1.0f;
+
+	float env_ = 0.0f;
+	float prev_y_ = 0.0f;
+	float release_coeff_ = 0.0f;
+	float smooth_coeff_ = 0.0f;
+	size_t block_frames_ = 0;
+	float block_coeff_ = 0.0f;
+
+	float low_gain_ = 0.0f;
+	float high_amt_ = 0.0f;
+	float bump_mid_ = 0.0f;
+	float mid_res_ = 0.0f;
+	float comp_amt_ = 0.0f;
+	float drive_gain_ = 2.5f;
+	float bias_amt_ = 0.0f;
+	float mem_amt_ = 0.05f;
+	float dry_mix_ = 1.0f;
+
+	DcBlocker dc_pre_;
+	DcBlocker dc_post_;
+	OnePoleLp low_bump_lp_;
+	OnePoleLp high_emph_lp_;
+	OnePoleLp post_lp_;
+};
+
+class BiquadLp
+{
+public:
+	void Reset()
+	{
+		z1_ = 0.0f;
+		z2_ = 0.0f;
+	}
+
+	void Set(float sample_rate, float freq, float q)
+	{
+		if (freq < 20.0f)
+		{
+			freq = 20.0f;
+		}
+		const float nyq = sample_rate * 0.49f;
+		if (freq > nyq)
+		{
+			freq = nyq;
+		}
+		if (q < 0.001f)
+		{
+			q = 0.001f;
+		}
+
+		const float w0 = (2.0f * kPi * freq) / sample_rate;
+		const float cos_w0 = cosf(w0);
+		const float sin_w0 = sinf(w0);
+		const float alpha = sin_w0 / (2.0f * q);
+
+		const float b0 = (1.0f - cos_w0) * 0.5f;
+		const float b1 = 1.0f - cos_w0;
+		const float b2 = (1.0f - cos_w0) * 0.5f;
+		const float a0 = 1.0f + alpha;
+		const float a1 = -2.0f * cos_w0;
+		const float a2 = 1.0f - alpha;
+
+		a0_ = b0 / a0;
+		a1_ = b1 / a0;
+		a2_ = b2 / a0;
+		b1_ = a1 / a0;
+		b2_ = a2 / a0;
+	}
+
+	float Process(float x)
+	{
+		const float y = (a0_ * x) + z1_;
+		z1_ = (a1_ * x) + z2_ - (b1_ * y);
+		z2_ = (a2_ * x) - (b2_ * y);
+		return y;
+	}
+
+private:
+	float a0_ = 0.0f;
+	float a1_ = 0.0f;
+	float a2_ = 0.0f;
+	float b1_ = 0.0f;
+	float b2_ = 0.0f;
+	float z1_ = 0.0f;
+	float z2_ = 0.0f;
+};
+
+class OnePoleHp
+{
+public:
+	void Init(float sample_rate, float cutoff_hz)
+	{
+		SetFreq(sample_rate, cutoff_hz);
+		y_ = 0.0f;
+		x1_ = 0.0f;
+	}
+
+	void SetFreq(float sample_rate, float cutoff_hz)
+	{
+		a_ = expf(-2.0f * kPi * cutoff_hz / sample_rate);
+	}
+
+	float Process(float x)
+	{
+		const float y = a_ * (y_ + x - x1_);
+		x1_ = x;
+		y_ = y;
+		return y;
+	}
+
+	void Reset()
+	{
+		y_ = 0.0f;
+		x1_ = 0.0f;
+	}
+
+private:
+	float a_ = 0.0f;
+	float y_ = 0.0f;
+	float x1_ = 0.0f;
+};
+
+static inline int ClampI(int v, int lo, int hi)
+{
+	return (v < lo) ? lo : (v > hi ? hi : v);
+}
+
+
+// One sine cycle plus a guard point for interpolation; filled at boot.
+constexpr int kSineTableSize = 256;
+static float sine_table[kSineTableSize + 1];
+
+static inline void InitSineTable()
+{
+	for (int i = 0; i <= kSineTableSize; ++i)
+	{
+		sine_table[i] = sinf(kTwoPi * static_cast<float>(i) / static_cast<float>(kSineTableSize));
+	}
+}
+
+// sin(2*pi*phase) for phase in [0, 1).
+static inline float SineFromPhase(float phase)
+{
+	const float pos = phase * static_cast<float>(kSineTableSize);
+	int idx = static_cast<int>(pos);
+	const float frac = pos - static_cast<float>(idx);
+	idx &= (kSineTableSize - 1);
+	return sine_table[idx] + (sine_table[idx + 1] - sine_table[idx]) * frac;
+}
+
+// Rounds half away from zero like roundf(), without the libm call.
+static inline float QuantizeToStep(float x, float step, float inv_step)
+{
+	const float q = x * inv_step;
+	const int32_t n = static_cast<int32_t>(q + ((q >= 0.0f) ? 0.5f : -0.5f));
+	return static_cast<float>(n) * step;
+}
+
+static inline int BitResoIndexFromValue(float value)
+{
+	if (value < 0.0f)
+	{
+		value = 0.0f;
+	}
+	else if (value > 1.0f)
+	{
+		value = 1.0f;
+	}
+	const int max_idx = kBitResoStepCount - 1;
+	const int idx = static_cast<int>(value * static_cast<float>(max_idx) + 0.5f);
+	return ClampI(idx, 0, max_idx);
+}
+
+static inline float AmpEnvMsFromFader(float value)
+{
+	if (value < 0.0f)
+	{
+		value = 0.0f;
+	}
+	else if (value > 1.0f)
+	{
+		value = 1.0f;
+	}
+	int steps = static_cast<int>(value / kAmpEnvStep + 0.5f);
+	if (steps < 0)
+	{
+		steps = 0;
+	}
+	const int max_steps = static_cast<int>(
+		((kAmpEnvMaxMs - kAmpEnvMinMs) / kAmpEnvStepMs) + 0.5f);
+	if (steps > max_steps)
+	{
+		steps = max_steps;
+	}
+	float ms = kAmpEnvMinMs + (static_cast<float>(steps) * kAmpEnvStepMs);
+	if (ms > kAmpEnvMaxMs)
+	{
+		ms = kAmpEnvMaxMs;
+	}
+	return ms;
+}
+
+static inline float FltCutoffFromFader(float value, float sample_rate)
+{
+	if (value < 0.0f)
+	{
+		value = 0.0f;
+	}
+	else if (value > 1.0f)
+	{
+		value = 1.0f;
+	}
+	const float min_hz = 20.0f;
+	const float max_hz = 20000.0f;
+	const float shaped = sqrtf(value);
+	float hz = min_hz * powf(max_hz / min_hz, shaped);
+	const float nyq = sample_rate * 0.49f;
+	if (hz > nyq)
+	{
+		hz = nyq;
+	}
+	return hz;
+}
+
+static inline float FltQFromFader(float value)
+{
+	if (value < 0.0f)
+	{
+		value = 0.0f;
+	}
+	else if (value > 1.0f)
+	{
+		value = 1.0f;
+	}
+	float q = value * 5.0f;
+	if (q < 0.001f)
+	{
+		q = 0.001f;
+	}
+	return q;
+}
+
+// Every FX, AMP and FLT parameter the UI edits. The firmware UI works on
+// fx_params; the audio callback copies it into its own snapshot once per
+// block, and skips the copy while the main loop is part-way through
+// rewriting it.
+struct FxParamBlock
+{
+	float amp_attack = 0.0f;
+	float amp_decay = 0.0f;
+	float amp_sustain = 0.0f;
+	float amp_release = 0.0f;
+	float flt_cutoff = 1.0f;
+	float flt_res = 0.02f;
+	float fx_s_wet = 0.0f;
+	float sat_drive = 0.5f;
+	float sat_tape_bump = 0.5f;
+	float sat_bit_reso = 0.5f;
+	float sat_bit_smpl = 0.5f;
+	int32_t sat_mode = 0;
+	float fx_c_wet = 0.0f;
+	float mod_depth = 0.5f;
+	float chorus_rate = 0.5f;
+	float chorus_wow = 0.5f;
+	float tape_rate = 0.5f;
+	int32_t chorus_mode = 0;
+	float delay_wet = kDelayDefaultWet;
+	float delay_time = 0.5f;
+	float delay_feedback = 0.5f;
+	float delay_spread = 0.5f;
+	float delay_freeze = 0.0f;
+	float reverb_wet = kReverbDefaultWet;
+	float reverb_pre = 0.5f;
+	float reverb_damp = 0.5f;
+	float reverb_decay = 0.5f;
+	float reverb_shimmer = 0.5f;
+};
+
+enum class FxStage : int32_t
+{
+	Sat,
+	Mod,
+	Delay,
+	Reverb,
+	Count,
+};
+
+constexpr int kFxStageCount = static_cast<int>(FxStage::Count);
+
+struct SatCoeffs
+{
+	bool tape = true;
+	float drive = 0.0f;
+	float bump = 0.5f;
+};
+
+struct ModCoeffs
+{
+	bool chorus = true;
+	float lfo_depth = 0.0f;
+	float lfo_hz = 0.0f;
+};
+
+struct DelayCoeffs
+{
+	float target_samples = 1.0f;
+};
+
+struct ReverbCoeffs
+{
+	float release = 1.0f;
+	float feedback = 0.0f;
+	float lp_hz = 0.0f;
+	float predelay_samples = 0.0f;
+};
+
+// Coefficients compiled from fx_params, one struct per FX stage.
+struct FxCoeffs
+{
+	SatCoeffs sat;
+	ModCoeffs mod;
+	DelayCoeffs delay;
+	ReverbCoeffs reverb;
+};
+
+static inline void ClampUnit(float& v)
+{
+	if (v < 0.0f) v = 0.0f;
+	if (v > 1.0f) v = 1.0f;
+}
+
+static inline void ClampFxParams(FxParamBlock& fx)
+{
+	ClampUnit(fx.sat_drive);
+	ClampUnit(fx.fx_s_wet);
+	ClampUnit(fx.sat_tape_bump);
+	ClampUnit(fx.sat_bit_smpl);
+	ClampUnit(fx.sat_bit_reso);
+	ClampUnit(fx.mod_depth);
+	ClampUnit(fx.fx_c_wet);
+	ClampUnit(fx.chorus_rate);
+	ClampUnit(fx.chorus_wow);
+	ClampUnit(fx.tape_rate);
+	ClampUnit(fx.delay_wet);
+	ClampUnit(fx.delay_time);
+	ClampUnit(fx.delay_feedback);
+	ClampUnit(fx.delay_spread);
+	ClampUnit(fx.delay_freeze);
+	ClampUnit(fx.reverb_wet);
+	ClampUnit(fx.reverb_pre);
+	ClampUnit(fx.reverb_damp);
+	ClampUnit(fx.reverb_decay);
+	ClampUnit(fx.reverb_shimmer);
+}
+
+static inline void CompileSatCoeffs(const FxParamBlock& fx, SatCoeffs& c)
+{
+	c.tape = (fx.sat_mode == 0);
+	c.drive = powf(fx.sat_drive, 0.7f);
+	c.bump = fx.sat_tape_bump;
+}
+
+static inline void CompileModCoeffs(const FxParamBlock& fx, ModCoeffs& c)
+{
+	c.chorus = (fx.chorus_mode == 0);
+	c.lfo_depth = fx.mod_depth * fx.mod_depth * (kChorusMaxDepth * 1.2f);
+	const float rate_curve = fx.chorus_rate * fx.chorus_rate;
+	c.lfo_hz = kChorusRateMinHz + rate_curve * (kChorusRateMaxHz - kChorusRateMinHz);
+}
+
+static inline void CompileDelayCoeffs(const FxParamBlock& fx, DelayCoeffs& c, float sr)
+{
+	const float time_curve = fx.delay_time * fx.delay_time;
+	const float delay_ms = kDelayTimeMinMs + (time_curve * (kDelayTimeMaxMs - kDelayTimeMinMs));
+	float target = delay_ms * 0.001f * sr;
+	const float max_delay = static_cast<float>(kDelayMaxSamples - 1);
+	if (target > max_delay)
+	{
+		target = max_delay;
+	}
+	if (target < 1.0f)
+	{
+		target = 1.0f;
+	}
+	c.target_samples = target;
+}
+
+static inline void CompileReverbCoeffs(const FxParamBlock& fx, ReverbCoeffs& c, float sr)
+{
+	const float decay_ms = kReverbDecayMinMs
+		+ fx.reverb_decay * fx.reverb_decay * (kReverbDecayMaxMs - kReverbDecayMinMs);
+	const float decay_samples = decay_ms * 0.001f * sr;
+	if (fx.reverb_decay >= 0.999f)
+	{
+		c.release = 1.0f;
+	}
+	else if (decay_samples > 1.0f)
+	{
+		c.release = expf(-1.0f / decay_samples);
+	}
+	else
+	{
+		c.release = 0.0f;
+	}
+	c.feedback = (fx.reverb_decay >= 0.999f) ? 0.99f : kReverbFeedback;
+	const float damp_curve = fx.reverb_damp * 1.6f;
+	float lp = kReverbDampMaxHz * powf(kReverbDampMinHz / kReverbDampMaxHz, damp_curve);
+	const float lp_max = sr * 0.49f;
+	if (lp > lp_max)
+	{
+		lp = lp_max;
+	}
+	if (lp < kReverbDampMinHz)
+	{
+		lp = kReverbDampMinHz;
+	}
+	c.lp_hz = lp;
+	const float pre_curve = fx.reverb_pre * fx.reverb_pre * fx.reverb_pre;
+	float predelay = pre_curve * (kReverbPreDelayMaxMs * 0.001f * sr);
+	const float predelay_max = static_cast<float>(kReverbPreDelayMaxSamples - 1);
+	if (predelay > predelay_max)
+	{
+		predelay = predelay_max;
+	}
+	c.predelay_samples = predelay;
+}
+
+#ifndef WAVECONT_PROFILE
+#define WAVECONT_PROFILE 1
+#endif
+
+// Callback profiler clock. Ticks are CPU cycles from the Cortex-M7 cycle
+// counter on the Pod (CMSIS arrives through daisy_pod.h) and steady_clock
+// nanoseconds on the host.
+#if defined(WAVECONT_HOST)
+static inline void ProfileClockInit()
+{
+}
+
+static inline uint32_t ProfileNow()
+{
+	return static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+static inline float ProfileTicksPerSecond()
+{
+	return 1e9f;
+}
+#else
+static inline void ProfileClockInit()
+{
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->LAR = 0xC5ACCE55;
+	DWT->CYCCNT = 0;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+static inline uint32_t ProfileNow()
+{
+	return DWT->CYCCNT;
+}
+
+static inline float ProfileTicksPerSecond()
+{
+	return static_cast<float>(SystemCoreClock);
+}
+#endif
+
+enum class ProfileStage : int32_t
+{
+	Control,
+	Voices,
+	Sat,
+	Mod,
+	Delay,
+	Reverb,
+	Callback,
+	Count,
+};
+
+constexpr int kProfileStageCount = static_cast<int>(ProfileStage::Count);
+constexpr const char* kProfileStageNames[kProfileStageCount]
+	= {"CTL", "VOI", "SAT", "MOD", "DLY", "REV", "ALL"};
+// Each histogram bin is 1/32 of the block deadline; the last bin also
+// takes anything past twice the deadline.
+constexpr int kProfileBinsPerBudget = 32;
+constexpr int kProfileHistBins = kProfileBinsPerBudget * 2;
+
+struct ProfileStageStats
+{
+	uint32_t count;
+	uint32_t min;
+	uint32_t max;
+	uint64_t sum;
+	uint32_t hist[kProfileHistBins];
+};
+
+// One measurement window. budget_ticks is the block deadline
+// (frames / sample rate) in profiler ticks.
+struct ProfileWindow
+{
+	ProfileStageStats stage[kProfileStageCount];
+	uint32_t budget_ticks;
+	float bin_scale;
+	uint32_t blocks;
+	uint32_t overruns;
+};
+
+static inline void ProfileWindowReset(ProfileWindow& w, uint32_t budget_ticks)
+{
+	std::memset(&w, 0, sizeof(w));
+	for (ProfileStageStats& s : w.stage)
+	{
+		s.min = UINT32_MAX;
+	}
+	w.budget_ticks = budget_ticks;
+	w.bin_scale = (budget_ticks > 0)
+		? (static_cast<float>(kProfileBinsPerBudget) / static_cast<float>(budget_ticks))
+		: 0.0f;
+}
+
+static inline void ProfileRecord(ProfileWindow& w, ProfileStage stage, uint32_t ticks)
+{
+	ProfileStageStats& s = w.stage[static_cast<int>(stage)];
+	++s.count;
+	s.sum += ticks;
+	if (ticks < s.min)
+	{
+		s.min = ticks;
+	}
+	if (ticks > s.max)
+	{
+		s.max = ticks;
+	}
+	int bin = static_cast<int>(static_cast<float>(ticks) * w.bin_scale);
+	if (bin >= kProfileHistBins)
+	{
+		bin = kProfileHistBins - 1;
+	}
+	++s.hist[bin];
+}
+
+// Closes a block: records the whole callback and counts a deadline miss.
+static inline void ProfileEndBlock(ProfileWindow& w, uint32_t callback_ticks)
+{
+	ProfileRecord(w, ProfileStage::Callback, callback_ticks);
+	++w.blocks;
+	if (callback_ticks > w.budget_ticks)
+	{
+		++w.overruns;
+	}
+}
+
+// Upper edge of the histogram bin holding quantile q, clamped to max.
+static inline uint32_t ProfilePercentile(const ProfileWindow& w, const ProfileStageStats& s, float q)
+{
+	if (s.count == 0)
+	{
+		return 0;
+	}
+	const uint32_t target = static_cast<uint32_t>(ceilf(q * static_cast<float>(s.count)));
+	uint32_t seen = 0;
+	for (int bin = 0; bin < kProfileHistBins; ++bin)
+	{
+		seen += s.hist[bin];
+		if (seen >= target)
+		{
+			const uint64_t edge = (static_cast<uint64_t>(bin) + 1U) * w.budget_ticks / kProfileBinsPerBudget;
+			return (edge < s.max) ? static_cast<uint32_t>(edge) : s.max;
+		}
+	}
+	return s.max;
+}
+
+static inline float ProfileLoadPercent(const ProfileWindow& w, uint32_t ticks)
+{
+	return (w.budget_ticks > 0)
+		? (100.0f * static_cast<float>(ticks) / static_cast<float>(w.budget_ticks))
+		: 0.0f;
+}
+
+// min/avg/p99/max of one stage as a percentage of the block deadline.
+static inline void ProfileStageLoads(const ProfileWindow& w,
+									 ProfileStage stage,
+									 float& min_pct,
+									 float& avg_pct,
+									 float& p99_pct,
+									 float& max_pct)
+{
+	const ProfileStageStats& s = w.stage[static_cast<int>(stage)];
+	if (s.count == 0)
+	{
+		min_pct = avg_pct = p99_pct = max_pct = 0.0f;
+		return;
+	}
+	min_pct = ProfileLoadPercent(w, s.min);
+	avg_pct = ProfileLoadPercent(w, static_cast<uint32_t>(s.sum / s.count));
+	p99_pct = ProfileLoadPercent(w, ProfilePercentile(w, s, 0.99f));
+	max_pct = ProfileLoadPercent(w, s.max);
+}
+
+// Large delay and reverb state behind an FxChain, kept apart so the
+// firmware can place it in SDRAM.
+struct FxChainMemory
+{
+	daisysp::ReverbSc reverb;
+	daisysp::DelayLine<float, kDelayMaxSamples> delay_l;
+	daisysp::DelayLine<float, kDelayMaxSamples> delay_r;
+	daisysp::DelayLine<float, kReverbPreDelayMaxSamples> predelay_l;
+	daisysp::DelayLine<float, kReverbPreDelayMaxSamples> predelay_r;
+	float shimmer_l[kShimmerBufferSize];
+	float shimmer_r[kShimmerBufferSize];
+};
+
+// SAT, MOD, DLY and REV stages run in a caller-chosen order. Mix levels
+// come from a clamped FxParamBlock snapshot (SetParams); everything that
+// costs a transcendental comes in precompiled through ApplyStage.
+class FxChain
+{
+public:
+	void Init(float sample_rate, FxChainMemory* mem)
+	{
+		sample_rate_ = sample_rate;
+		mem_ = mem;
+		InitSineTable();
+
+		mem_->reverb.Init(sample_rate);
+		mem_->reverb.SetFeedback(kReverbFeedback);
+		mem_->reverb.SetLpFreq(kReverbLpFreq);
+		shimmer_hp_l_.Init(sample_rate, kShimmerHpHz);
+		shimmer_hp_r_.Init(sample_rate, kShimmerHpHz);
+		for (size_t i = 0; i < kShimmerBufferSize; ++i)
+		{
+			mem_->shimmer_l[i] = 0.0f;
+			mem_->shimmer_r[i] = 0.0f;
+		}
+		shimmer_write_idx_ = 0;
+		shimmer_read_idx_ = static_cast<float>(kShimmerBufferSize - kShimmerDelaySamples);
+		shimmer_mode_ = 0;
+		for (int stage = 0; stage < kFxStageCount; ++stage)
+		{
+			stage_awake_[stage] = false;
+			stage_quiet_[stage] = 0;
+		}
+
+		sat_l_.Init(sample_rate);
+		sat_r_.Init(sample_rate);
+		sat_l_.SetTone(0.5f);
+		sat_r_.SetTone(0.5f);
+		sat_l_.SetBias(0.0f);
+		sat_r_.SetBias(0.0f);
+		sat_l_.SetOutput(0.666f);
+		sat_r_.SetOutput(0.666f);
+		sat_l_.SetDrive(0.0f);
+		sat_r_.SetDrive(0.0f);
+		sat_l_.SetMix(1.0f);
+		sat_r_.SetMix(1.0f);
+		sat_l_.SetBump(0.0f);
+		sat_r_.SetBump(0.0f);
+
+		chorus_l_.Init(sample_rate);
+		chorus_r_.Init(sample_rate);
+		chorus_l_.SetLfoFreq(kChorusRateHz);
+		chorus_r_.SetLfoFreq(-kChorusRateHz);
+		chorus_l_.SetDelayMs(kChorusDelayMs);
+		chorus_r_.SetDelayMs(kChorusDelayMs);
+		chorus_l_.SetFeedback(kChorusFeedback);
+		chorus_r_.SetFeedback(kChorusFeedback);
+		chorus_l_.SetLfoDepth(0.0f);
+		chorus_r_.SetLfoDepth(0.0f);
+
+		mem_->delay_l.Init();
+		mem_->delay_r.Init();
+		float delay_samples = kDelayTimeMinMs * 0.001f * sample_rate;
+		const float max_delay = static_cast<float>(kDelayMaxSamples - 1);
+		if (delay_samples > max_delay)
+		{
+			delay_samples = max_delay;
+		}
+		if (delay_samples < 1.0f)
+		{
+			delay_samples = 1.0f;
+		}
+		mem_->delay_l.SetDelay(delay_samples);
+		mem_->delay_r.SetDelay(delay_samples);
+
+		mem_->predelay_l.Init();
+		mem_->predelay_r.Init();
+		mem_->predelay_l.SetDelay(0.0f);
+		mem_->predelay_r.SetDelay(0.0f);
+	}
+
+	void SetParams(const FxParamBlock& params)
+	{
+		params_ = params;
+	}
+
+	const FxParamBlock& Params() const
+	{
+		return params_;
+	}
+
+	// Takes one compiled stage and pushes it into the DSP objects.
+	void ApplyStage(FxStage stage, const FxCoeffs& compiled)
+	{
+		switch (stage)
+		{
+			case FxStage::Sat:
+			{
+				const SatCoeffs& c = compiled.sat;
+				coeffs_.sat = c;
+				if (c.tape)
+				{
+					sat_l_.SetDrive(c.drive);
+					sat_r_.SetDrive(c.drive);
+					sat_l_.SetBump(c.bump);
+					sat_r_.SetBump(c.bump);
+				}
+			}
+			break;
+			case FxStage::Mod:
+			{
+				const ModCoeffs& c = compiled.mod;
+				coeffs_.mod = c;
+				if (c.chorus)
+				{
+					chorus_l_.SetLfoDepth(c.lfo_depth);
+					chorus_r_.SetLfoDepth(c.lfo_depth);
+				}
+				chorus_l_.SetLfoFreq(c.lfo_hz);
+				chorus_r_.SetLfoFreq(-c.lfo_hz);
+			}
+			break;
+			case FxStage::Delay:
+				coeffs_.delay = compiled.delay;
+				break;
+			case FxStage::Reverb:
+			{
+				const ReverbCoeffs& c = compiled.reverb;
+				coeffs_.reverb = c;
+				mem_->reverb.SetFeedback(c.feedback);
+				mem_->reverb.SetLpFreq(c.lp_hz);
+				mem_->predelay_l.SetDelay(c.predelay_samples);
+				mem_->predelay_r.SetDelay(c.predelay_samples);
+			}
+			break;
+			default:
+				break;
+		}
+	}
+
+	// Block-rate work: parameter slews and every per-block term the
+	// per-sample stages read.
+	void BeginBlock(size_t frames)
+	{
+#if WAVECONT_PROFILE
+		for (uint32_t& ticks : stage_ticks_)
+		{
+			ticks = 0;
+		}
+#endif
+		if (frames != slew_frames_)
+		{
+			slew_frames_ = frames;
+			const float dt = static_cast<float>(frames) / sample_rate_;
+			const float time_tau = kDelayTimeSlewMs * 0.001f;
+			time_alpha_ = (time_tau > 0.0f) ? (1.0f - expf(-dt / time_tau)) : 1.0f;
+			const float param_tau = kDelayParamSlewMs * 0.001f;
+			param_alpha_ = (param_tau > 0.0f) ? (1.0f - expf(-dt / param_tau)) : 1.0f;
+		}
+		const float delay_target = coeffs_.delay.target_samples;
+		if (delay_time_smoothed_ < 0.0f)
+		{
+			delay_time_smoothed_ = delay_target;
+		}
+		delay_time_smoothed_ += (delay_target - delay_time_smoothed_) * time_alpha_;
+		if (delay_feedback_smoothed_ < 0.0f)
+		{
+			delay_feedback_smoothed_ = params_.delay_feedback;
+		}
+		delay_feedback_smoothed_ += (params_.delay_feedback - delay_feedback_smoothed_) * param_alpha_;
+		if (delay_spread_smoothed_ < 0.0f)
+		{
+			delay_spread_smoothed_ = params_.delay_spread;
+		}
+		delay_spread_smoothed_ += (params_.delay_spread - delay_spread_smoothed_) * param_alpha_;
+		if (fabsf(delay_time_smoothed_ - last_delay_time_) > kFxParamEpsilon)
+		{
+			mem_->delay_l.SetDelay(delay_time_smoothed_);
+			mem_->delay_r.SetDelay(delay_time_smoothed_);
+			last_delay_time_ = delay_time_smoothed_;
+		}
+
+		bit_hold_samples_ = 1 + static_cast<int>(params_.sat_bit_smpl * static_cast<float>(kBitcrushMaxHold - 1));
+		if (bit_hold_samples_ < 1)
+		{
+			bit_hold_samples_ = 1;
+		}
+		const int bit_depth = kBitResoSteps[BitResoIndexFromValue(params_.sat_bit_reso)];
+		bit_step_ = ldexpf(1.0f, -(bit_depth - 1));
+		bit_inv_step_ = 1.0f / bit_step_;
+		// SAT and MOD pass the dry signal through exactly at zero wet, so
+		// they only run while their wet is up.
+		stage_awake_[kFxSatIndex] = (params_.fx_s_wet > 0.0f);
+		stage_awake_[kFxChorusIndex] = (params_.fx_c_wet > 0.0f);
+		if (stage_awake_[kFxSatIndex] && params_.sat_mode == 0)
+		{
+			sat_l_.Advance(frames);
+			sat_r_.Advance(frames);
+		}
+
+		// Tape-drop shape only changes with the WOW/RATE knobs.
+		const float drop_amt = params_.chorus_wow;
+		drop_active_ = (params_.chorus_mode == 1) && (drop_amt > 0.0f);
+		if (drop_active_)
+		{
+			const float drop_amt_mapped = powf(drop_amt, 0.6f);
+			drop_curve_ = drop_amt_mapped * drop_amt_mapped;
+			const float rate_curve = params_.tape_rate * params_.tape_rate;
+			const float rate_scale = 0.2f + (rate_curve * 6.0f);
+			const float drop_rate = (0.2f + (drop_curve_ * 12.0f)) * rate_scale;
+			drop_step_ = drop_rate / sample_rate_;
+			drop_prob_ = 0.05f + (drop_curve_ * 0.9f);
+			drop_hold_scale_ = 1200.0f * drop_curve_ / (0.5f + rate_curve * 2.0f);
+			drop_slew_ = 0.08f + (drop_curve_ * 0.8f);
+			trem_step_ = (1.0f + drop_curve_ * 20.0f) * rate_scale / sample_rate_;
+			trem_depth_ = drop_curve_ * 0.85f;
+		}
+		// DLY and REV stop taking input at zero wet and sleep once their
+		// tails have been silent for a full pass through their buffers.
+		delay_feed_ = (params_.delay_wet > 0.0f) ? 1.0f : 0.0f;
+		delay_sleep_samples_ = static_cast<uint32_t>(delay_time_smoothed_) + 2U;
+		bypass_gain_[kFxDelayIndex] = 1.0f - params_.delay_wet;
+		reverb_feed_ = (params_.reverb_wet > 0.0f) ? 1.0f : 0.0f;
+		reverb_sleep_samples_ = static_cast<uint32_t>(coeffs_.reverb.predelay_samples)
+			+ static_cast<uint32_t>(kShimmerBufferSize);
+		const float wet = params_.reverb_wet;
+		if (wet < 0.5f)
+		{
+			reverb_wet_mix_ = 2.0f * wet * wet;
+			reverb_dry_mix_ = 1.0f - reverb_wet_mix_;
+		}
+		else
+		{
+			reverb_dry_mix_ = 2.0f * (1.0f - wet) * (1.0f - wet);
+			reverb_wet_mix_ = 1.0f - reverb_dry_mix_;
+		}
+		reverb_wet_mix_ *= 1.12f;
+		if (reverb_wet_mix_ > 1.0f)
+		{
+			reverb_wet_mix_ = 1.0f;
+		}
+		if (wet >= 0.999f)
+		{
+			reverb_wet_mix_ = 1.0f;
+			reverb_dry_mix_ = 0.0f;
+		}
+		bypass_gain_[kFxReverbIndex] = reverb_dry_mix_;
+
+		chorus_width_ = 1.0f + (params_.mod_depth * (kChorusWidthMax - 1.0f));
+		if (chorus_width_ < 1.0f)
+		{
+			chorus_width_ = 1.0f;
+		}
+		if (chorus_width_ > kChorusWidthMax)
+		{
+			chorus_width_ = kChorusWidthMax;
+		}
+	}
+
+	void Process(const int32_t* order, int count, float& l, float& r)
+	{
+		for (int stage = 0; stage < count; ++stage)
+		{
+			const int32_t index = order[stage];
+			if (index < 0 || index >= kFxStageCount)
+			{
+				continue;
+			}
+			if (!stage_awake_[index] && !WakeOnInput(index, l, r))
+			{
+				l *= bypass_gain_[index];
+				r *= bypass_gain_[index];
+				continue;
+			}
+#if WAVECONT_PROFILE
+			const uint32_t t0 = ProfileNow();
+#endif
+			switch (index)
+			{
+				case kFxSatIndex: ProcessSat(l, r); break;
+				case kFxChorusIndex: ProcessMod(l, r); break;
+				case kFxDelayIndex: ProcessDelay(l, r); break;
+				case kFxReverbIndex: ProcessReverb(l, r); break;
+				default: break;
+			}
+#if WAVECONT_PROFILE
+			stage_ticks_[index] += ProfileNow() - t0;
+#endif
+		}
+	}
+
+	bool StageAwake(FxStage stage) const
+	{
+		return stage_awake_[static_cast<int>(stage)];
+	}
+
+	// Profiler ticks spent in one stage since the last BeginBlock.
+	uint32_t StageTicks(FxStage stage) const
+	{
+#if WAVECONT_PROFILE
+		return stage_ticks_[static_cast<int>(stage)];
+#else
+		(void)stage;
+		return 0;
+#endif
+	}
+
+private:
+	// A sleeping DLY or REV stage wakes on input while its wet is up.
+	bool WakeOnInput(int32_t index, float l, float r)
+	{
+		const float feed = (index == kFxDelayIndex) ? delay_feed_
+			: (index == kFxReverbIndex) ? reverb_feed_
+			: 0.0f;
+		if (feed <= 0.0f || (fabsf(l) + fabsf(r)) < kFxTailThreshold)
+		{
+			return false;
+		}
+		stage_awake_[index] = true;
+		stage_quiet_[index] = 0;
+		return true;
+	}
+
+	// Counts consecutive silent samples and puts the stage to sleep after
+	// window of them.
+	void TrackTail(int32_t index, bool silent, uint32_t window)
+	{
+		if (!silent)
+		{
+			stage_quiet_[index] = 0;
+		}
+		else if (++stage_quiet_[index] > window)
+		{
+			stage_awake_[index] = false;
+		}
+	}
+
+	void ProcessSat(float& l, float& r)
+	{
+		const float sat_mix = params_.fx_s_wet;
+		const float dry_l = l;
+		const float dry_r = r;
+		float wet_l = l;
+		float wet_r = r;
+		if (params_.sat_mode == 0)
+		{
+			wet_l = sat_l_.Process(l);
+			wet_r = sat_r_.Process(r);
+		}
+		else
+		{
+			// Quantize once per held sample rather than on every output.
+			if (bit_hold_ <= 0)
+			{
+				bit_hold_ = bit_hold_samples_;
+				bit_hold_l_ = QuantizeToStep(l, bit_step_, bit_inv_step_);
+				bit_hold_r_ = QuantizeToStep(r, bit_step_, bit_inv_step_);
+				if (bit_hold_l_ > 1.0f) bit_hold_l_ = 1.0f;
+				if (bit_hold_l_ < -1.0f) bit_hold_l_ = -1.0f;
+				if (bit_hold_r_ > 1.0f) bit_hold_r_ = 1.0f;
+				if (bit_hold_r_ < -1.0f) bit_hold_r_ = -1.0f;
+			}
+			else
+			{
+				--bit_hold_;
+			}
+			wet_l = bit_hold_l_;
+			wet_r = bit_hold_r_;
+		}
+		l = (dry_l * (1.0f - sat_mix)) + (wet_l * sat_mix);
+		r = (dry_r * (1.0f - sat_mix)) + (wet_r * sat_mix);
+	}
+
+	void ProcessMod(float& l, float& r)
+	{
+		const float chorus_mix = params_.fx_c_wet;
+		const float dry_l = l;
+		const float dry_r = r;
+		float chorus_proc_l = chorus_l_.Process(l);
+		float chorus_proc_r = chorus_r_.Process(r);
+		float tape_drop = 1.0f;
+		if (drop_active_)
+		{
+			drop_phase_ += drop_step_;
+			bool new_step = false;
+			if (drop_phase_ >= 1.0f)
+			{
+				drop_phase_ -= 1.0f;
+				new_step = true;
+			}
+			drop_rng_ = (drop_rng_ * 1664525u) + 1013904223u;
+			const float rnd = static_cast<float>((drop_rng_ >> 8) & 0xFFFF) * (1.0f / 65535.0f);
+			if (drop_hold_ > 0)
+			{
+				drop_hold_--;
+				drop_target_ = 0.0f;
+			}
+			else if (new_step)
+			{
+				if (rnd < drop_prob_)
+				{
+					drop_hold_ = 10 + static_cast<int>(rnd * drop_hold_scale_);
+					drop_target_ = 0.0f;
+				}
+				else
+				{
+					drop_target_ = 1.0f - (drop_curve_ * 0.9f) + (rnd * drop_curve_ * 0.9f);
+				}
+			}
+			drop_gain_ += (drop_target_ - drop_gain_) * drop_slew_;
+			trem_phase_ += trem_step_;
+			if (trem_phase_ >= 1.0f)
+			{
+				trem_phase_ -= 1.0f;
+			}
+			const float trem = 0.5f * (1.0f + SineFromPhase(trem_phase_));
+			tape_drop = drop_gain_ * (1.0f - trem_depth_ + (trem_depth_ * trem));
+		}
+		float wet_l = chorus_proc_l * tape_drop;
+		float wet_r = chorus_proc_r * tape_drop;
+		if (params_.chorus_mode == 0)
+		{
+			const float mid = 0.5f * (wet_l + wet_r);
+			const float side = 0.5f * (wet_l - wet_r);
+			wet_l = mid + (side * chorus_width_);
+			wet_r = mid - (side * chorus_width_);
+		}
+		l = (dry_l * (1.0f - chorus_mix)) + (wet_l * chorus_mix);
+		r = (dry_r * (1.0f - chorus_mix)) + (wet_r * chorus_mix);
+	}
+
+	void ProcessDelay(float& l, float& r)
+	{
+		const float freeze = (params_.delay_freeze >= 0.5f) ? 1.0f : 0.0f;
+		float feedback = delay_feedback_smoothed_;
+		if (feedback > kDelayFeedbackMax)
+		{
+			feedback = kDelayFeedbackMax;
+		}
+		if (feedback < 0.0f)
+		{
+			feedback = 0.0f;
+		}
+		const float freeze_mix = (freeze > 0.0f) ? freeze : 0.0f;
+		const float feedback_mix = feedback + (freeze_mix * (1.0f - feedback));
+		const float input_gain = (1.0f - freeze_mix) * delay_feed_;
+		const float delay_in = 0.5f * (l + r);
+		const float pingpong = feedback;
+		const float input_l = delay_in * input_gain;
+		const float input_r = delay_in * input_gain * (1.0f - pingpong);
+		const float delay_out_l = mem_->delay_l.Read();
+		const float delay_out_r = mem_->delay_r.Read();
+		// Ping-pong delay with spread.
+		float fb_l = delay_out_r * feedback_mix;
+		float fb_r = delay_out_l * feedback_mix;
+		mem_->delay_l.Write(input_l + fb_l);
+		mem_->delay_r.Write(input_r + fb_r);
+		TrackTail(kFxDelayIndex,
+				  (fabsf(input_l) + fabsf(input_r) + fabsf(delay_out_l) + fabsf(delay_out_r)) < kFxTailThreshold,
+				  delay_sleep_samples_);
+		const float spread = delay_spread_smoothed_;
+		float delay_l = delay_out_l;
+		float delay_r = delay_out_r;
+		if (spread > 0.0f)
+		{
+			const float width = 1.0f + (spread * spread * 2.5f);
+			const float mid = 0.5f * (delay_l + delay_r);
+			const float side = 0.5f * (delay_l - delay_r);
+			delay_l = mid + (side * width);
+			delay_r = mid - (side * width);
+		}
+		const float mix = params_.delay_wet;
+		const float delay_mix_l = (l * (1.0f - mix)) + (delay_l * mix);
+		const float delay_mix_r = (r * (1.0f - mix)) + (delay_r * mix);
+		l = delay_mix_l;
+		r = delay_mix_r;
+	}
+
+	void ProcessReverb(float& l, float& r)
+	{
+		const float in_l = l * reverb_feed_;
+		const float in_r = r * reverb_feed_;
+		float rev_in_l = 0.0f;
+		float rev_in_r = 0.0f;
+		const bool predelay_active = (coeffs_.reverb.predelay_samples >= 1.0f);
+		if (predelay_active)
+		{
+			rev_in_l = mem_->predelay_l.Read();
+			rev_in_r = mem_->predelay_r.Read();
+			mem_->predelay_l.Write(in_l);
+			mem_->predelay_r.Write(in_r);
+		}
+		else
+		{
+			mem_->predelay_l.Write(in_l);
+			mem_->predelay_r.Write(in_r);
+			rev_in_l = in_l;
+			rev_in_r = in_r;
+		}
+		const float rev_in_level = fabsf(in_l) + fabsf(in_r);
+		if (rev_in_level > kFxTailThreshold)
+		{
+			reverb_tail_gain_ = 1.0f;
+		}
+		else
+		{
+			reverb_tail_gain_ *= coeffs_.reverb.release;
+		}
+		// Shimmer: pitch-shifted octave layer around midpoint (0.5 = no shimmer).
+		const float rev_shimmer = params_.reverb_shimmer;
+		float shimmer_amount = 0.0f;
+		float shimmer_rate = 1.0f;
+		int next_mode = 0;
+		if (rev_shimmer > 0.0f)
+		{
+			shimmer_amount = rev_shimmer;
+			if (shimmer_amount > 1.0f)
+			{
+				shimmer_amount = 1.0f;
+			}
+			if (shimmer_amount < 0.25f)
+			{
+				shimmer_amount *= 2.0f;
+			}
+			else
+			{
+				shimmer_amount = 0.5f + (shimmer_amount - 0.25f) * (0.5f / 0.75f);
+			}
+			if (shimmer_amount > 1.0f)
+			{
+				shimmer_amount = 1.0f;
+			}
+			shimmer_rate = kShimmerRateUp;
+			next_mode = 1;
+		}
+		else
+		{
+			shimmer_amount = 0.0f;
+			shimmer_rate = kShimmerRateUp;
+			next_mode = 0;
+		}
+
+		if (next_mode != shimmer_mode_)
+		{
+			shimmer_mode_ = next_mode;
+			shimmer_read_idx_ = static_cast<float>(
+				(shimmer_write_idx_ + kShimmerBufferSize - kShimmerDelaySamples)
+				% kShimmerBufferSize);
+		}
+
+		float* shimmer_buf_l = mem_->shimmer_l;
+		float* shimmer_buf_r = mem_->shimmer_r;
+		float shimmer_fb_l = 0.0f;
+		float shimmer_fb_r = 0.0f;
+		if (shimmer_amount > 0.0f)
+		{
+			const size_t read_i0 = static_cast<size_t>(shimmer_read_idx_) % kShimmerBufferSize;
+			const size_t read_i1 = (read_i0 + 1) % kShimmerBufferSize;
+			const float frac = shimmer_read_idx_ - static_cast<float>(read_i0);
+			const float sh_l = shimmer_buf_l[read_i0]
+				+ (shimmer_buf_l[read_i1] - shimmer_buf_l[read_i0]) * frac;
+			const float sh_r = shimmer_buf_r[read_i0]
+				+ (shimmer_buf_r[read_i1] - shimmer_buf_r[read_i0]) * frac;
+			shimmer_fb_l = shimmer_amount * kShimmerFeedback * shimmer_hp_l_.Process(sh_l);
+			shimmer_fb_r = shimmer_amount * kShimmerFeedback * shimmer_hp_r_.Process(sh_r);
+
+			shimmer_read_idx_ += shimmer_rate;
+			while (shimmer_read_idx_ >= static_cast<float>(kShimmerBufferSize))
+			{
+				shimmer_read_idx_ -= static_cast<float>(kShimmerBufferSize);
+			}
+			const size_t read_int = static_cast<size_t>(shimmer_read_idx_);
+			size_t dist = (shimmer_write_idx_ >= read_int)
+				? (shimmer_write_idx_ - read_int)
+				: (shimmer_write_idx_ + kShimmerBufferSize - read_int);
+			if (dist < 4)
+			{
+				shimmer_read_idx_ = static_cast<float>(
+					(shimmer_write_idx_ + kShimmerBufferSize - kShimmerDelaySamples)
+					% kShimmerBufferSize);
+			}
+		}
+
+		float rev_l = 0.0f;
+		float rev_r = 0.0f;
+		mem_->reverb.Process(rev_in_l + shimmer_fb_l, rev_in_r + shimmer_fb_r, &rev_l, &rev_r);
+		rev_l *= reverb_tail_gain_;
+		rev_r *= reverb_tail_gain_;
+
+		shimmer_buf_l[shimmer_write_idx_] = rev_l;
+		shimmer_buf_r[shimmer_write_idx_] = rev_r;
+		shimmer_write_idx_ = (shimmer_write_idx_ + 1) % kShimmerBufferSize;
+		// The predelay and shimmer buffers must drain before the tail is
+		// really gone.
+		TrackTail(kFxReverbIndex,
+				  rev_in_level <= kFxTailThreshold && reverb_tail_gain_ < kFxTailThreshold,
+				  reverb_sleep_samples_);
+		l = (l * reverb_dry_mix_) + (rev_l * reverb_wet_mix_);
+		r = (r * reverb_dry_mix_) + (rev_r * reverb_wet_mix_);
+	}
+
+	float sample_rate_ = 48000.0f;
+	FxChainMemory* mem_ = nullptr;
+	FxParamBlock params_;
+	FxCoeffs coeffs_;
+
+	TapeSaturator sat_l_;
+	TapeSaturator sat_r_;
+	int bit_hold_ = 0;
+	int bit_hold_samples_ = 1;
+	float bit_hold_l_ = 0.0f;
+	float bit_hold_r_ = 0.0f;
+	float bit_step_ = 1.0f;
+	float bit_inv_step_ = 1.0f;
+
+	daisysp::ChorusEngine chorus_l_;
+	daisysp::ChorusEngine chorus_r_;
+	float chorus_width_ = 1.0f;
+	bool drop_active_ = false;
+	float drop_phase_ = 0.0f;
+	float drop_gain_ = 1.0f;
+	float drop_target_ = 1.0f;
+	int drop_hold_ = 0;
+	uint32_t drop_rng_ = 0x12345678;
+	float drop_curve_ = 0.0f;
+	float drop_step_ = 0.0f;
+	float drop_prob_ = 0.0f;
+	float drop_hold_scale_ = 0.0f;
+	float drop_slew_ = 0.0f;
+	float trem_phase_ = 0.0f;
+	float trem_step_ = 0.0f;
+	float trem_depth_ = 0.0f;
+
+	size_t slew_frames_ = 0;
+	float time_alpha_ = 1.0f;
+	float param_alpha_ = 1.0f;
+	float delay_time_smoothed_ = -1.0f;
+	float delay_feedback_smoothed_ = -1.0f;
+	float delay_spread_smoothed_ = -1.0f;
+	float last_delay_time_ = -1.0f;
+
+	OnePoleHp shimmer_hp_l_;
+	OnePoleHp shimmer_hp_r_;
+	size_t shimmer_write_idx_ = 0;
+	float shimmer_read_idx_ = 0.0f;
+	int shimmer_mode_ = 0;
+	float reverb_tail_gain_ = 0.0f;
+	float reverb_feed_ = 0.0f;
+	float reverb_wet_mix_ = 0.0f;
+	float reverb_dry_mix_ = 1.0f;
+	uint32_t reverb_sleep_samples_ = 0;
+
+	float delay_feed_ = 0.0f;
+	uint32_t delay_sleep_samples_ = 0;
+
+	// Idle-stage bypass. A sleeping stage only scales the signal by its
+	// dry gain.
+	bool stage_awake_[kFxStageCount] = {};
+	uint32_t stage_quiet_[kFxStageCount] = {};
+	float bypass_gain_[kFxStageCount] = {1.0f, 1.0f, 1.0f, 1.0f};
+
+#if WAVECONT_PROFILE
+	uint32_t stage_ticks_[kFxStageCount] = {};
+#endif
+};
+
+// Four-pole lowpass per voice: two biquads per channel.
+struct VoiceFilter
+{
+	BiquadLp l1;
+	BiquadLp l2;
+	BiquadLp r1;
+	BiquadLp r2;
+
+	void Reset()
+	{
+		l1.Reset();
+		l2.Reset();
+		r1.Reset();
+		r2.Reset();
+	}
+
+	void Set(float sample_rate, float freq, float q)
+	{
+		l1.Set(sample_rate, freq, q);
+		l2.Set(sample_rate, freq, q);
+		r1.Set(sample_rate, freq, q);
+		r2.Set(sample_rate, freq, q);
+	}
+};
+
+static int16_t sample_silence[2] = {0, 0};
+
+// Sample memory a voice reads from. Each voice carries its own so PLAY
+// tracks can sound together from their resident buffers.
+struct VoiceSample
+{
+	const int16_t* l = sample_silence;
+	const int16_t* r = sample_silence;
+	size_t resident = 0;
+	bool stereo = false;
+};
+
+struct PerformVoice
+{
+	bool active = false;
+	bool releasing = false;
+	float phase = 0.0f;
+	float rate = 1.0f;
+	float amp = 1.0f;
+	float env = 0.0f;
+	float release_start = 0.0f;
+	float release_pos = 0.0f;
+	int32_t note = -1;
+	size_t offset = 0;
+	size_t length = 0;
+	uint32_t env_samples = 0;
+	uint32_t generation = 0;
+	int8_t stream_slot = -1;
+	VoiceSample sample;
+	// Steal handoff: the audio callback fades the current note out over
+	// kVoiceStealFadeFrames, then starts the pending one.
+	volatile bool steal_pending = false;
+	size_t steal_fade_left = 0;
+	bool pending_release = false;
+	uint32_t pending_release_clock = 0;
+	// Voices wait for start_clock on audio_frame_clock and begin their
+	// release at release_clock.
+	bool scheduled = false;
+	uint32_t start_clock = 0;
+	bool release_scheduled = false;
+	uint32_t release_clock = 0;
+	bool pending_scheduled = false;
+	uint32_t pending_start_clock = 0;
+	uint32_t pending_generation = 0;
+	int32_t pending_note = -1;
+	float pending_rate = 1.0f;
+	size_t pending_offset = 0;
+	size_t pending_length = 0;
+	int8_t pending_stream_slot = -1;
+	VoiceSample pending_sample;
+};
+
+struct VoiceRenderParams
+{
+	bool env_active = false;
+	float inv_attack_samples = 0.0f;
+	float release_samples = 0.0f;
+	float inv_release_samples = 0.0f;
+};
+
+// Sample access for a voice window, indexed relative to voice.offset.
+struct ResidentVoiceSource
+{
+	const int16_t* l;
+	const int16_t* r;
+
+	bool Available(size_t) const { return true; }
+	bool Failed() const { return false; }
+	float L(size_t i) const { return static_cast<float>(l[i]); }
+	float R(size_t i) const { return static_cast<float>(r[i]); }
+};
+
+static inline void RetirePerformVoice(PerformVoice& voice)
+{
+	voice.active = false;
+	voice.releasing = false;
+	voice.release_pos = 0.0f;
+	voice.env_samples = 0;
+}
+
+static inline void BeginVoiceRelease(PerformVoice& voice)
+{
+	voice.release_pos = 0.0f;
+	voice.release_start = voice.env;
+	if (voice.release_start < 0.0f)
+	{
+		voice.release_start = 0.0f;
+	}
+	else if (voice.release_start > 1.0f)
+	{
+		voice.release_start = 1.0f;
+	}
+	voice.releasing = true;
+}
+
+// Renders one voice across the whole block and sums it into mix_l/mix_r.
+// Channel layout and the per-voice filter are template arguments so the
+// inner loop carries no per-sample mode checks. gain/gain_step carry the
+// steal fade-out. Returns true when a streamed source ran dry and the voice
+// is holding position.
+template <typename Source, bool kStereo, bool kFilter>
+static bool RenderPerformVoiceBlock(PerformVoice& voice,
+									VoiceFilter& lpf,
+									const Source& src,
+									const VoiceRenderParams& p,
+									float* mix_l,
+									float* mix_r,
+									size_t frames,
+									float gain,
+									float gain_step)
+{
+	BiquadLp& lpf_l1 = lpf.l1;
+	BiquadLp& lpf_l2 = lpf.l2;
+	BiquadLp& lpf_r1 = lpf.r1;
+	BiquadLp& lpf_r2 = lpf.r2;
+	const float amp_scale = voice.amp * kSampleScale;
+	const bool releasing = voice.releasing;
+	const bool release_ends = releasing && (p.release_samples > 1.0f);
+	const float length_end = static_cast<float>(voice.length - 1);
+	float phase = voice.phase;
+	float release_pos = voice.release_pos;
+	uint32_t env_samples = voice.env_samples;
+	float env = voice.env;
+
+	if (voice.length == 1)
+	{
+		if (!src.Available(1))
+		{
+			if (src.Failed())
+			{
+				RetirePerformVoice(voice);
+			}
+			return false;
+		}
+		env = (p.env_active && p.inv_attack_samples > 0.0f)
+			? static_cast<float>(env_samples) * p.inv_attack_samples
+			: 1.0f;
+		if (env > 1.0f)
+		{
+			env = 1.0f;
+		}
+		if (releasing)
+		{
+			float noteoff_env = voice.release_start;
+			if (p.release_samples > 1.0f)
+			{
+				noteoff_env *= (1.0f - (release_pos * p.inv_release_samples));
+			}
+			if (noteoff_env < env)
+			{
+				env = noteoff_env;
+			}
+		}
+		if (env < 0.0f)
+		{
+			env = 0.0f;
+		}
+		const float amp = amp_scale * env * gain;
+		float samp_l = src.L(0) * amp;
+		float samp_r = (kStereo ? src.R(0) : src.L(0)) * amp;
+		if (kFilter)
+		{
+			samp_l = lpf_l2.Process(lpf_l1.Process(samp_l));
+			samp_r = lpf_r2.Process(lpf_r1.Process(samp_r));
+		}
+		mix_l[0] += samp_l;
+		mix_r[0] += samp_r;
+		voice.env = env;
+		RetirePerformVoice(voice);
+		return false;
+	}
+
+	const bool attack_ramp = p.env_active && (p.inv_attack_samples > 0.0f);
+	bool stalled = false;
+	for (size_t i = 0; i < frames; ++i)
+	{
+		const size_t idx = static_cast<size_t>(phase);
+		if (idx + 1 >= voice.length)
+		{
+			RetirePerformVoice(voice);
+			return false;
+		}
+		if (!src.Available(idx + 2))
+		{
+			// Streamed voice ran ahead of its refill ring: hold position.
+			if (src.Failed())
+			{
+				RetirePerformVoice(voice);
+				return false;
+			}
+			stalled = true;
+			break;
+		}
+		env = attack_ramp ? static_cast<float>(env_samples) * p.inv_attack_samples : 1.0f;
+		if (env > 1.0f)
+		{
+			env = 1.0f;
+		}
+		if (releasing)
+		{
+			float noteoff_env = voice.release_start;
+			if (p.release_samples > 1.0f)
+			{
+				noteoff_env *= (1.0f - (release_pos * p.inv_release_samples));
+			}
+			if (noteoff_env < env)
+			{
+				env = noteoff_env;
+			}
+		}
+		if (env < 0.0f)
+		{
+			env = 0.0f;
+		}
+		const float frac = phase - static_cast<float>(idx);
+		const float amp = amp_scale * env * gain;
+		gain += gain_step;
+		const float l0 = src.L(idx);
+		const float l1 = src.L(idx + 1);
+		float samp_l = (l0 + (l1 - l0) * frac) * amp;
+		float samp_r = samp_l;
+		if (kStereo)
+		{
+			const float r0 = src.R(idx);
+			const float r1 = src.R(idx + 1);
+			samp_r = (r0 + (r1 - r0) * frac) * amp;
+		}
+		if (kFilter)
+		{
+			samp_l = lpf_l2.Process(lpf_l1.Process(samp_l));
+			samp_r = lpf_r2.Process(lpf_r1.Process(samp_r));
+		}
+		mix_l[i] += samp_l;
+		mix_r[i] += samp_r;
+		phase += voice.rate;
+		if (!releasing)
+		{
+			++env_samples;
+		}
+		else
+		{
+			release_pos += 1.0f;
+			if (release_ends && release_pos >= p.release_samples)
+			{
+				voice.env = env;
+				RetirePerformVoice(voice);
+				return false;
+			}
+		}
+		if (phase >= length_end)
+		{
+			voice.env = env;
+			RetirePerformVoice(voice);
+			return false;
+		}
+	}
+	voice.phase = phase;
+	voice.release_pos = release_pos;
+	voice.env_samples = env_samples;
+	voice.env = env;
+	return stalled;
+}
+
+template <typename Source>
+static bool DispatchPerformVoiceBlock(PerformVoice& voice,
+									  VoiceFilter& lpf,
+									  const Source& src,
+									  const VoiceRenderParams& p,
+									  bool stereo,
+									  bool filter,
+									  float* mix_l,
+									  float* mix_r,
+									  size_t frames,
+									  float gain,
+									  float gain_step)
+{
+	if (stereo)
+	{
+		if (filter)
+		{
+			return RenderPerformVoiceBlock<Source, true, true>(voice, lpf, src, p, mix_l, mix_r, frames, gain, gain_step);
+		}
+		else
+		{
+			return RenderPerformVoiceBlock<Source, true, false>(voice, lpf, src, p, mix_l, mix_r, frames, gain, gain_step);
+		}
+	}
+	else if (filter)
+	{
+		return RenderPerformVoiceBlock<Source, false, true>(voice, lpf, src, p, mix_l, mix_r, frames, gain, gain_step);
+	}
+	else
+	{
+		return RenderPerformVoiceBlock<Source, false, false>(voice, lpf, src, p, mix_l, mix_r, frames, gain, gain_step);
+	}
+}
+
+struct WavInfo
+{
+	uint16_t num_channels = 0;
+	uint32_t sample_rate = 0;
+	uint16_t bits_per_sample = 0;
+	uint32_t data_offset = 0;
+	uint32_t data_size = 0;
+};
+
+static inline uint16_t WavReadLe16(const uint8_t* p)
+{
+	return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+static inline uint32_t WavReadLe32(const uint8_t* p)
+{
+	return static_cast<uint32_t>(p[0])
+		| (static_cast<uint32_t>(p[1]) << 8)
+		| (static_cast<uint32_t>(p[2]) << 16)
+		| (static_cast<uint32_t>(p[3]) << 24);
+}
+
+// Fills the format fields of info from the body of a "fmt " chunk and
+// returns its audio format tag (1 = PCM), or 0 if the chunk is too short.
+static inline uint16_t ParseWavFmtChunk(const uint8_t* fmt, size_t len, WavInfo& info)
+{
+	if (len < 16)
+	{
+		return 0;
+	}
+	info.num_channels = WavReadLe16(fmt + 2);
+	info.sample_rate = WavReadLe32(fmt + 4);
+	info.bits_per_sample = WavReadLe16(fmt + 14);
+	return WavReadLe16(fmt);
+}
+
+// Splits interleaved 16-bit PCM into the engine's per-channel buffers.
+// Mono input only writes dst_l.
+static inline void DeinterleavePcm16(const int16_t* src,
+									 size_t frames,
+									 uint16_t channels,
+									 int16_t* dst_l,
+									 int16_t* dst_r)
+{
+	if (channels == 1)
+	{
+		std::memcpy(dst_l, src, frames * sizeof(int16_t));
+		return;
+	}
+	// Two frames per pass: two 32-bit loads (L|R, little-endian) become one
+	// 32-bit store per channel.
+	size_t i = 0;
+	for (; i + 2 <= frames; i += 2)
+	{
+		uint32_t f0;
+		uint32_t f1;
+		std::memcpy(&f0, src + (i * 2), sizeof(f0));
+		std::memcpy(&f1, src + (i * 2) + 2, sizeof(f1));
+		const uint32_t l = (f0 & 0xFFFFu) | (f1 << 16);
+		const uint32_t r = (f0 >> 16) | (f1 & 0xFFFF0000u);
+		std::memcpy(dst_l + i, &l, sizeof(l));
+		std::memcpy(dst_r + i, &r, sizeof(r));
+	}
+	for (; i < frames; ++i)
+	{
+		dst_l[i] = src[i * 2];
+		dst_r[i] = src[i * 2 + 1];
+	}
+}
+
+// Min/max pyramid over the left channel of a sample. Level 0 holds one
+// min/max pair per 2^kWavePyramidBaseShift frames and every level above
+// halves the one below, so any window of the sample can be summarised
+// from a handful of bins. Storage is supplied by the caller.
+constexpr size_t kWavePyramidBaseShift = 5;
+constexpr size_t kWavePyramidBaseFrames = static_cast<size_t>(1) << kWavePyramidBaseShift;
+constexpr int32_t kWavePyramidMaxLevels = 24;
+
+static inline constexpr size_t WavePyramidEntries(size_t max_frames)
+{
+	size_t bins = (max_frames + kWavePyramidBaseFrames - 1) >> kWavePyramidBaseShift;
+	size_t total = bins;
+	while (bins > 1)
+	{
+		bins = (bins + 1) / 2;
+		total += bins;
+	}
+	return total;
+}
+
+struct WavePyramid
+{
+	int16_t* lo = nullptr;
+	int16_t* hi = nullptr;
+	size_t capacity = 0;
+	size_t frames = 0;
+	int32_t levels = 0;
+	size_t offset[kWavePyramidMaxLevels] = {};
+	size_t bins[kWavePyramidMaxLevels] = {};
+	bool ready = false;
+};
+
+static inline void WavePyramidInit(WavePyramid& p, int16_t* lo, int16_t* hi, size_t capacity)
+{
+	p = WavePyramid();
+	p.lo = lo;
+	p.hi = hi;
+	p.capacity = capacity;
+}
+
+// Starts a new sample. Level 0 is then fed in frame order; each bin is
+// overwritten by the first frame that lands in it, so nothing is cleared.
+static inline void WavePyramidBegin(WavePyramid& p)
+{
+	p.ready = false;
+	p.frames = 0;
+	p.levels = 0;
+}
+
+static inline void WavePyramidAddBin(WavePyramid& p, size_t frame, int16_t lo, int16_t hi)
+{
+	const size_t bin = frame >> kWavePyramidBaseShift;
+	if (bin >= p.capacity)
+	{
+		return;
+	}
+	if ((frame & (kWavePyramidBaseFrames - 1)) == 0)
+	{
+		p.lo[bin] = lo;
+		p.hi[bin] = hi;
+		return;
+	}
+	p.lo[bin] = (lo < p.lo[bin]) ? lo : p.lo[bin];
+	p.hi[bin] = (hi > p.hi[bin]) ? hi : p.hi[bin];
+}
+
+static inline void WavePyramidAddSample(WavePyramid& p, size_t frame, int16_t s)
+{
+	WavePyramidAddBin(p, frame, s, s);
+}
+
+// Builds the upper levels once level 0 covers frames. Returns false if
+// the storage is too small, leaving the pyramid unusable.
+static inline bool WavePyramidFinish(WavePyramid& p, size_t frames)
+{
+	p.ready = false;
+	p.frames = frames;
+	p.levels = 0;
+	if (frames == 0 || p.lo == nullptr || WavePyramidEntries(frames) > p.capacity)
+	{
+		return false;
+	}
+	size_t bins = (frames + kWavePyramidBaseFrames - 1) >> kWavePyramidBaseShift;
+	size_t offset = 0;
+	p.offset[0] = 0;
+	p.bins[0] = bins;
+	p.levels = 1;
+	while (bins > 1 && p.levels < kWavePyramidMaxLevels)
+	{
+		const size_t src = offset;
+		offset += bins;
+		const size_t next = (bins + 1) / 2;
+		for (size_t b = 0; b < next; ++b)
+		{
+			const size_t a = src + b * 2;
+			int16_t lo = p.lo[a];
+			int16_t hi = p.hi[a];
+			if (b * 2 + 1 < bins)
+			{
+				lo = (p.lo[a + 1] < lo) ? p.lo[a + 1] : lo;
+				hi = (p.hi[a + 1] > hi) ? p.hi[a + 1] : hi;
+			}
+			p.lo[offset + b] = lo;
+			p.hi[offset + b] = hi;
+		}
+		bins = next;
+		p.offset[p.levels] = offset;
+		p.bins[p.levels] = bins;
+		++p.levels;
+	}
+	p.ready = true;
+	return true;
+}
+
+static inline void WavePyramidTake(const WavePyramid& p, int32_t level, size_t bin, int16_t& lo, int16_t& hi)
+{
+	const size_t at = p.offset[level] + bin;
+	lo = (p.lo[at] < lo) ? p.lo[at] : lo;
+	hi = (p.hi[at] > hi) ? p.hi[at] : hi;
+}
+
+// Min/max of frames [start, end). The partial level-0 bins at either end
+// are read from the samples, and the whole bins between them are split
+// into aligned runs, taking at most two bins per level on the way up, so
+// the cost is bounded by the pyramid's height whatever the range. Without
+// samples the edges widen to whole level-0 bins.
+static inline bool WavePyramidRange(const WavePyramid& p,
+									const int16_t* samples,
+									size_t start,
+									size_t end,
+									int16_t& lo,
+									int16_t& hi)
+{
+	if (!p.ready || start >= end || start >= p.frames)
+	{
+		return false;
+	}
+	if (end > p.frames)
+	{
+		end = p.frames;
+	}
+	lo = 32767;
+	hi = -32768;
+	constexpr size_t kMask = kWavePyramidBaseFrames - 1;
+	size_t first = start >> kWavePyramidBaseShift;
+	size_t last = (end + kMask) >> kWavePyramidBaseShift;
+	if (samples != nullptr)
+	{
+		size_t head_end = (start + kMask) & ~kMask;
+		head_end = (head_end < end) ? head_end : end;
+		size_t tail_start = end & ~kMask;
+		tail_start = (tail_start > head_end) ? tail_start : head_end;
+		for (size_t i = start; i < head_end; ++i)
+		{
+			lo = (samples[i] < lo) ? samples[i] : lo;
+			hi = (samples[i] > hi) ? samples[i] : hi;
+		}
+		for (size_t i = tail_start; i < end; ++i)
+		{
+			lo = (samples[i] < lo) ? samples[i] : lo;
+			hi = (samples[i] > hi) ? samples[i] : hi;
+		}
+		first = head_end >> kWavePyramidBaseShift;
+		last = tail_start >> kWavePyramidBaseShift;
+	}
+	for (int32_t level = 0; first < last; ++level)
+	{
+		if (level + 1 >= p.levels)
+		{
+			for (size_t b = first; b < last; ++b)
+			{
+				WavePyramidTake(p, level, b, lo, hi);
+			}
+			break;
+		}
+		if ((first & 1U) != 0)
+		{
+			WavePyramidTake(p, level, first++, lo, hi);
+		}
+		if ((last & 1U) != 0 && first < last)
+		{
+			WavePyramidTake(p, level, --last, lo, hi);
+		}
+		first >>= 1;
+		last >>= 1;
+	}
+	return true;
+}
+
+// Overview sidecar (.wvo) stored next to a WAV so the LOAD list can show
+// it without decoding audio: a 32-byte little-endian header followed by a
+// min/max pyramid of the left channel, 256 bins over the whole file down
+// to one. wav_size/date/time copy the WAV's directory entry so a changed
+// file is noticed.
+constexpr uint32_t kWaveOverviewMagic = 0x314F5657; // "WVO1"
+constexpr size_t kWaveOverviewBins = 256;
+constexpr int32_t kWaveOverviewLevels = 9;
+constexpr size_t kWaveOverviewPairs = kWaveOverviewBins * 2 - 1;
+constexpr size_t kWaveOverviewHeaderBytes = 32;
+constexpr size_t kWaveOverviewBytes = kWaveOverviewHeaderBytes + kWaveOverviewPairs * 4;
+
+struct WaveOverview
+{
+	uint32_t wav_size = 0;
+	uint16_t wav_date = 0;
+	uint16_t wav_time = 0;
+	uint32_t frames = 0;
+	uint32_t rate = 0;
+	uint16_t channels = 0;
+	uint16_t peak = 0;
+	int16_t lo[kWaveOverviewPairs] = {};
+	int16_t hi[kWaveOverviewPairs] = {};
+};
+
+// Index of the first pair of a level; level 0 has kWaveOverviewBins bins.
+static inline size_t WaveOverviewLevelOffset(int32_t level)
+{
+	size_t offset = 0;
+	size_t bins = kWaveOverviewBins;
+	for (int32_t i = 0; i < level; ++i)
+	{
+		offset += bins;
+		bins /= 2;
+	}
+	return offset;
+}
+
+// Fills the levels above level 0.
+static inline void WaveOverviewBuildLevels(WaveOverview& ov)
+{
+	size_t src = 0;
+	size_t bins = kWaveOverviewBins;
+	while (bins > 1)
+	{
+		const size_t dst = src + bins;
+		for (size_t b = 0; b < bins / 2; ++b)
+		{
+			const size_t a = src + b * 2;
+			ov.lo[dst + b] = (ov.lo[a + 1] < ov.lo[a]) ? ov.lo[a + 1] : ov.lo[a];
+			ov.hi[dst + b] = (ov.hi[a + 1] > ov.hi[a]) ? ov.hi[a + 1] : ov.hi[a];
+		}
+		src = dst;
+		bins /= 2;
+	}
+}
+
+static inline void WavWriteLe16(uint8_t* p, uint16_t v)
+{
+	p[0] = static_cast<uint8_t>(v);
+	p[1] = static_cast<uint8_t>(v >> 8);
+}
+
+static inline void WavWriteLe32(uint8_t* p, uint32_t v)
+{
+	p[0] = static_cast<uint8_t>(v);
+	p[1] = static_cast<uint8_t>(v >> 8);
+	p[2] = static_cast<uint8_t>(v >> 16);
+	p[3] = static_cast<uint8_t>(v >> 24);
+}
+
+static inline void WaveOverviewEncode(const WaveOverview& ov, uint8_t* out)
+{
+	std::memset(out, 0, kWaveOverviewHeaderBytes);
+	WavWriteLe32(out, kWaveOverviewMagic);
+	WavWriteLe32(out + 4, ov.wav_size);
+	WavWriteLe16(out + 8, ov.wav_date);
+	WavWriteLe16(out + 10, ov.wav_time);
+	WavWriteLe32(out + 12, ov.frames);
+	WavWriteLe32(out + 16, ov.rate);
+	WavWriteLe16(out + 20, ov.channels);
+	WavWriteLe16(out + 22, ov.peak);
+	WavWriteLe16(out + 24, static_cast<uint16_t>(kWaveOverviewLevels));
+	WavWriteLe16(out + 26, static_cast<uint16_t>(kWaveOverviewBins));
+	uint8_t* p = out + kWaveOverviewHeaderBytes;
+	for (size_t i = 0; i < kWaveOverviewPairs; ++i)
+	{
+		WavWriteLe16(p, static_cast<uint16_t>(ov.lo[i]));
+		WavWriteLe16(p + 2, static_cast<uint16_t>(ov.hi[i]));
+		p += 4;
+	}
+}
+
+static inline bool WaveOverviewDecode(const uint8_t* in, size_t len, WaveOverview& ov)
+{
+	if (len < kWaveOverviewBytes
+		|| WavReadLe32(in) != kWaveOverviewMagic
+		|| WavReadLe16(in + 24) != kWaveOverviewLevels
+		|| WavReadLe16(in + 26) != kWaveOverviewBins)
+	{
+		return false;
+	}
+	ov.wav_size = WavReadLe32(in + 4);
+	ov.wav_date = WavReadLe16(in + 8);
+	ov.wav_time = WavReadLe16(in + 10);
+	ov.frames = WavReadLe32(in + 12);
+	ov.rate = WavReadLe32(in + 16);
+	ov.channels = WavReadLe16(in + 20);
+	ov.peak = WavReadLe16(in + 22);
+	const uint8_t* p = in + kWaveOverviewHeaderBytes;
+	for (size_t i = 0; i < kWaveOverviewPairs; ++i)
+	{
+		ov.lo[i] = static_cast<int16_t>(WavReadLe16(p));
+		ov.hi[i] = static_cast<int16_t>(WavReadLe16(p + 2));
+		p += 4;
+	}
+	return true;
+}
+
+// Sample library index (WAVECONT.IDX at the card root): a 32-byte
+// little-endian header followed by 128-byte records, one per folder and WAV
+// on the card. Each folder's entries form one contiguous block, its
+// subfolders first, and blocks are written breadth first, so the root's
+// block starts at record 0. The path is relative to the root. A file's
+// size/date/time copy its directory entry so a changed file is noticed;
+// peak is 0 until an overview of the file has been built. A folder keeps
+// the position and size of its block in the size/frames/rate slots. The
+// header counts the entries left out because their path did not fit. A
+// deleted record is left behind its folder's block until the next sync
+// rewrites the index.
+constexpr uint32_t kLibraryMagic = 0x58494357; // "WCIX"
+constexpr uint16_t kLibraryVersion = 3;
+constexpr size_t kLibraryHeaderBytes = 32;
+constexpr size_t kLibraryRecordBytes = 128;
+constexpr size_t kLibraryPathLen = 104;
+constexpr size_t kLibraryPeakOffset = kLibraryPathLen + 18;
+constexpr size_t kLibraryKindOffset = kLibraryPathLen + 20;
+static_assert(kLibraryPathLen + 24 <= kLibraryRecordBytes, "library record fields must fit");
+constexpr uint8_t kLibraryKindFile = 0;
+constexpr uint8_t kLibraryKindFolder = 1;
+constexpr uint8_t kLibraryKindDeleted = 2;
+
+struct LibraryHeader
+{
+	uint32_t count = 0;
+	uint32_t root_children = 0;
+	uint32_t root_folders = 0;
+	uint32_t skipped = 0;
+};
+
+struct LibraryRecord
+{
+	char path[kLibraryPathLen] = {};
+	uint8_t kind = kLibraryKindFile;
+	uint32_t size = 0;
+	uint16_t date = 0;
+	uint16_t time = 0;
+	uint32_t frames = 0;
+	uint32_t rate = 0;
+	uint8_t channels = 0;
+	uint8_t bits = 0;
+	uint16_t peak = 0;
+	// Folders only.
+	uint32_t first = 0;
+	uint32_t children = 0;
+	uint32_t folders = 0;
+};
+
+static inline void LibraryHeaderEncode(const LibraryHeader& header, uint8_t* out)
+{
+	std::memset(out, 0, kLibraryHeaderBytes);
+	WavWriteLe32(out, kLibraryMagic);
+	WavWriteLe16(out + 4, kLibraryVersion);
+	WavWriteLe16(out + 6, static_cast<uint16_t>(kLibraryRecordBytes));
+	WavWriteLe32(out + 8, header.count);
+	WavWriteLe32(out + 12, header.root_children);
+	WavWriteLe32(out + 16, header.root_folders);
+	WavWriteLe32(out + 20, header.skipped);
+}
+
+static inline bool LibraryHeaderDecode(const uint8_t* in, size_t len, LibraryHeader& header)
+{
+	if (len < kLibraryHeaderBytes
+		|| WavReadLe32(in) != kLibraryMagic
+		|| WavReadLe16(in + 4) != kLibraryVersion
+		|| WavReadLe16(in + 6) != kLibraryRecordBytes)
+	{
+		return false;
+	}
+	header.count = WavReadLe32(in + 8);
+	header.root_children = WavReadLe32(in + 12);
+	header.root_folders = WavReadLe32(in + 16);
+	header.skipped = WavReadLe32(in + 20);
+	return header.root_children <= header.count && header.root_folders <= header.root_children;
+}
+
+static inline void LibraryRecordEncode(const LibraryRecord& rec, uint8_t* out)
+{
+	std::memset(out, 0, kLibraryRecordBytes);
+	std::memcpy(out, rec.path, kLibraryPathLen);
+	out[kLibraryPathLen - 1] = 0;
+	uint8_t* f = out + kLibraryPathLen;
+	out[kLibraryKindOffset] = rec.kind;
+	if (rec.kind == kLibraryKindFolder)
+	{
+		WavWriteLe32(f, rec.folders);
+		WavWriteLe32(f + 8, rec.first);
+		WavWriteLe32(f + 12, rec.children);
+		return;
+	}
+	WavWriteLe32(f, rec.size);
+	WavWriteLe16(f + 4, rec.date);
+	WavWriteLe16(f + 6, rec.time);
+	WavWriteLe32(f + 8, rec.frames);
+	WavWriteLe32(f + 12, rec.rate);
+	f[16] = rec.channels;
+	f[17] = rec.bits;
+	WavWriteLe16(out + kLibraryPeakOffset, rec.peak);
+}
+
+static inline void LibraryRecordDecode(const uint8_t* in, LibraryRecord& rec)
+{
+	rec = LibraryRecord();
+	std::memcpy(rec.path, in, kLibraryPathLen);
+	rec.path[kLibraryPathLen - 1] = '\0';
+	const uint8_t* f = in + kLibraryPathLen;
+	rec.kind = in[kLibraryKindOffset];
+	if (rec.kind == kLibraryKindFolder)
+	{
+		rec.folders = WavReadLe32(f);
+		rec.first = WavReadLe32(f + 8);
+		rec.children = WavReadLe32(f + 12);
+		return;
+	}
+	rec.size = WavReadLe32(f);
+	rec.date = WavReadLe16(f + 4);
+	rec.time = WavReadLe16(f + 6);
+	rec.frames = WavReadLe32(f + 8);
+	rec.rate = WavReadLe32(f + 12);
+	rec.channels = f[16];
+	rec.bits = f[17];
+	rec.peak = WavReadLe16(in + kLibraryPeakOffset);
+}
+
+constexpr size_t kLoadScanColumns = 128;
+constexpr float kLoadScanOverviewScale = 28.0f;
+
+// One pass over a sample as it is loaded: splits the channels, applies
+// the 5 ms edge fades and accumulates the overview columns and waveform
+// pyramid (left channel, after the fade) and the level statistics of both
+// channels.
+struct PcmLoadScan
+{
+	size_t total_frames = 0;
+	size_t column_frames = 1;
+	size_t fade_len = 0;
+	size_t tail_start = 0;
+	float fade_denom = 1.0f;
+	int16_t* overview_min = nullptr;
+	int16_t* overview_max = nullptr;
+	WavePyramid* pyramid = nullptr;
+	size_t column = kLoadScanColumns;
+	int32_t column_min = 0;
+	int32_t column_max = 0;
+	int32_t level_min = 0;
+	int32_t level_max = 0;
+	int64_t sum = 0;
+	uint64_t sum_sq = 0;
+	uint64_t samples = 0;
+};
+
+// overview_min/max and pyramid may be null to skip them. With fade_tail
+// false (streamed samples) only the head is faded.
+static inline void PcmLoadScanInit(PcmLoadScan& scan,
+								   size_t total_frames,
+								   uint32_t rate,
+								   bool fade_tail,
+								   int16_t* overview_min,
+								   int16_t* overview_max,
+								   WavePyramid* pyramid)
+{
+	scan = PcmLoadScan();
+	scan.pyramid = pyramid;
+	if (pyramid != nullptr)
+	{
+		WavePyramidBegin(*pyramid);
+	}
+	scan.total_frames = total_frames;
+	scan.column_frames = (total_frames / kLoadScanColumns > 0) ? (total_frames / kLoadScanColumns) : 1;
+	size_t fade_len = static_cast<size_t>(static_cast<float>(rate) * 0.005f + 0.5f);
+	if (fade_len > (total_frames / 2))
+	{
+		fade_len = total_frames / 2;
+	}
+	scan.fade_len = fade_len;
+	scan.tail_start = (fade_tail && fade_len > 0) ? (total_frames - fade_len) : total_frames;
+	scan.fade_denom = (fade_len > 1) ? static_cast<float>(fade_len - 1) : 1.0f;
+	if (total_frames >= 2)
+	{
+		scan.overview_min = overview_min;
+		scan.overview_max = overview_max;
+	}
+}
+
+static inline void PcmLoadScanFlushColumn(PcmLoadScan& scan)
+{
+	if (scan.column >= kLoadScanColumns || scan.overview_min == nullptr)
+	{
+		return;
+	}
+	scan.overview_min[scan.column] = static_cast<int16_t>(
+		static_cast<float>(scan.column_min) * kSampleScale * kLoadScanOverviewScale);
+	scan.overview_max[scan.column] = static_cast<int16_t>(
+		static_cast<float>(scan.column_max) * kSampleScale * kLoadScanOverviewScale);
+}
+
+// src holds the interleaved frames from first_frame on; dst_l/dst_r point
+// at first_frame in the channel buffers. Mono input only writes dst_l.
+static inline void PcmLoadScanFrames(PcmLoadScan& scan,
+									 const int16_t* src,
+									 size_t first_frame,
+									 size_t frames,
+									 uint16_t channels,
+									 int16_t* dst_l,
+									 int16_t* dst_r)
+{
+	const bool stereo = (channels == 2);
+	size_t i = 0;
+	while (i < frames)
+	{
+		const size_t frame = first_frame + i;
+		size_t column = frame / scan.column_frames;
+		if (column >= kLoadScanColumns)
+		{
+			column = kLoadScanColumns - 1;
+		}
+		if (column != scan.column)
+		{
+			PcmLoadScanFlushColumn(scan);
+			scan.column = column;
+			scan.column_min = 32767;
+			scan.column_max = -32768;
+		}
+		// Runs stop at column, fade and pyramid bin edges so the inner loops
+		// stay simple.
+		size_t run_end = (column == kLoadScanColumns - 1)
+			? (first_frame + frames)
+			: ((column + 1) * scan.column_frames);
+		const bool head = (frame < scan.fade_len);
+		const bool tail = (frame >= scan.tail_start);
+		if (head && scan.fade_len < run_end)
+		{
+			run_end = scan.fade_len;
+		}
+		else if (!head && !tail && scan.tail_start < run_end)
+		{
+			run_end = scan.tail_start;
+		}
+		if (scan.pyramid != nullptr)
+		{
+			const size_t bin_end = (frame | (kWavePyramidBaseFrames - 1)) + 1;
+			run_end = (bin_end < run_end) ? bin_end : run_end;
+		}
+		if (run_end > first_frame + frames)
+		{
+			run_end = first_frame + frames;
+		}
+		const size_t run = run_end - frame;
+		int32_t lvl_min = scan.level_min;
+		int32_t lvl_max = scan.level_max;
+		int32_t run_min = 32767;
+		int32_t run_max = -32768;
+		int64_t sum = 0;
+		uint64_t sum_sq = 0;
+		for (size_t k = i; k < i + run; ++k)
+		{
+			int32_t l = src[k * channels];
+			int32_t r = stereo ? src[k * 2 + 1] : 0;
+			if (head || tail)
+			{
+				const size_t pos = head ? (first_frame + k) : (scan.fade_len - 1 - (first_frame + k - scan.tail_start));
+				const float gain = (scan.fade_len > 1) ? (static_cast<float>(pos) / scan.fade_denom) : 0.0f;
+				l = static_cast<int16_t>(static_cast<float>(l) * gain);
+				r = static_cast<int16_t>(static_cast<float>(r) * gain);
+			}
+			dst_l[k] = static_cast<int16_t>(l);
+			run_min = (l < run_min) ? l : run_min;
+			run_max = (l > run_max) ? l : run_max;
+			lvl_min = (l < lvl_min) ? l : lvl_min;
+			lvl_max = (l > lvl_max) ? l : lvl_max;
+			sum += l;
+			sum_sq += static_cast<uint64_t>(l * l);
+			if (stereo)
+			{
+				dst_r[k] = static_cast<int16_t>(r);
+				lvl_min = (r < lvl_min) ? r : lvl_min;
+				lvl_max = (r > lvl_max) ? r : lvl_max;
+				sum += r;
+				sum_sq += static_cast<uint64_t>(r * r);
+			}
+		}
+		scan.column_min = (run_min < scan.column_min) ? run_min : scan.column_min;
+		scan.column_max = (run_max > scan.column_max) ? run_max : scan.column_max;
+		if (scan.pyramid != nullptr)
+		{
+			WavePyramidAddBin(*scan.pyramid, frame, static_cast<int16_t>(run_min), static_cast<int16_t>(run_max));
+		}
+		scan.level_min = lvl_min;
+		scan.level_max = lvl_max;
+		scan.sum += sum;
+		scan.sum_sq += sum_sq;
+		scan.samples += run * (stereo ? 2U : 1U);
+		i += run;
+	}
+}
+
+static inline void PcmLoadScanFinish(PcmLoadScan& scan)
+{
+	PcmLoadScanFlushColumn(scan);
+	scan.column = kLoadScanColumns;
+}
+
+static inline float PcmLoadScanPeak(const PcmLoadScan& scan)
+{
+	const int32_t peak = (-scan.level_min > scan.level_max) ? -scan.level_min : scan.level_max;
+	return static_cast<float>(peak) * kSampleScale;
+}
+
+static inline float PcmLoadScanRms(const PcmLoadScan& scan)
+{
+	if (scan.samples == 0)
+	{
+		return 0.0f;
+	}
+	const double mean_sq = static_cast<double>(scan.sum_sq) / static_cast<double>(scan.samples);
+	return static_cast<float>(std::sqrt(mean_sq)) * kSampleScale;
+}
+
+static inline float PcmLoadScanDc(const PcmLoadScan& scan)
+{
+	if (scan.samples == 0)
+	{
+		return 0.0f;
+	}
+	return static_cast<float>(static_cast<double>(scan.sum) / static_cast<double>(scan.samples)) * kSampleScale;
+}
@@ -4,11 +4,13 @@
 #include "fatfs.h"
 #include "util/wav_format.h"
 #include "util/bsp_sd_diskio.h"
+#include "WaveContCore.h"
 #include <cmath>
 #include <initializer_list>
 #include <math.h>
 #include <cstring>
 #include <cstdio>
+#include <atomic>
 
 using namespace daisy;
 using namespace daisysp;
@@ -17,18 +19,13 @@ using PodDisplay = OledDisplay<SSD130xI2c128x64Driver>;
 
 constexpr bool kLogEnabled = true;
 constexpr int32_t kMenuCount = 4;
-constexpr int32_t kShiftMenuCount = 2;
+constexpr int32_t kShiftMenuCount = 3;
 constexpr int32_t kLoadTargetCount = 2;
 constexpr int32_t kRecordTargetCount = 2;
 constexpr int32_t kRecordTargetSave = 0;
 constexpr int32_t kRecordTargetDiscard = 1;
 constexpr int32_t kPerformBoxCount = 4;
 constexpr int32_t kPerformEdtIndex = 0;
-constexpr int32_t kPerformFaderCount = 4;
-constexpr int32_t kFxSatIndex = 0;
-constexpr int32_t kFxChorusIndex = 1;
-constexpr int32_t kFxDelayIndex = 2;
-constexpr int32_t kFxReverbIndex = 3;
 constexpr int32_t kReverbFaderCount = 5;
 constexpr int32_t kDelayFaderCount = 5;
 constexpr int32_t kPerformFltFaderCount = 2;
@@ -37,28 +34,65 @@ constexpr int32_t kPerformFltIndex = 2;
 constexpr int32_t kPerformFxIndex = 3;
 constexpr uint32_t kFxChainIdleMs = 300;
 constexpr float kFxChainFadeMs = 20.0f;
+// Silence the sources must hold before the engine idles, long enough for
+// the SAT filters and chorus line to ring out.
+constexpr uint32_t kEngineIdleHoldMs = 50;
+constexpr uint32_t kMainLoopPeriodMs = 10;
 constexpr uint32_t kSdInitMinMs = 800;
 constexpr uint32_t kSdInitRetryMs = 300;
 constexpr uint32_t kSdInitResultMs = 1500;
 constexpr int32_t kSdInitAttempts = 3;
 constexpr uint32_t kSaveResultMs = 1500;
 constexpr uint32_t kSaveStepBudgetMs = 20;
-constexpr int32_t kMaxWavFiles = 32;
+constexpr uint32_t kLoadStepBudgetMs = 8;
+// Frames that must be resident before a loading sample can be played.
+constexpr size_t kLoadPlayableFrames = 4096;
+constexpr int32_t kLibraryMaxRecords = 4096;
+constexpr int32_t kLibraryPageEntries = 32;
+constexpr int32_t kLibraryMaxDepth = 4;
+constexpr int32_t kLibrarySyncLookahead = 8;
+constexpr uint32_t kLibrarySyncBudgetMs = 4;
+constexpr int32_t kBrowseCursorCount = 8;
+constexpr const char* kLibraryIndexName = "WAVECONT.IDX";
+constexpr const char* kLibraryTempName = "WAVECONT.TMP";
 constexpr size_t kMaxWavNameLen = 32;
 constexpr int32_t kLoadFontScale = 1;
 constexpr size_t kMaxSampleSamples = 240000;
+constexpr size_t kSamplePoolBytes = 32U * 1024U * 1024U;
+constexpr size_t kStreamHeadFrames = 48000;
+constexpr size_t kStreamRingFrames = 16384;
+constexpr int32_t kStreamSlotCount = 4;
+constexpr size_t kStreamReadFrames = 1024;
+constexpr uint32_t kStreamFillBudgetMs = 3;
+// Longest main-loop pass the audio path has to ride out. SD jobs are
+// budgeted to a few ms each, but one pass can still stack a load step, a
+// sidecar write and the OLED update.
+constexpr uint32_t kMainLoopStallMs = 100;
+// A refill ring is read this far ahead before its voice is armed, so a
+// 48 kHz source at its native rate survives one stall.
+constexpr size_t kStreamPrimeFrames = 48U * kMainLoopStallMs + kStreamReadFrames;
+static_assert(kStreamPrimeFrames < kStreamRingFrames, "stream prime must fit in the ring");
+// Card path of a library entry: drive prefix, index path and ".wvo".
+constexpr size_t kSamplePathLen = kLibraryPathLen + 8;
 constexpr int32_t kRecordMaxSeconds = 5;
 constexpr size_t kSampleChunkFrames = 256;
+// Sample loads read in large sector-aligned chunks so FatFS can hand whole
+// multi-block reads to the SD DMA instead of going through its sector
+// window.
+constexpr size_t kLoadChunkBytes = 32768;
+constexpr size_t kLoadCarryBytes = 32;
+constexpr size_t kSdSectorBytes = 512;
+// Shared read cache for preview, load and index reads. Reads shorter than a
+// block fill whole blocks; longer ones copy the cached blocks and read the
+// rest straight from the card.
+constexpr size_t kSdCacheBlockBytes = 4096;
+constexpr int32_t kSdCacheBlocks = 256;
 constexpr size_t kSaveChunkFrames = 8192;
-constexpr int32_t kBaseMidiNote = 60;
-constexpr float kSampleScale = 1.0f / 32768.0f;
 constexpr int32_t kLoadProgressStep = 5;
 constexpr float kLedBlinkPeriodMs = 25.0f;
 constexpr float kLedBlinkDuty = 0.5f;
 constexpr uint32_t kPerformPlayheadIntervalMs = 33;
 constexpr bool kPlaybackVerboseLog = false;
-constexpr float kPi = 3.14159265f;
-constexpr float kTwoPi = 6.2831853f;
 constexpr int kDisplayW = 128;
 constexpr int kDisplayH = 64;
 constexpr int kPlayBpm = 120;
@@ -66,9 +100,31 @@ constexpr int32_t kPlayBpmMin = 40;
 constexpr int32_t kPlayBpmMax = 240;
 constexpr int32_t kPlayTrackCount = 4;
 constexpr int kPlayStepCount = 16;
+// MIDI notes sound this long after the audio block that received them.
+// It covers an ordinary main-loop pass with its budgeted SD jobs, so those
+// notes keep a fixed latency; a note handled later than this (during a
+// load or save step, or a kMainLoopStallMs stall) starts as soon as the
+// main loop gets to it.
+constexpr uint32_t kMidiLatencyMs = 6;
+constexpr uint32_t kMidiLatencyFrames = 48U * kMidiLatencyMs;
 constexpr uint32_t kPreviewReadBudgetMs = 2;
+constexpr uint32_t kOverviewStepBudgetMs = 4;
+constexpr uint32_t kWaveformProbeBudgetMs = 2;
+constexpr size_t kOverviewChunkBytes = 4096;
+// Rows under the LOAD list kept for the selected file's overview.
+constexpr int32_t kLoadOverviewLines = 2;
 constexpr size_t kPreviewBufferFrames = 4096;
 constexpr size_t kPreviewReadFrames = 256;
+// Preview start positions across the data chunk, picked with the right
+// encoder in the LOAD list.
+constexpr int32_t kPreviewOffsetSteps = 16;
+// Once the cursor rests this long, the heads of the selected file and its
+// neighbours are read so preview starts without waiting on the card.
+constexpr uint32_t kPreviewHoverMs = 250;
+constexpr int32_t kPreviewHeadCount = 3;
+constexpr size_t kPreviewHeadFrames = 2048;
+static_assert(kPreviewHeadFrames < kPreviewBufferFrames,
+			  "preview head must fit in the preview ring");
 
 static const char* kSaveColors[] =
 {
@@ -296,58 +352,29 @@ static const char* kSaveNouns[] =
 	"Lowtide",
 	"Earthsong",
 };
-constexpr int kPerformVoiceCount = 5;
-constexpr float kReverbFeedback = 0.85f;
-constexpr float kReverbLpFreq = 12000.0f;
-constexpr float kReverbFeedbackMin = 0.2f;
-constexpr float kReverbFeedbackMax = 0.98f;
-constexpr float kReverbDampMinHz = 800.0f;
-constexpr float kReverbDampMaxHz = 20000.0f;
-constexpr float kReverbPreDelayMaxMs = 1000.0f;
-constexpr float kReverbDecayMinMs = 10.0f;
-constexpr float kReverbDecayMaxMs = 4000.0f;
+#ifndef WAVECONT_PERFORM_VOICES
+#define WAVECONT_PERFORM_VOICES 16
+#endif
+constexpr int kPerformVoiceCount = WAVECONT_PERFORM_VOICES;
+static_assert(kPerformVoiceCount >= 1 && kPerformVoiceCount <= 32,
+			  "WAVECONT_PERFORM_VOICES must be between 1 and 32");
+constexpr size_t kVoiceStealFadeFrames = 96;
+constexpr uint32_t kVoiceRetireQueueSize = 64;
+constexpr uint32_t kVoiceEventQueueSize = 64;
+constexpr uint32_t kMidiInQueueSize = 64;
 constexpr float kReverbParamStep = 0.02f;
-constexpr size_t kReverbPreDelayMaxSamples = 48000;
 constexpr float kReverbDecayDefault =
 	(kReverbFeedback - kReverbFeedbackMin) / (kReverbFeedbackMax - kReverbFeedbackMin);
 constexpr float kReverbDampDefault =
 	(kReverbDampMaxHz - kReverbLpFreq) / (kReverbDampMaxHz - kReverbDampMinHz);
-constexpr float kReverbDefaultWet = 0.0f;
 constexpr float kReverbWetStep = 0.02f;
 constexpr float kReverbShimmerStep = 0.02f;
-constexpr float kShimmerHpHz = 900.0f;
-constexpr size_t kShimmerBufferSize = 8192;
-constexpr size_t kShimmerDelaySamples = 2048;
-constexpr float kShimmerRateUp = 2.0f;
-constexpr float kShimmerFeedback = 0.6f;
-constexpr float kChorusRateHz = 0.25f;
-constexpr float kChorusRateMinHz = 0.05f;
-constexpr float kChorusRateMaxHz = 0.9f;
 constexpr float kChorusRateStep = 0.02f;
-constexpr float kChorusDelayMs = 9.0f;
-constexpr float kChorusFeedback = 0.18f;
-constexpr float kChorusMaxDepth = 3.0f;
-constexpr float kChorusWidthMax = 2.2f;
-constexpr size_t kDelayMaxSamples = 96000;
-constexpr float kDelayTimeMinMs = 50.0f;
-constexpr float kDelayTimeMaxMs = 2000.0f;
-constexpr float kDelayTimeSlewMs = 180.0f;
-constexpr float kDelayParamSlewMs = 120.0f;
-constexpr float kDelayFeedbackMax = 0.98f;
 constexpr bool kLoadPresetsPlaceholder = true;
-constexpr float kDelayDefaultWet = 0.0f;
 constexpr float kDelayWetStep = 0.02f;
 constexpr float kDelayParamStep = 0.02f;
-constexpr int kBitResoStepCount = 3;
-constexpr int kBitResoSteps[kBitResoStepCount] = {2, 3, 4};
 constexpr const char* kBitResoLabels[kBitResoStepCount] = {"CRUSH", "STATIC", "HISS"};
-constexpr int kBitcrushMaxHold = 32;
-constexpr float kFxParamEpsilon = 1e-5f;
-constexpr float kAmpEnvStep = 0.02f;
 constexpr float kFltParamStep = 0.02f;
-constexpr float kAmpEnvMinMs = 5.0f;
-constexpr float kAmpEnvMaxMs = 1000.0f;
-constexpr float kAmpEnvStepMs = 20.0f;
 
 enum class UiMode : int32_t
 {
@@ -364,6 +391,7 @@ enum class UiMode : int32_t
 	Record,
 	PresetSaveStub,
 	Shift,
+	CpuLoad,
 };
 
 enum class LoadDestination : int32_t
@@ -402,350 +430,192 @@ enum class PlaySelectMode : int32_t
 	GridCell,
 };
 
-class TapeSaturator
+// First-fit arena for sample data in SDRAM. Blocks are addressed by handle
+// so Defragment() can slide them towards the start of the arena; callers
+// re-resolve their pointers with Ptr() afterwards. Main loop only.
+class SamplePool
 {
 public:
-	void Init(float sample_rate)
-	{
-		sample_rate_ = sample_rate;
-		dc_pre_.Init(sample_rate, 20.0f);
-		dc_post_.Init(sample_rate, 20.0f);
-		low_bump_lp_.Init(sample_rate, 90.0f);
-		high_emph_lp_.Init(sample_rate, 2000.0f);
-		post_lp_.Init(sample_rate, 16000.0f);
-		release_coeff_ = expf(-1.0f / (0.08f * sample_rate));
-		smooth_coeff_ = 1.0f - expf(-1.0f / (0.03f * sample_rate));
-		drive_target_ = 0.0f;
-		bias_target_ = 0.0f;
-		tone_target_ = 0.5f;
-		bump_target_ = 0.0f;
-		mix_target_ = 0.0f;
-		output_gain_target_ = 1.0f;
-		post_gain_target_ = 1.0f;
-		drive_ = 0.0f;
-		bias_ = 0.0f;
-		tone_ = 0.5f;
-		bump_ = 0.0f;
-		mix_ = 0.0f;
-		output_gain_ = 1.0f;
-		post_gain_ = 1.0f;
-		env_ = 0.0f;
-		prev_y_ = 0.0f;
-		UpdatePostCutoff(drive_);
-	}
-
-	float Process(float x)
-	{
-		// Smooth parameters for real-time-safe changes.
-		drive_ += smooth_coeff_ * (drive_target_ - drive_);
-		bias_ += smooth_coeff_ * (bias_target_ - bias_);
-		tone_ += smooth_coeff_ * (tone_target_ - tone_);
-		bump_ += smooth_coeff_ * (bump_target_ - bump_);
-		mix_ += smooth_coeff_ * (mix_target_ - mix_);
-		output_gain_ += smooth_coeff_ * (output_gain_target_ - output_gain_);
-		post_gain_ += smooth_coeff_ * (post_gain_target_ - post_gain_);
-
-		const float dry = x;
-
-		// 1) DC blocker.
-		x = dc_pre_.Process(x);
-
-		// 2) Pre-emphasis: low bump + gentle high lift.
-		const float pre_emph_boost = 1.0f + drive_;
-		const float low_amt = (0.06f + 0.08f * (1.0f - tone_)) * pre_emph_boost;
-		const float high_amt = (0.02f + 0.08f * tone_) * pre_emph_boost;
-		const float low = low_bump_lp_.Process(x);
-		const float high = x - high_emph_lp_.Process(x);
-		const float bump_curve = bump_ * bump_;
-		const float mid = x - low - high;
-		const float bump_low = bump_curve * 0.25f;
-		const float bump_mid = bump_curve * 1.6f;
-		const float mid_res = bump_curve * 1.8f;
-		const float mid_res_sample = (mid + (prev_y_ * 0.35f)) * mid_res;
-		x = x + (low * (low_amt + bump_low))
-			+ (mid * bump_mid)
-			+ (mid_res_sample)
-			+ (high * high_amt);
-
-		// 3) Envelope follower for mild tape compression.
-		const float abs_x = fabsf(x);
-		if (abs_x > env_)
-		{
-			env_ = abs_x;
-		}
-		else
-		{
-			env_ *= release_coeff_;
-		}
-		const float comp_amt = 0.35f * drive_;
-		const float eff_drive = drive_ / (1.0f + comp_amt * env_);
-		const float drive_boost = (1.0f + drive_) * (1.0f + drive_);
-
-		// 4) Nonlinearity + bias + tape memory.
-		const float bias_amt = bias_ * 0.12f;
-		const float xb = x * (1.0f + eff_drive * 2.5f * drive_boost) + bias_amt;
-		float y = FastTanh(xb);
-		const float mem_amt = 0.05f + 0.1f * drive_;
-		y += mem_amt * prev_y_;
-		prev_y_ = y;
-		y = dc_post_.Process(y);
-
-		// 5) Post-shape HF loss.
-		y = post_lp_.Process(y);
-		y *= post_gain_;
-
-		// 6) Wet/dry mix and 7) output trim.
-		float out = (mix_ * y) + ((1.0f - mix_) * dry);
-		out *= output_gain_;
-		return out;
-	}
-
-	void SetDrive(float d01)
-	{
-		drive_target_ = Clamp(d01, 0.0f, 1.0f);
-		UpdatePostCutoff(drive_target_);
-		post_gain_target_ = DbToGain(-6.0f * drive_target_);
-	}
-
-	void SetBias(float b11)
-	{
-		bias_target_ = Clamp(b11, -1.0f, 1.0f);
-	}
-
-	void SetTone(float t01)
-	{
-		tone_target_ = Clamp(t01, 0.0f, 1.0f);
-	}
-
-	void SetBump(float b01)
-	{
-		bump_target_ = Clamp(b01, 0.0f, 1.0f);
-	}
+	static constexpr int32_t kMaxBlocks = 32;
+	static constexpr size_t kAlign = 32;
 
-	void SetMix(float m01)
+	void Init(uint8_t* base, size_t bytes)
 	{
-		mix_target_ = Clamp(m01, 0.0f, 1.0f);
-	}
-
-	void SetOutput(float o01)
-	{
-		const float out = Clamp(o01, 0.0f, 1.0f);
-		const float gain_db = -12.0f + (18.0f * out);
-		output_gain_target_ = powf(10.0f, gain_db / 20.0f);
+		base_ = base;
+		size_ = bytes;
+		count_ = 0;
+		for (auto& block : blocks_)
+		{
+			block.used = false;
+			block.offset = 0;
+			block.bytes = 0;
+		}
 	}
 
-private:
-	struct DcBlocker
+	int32_t Allocate(size_t bytes)
 	{
-		float x1 = 0.0f;
-		float y1 = 0.0f;
-		float r = 0.0f;
-
-		void Init(float sample_rate, float cutoff_hz)
+		if (bytes == 0)
 		{
-			r = expf(-2.0f * kPi * cutoff_hz / sample_rate);
-			x1 = 0.0f;
-			y1 = 0.0f;
+			return -1;
 		}
-
-		float Process(float x)
+		const size_t need = AlignUp(bytes);
+		int32_t handle = -1;
+		for (int32_t i = 0; i < kMaxBlocks; ++i)
 		{
-			const float y = x - x1 + (r * y1);
-			x1 = x;
-			y1 = y;
-			return y;
+			if (!blocks_[i].used)
+			{
+				handle = i;
+				break;
+			}
 		}
-	};
-
-	struct OnePoleLp
-	{
-		float a = 0.0f;
-		float y = 0.0f;
-
-		void Init(float sample_rate, float cutoff_hz)
+		if (handle < 0)
 		{
-			SetFreq(sample_rate, cutoff_hz);
-			y = 0.0f;
+			return -1;
 		}
-
-		void SetFreq(float sample_rate, float cutoff_hz)
+		size_t cursor = 0;
+		int32_t pos = 0;
+		for (; pos < count_; ++pos)
 		{
-			a = expf(-2.0f * kPi * cutoff_hz / sample_rate);
+			const Block& block = blocks_[order_[pos]];
+			if (block.offset - cursor >= need)
+			{
+				break;
+			}
+			cursor = block.offset + AlignUp(block.bytes);
 		}
-
-		float Process(float x)
+		if (pos == count_ && size_ - cursor < need)
 		{
-			y = (1.0f - a) * x + (a * y);
-			return y;
+			return -1;
 		}
-	};
+		for (int32_t i = count_; i > pos; --i)
+		{
+			order_[i] = order_[i - 1];
+		}
+		order_[pos] = handle;
+		++count_;
+		blocks_[handle].used = true;
+		blocks_[handle].offset = cursor;
+		blocks_[handle].bytes = bytes;
+		return handle;
+	}
 
-	static float Clamp(float v, float lo, float hi)
+	void Free(int32_t handle)
 	{
-		if (v < lo)
+		if (!Valid(handle))
 		{
-			return lo;
+			return;
 		}
-		if (v > hi)
+		int32_t pos = 0;
+		while (pos < count_ && order_[pos] != handle)
 		{
-			return hi;
+			++pos;
 		}
-		return v;
-	}
-
-	static float FastTanh(float x)
-	{
-		if (x > 3.0f)
+		for (int32_t i = pos; i + 1 < count_; ++i)
 		{
-			x = 3.0f;
+			order_[i] = order_[i + 1];
 		}
-		else if (x < -3.0f)
+		if (pos < count_)
 		{
-			x = -3.0f;
+			--count_;
 		}
-		const float x2 = x * x;
-		return x * (27.0f + x2) / (27.0f + 9.0f * x2);
+		blocks_[handle].used = false;
+		blocks_[handle].bytes = 0;
 	}
 
-	static float DbToGain(float db)
+	// Shrinks in place; the released tail becomes free space.
+	bool Shrink(int32_t handle, size_t bytes)
 	{
-		return powf(10.0f, db / 20.0f);
+		if (!Valid(handle) || bytes == 0 || bytes > blocks_[handle].bytes)
+		{
+			return false;
+		}
+		blocks_[handle].bytes = bytes;
+		return true;
 	}
 
-	void UpdatePostCutoff(float drive)
+	// Slides every block down to close the gaps. Returns true if anything
+	// moved, in which case all pointers from Ptr() are stale.
+	bool Defragment()
 	{
-		float cutoff = 16000.0f - (drive * 8000.0f);
-		if (cutoff < 8000.0f)
+		size_t cursor = 0;
+		bool moved = false;
+		for (int32_t pos = 0; pos < count_; ++pos)
 		{
-			cutoff = 8000.0f;
+			Block& block = blocks_[order_[pos]];
+			if (block.offset != cursor)
+			{
+				std::memmove(base_ + cursor, base_ + block.offset, block.bytes);
+				block.offset = cursor;
+				moved = true;
+			}
+			cursor += AlignUp(block.bytes);
 		}
-		post_lp_.SetFreq(sample_rate_, cutoff);
+		return moved;
 	}
 
-	float sample_rate_ = 48000.0f;
-	float drive_target_ = 0.0f;
-	float bias_target_ = 0.0f;
-	float tone_target_ = 0.5f;
-	float bump_target_ = 0.0f;
-	float mix_target_ = 0.0f;
-	float output_gain_target_ = 1.0f;
-	float post_gain_target_ = 1.0f;
-
-	float drive_ = 0.0f;
-	float bias_ = 0.0f;
-	float tone_ = 0.5f;
-	float bump_ = 0.0f;
-	float mix_ = 0.0f;
-	float output_gain_ = 1.0f;
-	float post_gain_ = 1.0f;
-
-	float env_ = 0.0f;
-	float prev_y_ = 0.0f;
-	float release_coeff_ = 0.0f;
-	float smooth_coeff_ = 0.0f;
-
-	DcBlocker dc_pre_;
-	DcBlocker dc_post_;
-	OnePoleLp low_bump_lp_;
-	OnePoleLp high_emph_lp_;
-	OnePoleLp post_lp_;
-};
-
-class BiquadLp
-{
-public:
-	void Reset()
+	int16_t* Ptr(int32_t handle) const
 	{
-		z1_ = 0.0f;
-		z2_ = 0.0f;
+		if (!Valid(handle))
+		{
+			return nullptr;
+		}
+		return reinterpret_cast<int16_t*>(base_ + blocks_[handle].offset);
 	}
 
-	void Set(float sample_rate, float freq, float q)
+	size_t UsedBytes() const
 	{
-		if (freq < 20.0f)
+		size_t used = 0;
+		for (int32_t pos = 0; pos < count_; ++pos)
 		{
-			freq = 20.0f;
+			used += AlignUp(blocks_[order_[pos]].bytes);
 		}
-		const float nyq = sample_rate * 0.49f;
-		if (freq > nyq)
+		return used;
+	}
+
+	size_t FreeBytes() const { return size_ - UsedBytes(); }
+
+	size_t LargestFreeBytes() const
+	{
+		size_t cursor = 0;
+		size_t largest = 0;
+		for (int32_t pos = 0; pos < count_; ++pos)
 		{
-			freq = nyq;
+			const Block& block = blocks_[order_[pos]];
+			if (block.offset - cursor > largest)
+			{
+				largest = block.offset - cursor;
+			}
+			cursor = block.offset + AlignUp(block.bytes);
 		}
-		if (q < 0.001f)
+		if (size_ - cursor > largest)
 		{
-			q = 0.001f;
+			largest = size_ - cursor;
 		}
-
-		const float w0 = (2.0f * kPi * freq) / sample_rate;
-		const float cos_w0 = cosf(w0);
-		const float sin_w0 = sinf(w0);
-		const float alpha = sin_w0 / (2.0f * q);
-
-		const float b0 = (1.0f - cos_w0) * 0.5f;
-		const float b1 = 1.0f - cos_w0;
-		const float b2 = (1.0f - cos_w0) * 0.5f;
-		const float a0 = 1.0f + alpha;
-		const float a1 = -2.0f * cos_w0;
-		const float a2 = 1.0f - alpha;
-
-		a0_ = b0 / a0;
-		a1_ = b1 / a0;
-		a2_ = b2 / a0;
-		b1_ = a1 / a0;
-		b2_ = a2 / a0;
+		return largest;
 	}
 
-	float Process(float x)
-	{
-		const float y = (a0_ * x) + z1_;
-		z1_ = (a1_ * x) + z2_ - (b1_ * y);
-		z2_ = (a2_ * x) - (b2_ * y);
-		return y;
-	}
+	int32_t BlockCount() const { return count_; }
 
 private:
-	float a0_ = 0.0f;
-	float a1_ = 0.0f;
-	float a2_ = 0.0f;
-	float b1_ = 0.0f;
-	float b2_ = 0.0f;
-	float z1_ = 0.0f;
-	float z2_ = 0.0f;
-};
-
-class OnePoleHp
-{
-public:
-	void Init(float sample_rate, float cutoff_hz)
-	{
-		SetFreq(sample_rate, cutoff_hz);
-		y_ = 0.0f;
-		x1_ = 0.0f;
-	}
-
-	void SetFreq(float sample_rate, float cutoff_hz)
+	struct Block
 	{
-		a_ = expf(-2.0f * kPi * cutoff_hz / sample_rate);
-	}
+		size_t offset;
+		size_t bytes;
+		bool used;
+	};
 
-	float Process(float x)
-	{
-		const float y = a_ * (y_ + x - x1_);
-		x1_ = x;
-		y_ = y;
-		return y;
-	}
+	static size_t AlignUp(size_t bytes) { return (bytes + kAlign - 1) & ~(kAlign - 1); }
 
-	void Reset()
+	bool Valid(int32_t handle) const
 	{
-		y_ = 0.0f;
-		x1_ = 0.0f;
+		return handle >= 0 && handle < kMaxBlocks && blocks_[handle].used;
 	}
 
-private:
-	float a_ = 0.0f;
-	float y_ = 0.0f;
-	float x1_ = 0.0f;
+	Block blocks_[kMaxBlocks];
+	int32_t order_[kMaxBlocks];
+	int32_t count_ = 0;
+	uint8_t* base_ = nullptr;
+	size_t size_ = 0;
 };
 
 DaisyPod    hw;
@@ -754,26 +624,9 @@ SdmmcHandler   sdcard;
 FatFSInterface fsi;
 Encoder      encoder_r;
 Switch       shift_button;
-DSY_SDRAM_BSS ReverbSc reverb;
-OnePoleHp shimmer_hp_l;
-OnePoleHp shimmer_hp_r;
-DSY_SDRAM_BSS float shimmer_buf_l[kShimmerBufferSize];
-DSY_SDRAM_BSS float shimmer_buf_r[kShimmerBufferSize];
-static size_t shimmer_write_idx = 0;
-static float shimmer_read_idx = 0.0f;
-static int shimmer_mode = 0;
-DelayLine<float, kDelayMaxSamples> DSY_SDRAM_BSS delay_line_l;
-DelayLine<float, kDelayMaxSamples> DSY_SDRAM_BSS delay_line_r;
-DelayLine<float, kReverbPreDelayMaxSamples> DSY_SDRAM_BSS reverb_predelay_l;
-DelayLine<float, kReverbPreDelayMaxSamples> DSY_SDRAM_BSS reverb_predelay_r;
-ChorusEngine chorus_l;
-ChorusEngine chorus_r;
-TapeSaturator sat_l;
-TapeSaturator sat_r;
-BiquadLp perform_lpf_l1[kPerformVoiceCount];
-BiquadLp perform_lpf_l2[kPerformVoiceCount];
-BiquadLp perform_lpf_r1[kPerformVoiceCount];
-BiquadLp perform_lpf_r2[kPerformVoiceCount];
+DSY_SDRAM_BSS FxChainMemory fx_memory;
+FxChain fx_chain;
+VoiceFilter perform_lpf[kPerformVoiceCount];
 
 volatile UiMode ui_mode = UiMode::Main;
 volatile int32_t menu_index = 0;
@@ -828,24 +681,129 @@ static uint16_t save_channels = 1;
 static uint32_t save_sr = 48000;
 static uint32_t save_data_bytes = 0;
 static FRESULT save_last_error = FR_OK;
+static bool load_in_progress = false;
+static uint32_t load_draw_next_ms = 0;
+static LoadDestination load_job_destination = LoadDestination::Play;
+static bool load_file_open = false;
+static bool load_streaming = false;
+static uint16_t load_channels = 1;
+static size_t load_frame_bytes = 0;
+static size_t load_total_frames = 0;
+static size_t load_resident_frames = 0;
+static size_t load_dest_index = 0;
+static size_t load_carry = 0;
+static size_t load_next_read_bytes = 0;
+static size_t load_cluster_bytes = 0;
+static int32_t load_last_percent = 0;
+static uint32_t load_read_us = 0;
+static int32_t load_file_index = -1;
+static PcmLoadScan load_scan;
 static volatile bool delete_mode = false;
 static UiMode delete_prev_mode = UiMode::Main;
+static volatile bool request_voice_reset = false;
 static volatile bool request_delete_scan = false;
 static volatile bool request_delete_file = false;
 static volatile int32_t request_delete_index = -1;
 static volatile bool delete_confirm = false;
 static bool request_delete_redraw = false;
 static char delete_confirm_name[kMaxWavNameLen] = {0};
-char wav_files[kMaxWavFiles][kMaxWavNameLen];
+// Record the confirm dialog was opened on; the delete is refused if the
+// list position no longer holds it.
+static char delete_confirm_path[kLibraryPathLen] = {0};
+// The card's library index, paged in kLibraryPageEntries records at a
+// time.
+static FIL library_file;
+static bool library_open = false;
+static bool library_synced = false;
+static bool request_library_redraw = false;
+static LibraryHeader library_header;
+static LibraryRecord library_page[kLibraryPageEntries];
+static int32_t library_page_first = -1;
+static int32_t library_page_count = 0;
+alignas(32) static uint8_t library_io_buf[kLibraryPageEntries * kLibraryRecordBytes];
+// The LOAD/DELETE list shows one folder's block of the index, led by a
+// ".." entry below the root; wav_file_count is its length and the first
+// browse_folder_entries entries open folders.
+struct BrowseCursor
+{
+	int32_t folder = -1;
+	int32_t selected = 0;
+	int32_t scroll = 0;
+};
+
+static int32_t browse_stack[kLibraryMaxDepth];
+static int32_t browse_depth = 0;
+static int32_t browse_first = 0;
+volatile int32_t browse_folder_entries = 0;
+static BrowseCursor browse_cursors[kBrowseCursorCount];
+static int32_t browse_cursor_count = 0;
+volatile bool request_browse_open = false;
+volatile int32_t request_browse_index = -1;
+// Background walk of the card that rewrites the index breadth first,
+// reusing the old record of every file whose directory entry is
+// unchanged. Folders queue themselves by their records in the new index.
+static bool library_sync_active = false;
+static uint32_t library_sync_start_ms = 0;
+static DIR library_sync_dir;
+static bool library_sync_dir_open = false;
+static bool library_sync_files_pass = false;
+static int32_t library_sync_parent = -1;
+static LibraryRecord library_sync_parent_rec;
+static uint32_t library_sync_block_first = 0;
+static uint32_t library_sync_block_children = 0;
+static uint32_t library_sync_block_folders = 0;
+static uint32_t library_sync_cursor = 0;
+static LibraryHeader library_sync_header;
+static FIL library_sync_old;
+static bool library_sync_old_open = false;
+static uint32_t library_sync_old_count = 0;
+static uint32_t library_sync_old_read = 0;
+static LibraryRecord library_sync_ahead[kLibrarySyncLookahead];
+static int32_t library_sync_ahead_count = 0;
+static FIL library_sync_out;
+static uint32_t library_sync_count = 0;
+static uint32_t library_sync_new = 0;
+static uint32_t library_sync_removed = 0;
+static uint32_t library_sync_skipped = 0;
+alignas(32) static uint8_t library_sync_buf[kLibraryRecordBytes];
 char loaded_sample_name[kMaxWavNameLen] = {0};
 int32_t load_lines = 1;
 int32_t load_line_height = 1;
 int32_t load_chars_per_line = 1;
 
+enum class OverviewState : uint8_t
+{
+	Unknown,
+	Valid,
+	Missing,
+	Failed,
+};
+
+static OverviewState wav_overview_state[kLibraryMaxRecords];
+static WaveOverview load_overview;
+static int32_t load_overview_index = -1;
+static int32_t load_overview_selected = -1;
+static bool request_load_overview_redraw = false;
+// Background sidecar generation for one file at a time.
+static bool overview_job_active = false;
+static int32_t overview_job_index = -1;
+static FIL overview_job_file;
+static size_t overview_job_frames = 0;
+static size_t overview_job_pos = 0;
+static size_t overview_job_frame_bytes = 0;
+static uint16_t overview_job_channels = 1;
+static size_t overview_job_bin = 0;
+static size_t overview_job_bin_end = 0;
+static int32_t overview_job_peak = 0;
+static WaveOverview overview_job;
+alignas(32) static uint8_t overview_io_buf[kOverviewChunkBytes];
+static_assert(kOverviewChunkBytes >= kWaveOverviewBytes, "sidecar must fit the overview buffer");
+
 enum class SampleContext : int32_t
 {
 	Perform,
 	Play,
+	Track,
 };
 
 struct SampleState
@@ -860,24 +818,39 @@ struct SampleState
 	float trim_start = 0.0f;
 	float trim_end = 1.0f;
 	bool from_recording = false;
+	bool streaming = false;
+	size_t head_frames = 0;
+	uint32_t data_offset = 0;
+	char path[kSamplePathLen] = {};
+	int32_t pool_l = -1;
+	int32_t pool_r = -1;
 };
 
 static SampleState perform_sample_state;
 static SampleState play_sample_state;
 static SampleContext current_sample_context = SampleContext::Perform;
-
-DSY_SDRAM_BSS int16_t perform_sample_buffer_l[kMaxSampleSamples];
-DSY_SDRAM_BSS int16_t perform_sample_buffer_r[kMaxSampleSamples];
-DSY_SDRAM_BSS int16_t play_sample_buffer_l[kMaxSampleSamples];
-DSY_SDRAM_BSS int16_t play_sample_buffer_r[kMaxSampleSamples];
-static int16_t* sample_buffer_l = perform_sample_buffer_l;
-static int16_t* sample_buffer_r = perform_sample_buffer_r;
+static int32_t current_sample_track = 0;
+
+alignas(32) DSY_SDRAM_BSS uint8_t sample_pool_mem[kSamplePoolBytes];
+static SamplePool sample_pool;
+// Stand-in for contexts without a sample so the buffer pointers never dangle.
+static int16_t* sample_buffer_l = sample_silence;
+static int16_t* sample_buffer_r = sample_silence;
+// Pool handles of the current context; mono samples have no right block.
+static int32_t sample_pool_l = -1;
+static int32_t sample_pool_r = -1;
 volatile size_t sample_length = 0;
 volatile size_t sample_play_start = 0;
 volatile size_t sample_play_end = 0;
 volatile uint32_t sample_rate = 48000;
 volatile uint16_t sample_channels = 1;
 volatile bool sample_loaded = false;
+// Streamed samples keep only their first sample_head_frames in SDRAM; the
+// rest is read from sample_stream_path into per-voice rings.
+volatile bool sample_streaming = false;
+volatile size_t sample_head_frames = 0;
+static uint32_t sample_stream_data_offset = 0;
+static char sample_stream_path[kSamplePathLen] = {};
 volatile bool playback_active = false;
 volatile float playback_rate = 1.0f;
 volatile float playback_phase = 0.0f;
@@ -888,23 +861,132 @@ volatile float playback_release_pos = 0.0f;
 volatile float playback_release_start = 0.0f;
 volatile int32_t current_note = -1;
 
-struct PerformVoice
+// Everything needed to start a voice on a sample, taken either from the
+// working globals or from a stored SampleState.
+struct VoiceSampleSource
 {
-	bool active = false;
-	bool releasing = false;
-	float phase = 0.0f;
-	float rate = 1.0f;
-	float amp = 1.0f;
-	float env = 0.0f;
-	float release_start = 0.0f;
-	float release_pos = 0.0f;
+	VoiceSample sample;
+	size_t length = 0;
+	uint32_t rate = 48000;
+	uint16_t channels = 1;
+	bool streaming = false;
+	uint32_t data_offset = 0;
+	const char* path = "";
+};
+
+static PerformVoice perform_voices[kPerformVoiceCount];
+
+enum class StreamSlotState : int32_t
+{
+	Free,
+	Active,
+	Released,
+};
+
+// Refill ring for one streamed voice. The main loop opens the file and
+// fills [read_frame, write_frame); the audio callback advances read_frame
+// and marks the slot Released when the voice is done with it. A freed slot
+// keeps its file open so the next note on the same sample only seeks.
+struct StreamSlot
+{
+	volatile StreamSlotState state = StreamSlotState::Free;
+	volatile bool failed = false;
+	volatile size_t read_frame = 0;
+	volatile size_t write_frame = 0;
+	size_t end_frame = 0;
+	size_t length = 0;
+	size_t fade_len = 0;
+	uint32_t data_offset = 0;
+	uint16_t channels = 1;
+	bool file_open = false;
+	char path[kSamplePathLen] = {};
+	FIL file;
+};
+
+static StreamSlot stream_slots[kStreamSlotCount];
+DSY_SDRAM_BSS int16_t stream_ring_l[kStreamSlotCount][kStreamRingFrames];
+DSY_SDRAM_BSS int16_t stream_ring_r[kStreamSlotCount][kStreamRingFrames];
+alignas(32) static int16_t stream_read_buf[kStreamReadFrames * 2];
+volatile uint32_t stream_underruns = 0;
+static_assert((kStreamRingFrames & (kStreamRingFrames - 1)) == 0,
+			  "stream ring size must be a power of two");
+
+enum class VoiceList : int8_t
+{
+	Free = 0,
+	Held,
+	Releasing,
+	Count
+};
+
+// Voice allocator state, owned by the main loop. Voices sit on one of three
+// FIFO lists so note-on, note-off and stealing are all O(1). The audio
+// callback reports finished voices through voice_retire_queue.
+struct VoiceAllocator
+{
+	VoiceList list[kPerformVoiceCount];
+	int8_t prev[kPerformVoiceCount];
+	int8_t next[kPerformVoiceCount];
+	int8_t note[kPerformVoiceCount];
+	int8_t head[static_cast<int>(VoiceList::Count)];
+	int8_t tail[static_cast<int>(VoiceList::Count)];
+	int8_t note_voice[128];
+	uint32_t generation[kPerformVoiceCount];
+};
+
+static VoiceAllocator voice_alloc;
+static uint32_t voice_retire_queue[kVoiceRetireQueueSize];
+static volatile uint32_t voice_retire_write = 0;
+static volatile uint32_t voice_retire_read = 0;
+static_assert((kVoiceRetireQueueSize & (kVoiceRetireQueueSize - 1)) == 0,
+			  "retire queue size must be a power of two");
+static_assert(kVoiceRetireQueueSize > static_cast<uint32_t>(kPerformVoiceCount),
+			  "retire queue must hold one entry per voice");
+
+enum class VoiceEventType : uint8_t
+{
+	Start,
+	Release,
+	Reset,
+};
+
+// Main loop to audio callback: every change to a voice travels through this
+// single-producer/single-consumer queue, stamped with the audio_frame_clock
+// frame it should take effect on. epoch drops events queued before a reset.
+struct VoiceEvent
+{
+	VoiceEventType type = VoiceEventType::Start;
+	int8_t voice = -1;
+	int8_t stream_slot = -1;
+	uint32_t generation = 0;
+	uint32_t epoch = 0;
+	uint32_t clock = 0;
 	int32_t note = -1;
+	float rate = 1.0f;
 	size_t offset = 0;
 	size_t length = 0;
-	uint32_t env_samples = 0;
+	VoiceSample sample;
 };
 
-static PerformVoice perform_voices[kPerformVoiceCount];
+static VoiceEvent voice_event_queue[kVoiceEventQueueSize];
+static volatile uint32_t voice_event_write = 0;
+static volatile uint32_t voice_event_read = 0;
+static volatile uint32_t voice_event_epoch = 0;
+static_assert((kVoiceEventQueueSize & (kVoiceEventQueueSize - 1)) == 0,
+			  "voice event queue size must be a power of two");
+
+// MIDI received by the audio callback, stamped with the block it arrived in.
+struct MidiInEvent
+{
+	MidiEvent msg;
+	uint32_t stamp = 0;
+};
+
+static MidiInEvent midi_in_queue[kMidiInQueueSize];
+static volatile uint32_t midi_in_write = 0;
+static volatile uint32_t midi_in_read = 0;
+static_assert((kMidiInQueueSize & (kMidiInQueueSize - 1)) == 0,
+			  "MIDI input queue size must be a power of two");
 
 struct PerformState
 {
@@ -918,46 +1000,13 @@ struct PerformState
 	bool amp_window_active = false;
 	bool flt_window_active = false;
 	int32_t fx_chain_order[kPerformFaderCount] = {};
-	float amp_attack = 0.0f;
-	float amp_decay = 0.0f;
-	float amp_sustain = 0.0f;
-	float amp_release = 0.0f;
-	float flt_cutoff = 1.0f;
-	float flt_res = 0.02f;
-	float fx_s_wet = 0.0f;
-	float sat_tape_bump = 0.0f;
-	float sat_bit_reso = 0.0f;
-	float sat_bit_smpl = 0.0f;
-	int32_t sat_mode = 0;
-	float fx_c_wet = 0.0f;
-	float chorus_rate = 0.0f;
-	float chorus_wow = 0.0f;
-	float tape_rate = 0.0f;
-	int32_t chorus_mode = 0;
-	float delay_wet = 0.0f;
-	float delay_time = 0.0f;
-	float delay_feedback = 0.0f;
-	float delay_spread = 0.0f;
-	float delay_freeze = 0.0f;
-	float reverb_wet = 0.0f;
-	float reverb_pre = 0.0f;
-	float reverb_damp = 0.0f;
-	float reverb_decay = 0.0f;
-	float reverb_shimmer = 0.0f;
+	FxParamBlock params;
 	bool sat_params_initialized = false;
 	bool reverb_params_initialized = false;
 	bool delay_params_initialized = false;
 	bool mod_params_initialized = false;
 };
 
-struct TrackSampleState
-{
-	bool loaded = false;
-	char name[kMaxWavNameLen] = {};
-	float trim_start = 0.0f;
-	float trim_end = 1.0f;
-};
-
 enum class PerformContext : int32_t
 {
 	Main,
@@ -976,17 +1025,22 @@ static PerformState play_perform_state;
 static PerformState track_perform_state[kPlayTrackCount];
 static PerformContext perform_context = PerformContext::Main;
 static int32_t perform_context_track = 0;
-static TrackSampleState track_samples[kPlayTrackCount];
+// Every PLAY track keeps its own resident sample; the current track's
+// state lives in the working globals until the context changes.
+static SampleState track_samples[kPlayTrackCount];
 static UiMode edt_prev_mode = UiMode::Perform;
 static SampleContext edt_sample_context = SampleContext::Perform;
+// EDT zoom: the view shows sample_length >> edt_zoom frames from
+// edt_view_start and follows the trim edge that moved last.
+static int32_t edt_zoom = 0;
+static size_t edt_view_start = 0;
+static bool edt_focus_end = false;
 static UiMode fx_detail_prev_mode = UiMode::Perform;
 static UiMode load_prev_mode = UiMode::Main;
 static LoadContext load_context = LoadContext::Main;
 static int32_t load_context_track = 0;
 static int32_t load_mode_index = 0;
 static LoadStubMode load_stub_mode = LoadStubMode::Presets;
-static volatile bool request_track_sample_load = false;
-static volatile int32_t request_track_sample_index = -1;
 
 // Normalized trim window (0..1 over entire sample)
 float trim_start = 0.0f;
@@ -1012,6 +1066,18 @@ struct WaveformCache
 
 static WaveformCache perform_waveform_cache;
 static WaveformCache play_waveform_cache;
+static WaveformCache track_waveform_cache[kPlayTrackCount];
+// Background read of a streamed sample's tail columns, see StepWaveformProbe.
+static bool probe_job_active = false;
+static FIL probe_job_file;
+static char probe_job_path[kSamplePathLen] = {};
+static SampleContext probe_job_context = SampleContext::Perform;
+static int32_t probe_job_track = 0;
+static size_t probe_job_frames = 0;
+static size_t probe_job_resident = 0;
+static size_t probe_job_col = 0;
+static uint32_t probe_job_data_offset = 0;
+static uint16_t probe_job_channels = 1;
 static bool waveform_from_recording = false;
 static volatile float perform_attack_norm = 0.0f;
 static volatile float perform_release_norm = 0.0f;
@@ -1023,6 +1089,18 @@ static bool live_wave_dirty = false;
 static int32_t live_wave_last_col = -1;
 
 constexpr size_t kRecordMaxFrames = static_cast<size_t>(kRecordMaxSeconds) * 48000U;
+
+// One waveform pyramid per sample context, covering the resident frames.
+constexpr size_t kWavePyramidFrames = (kMaxSampleSamples > kRecordMaxFrames) ? kMaxSampleSamples : kRecordMaxFrames;
+constexpr size_t kWavePyramidCapacity = WavePyramidEntries(kWavePyramidFrames);
+constexpr int32_t kWavePyramidCount = 2 + kPlayTrackCount;
+DSY_SDRAM_BSS int16_t wave_pyramid_lo[kWavePyramidCount][kWavePyramidCapacity];
+DSY_SDRAM_BSS int16_t wave_pyramid_hi[kWavePyramidCount][kWavePyramidCapacity];
+static WavePyramid perform_wave_pyramid;
+static WavePyramid play_wave_pyramid;
+static WavePyramid track_wave_pyramid[kPlayTrackCount];
+static WavePyramid* sample_pyramid = &perform_wave_pyramid;
+
 constexpr uint32_t kRecordCountdownMs = 4000;
 volatile RecordState record_state = RecordState::Armed;
 volatile int32_t record_source_index = 0;
@@ -1030,58 +1108,97 @@ volatile int32_t record_target_index = kRecordTargetSave;
 volatile uint32_t record_countdown_start_ms = 0;
 volatile size_t record_pos = 0;
 volatile bool record_waveform_pending = false;
+// Posted by the callback when a recording stops; logged by the main loop.
+volatile bool request_record_stop_log = false;
+volatile bool record_stop_auto = false;
+// Record target block, allocated by the main loop while the RECORD screen is
+// open and handed to the PLAY context when recording starts.
+static int32_t record_pool_handle = -1;
+static int16_t* volatile record_buffer = nullptr;
+volatile bool record_buffer_swapped = false;
+volatile bool record_trim_pending = false;
+static int32_t record_replaced_l = -1;
+static int32_t record_replaced_r = -1;
 volatile int32_t encoder_r_accum = 0;
 volatile bool encoder_r_button_press = false;
 volatile bool request_length_redraw = false;
 static int32_t play_bpm = kPlayBpm;
-static uint32_t play_step_ms = 0;
 static PlaySelectMode play_select_mode = PlaySelectMode::Bpm;
 static int32_t play_select_row = 0;
 static int32_t play_select_col = 0;
 static bool play_screen_dirty = true;
-static bool playhead_running = false;
-static int32_t playhead_step = 0;
-static uint32_t playhead_last_step_ms = 0;
+volatile bool playhead_running = false;
+volatile int32_t playhead_step = 0;
+// Frames rendered since boot, advanced by the audio callback. The sequencer
+// schedules steps on this clock; the anchor is moved on tempo changes so
+// step times never accumulate rounding.
+volatile uint32_t audio_frame_clock = 0;
+volatile uint32_t audio_block_us = 0;
+volatile uint32_t audio_block_frames = 1;
+// Set by the audio callback while nothing is sounding; the main loop then
+// sleeps between interrupts.
+volatile bool engine_idle = false;
+static uint32_t engine_quiet_frames = 0;
+#if WAVECONT_PROFILE
+// Callback profile. The callback fills profile_live and, every
+// kProfileWindowMs, hands it to the main loop through profile_report.
+constexpr uint32_t kProfileWindowMs = 500;
+static ProfileWindow profile_live;
+static ProfileWindow profile_report;
+static ProfileWindow profile_shown;
+static volatile bool profile_report_ready = false;
+static bool profile_shown_valid = false;
+#endif
+// Step clock, owned by the audio callback while playhead_running is set.
+static uint32_t seq_anchor_frame = 0;
+static uint32_t seq_anchor_steps = 0;
+static int32_t seq_bpm = kPlayBpm;
+static int32_t seq_next_step = 0;
+static uint32_t seq_next_frame = 0;
+
+// What a track plays on its next step. The main loop picks the voice, the
+// window and the refill ring ahead of time and publishes a plan by flipping
+// seq_plan_live; the audio callback starts the voice on the step frame and
+// counts the start in seq_plan_fired. Only the first start gets the ring,
+// so a track that fires again before the main loop re-arms retriggers the
+// same voice from its resident head.
+struct SeqTrackPlan
+{
+	bool valid = false;
+	int8_t voice = -1;
+	int8_t stream_slot = -1;
+	uint32_t generation = 0;
+	float rate = 1.0f;
+	size_t offset = 0;
+	size_t length = 0;
+	size_t window_end = 0;
+	VoiceSample sample;
+};
+
+static SeqTrackPlan seq_plans[kPlayTrackCount][2];
+static volatile uint8_t seq_plan_live[kPlayTrackCount] = {};
+static volatile uint32_t seq_plan_fired[kPlayTrackCount][2] = {};
 static bool play_steps[kPlayTrackCount][kPlayStepCount] = {};
 volatile bool request_playhead_redraw = false;
 volatile bool button1_press = false;
 volatile bool button2_press = false;
 volatile bool request_playback_stop_log = false;
-volatile float reverb_wet = kReverbDefaultWet;
-volatile float reverb_pre = 0.5f;
-volatile float reverb_damp = 0.5f;
-volatile float reverb_decay = 0.5f;
-volatile float reverb_shimmer = 0.5f;
-volatile float delay_wet = kDelayDefaultWet;
-volatile float delay_time = 0.5f;
-volatile float delay_feedback = 0.5f;
-volatile float delay_spread = 0.5f;
-volatile float delay_freeze = 0.0f;
-volatile float fx_s_wet = 0.0f;
-volatile float sat_drive = 0.5f;
-volatile float sat_tape_bump = 0.5f;
-volatile float sat_bit_reso = 0.5f;
-volatile float sat_bit_smpl = 0.5f;
-volatile float fx_c_wet = 0.0f;
-volatile float mod_depth = 0.5f;
-volatile float chorus_rate = 0.5f;
-volatile int32_t sat_mode = 0;
-volatile int32_t chorus_mode = 0;
-volatile float chorus_wow = 0.5f;
-volatile float tape_rate = 0.5f;
+static FxParamBlock fx_params;
 volatile bool fx_params_dirty = true;
+// Set while the main loop rewrites fx_params as a whole (context switches).
+volatile bool fx_params_busy = false;
+// Per-stage coefficient handoff: the UI marks a stage dirty, the main loop
+// compiles it into fx_coeffs_mailbox and raises ready, the audio callback
+// takes it and clears ready. A stage is not recompiled while still ready.
+static volatile bool fx_stage_dirty[kFxStageCount] = {true, true, true, true};
+static volatile bool fx_stage_ready[kFxStageCount] = {};
+static FxCoeffs fx_coeffs_mailbox;
 static bool sat_params_initialized = false;
 static bool reverb_params_initialized = false;
 static bool delay_params_initialized = false;
 static bool mod_params_initialized = false;
-volatile float amp_attack = 0.0f;
-volatile float amp_decay = 0.0f;
-volatile float amp_sustain = 0.0f;
-volatile float amp_release = 0.0f;
 volatile int32_t fx_detail_index = 0;
 volatile int32_t fx_detail_param_index = 0;
-volatile float flt_cutoff = 1.0f;
-volatile float flt_res = 0.02f;
 volatile bool preview_hold = false;
 volatile bool preview_active = false;
 volatile int32_t preview_index = -1;
@@ -1091,10 +1208,32 @@ volatile float preview_rate = 1.0f;
 volatile float preview_read_frac = 0.0f;
 volatile size_t preview_read_index = 0;
 volatile size_t preview_write_index = 0;
-volatile uint32_t preview_data_offset = 0;
+volatile int32_t preview_offset_step = 0;
+
+// File layout of one preview: it plays from loop_pos to data_end and wraps
+// back to loop_pos. Prefetched heads keep the frames read from loop_pos.
+struct PreviewHead
+{
+	int32_t record = -1;
+	int32_t step = 0;
+	uint32_t sample_rate = 48000;
+	uint16_t channels = 1;
+	uint32_t loop_pos = 0;
+	uint32_t data_end = 0;
+	size_t frames = 0;
+};
+
+static PreviewHead preview_info;
 static FIL preview_file;
 static bool preview_file_open = false;
-alignas(32) static int16_t preview_buffer[kPreviewBufferFrames];
+alignas(32) static int16_t preview_buffer_l[kPreviewBufferFrames];
+alignas(32) static int16_t preview_buffer_r[kPreviewBufferFrames];
+static PreviewHead preview_heads[kPreviewHeadCount];
+DSY_SDRAM_BSS int16_t preview_head_l[kPreviewHeadCount][kPreviewHeadFrames];
+DSY_SDRAM_BSS int16_t preview_head_r[kPreviewHeadCount][kPreviewHeadFrames];
+static int32_t preview_hover_selected = -1;
+static int32_t preview_hover_step = 0;
+static uint32_t preview_hover_since_ms = 0;
 alignas(32) static int16_t preview_read_buf[kPreviewReadFrames * 2];
 float led1_level = 0.0f;
 float led1_phase_ms = 0.0f;
@@ -1105,6 +1244,8 @@ static uint8_t record_invert_mask[kDisplayH][kDisplayW];
 static uint8_t record_fb_buf[kDisplayH][kDisplayW];
 static uint8_t record_bold_mask[kDisplayH][kDisplayW];
 static bool request_shift_redraw = false;
+static bool request_cpu_load_redraw = false;
+static bool request_profile_dump = false;
 static bool request_perform_redraw = false;
 static bool request_fx_detail_redraw = false;
 static uint32_t delay_snow_next_ms = 0;
@@ -1124,6 +1265,9 @@ static inline bool UiLogEnabled()
 }
 
 static void ComputeWaveform();
+static void CancelOverviewJob();
+static void CloseIdleStreamFiles();
+static bool SequencerPlansIdle();
 
 static double NowMs()
 {
@@ -1257,6 +1401,9 @@ static void ForCirclePixels(int cx, int cy, int r, F&& fn)
 
 static FIL wav_file;
 alignas(32) static int16_t wav_read[kSampleChunkFrames * 2];
+// The read lands at load_chunk_buf + kLoadCarryBytes; a frame split across
+// two reads is carried just in front of it.
+alignas(32) static uint8_t load_chunk_buf[kLoadCarryBytes + kLoadChunkBytes];
 
 const char* kMenuLabels[kMenuCount] = {"LOAD", "RECORD", "PERFORM", "PLAY"};
 
@@ -1283,7 +1430,7 @@ static int32_t NextMenuIndex(int32_t current, int32_t delta)
 	}
 	return order[pos];
 }
-const char* kShiftMenuLabels[kShiftMenuCount] = {"SAVE PRESET", "DELETE"};
+const char* kShiftMenuLabels[kShiftMenuCount] = {"SAVE PRESET", "DELETE", "CPU LOAD"};
 
 template <typename... Va>
 static void LogLine(const char* format, Va... va)
@@ -1344,6 +1491,7 @@ static const char* UiModeName(UiMode mode)
 		case UiMode::Record: return "RECORD";
 		case UiMode::PresetSaveStub: return "PRESET_SAVE_STUB";
 		case UiMode::Shift: return "SHIFT";
+		case UiMode::CpuLoad: return "CPU_LOAD";
 		default: return "UNKNOWN";
 	}
 }
@@ -1405,20 +1553,176 @@ static void LogSdCardStatus()
 			static_cast<unsigned long>(info.CardSpeed));
 }
 
-struct WavInfo
-{
-	uint16_t num_channels = 0;
-	uint32_t sample_rate = 0;
-	uint16_t bits_per_sample = 0;
-	uint32_t data_offset = 0;
-	uint32_t data_size = 0;
-};
-
 alignas(32) static uint8_t wav_riff_hdr[12];
 alignas(32) static uint8_t wav_chunk_hdr[8];
 alignas(32) static uint8_t wav_fmt_buf[32];
 alignas(32) static int16_t wav_write[kSaveChunkFrames * 2];
 
+// Blocks are keyed by the file's start cluster and size, which stay fixed
+// for files that are only read; deletes and remounts drop the whole cache.
+struct SdCacheBlock
+{
+	DWORD cluster = 0;
+	FSIZE_t size = 0;
+	uint32_t block = 0;
+	uint32_t valid = 0;
+	uint32_t used = 0;
+};
+
+static SdCacheBlock sd_cache_blocks[kSdCacheBlocks];
+alignas(32) DSY_SDRAM_BSS uint8_t sd_cache_mem[kSdCacheBlocks][kSdCacheBlockBytes];
+alignas(32) static uint8_t sd_cache_fill_buf[kSdCacheBlockBytes];
+static uint32_t sd_cache_clock = 0;
+static uint32_t sd_cache_hits = 0;
+static uint32_t sd_cache_misses = 0;
+
+static void SdCacheInvalidate()
+{
+	for (auto& entry : sd_cache_blocks)
+	{
+		entry.valid = 0;
+		entry.used = 0;
+	}
+}
+
+static int32_t SdCacheFind(const FIL* file, uint32_t block)
+{
+	for (int32_t i = 0; i < kSdCacheBlocks; ++i)
+	{
+		SdCacheBlock& entry = sd_cache_blocks[i];
+		if (entry.valid > 0
+			&& entry.block == block
+			&& entry.cluster == file->obj.sclust
+			&& entry.size == f_size(file))
+		{
+			entry.used = ++sd_cache_clock;
+			return i;
+		}
+	}
+	return -1;
+}
+
+// Reads block into the least recently used slot. The card read lands in
+// SRAM like the other reads here and is copied out to SDRAM.
+static FRESULT SdCacheFill(FIL* file, uint32_t block, int32_t& slot)
+{
+	slot = 0;
+	for (int32_t i = 1; i < kSdCacheBlocks; ++i)
+	{
+		if (sd_cache_blocks[i].used < sd_cache_blocks[slot].used)
+		{
+			slot = i;
+		}
+	}
+	SdCacheBlock& entry = sd_cache_blocks[slot];
+	entry.valid = 0;
+	entry.used = 0;
+	const FSIZE_t pos = static_cast<FSIZE_t>(block) * kSdCacheBlockBytes;
+	FRESULT res = (f_tell(file) != pos) ? f_lseek(file, pos) : FR_OK;
+	UINT got = 0;
+	if (res == FR_OK)
+	{
+		res = f_read(file, sd_cache_fill_buf, kSdCacheBlockBytes, &got);
+	}
+	if (res != FR_OK || got == 0)
+	{
+		slot = -1;
+		return (res != FR_OK) ? res : FR_DISK_ERR;
+	}
+	std::memcpy(sd_cache_mem[slot], sd_cache_fill_buf, got);
+	entry.cluster = file->obj.sclust;
+	entry.size = f_size(file);
+	entry.block = block;
+	entry.valid = got;
+	entry.used = ++sd_cache_clock;
+	return FR_OK;
+}
+
+// f_read through the block cache, for files opened read-only.
+static FRESULT SdCachedRead(FIL* file, void* buf, UINT bytes, UINT* bytes_read)
+{
+	*bytes_read = 0;
+	if (file->obj.sclust == 0)
+	{
+		return f_read(file, buf, bytes, bytes_read);
+	}
+	uint8_t* const start = static_cast<uint8_t*>(buf);
+	uint8_t* dst = start;
+	FSIZE_t pos = f_tell(file);
+	const FSIZE_t end = (f_size(file) - pos < bytes) ? f_size(file) : pos + bytes;
+	const bool fill = bytes < kSdCacheBlockBytes;
+	FRESULT res = FR_OK;
+	while (pos < end)
+	{
+		const uint32_t block = static_cast<uint32_t>(pos / kSdCacheBlockBytes);
+		const size_t offset = static_cast<size_t>(pos % kSdCacheBlockBytes);
+		int32_t slot = SdCacheFind(file, block);
+		if (slot >= 0)
+		{
+			++sd_cache_hits;
+		}
+		else if (fill)
+		{
+			++sd_cache_misses;
+			res = SdCacheFill(file, block, slot);
+			if (res != FR_OK)
+			{
+				break;
+			}
+		}
+		if (slot >= 0)
+		{
+			const SdCacheBlock& entry = sd_cache_blocks[slot];
+			if (offset >= entry.valid)
+			{
+				break;
+			}
+			size_t n = entry.valid - offset;
+			if (n > end - pos)
+			{
+				n = static_cast<size_t>(end - pos);
+			}
+			std::memcpy(dst, sd_cache_mem[slot] + offset, n);
+			dst += n;
+			pos += n;
+			continue;
+		}
+		// Long read: everything up to the next cached block goes straight to
+		// the caller's buffer as one multi-block read.
+		FSIZE_t run_end = static_cast<FSIZE_t>(block + 1) * kSdCacheBlockBytes;
+		++sd_cache_misses;
+		while (run_end < end && SdCacheFind(file, static_cast<uint32_t>(run_end / kSdCacheBlockBytes)) < 0)
+		{
+			run_end += kSdCacheBlockBytes;
+			++sd_cache_misses;
+		}
+		run_end = (run_end > end) ? end : run_end;
+		if (f_tell(file) != pos)
+		{
+			res = f_lseek(file, pos);
+			if (res != FR_OK)
+			{
+				break;
+			}
+		}
+		const UINT want = static_cast<UINT>(run_end - pos);
+		UINT got = 0;
+		res = f_read(file, dst, want, &got);
+		dst += got;
+		pos += got;
+		if (res != FR_OK || got < want)
+		{
+			break;
+		}
+	}
+	*bytes_read = static_cast<UINT>(dst - start);
+	if (res == FR_OK && f_tell(file) != pos)
+	{
+		res = f_lseek(file, pos);
+	}
+	return res;
+}
+
 static bool ParseWavHeader(FIL* file, WavInfo& info)
 {
 	if (file == nullptr)
@@ -1448,7 +1752,7 @@ static bool ParseWavHeader(FIL* file, WavInfo& info)
 		return false;
 	}
 
-	fres = f_read(file, wav_riff_hdr, sizeof(wav_riff_hdr), &bytes_read);
+	fres = SdCachedRead(file, wav_riff_hdr, sizeof(wav_riff_hdr), &bytes_read);
 	if (fres != FR_OK || bytes_read != sizeof(wav_riff_hdr))
 	{
 		LogLine("Load failed: RIFF header read %s (%d), bytes=%u",
@@ -1471,7 +1775,7 @@ static bool ParseWavHeader(FIL* file, WavInfo& info)
 
 	while (!data_found)
 	{
-		fres = f_read(file, wav_chunk_hdr, sizeof(wav_chunk_hdr), &bytes_read);
+		fres = SdCachedRead(file, wav_chunk_hdr, sizeof(wav_chunk_hdr), &bytes_read);
 		if (fres != FR_OK || bytes_read != sizeof(wav_chunk_hdr))
 		{
 			LogLine("Load failed: chunk header read %s (%d), bytes=%u",
@@ -1481,17 +1785,13 @@ static bool ParseWavHeader(FIL* file, WavInfo& info)
 			return false;
 		}
 
-		const uint32_t chunk_size =
-			(uint32_t)wav_chunk_hdr[4]
-			| ((uint32_t)wav_chunk_hdr[5] << 8)
-			| ((uint32_t)wav_chunk_hdr[6] << 16)
-			| ((uint32_t)wav_chunk_hdr[7] << 24);
+		const uint32_t chunk_size = WavReadLe32(wav_chunk_hdr + 4);
 
 		if (std::memcmp(wav_chunk_hdr, "fmt ", 4) == 0)
 		{
 			const UINT to_read = (UINT)((chunk_size < sizeof(wav_fmt_buf)) ? chunk_size : sizeof(wav_fmt_buf));
 
-			fres = f_read(file, wav_fmt_buf, to_read, &bytes_read);
+			fres = SdCachedRead(file, wav_fmt_buf, to_read, &bytes_read);
 			if (fres != FR_OK || bytes_read < 16)
 			{
 				LogLine("Load failed: fmt chunk read %s (%d), bytes=%u",
@@ -1501,17 +1801,7 @@ static bool ParseWavHeader(FIL* file, WavInfo& info)
 				return false;
 			}
 
-			const uint16_t audio_format =
-				(uint16_t)(wav_fmt_buf[0] | (wav_fmt_buf[1] << 8));
-			info.num_channels =
-				(uint16_t)(wav_fmt_buf[2] | (wav_fmt_buf[3] << 8));
-			info.sample_rate =
-				(uint32_t)(wav_fmt_buf[4]
-					| (wav_fmt_buf[5] << 8)
-					| (wav_fmt_buf[6] << 16)
-					| (wav_fmt_buf[7] << 24));
-			info.bits_per_sample =
-				(uint16_t)(wav_fmt_buf[14] | (wav_fmt_buf[15] << 8));
+			const uint16_t audio_format = ParseWavFmtChunk(wav_fmt_buf, bytes_read, info);
 
 			if (audio_format != WAVE_FORMAT_PCM)
 			{
@@ -1669,7 +1959,8 @@ static void InitLoadLayout()
 
 static int32_t LoadVisibleLines()
 {
-	return load_lines;
+	const int32_t lines = load_lines - (delete_mode ? 0 : kLoadOverviewLines);
+	return (lines < 1) ? 1 : lines;
 }
 
 template <size_t N>
@@ -1678,6 +1969,20 @@ constexpr size_t ArraySize(const char* const (&)[N])
 	return N;
 }
 
+// File handles belong to the mount they were opened on.
+static void ResetLibraryState()
+{
+	library_open = false;
+	library_synced = false;
+	library_sync_active = false;
+	library_sync_dir_open = false;
+	library_sync_old_open = false;
+	library_page_first = -1;
+	library_page_count = 0;
+	SdCacheInvalidate();
+	CloseIdleStreamFiles();
+}
+
 static void MountSd()
 {
 	if (sd_mounted)
@@ -1692,6 +1997,7 @@ static void MountSd()
 	sd_mounted = (f_mount(&fsi.GetSDFileSystem(), fsi.GetSDPath(), 1) == FR_OK);
 	if (sd_mounted)
 	{
+		ResetLibraryState();
 		LogLine("SD mount OK at %s", fsi.GetSDPath());
 	}
 	else
@@ -1935,6 +2241,7 @@ static bool StepSaveRecordedSample(bool& done)
 		save_file_open = false;
 		done = true;
 		LogLine("Save OK: %s (%lu frames)", save_filename, (unsigned long)sample_length);
+		library_synced = false;
 		CopyString(loaded_sample_name, save_filename, kMaxWavNameLen);
 		return true;
 	}
@@ -1961,53 +2268,1196 @@ static bool ReinitSdNow()
 	return sd_mounted;
 }
 
-static void ScanSdFiles(bool wav_only)
+static void ClampLoadSelection()
 {
-	LogLine("Scanning WAV files...");
-	bool detected = BSP_SD_IsDetected();
-	if (!detected)
-	{
-		SdmmcHandler::Config sd_cfg;
-		sd_cfg.Defaults();
-		sdcard.Init(sd_cfg);
-		fsi.Init(FatFSInterface::Config::MEDIA_SD);
-		const uint8_t init_res = BSP_SD_Init();
-		LogLine("SD init (detect): %u", static_cast<unsigned>(init_res));
-		detected = BSP_SD_IsDetected();
-		if (!detected)
-		{
-			sd_mounted = false;
-			sd_need_reinit = true;
-			sd_detected_last = false;
-			wav_file_count = 0;
-			load_selected = 0;
-			load_scroll = 0;
-			LogLine("Scan aborted: SD not detected");
-			return;
-		}
-	}
-	if (BSP_SD_GetCardState() != SD_TRANSFER_OK)
+	if (wav_file_count <= 0)
 	{
-		sd_mounted = false;
-		sd_need_reinit = true;
-		wav_file_count = 0;
 		load_selected = 0;
 		load_scroll = 0;
-		LogLine("Scan aborted: SD not ready");
 		return;
 	}
-	if (detected && !sd_detected_last)
+	if (load_selected >= wav_file_count)
 	{
-		sd_need_reinit = true;
+		load_selected = wav_file_count - 1;
 	}
-	sd_detected_last = true;
-
-	if (sd_need_reinit)
+	if (load_selected < load_scroll)
 	{
-		f_mount(0, fsi.GetSDPath(), 0);
-		sd_mounted = false;
-		SdmmcHandler::Config sd_cfg;
-		sd_cfg.Defaults();
+		load_scroll = load_selected;
+	}
+	else if (load_selected >= load_scroll + LoadVisibleLines())
+	{
+		load_scroll = load_selected - (LoadVisibleLines() - 1);
+	}
+	if (load_scroll < 0)
+	{
+		load_scroll = 0;
+	}
+	const int32_t max_top = wav_file_count - LoadVisibleLines();
+	if (max_top < 0)
+	{
+		load_scroll = 0;
+	}
+	else if (load_scroll > max_top)
+	{
+		load_scroll = max_top;
+	}
+}
+
+static const char* LibraryBaseName(const char* path)
+{
+	const char* base = path;
+	for (const char* p = path; *p != '\0'; ++p)
+	{
+		if (*p == '/')
+		{
+			base = p + 1;
+		}
+	}
+	return base;
+}
+
+static void CloseLibrary()
+{
+	if (library_open)
+	{
+		f_close(&library_file);
+		library_open = false;
+	}
+	library_page_first = -1;
+	library_page_count = 0;
+}
+
+// Heads are keyed by record, so they go whenever records are renumbered.
+static void ResetPreviewHeads()
+{
+	for (auto& head : preview_heads)
+	{
+		head.record = -1;
+		head.frames = 0;
+	}
+}
+
+static void SetBrowseBlock(uint32_t first, uint32_t children, uint32_t folders)
+{
+	const int32_t up = (browse_depth > 0) ? 1 : 0;
+	browse_first = static_cast<int32_t>(first);
+	browse_folder_entries = up + static_cast<int32_t>(folders);
+	wav_file_count = up + static_cast<int32_t>(children);
+}
+
+static void ResetBrowse()
+{
+	browse_depth = 0;
+	browse_cursor_count = 0;
+	load_selected = 0;
+	load_scroll = 0;
+	SetBrowseBlock(0, library_header.root_children, library_header.root_folders);
+}
+
+static bool OpenLibraryIndex()
+{
+	CloseLibrary();
+	library_header = LibraryHeader();
+	ResetBrowse();
+	char path[64];
+	BuildFilePath(kLibraryIndexName, path, sizeof(path));
+	if (f_open(&library_file, path, FA_READ | FA_WRITE) != FR_OK)
+	{
+		LogLine("Library: no index");
+		return false;
+	}
+	UINT bytes_read = 0;
+	LibraryHeader header;
+	if (f_read(&library_file, library_io_buf, kLibraryHeaderBytes, &bytes_read) != FR_OK
+		|| !LibraryHeaderDecode(library_io_buf, bytes_read, header)
+		|| header.count > static_cast<uint32_t>(kLibraryMaxRecords)
+		|| f_size(&library_file) < kLibraryHeaderBytes + static_cast<FSIZE_t>(header.count) * kLibraryRecordBytes)
+	{
+		LogLine("Library: index invalid");
+		f_close(&library_file);
+		library_synced = false;
+		return false;
+	}
+	library_open = true;
+	library_header = header;
+	for (uint32_t i = 0; i < header.count; ++i)
+	{
+		wav_overview_state[i] = OverviewState::Unknown;
+	}
+	ResetPreviewHeads();
+	ResetBrowse();
+	// List positions are renumbered, so a pending delete no longer
+	// points at the file that was confirmed.
+	if (delete_confirm || request_delete_file)
+	{
+		delete_confirm = false;
+		request_delete_file = false;
+		request_delete_index = -1;
+		request_delete_redraw = true;
+	}
+	delete_confirm_path[0] = '\0';
+	return true;
+}
+
+// Reads the page of records around index in one f_read.
+static bool LoadLibraryPage(int32_t index)
+{
+	const int32_t total = static_cast<int32_t>(library_header.count);
+	int32_t first = index - kLibraryPageEntries / 2;
+	if (first > total - kLibraryPageEntries)
+	{
+		first = total - kLibraryPageEntries;
+	}
+	if (first < 0)
+	{
+		first = 0;
+	}
+	int32_t count = total - first;
+	if (count > kLibraryPageEntries)
+	{
+		count = kLibraryPageEntries;
+	}
+	library_page_first = -1;
+	library_page_count = 0;
+	UINT bytes_read = 0;
+	if (f_lseek(&library_file, kLibraryHeaderBytes + static_cast<FSIZE_t>(first) * kLibraryRecordBytes) != FR_OK
+		|| f_read(&library_file, library_io_buf, static_cast<UINT>(count * kLibraryRecordBytes), &bytes_read) != FR_OK)
+	{
+		LogLine("Library: page read failed at %ld", static_cast<long>(first));
+		return false;
+	}
+	const int32_t got = static_cast<int32_t>(bytes_read / kLibraryRecordBytes);
+	for (int32_t i = 0; i < got; ++i)
+	{
+		LibraryRecordDecode(library_io_buf + i * kLibraryRecordBytes, library_page[i]);
+	}
+	library_page_first = first;
+	library_page_count = got;
+	return index < first + got;
+}
+
+// Main loop only. The record stays valid until the next call pages.
+static const LibraryRecord* LibraryEntry(int32_t index)
+{
+	if (!library_open || index < 0 || index >= static_cast<int32_t>(library_header.count))
+	{
+		return nullptr;
+	}
+	if ((index < library_page_first || index >= library_page_first + library_page_count)
+		&& !LoadLibraryPage(index))
+	{
+		return nullptr;
+	}
+	return &library_page[index - library_page_first];
+}
+
+static bool LibraryCopy(int32_t index, LibraryRecord& rec)
+{
+	const LibraryRecord* entry = LibraryEntry(index);
+	if (entry == nullptr)
+	{
+		return false;
+	}
+	rec = *entry;
+	return true;
+}
+
+static const char* LibraryPath(int32_t index)
+{
+	const LibraryRecord* rec = LibraryEntry(index);
+	return (rec != nullptr) ? rec->path : "";
+}
+
+// Record shown at a list position; -1 for the ".." entry.
+static int32_t BrowseRecord(int32_t list_index)
+{
+	const int32_t up = (browse_depth > 0) ? 1 : 0;
+	if (list_index < up || list_index >= wav_file_count)
+	{
+		return -1;
+	}
+	return browse_first + list_index - up;
+}
+
+// File record at a list position, or -1 for folders.
+static int32_t BrowseFileRecord(int32_t list_index)
+{
+	return (list_index < browse_folder_entries) ? -1 : BrowseRecord(list_index);
+}
+
+static int32_t BrowseFolder()
+{
+	return (browse_depth > 0) ? browse_stack[browse_depth - 1] : -1;
+}
+
+static void SaveBrowseCursor()
+{
+	const int32_t folder = BrowseFolder();
+	int32_t slot = 0;
+	while (slot < browse_cursor_count && browse_cursors[slot].folder != folder)
+	{
+		++slot;
+	}
+	if (slot == browse_cursor_count && browse_cursor_count < kBrowseCursorCount)
+	{
+		++browse_cursor_count;
+	}
+	if (slot == kBrowseCursorCount)
+	{
+		slot = kBrowseCursorCount - 1;
+	}
+	// Most recent first; the oldest falls off the end.
+	for (int32_t i = slot; i > 0; --i)
+	{
+		browse_cursors[i] = browse_cursors[i - 1];
+	}
+	browse_cursors[0].folder = folder;
+	browse_cursors[0].selected = load_selected;
+	browse_cursors[0].scroll = load_scroll;
+}
+
+static bool RestoreBrowseCursor()
+{
+	const int32_t folder = BrowseFolder();
+	for (int32_t i = 0; i < browse_cursor_count; ++i)
+	{
+		if (browse_cursors[i].folder == folder)
+		{
+			load_selected = browse_cursors[i].selected;
+			load_scroll = browse_cursors[i].scroll;
+			ClampLoadSelection();
+			return true;
+		}
+	}
+	return false;
+}
+
+// Opens the folder or ".." entry at a list position. Going back lands on
+// the folder just left unless its parent has a remembered cursor.
+static void BrowseOpen(int32_t list_index)
+{
+	if (list_index < 0 || list_index >= browse_folder_entries)
+	{
+		return;
+	}
+	const int32_t record = BrowseRecord(list_index);
+	LibraryRecord rec;
+	if (record >= 0)
+	{
+		if (browse_depth >= kLibraryMaxDepth || !LibraryCopy(record, rec) || rec.kind != kLibraryKindFolder)
+		{
+			return;
+		}
+		SaveBrowseCursor();
+		browse_stack[browse_depth] = record;
+		++browse_depth;
+		SetBrowseBlock(rec.first, rec.children, rec.folders);
+		if (!RestoreBrowseCursor())
+		{
+			load_selected = 0;
+			load_scroll = 0;
+		}
+		LogLine("Browse: %s (%lu entries)", rec.path, static_cast<unsigned long>(rec.children));
+	}
+	else
+	{
+		const int32_t left = BrowseFolder();
+		SaveBrowseCursor();
+		--browse_depth;
+		const int32_t parent = BrowseFolder();
+		if (parent < 0)
+		{
+			SetBrowseBlock(0, library_header.root_children, library_header.root_folders);
+		}
+		else if (LibraryCopy(parent, rec))
+		{
+			SetBrowseBlock(rec.first, rec.children, rec.folders);
+		}
+		if (!RestoreBrowseCursor())
+		{
+			load_selected = left - browse_first + ((browse_depth > 0) ? 1 : 0);
+			load_scroll = load_selected;
+			ClampLoadSelection();
+		}
+		LogLine("Browse: up to %s", (parent < 0) ? "/" : rec.path);
+	}
+	load_overview_selected = -1;
+	load_overview_index = -1;
+	request_library_redraw = true;
+}
+
+static void LibrarySetPeak(int32_t index, uint16_t peak)
+{
+	if (!library_open || library_sync_active || index < 0 || index >= static_cast<int32_t>(library_header.count))
+	{
+		return;
+	}
+	uint8_t bytes[2];
+	WavWriteLe16(bytes, peak);
+	UINT written = 0;
+	const FSIZE_t offset = kLibraryHeaderBytes + static_cast<FSIZE_t>(index) * kLibraryRecordBytes + kLibraryPeakOffset;
+	if (f_lseek(&library_file, offset) != FR_OK
+		|| f_write(&library_file, bytes, sizeof(bytes), &written) != FR_OK
+		|| f_sync(&library_file) != FR_OK)
+	{
+		LogLine("Library: peak update failed at %ld", static_cast<long>(index));
+		return;
+	}
+	if (index >= library_page_first && index < library_page_first + library_page_count)
+	{
+		library_page[index - library_page_first].peak = peak;
+	}
+}
+
+static bool LibraryWriteRecord(int32_t index, const LibraryRecord& rec)
+{
+	LibraryRecordEncode(rec, library_sync_buf);
+	UINT written = 0;
+	if (f_lseek(&library_file, kLibraryHeaderBytes + static_cast<FSIZE_t>(index) * kLibraryRecordBytes) != FR_OK
+		|| f_write(&library_file, library_sync_buf, kLibraryRecordBytes, &written) != FR_OK
+		|| written != kLibraryRecordBytes)
+	{
+		return false;
+	}
+	if (index >= library_page_first && index < library_page_first + library_page_count)
+	{
+		library_page[index - library_page_first] = rec;
+	}
+	return true;
+}
+
+// Drops a deleted file from the folder being browsed in a few small
+// writes: the block's last file takes its slot, the folder's block
+// shrinks by one and the freed slot is marked deleted. The next sync
+// compacts the index and restores the card's file order.
+static bool LibraryRemoveAt(int32_t index)
+{
+	const int32_t up = (browse_depth > 0) ? 1 : 0;
+	const int32_t files_first = browse_first + browse_folder_entries - up;
+	const int32_t last = browse_first + wav_file_count - up - 1;
+	if (!library_open || index < files_first || index > last)
+	{
+		return false;
+	}
+	const int32_t parent = BrowseFolder();
+	LibraryRecord moved;
+	LibraryRecord folder;
+	bool ok = LibraryCopy(last, moved) && (parent < 0 || LibraryCopy(parent, folder));
+	// No path, so the sync never matches it to a file on the card.
+	LibraryRecord dead;
+	dead.kind = kLibraryKindDeleted;
+	if (ok && index != last)
+	{
+		ok = LibraryWriteRecord(index, moved);
+	}
+	if (ok && parent < 0)
+	{
+		--library_header.root_children;
+		LibraryHeaderEncode(library_header, library_sync_buf);
+		UINT written = 0;
+		ok = f_lseek(&library_file, 0) == FR_OK
+			&& f_write(&library_file, library_sync_buf, kLibraryHeaderBytes, &written) == FR_OK
+			&& written == kLibraryHeaderBytes;
+	}
+	else if (ok)
+	{
+		--folder.children;
+		ok = LibraryWriteRecord(parent, folder);
+	}
+	ok = ok && LibraryWriteRecord(last, dead) && f_sync(&library_file) == FR_OK;
+	if (!ok)
+	{
+		LogLine("Library: remove failed at %ld", static_cast<long>(index));
+		library_synced = false;
+		return false;
+	}
+	wav_overview_state[index] = wav_overview_state[last];
+	wav_overview_state[last] = OverviewState::Unknown;
+	load_overview_index = -1;
+	load_overview_selected = -1;
+	ResetPreviewHeads();
+	SetBrowseBlock(static_cast<uint32_t>(browse_first),
+				   static_cast<uint32_t>(wav_file_count - up - 1),
+				   static_cast<uint32_t>(browse_folder_entries - up));
+	return true;
+}
+
+static void BuildOverviewPath(const char* wav_name, char* out, size_t out_len)
+{
+	char base[kLibraryPathLen];
+	CopyNameSansWav(base, wav_name, sizeof(base));
+	char name[kLibraryPathLen + 4];
+	snprintf(name, sizeof(name), "%s.wvo", base);
+	BuildFilePath(name, out, out_len);
+}
+
+static bool OverviewMatchesFile(const WaveOverview& ov, const LibraryRecord& rec)
+{
+	return ov.wav_size == rec.size
+		&& ov.wav_date == rec.date
+		&& ov.wav_time == rec.time;
+}
+
+// One small read: the whole sidecar, checked against the WAV's size and
+// date in the library index.
+static bool ReadOverviewSidecar(int32_t index, WaveOverview& ov)
+{
+	LibraryRecord rec;
+	if (!LibraryCopy(index, rec))
+	{
+		return false;
+	}
+	char path[kSamplePathLen];
+	BuildOverviewPath(rec.path, path, sizeof(path));
+	FIL file;
+	if (f_open(&file, path, FA_READ) != FR_OK)
+	{
+		return false;
+	}
+	UINT bytes_read = 0;
+	const FRESULT res = f_read(&file, overview_io_buf, kWaveOverviewBytes, &bytes_read);
+	f_close(&file);
+	if (res != FR_OK || !WaveOverviewDecode(overview_io_buf, bytes_read, ov))
+	{
+		LogLine("Overview: bad sidecar for %s", rec.path);
+		return false;
+	}
+	if (!OverviewMatchesFile(ov, rec))
+	{
+		LogLine("Overview: stale sidecar for %s", rec.path);
+		return false;
+	}
+	return true;
+}
+
+static bool WriteOverviewSidecar(int32_t index, const WaveOverview& ov)
+{
+	char path[kSamplePathLen];
+	BuildOverviewPath(LibraryPath(index), path, sizeof(path));
+	WaveOverviewEncode(ov, overview_io_buf);
+	FIL file;
+	FRESULT res = f_open(&file, path, FA_WRITE | FA_CREATE_ALWAYS);
+	if (res != FR_OK)
+	{
+		LogLine("Overview: f_open %s (%d)", FresultName(res), (int)res);
+		return false;
+	}
+	UINT written = 0;
+	res = f_write(&file, overview_io_buf, kWaveOverviewBytes, &written);
+	f_close(&file);
+	if (res != FR_OK || written != kWaveOverviewBytes)
+	{
+		LogLine("Overview: write %s (%d)", FresultName(res), (int)res);
+		f_unlink(path);
+		return false;
+	}
+	wav_overview_state[index] = OverviewState::Valid;
+	LibrarySetPeak(index, ov.peak);
+	if (index == load_overview_selected)
+	{
+		load_overview = ov;
+		load_overview_index = index;
+		request_load_overview_redraw = true;
+	}
+	LogLine("Overview: wrote %s", path);
+	return true;
+}
+
+static void CancelOverviewJob()
+{
+	if (overview_job_active)
+	{
+		f_close(&overview_job_file);
+		overview_job_active = false;
+	}
+	overview_job_index = -1;
+}
+
+static void SetOverviewJobBin(size_t bin)
+{
+	overview_job_bin = bin;
+	overview_job_bin_end = static_cast<size_t>(
+		((static_cast<uint64_t>(bin) + 1U) * overview_job_frames + kWaveOverviewBins - 1U) / kWaveOverviewBins);
+}
+
+static bool BeginOverviewJob(int32_t index)
+{
+	CancelOverviewJob();
+	LibraryRecord rec;
+	if (!LibraryCopy(index, rec))
+	{
+		return false;
+	}
+	char path[kSamplePathLen];
+	BuildFilePath(rec.path, path, sizeof(path));
+	if (f_open(&overview_job_file, path, FA_READ) != FR_OK)
+	{
+		return false;
+	}
+	WavInfo wav;
+	const bool ok = ParseWavHeader(&overview_job_file, wav)
+		&& wav.bits_per_sample == 16
+		&& wav.num_channels >= 1
+		&& wav.num_channels <= 2
+		&& wav.data_size >= wav.num_channels * sizeof(int16_t)
+		&& f_lseek(&overview_job_file, wav.data_offset) == FR_OK;
+	if (!ok)
+	{
+		f_close(&overview_job_file);
+		return false;
+	}
+	overview_job_active = true;
+	overview_job_index = index;
+	overview_job_channels = wav.num_channels;
+	overview_job_frame_bytes = wav.num_channels * sizeof(int16_t);
+	overview_job_frames = wav.data_size / overview_job_frame_bytes;
+	overview_job_pos = 0;
+	overview_job_peak = 0;
+	overview_job = WaveOverview();
+	overview_job.wav_size = rec.size;
+	overview_job.wav_date = rec.date;
+	overview_job.wav_time = rec.time;
+	overview_job.frames = static_cast<uint32_t>(overview_job_frames);
+	overview_job.rate = wav.sample_rate;
+	overview_job.channels = wav.num_channels;
+	overview_job.lo[0] = 32767;
+	overview_job.hi[0] = -32768;
+	SetOverviewJobBin(0);
+	LogLine("Overview: building %s", rec.path);
+	return true;
+}
+
+static void FinishOverviewJob()
+{
+	const int32_t index = overview_job_index;
+	CancelOverviewJob();
+	if (overview_job_pos == 0)
+	{
+		wav_overview_state[index] = OverviewState::Failed;
+		return;
+	}
+	// Files shorter than kWaveOverviewBins frames leave empty bins.
+	for (size_t b = 0; b < kWaveOverviewBins; ++b)
+	{
+		if (overview_job.lo[b] > overview_job.hi[b])
+		{
+			overview_job.lo[b] = 0;
+			overview_job.hi[b] = 0;
+		}
+	}
+	WaveOverviewBuildLevels(overview_job);
+	overview_job.peak = static_cast<uint16_t>((overview_job_peak > 32767) ? 32767 : overview_job_peak);
+	if (!WriteOverviewSidecar(index, overview_job))
+	{
+		wav_overview_state[index] = OverviewState::Failed;
+	}
+}
+
+// Decodes the file for up to kOverviewStepBudgetMs per call.
+static void StepOverviewJob()
+{
+	if (!overview_job_active)
+	{
+		return;
+	}
+	const uint32_t start_ms = System::GetNow();
+	const size_t chunk_frames = kOverviewChunkBytes / overview_job_frame_bytes;
+	const int16_t* pcm = reinterpret_cast<const int16_t*>(overview_io_buf);
+	while (overview_job_pos < overview_job_frames)
+	{
+		size_t frames = overview_job_frames - overview_job_pos;
+		if (frames > chunk_frames)
+		{
+			frames = chunk_frames;
+		}
+		UINT bytes_read = 0;
+		const FRESULT res = f_read(&overview_job_file,
+								   overview_io_buf,
+								   static_cast<UINT>(frames * overview_job_frame_bytes),
+								   &bytes_read);
+		const size_t got = bytes_read / overview_job_frame_bytes;
+		for (size_t i = 0; i < got; ++i)
+		{
+			if (overview_job_pos >= overview_job_bin_end && overview_job_bin + 1 < kWaveOverviewBins)
+			{
+				SetOverviewJobBin(overview_job_bin + 1);
+				overview_job.lo[overview_job_bin] = 32767;
+				overview_job.hi[overview_job_bin] = -32768;
+			}
+			const int16_t l = pcm[i * overview_job_channels];
+			int16_t& lo = overview_job.lo[overview_job_bin];
+			int16_t& hi = overview_job.hi[overview_job_bin];
+			lo = (l < lo) ? l : lo;
+			hi = (l > hi) ? l : hi;
+			for (uint16_t c = 0; c < overview_job_channels; ++c)
+			{
+				const int32_t v = pcm[i * overview_job_channels + c];
+				const int32_t mag = (v < 0) ? -v : v;
+				overview_job_peak = (mag > overview_job_peak) ? mag : overview_job_peak;
+			}
+			++overview_job_pos;
+		}
+		if (res != FR_OK || got < frames)
+		{
+			LogLine("Overview: read stopped at %lu/%lu frames",
+					static_cast<unsigned long>(overview_job_pos),
+					static_cast<unsigned long>(overview_job_frames));
+			break;
+		}
+		if ((System::GetNow() - start_ms) >= kOverviewStepBudgetMs)
+		{
+			return;
+		}
+	}
+	FinishOverviewJob();
+}
+
+// Main loop, LOAD list only: shows the selected file's sidecar, then
+// generates missing ones in the background, the selected file first.
+// Indices here are library records.
+static void UpdateLoadOverviews(bool io_allowed)
+{
+	const int32_t selected = BrowseFileRecord(load_selected);
+	if (selected != load_overview_selected)
+	{
+		load_overview_selected = selected;
+		load_overview_index = -1;
+		if (selected >= 0
+			&& (wav_overview_state[selected] == OverviewState::Unknown
+				|| wav_overview_state[selected] == OverviewState::Valid))
+		{
+			if (ReadOverviewSidecar(selected, load_overview))
+			{
+				wav_overview_state[selected] = OverviewState::Valid;
+				load_overview_index = selected;
+			}
+			else
+			{
+				wav_overview_state[selected] = OverviewState::Missing;
+			}
+		}
+		request_load_overview_redraw = true;
+	}
+	if (!io_allowed)
+	{
+		return;
+	}
+	if (overview_job_active)
+	{
+		if (selected >= 0 && overview_job_index != selected && wav_overview_state[selected] == OverviewState::Missing)
+		{
+			CancelOverviewJob();
+		}
+		else
+		{
+			StepOverviewJob();
+			return;
+		}
+	}
+	int32_t target = -1;
+	if (selected >= 0 && wav_overview_state[selected] == OverviewState::Missing)
+	{
+		target = selected;
+	}
+	// Only the files around the cursor; a large library is never decoded
+	// wholesale.
+	int32_t first = load_selected - kLibraryPageEntries / 2;
+	first = (first < browse_folder_entries) ? browse_folder_entries : first;
+	const int32_t last = (first + kLibraryPageEntries < wav_file_count) ? (first + kLibraryPageEntries) : wav_file_count;
+	for (int32_t entry = first; target < 0 && entry < last; ++entry)
+	{
+		const int32_t i = BrowseFileRecord(entry);
+		if (i < 0)
+		{
+			continue;
+		}
+		if (wav_overview_state[i] == OverviewState::Unknown)
+		{
+			// One probe per pass keeps the loop responsive.
+			WaveOverview probe;
+			wav_overview_state[i] = ReadOverviewSidecar(i, probe) ? OverviewState::Valid : OverviewState::Missing;
+			return;
+		}
+		if (wav_overview_state[i] == OverviewState::Missing)
+		{
+			target = i;
+		}
+	}
+	if (target >= 0 && !BeginOverviewJob(target))
+	{
+		wav_overview_state[target] = OverviewState::Failed;
+	}
+}
+
+// A fully loaded sample already has its pyramid, so its sidecar costs no
+// extra decode.
+static void WriteOverviewFromSample(int32_t index, uint16_t peak)
+{
+	if (index < 0 || index >= wav_file_count
+		|| wav_overview_state[index] == OverviewState::Valid
+		|| overview_job_active)
+	{
+		return;
+	}
+	LibraryRecord rec;
+	if (!LibraryCopy(index, rec))
+	{
+		return;
+	}
+	WaveOverview& ov = overview_job;
+	ov = WaveOverview();
+	ov.wav_size = rec.size;
+	ov.wav_date = rec.date;
+	ov.wav_time = rec.time;
+	ov.frames = static_cast<uint32_t>(sample_length);
+	ov.rate = sample_rate;
+	ov.channels = sample_channels;
+	ov.peak = peak;
+	for (size_t b = 0; b < kWaveOverviewBins; ++b)
+	{
+		const size_t start = (b * sample_length) / kWaveOverviewBins;
+		size_t end = ((b + 1) * sample_length) / kWaveOverviewBins;
+		if (end <= start)
+		{
+			end = start + 1;
+		}
+		int16_t lo = 0;
+		int16_t hi = 0;
+		if (WavePyramidRange(*sample_pyramid, sample_buffer_l, start, end, lo, hi))
+		{
+			ov.lo[b] = lo;
+			ov.hi[b] = hi;
+		}
+	}
+	WaveOverviewBuildLevels(ov);
+	WriteOverviewSidecar(index, ov);
+}
+
+static void CloseLibrarySync()
+{
+	if (library_sync_dir_open)
+	{
+		f_closedir(&library_sync_dir);
+		library_sync_dir_open = false;
+	}
+	if (library_sync_old_open)
+	{
+		f_close(&library_sync_old);
+		library_sync_old_open = false;
+	}
+	if (library_sync_active)
+	{
+		f_close(&library_sync_out);
+		library_sync_active = false;
+	}
+}
+
+static void CancelLibrarySync()
+{
+	if (!library_sync_active)
+	{
+		return;
+	}
+	CloseLibrarySync();
+	char path[64];
+	BuildFilePath(kLibraryTempName, path, sizeof(path));
+	f_unlink(path);
+	LogLine("Library: sync cancelled");
+}
+
+static bool LibrarySyncOpenDir(const char* rel_path)
+{
+	char path[kSamplePathLen];
+	BuildFilePath(rel_path, path, sizeof(path));
+	library_sync_dir_open = (f_opendir(&library_sync_dir, path) == FR_OK);
+	library_sync_files_pass = false;
+	library_sync_block_first = library_sync_count;
+	library_sync_block_children = 0;
+	library_sync_block_folders = 0;
+	return library_sync_dir_open;
+}
+
+static bool BeginLibrarySync()
+{
+	CancelLibrarySync();
+	char path[64];
+	BuildFilePath(kLibraryTempName, path, sizeof(path));
+	FRESULT res = f_open(&library_sync_out, path, FA_READ | FA_WRITE | FA_CREATE_ALWAYS);
+	if (res != FR_OK)
+	{
+		LogLine("Library: f_open %s (%d)", FresultName(res), (int)res);
+		return false;
+	}
+	library_sync_header = LibraryHeader();
+	LibraryHeaderEncode(library_sync_header, library_sync_buf);
+	UINT written = 0;
+	res = f_write(&library_sync_out, library_sync_buf, kLibraryHeaderBytes, &written);
+	library_sync_count = 0;
+	if (res != FR_OK || !LibrarySyncOpenDir(""))
+	{
+		LogLine("Library: sync start %s (%d)", FresultName(res), (int)res);
+		f_close(&library_sync_out);
+		f_unlink(path);
+		return false;
+	}
+	library_sync_parent = -1;
+	library_sync_cursor = 0;
+	library_sync_old_count = 0;
+	library_sync_old_read = 0;
+	library_sync_ahead_count = 0;
+	BuildFilePath(kLibraryIndexName, path, sizeof(path));
+	if (f_open(&library_sync_old, path, FA_READ) == FR_OK)
+	{
+		UINT bytes_read = 0;
+		LibraryHeader old_header;
+		library_sync_old_open = (f_read(&library_sync_old, library_sync_buf, kLibraryHeaderBytes, &bytes_read) == FR_OK
+			&& LibraryHeaderDecode(library_sync_buf, bytes_read, old_header));
+		library_sync_old_count = library_sync_old_open ? old_header.count : 0;
+		if (!library_sync_old_open)
+		{
+			f_close(&library_sync_old);
+		}
+	}
+	library_sync_new = 0;
+	library_sync_removed = 0;
+	library_sync_skipped = 0;
+	library_sync_start_ms = System::GetNow();
+	library_sync_active = true;
+	LogLine("Library: sync started (%lu indexed)", static_cast<unsigned long>(library_sync_old_count));
+	return true;
+}
+
+static bool LibrarySyncReadOld(LibraryRecord& rec)
+{
+	if (!library_sync_old_open || library_sync_old_read >= library_sync_old_count)
+	{
+		return false;
+	}
+	UINT bytes_read = 0;
+	if (f_read(&library_sync_old, library_sync_buf, kLibraryRecordBytes, &bytes_read) != FR_OK
+		|| bytes_read != kLibraryRecordBytes)
+	{
+		library_sync_old_count = library_sync_old_read;
+		return false;
+	}
+	LibraryRecordDecode(library_sync_buf, rec);
+	++library_sync_old_read;
+	return true;
+}
+
+// The walk visits entries in the order the old index was written in, so
+// an entry is looked for in the next few old records only; the ones
+// skipped over belong to entries that have gone.
+static bool LibrarySyncFindOld(const char* path, LibraryRecord& rec)
+{
+	while (library_sync_ahead_count < kLibrarySyncLookahead
+		   && LibrarySyncReadOld(library_sync_ahead[library_sync_ahead_count]))
+	{
+		++library_sync_ahead_count;
+	}
+	for (int32_t k = 0; k < library_sync_ahead_count; ++k)
+	{
+		if (std::strcmp(library_sync_ahead[k].path, path) != 0)
+		{
+			continue;
+		}
+		rec = library_sync_ahead[k];
+		library_sync_removed += static_cast<uint32_t>(k);
+		for (int32_t i = k + 1; i < library_sync_ahead_count; ++i)
+		{
+			library_sync_ahead[i - k - 1] = library_sync_ahead[i];
+		}
+		library_sync_ahead_count -= k + 1;
+		return true;
+	}
+	return false;
+}
+
+static bool LibrarySyncWrite(uint32_t index, const LibraryRecord& rec)
+{
+	LibraryRecordEncode(rec, library_sync_buf);
+	UINT written = 0;
+	return f_lseek(&library_sync_out, kLibraryHeaderBytes + static_cast<FSIZE_t>(index) * kLibraryRecordBytes) == FR_OK
+		&& f_write(&library_sync_out, library_sync_buf, kLibraryRecordBytes, &written) == FR_OK
+		&& written == kLibraryRecordBytes;
+}
+
+static bool LibrarySyncRead(uint32_t index, LibraryRecord& rec)
+{
+	UINT bytes_read = 0;
+	if (f_lseek(&library_sync_out, kLibraryHeaderBytes + static_cast<FSIZE_t>(index) * kLibraryRecordBytes) != FR_OK
+		|| f_read(&library_sync_out, library_sync_buf, kLibraryRecordBytes, &bytes_read) != FR_OK
+		|| bytes_read != kLibraryRecordBytes)
+	{
+		return false;
+	}
+	LibraryRecordDecode(library_sync_buf, rec);
+	return true;
+}
+
+static void LibrarySyncAddEntry(const FILINFO& fno, bool folder)
+{
+	if (library_sync_count >= static_cast<uint32_t>(kLibraryMaxRecords))
+	{
+		++library_sync_skipped;
+		return;
+	}
+	LibraryRecord rec;
+	const char* dir_path = (library_sync_parent < 0) ? "" : library_sync_parent_rec.path;
+	const int len = snprintf(rec.path, sizeof(rec.path), "%s%s%s", dir_path, (dir_path[0] != '\0') ? "/" : "", fno.fname);
+	if (len < 0 || static_cast<size_t>(len) >= sizeof(rec.path))
+	{
+		LogLine("Library: path too long, skipped %s", fno.fname);
+		++library_sync_skipped;
+		return;
+	}
+	LibraryRecord old;
+	const bool found = LibrarySyncFindOld(rec.path, old);
+	if (folder)
+	{
+		rec.kind = kLibraryKindFolder;
+		library_sync_new += found ? 0 : 1;
+	}
+	else if (found
+			 && old.kind == kLibraryKindFile
+			 && old.size == static_cast<uint32_t>(fno.fsize)
+			 && old.date == fno.fdate
+			 && old.time == fno.ftime)
+	{
+		rec = old;
+	}
+	else
+	{
+		rec.size = static_cast<uint32_t>(fno.fsize);
+		rec.date = fno.fdate;
+		rec.time = fno.ftime;
+		char path[kSamplePathLen];
+		BuildFilePath(rec.path, path, sizeof(path));
+		FIL file;
+		WavInfo wav;
+		if (f_open(&file, path, FA_READ) == FR_OK)
+		{
+			if (ParseWavHeader(&file, wav) && wav.num_channels > 0 && wav.bits_per_sample >= 8)
+			{
+				rec.frames = wav.data_size / (wav.num_channels * (wav.bits_per_sample / 8U));
+				rec.rate = wav.sample_rate;
+				rec.channels = static_cast<uint8_t>(wav.num_channels);
+				rec.bits = static_cast<uint8_t>(wav.bits_per_sample);
+			}
+			f_close(&file);
+		}
+		++library_sync_new;
+	}
+	if (LibrarySyncWrite(library_sync_count, rec))
+	{
+		++library_sync_count;
+		++library_sync_block_children;
+		library_sync_block_folders += folder ? 1 : 0;
+	}
+}
+
+// Records the finished block in its folder (or the header for the root)
+// and opens the next folder queued in the new index.
+static bool LibrarySyncNextDir()
+{
+	if (library_sync_parent < 0)
+	{
+		library_sync_header.root_children = library_sync_block_children;
+		library_sync_header.root_folders = library_sync_block_folders;
+	}
+	else
+	{
+		library_sync_parent_rec.first = library_sync_block_first;
+		library_sync_parent_rec.children = library_sync_block_children;
+		library_sync_parent_rec.folders = library_sync_block_folders;
+		LibrarySyncWrite(static_cast<uint32_t>(library_sync_parent), library_sync_parent_rec);
+	}
+	while (library_sync_cursor < library_sync_count)
+	{
+		LibraryRecord rec;
+		const uint32_t index = library_sync_cursor++;
+		if (!LibrarySyncRead(index, rec))
+		{
+			return false;
+		}
+		if (rec.kind != kLibraryKindFolder)
+		{
+			continue;
+		}
+		library_sync_parent = static_cast<int32_t>(index);
+		library_sync_parent_rec = rec;
+		if (LibrarySyncOpenDir(rec.path))
+		{
+			return true;
+		}
+		LogLine("Library: cannot open %s", rec.path);
+	}
+	return false;
+}
+
+static int32_t LibraryPathDepth(const char* path)
+{
+	int32_t depth = (path[0] != '\0') ? 1 : 0;
+	for (const char* p = path; *p != '\0'; ++p)
+	{
+		depth += (*p == '/') ? 1 : 0;
+	}
+	return depth;
+}
+
+// Swaps the rewritten index in when the walk found any difference.
+static void FinishLibrarySync()
+{
+	library_sync_removed += static_cast<uint32_t>(library_sync_ahead_count)
+		+ (library_sync_old_count - library_sync_old_read);
+	const bool changed = (library_sync_new > 0)
+		|| (library_sync_removed > 0)
+		|| (library_sync_skipped != library_header.skipped)
+		|| !library_open;
+	library_sync_header.count = library_sync_count;
+	library_sync_header.skipped = library_sync_skipped;
+	LibraryHeaderEncode(library_sync_header, library_sync_buf);
+	UINT written = 0;
+	bool ok = f_lseek(&library_sync_out, 0) == FR_OK
+		&& f_write(&library_sync_out, library_sync_buf, kLibraryHeaderBytes, &written) == FR_OK
+		&& written == kLibraryHeaderBytes;
+	CloseLibrarySync();
+	char temp_path[64];
+	BuildFilePath(kLibraryTempName, temp_path, sizeof(temp_path));
+	if (ok && changed)
+	{
+		char index_path[64];
+		BuildFilePath(kLibraryIndexName, index_path, sizeof(index_path));
+		CloseLibrary();
+		CancelOverviewJob();
+		load_overview_index = -1;
+		load_overview_selected = -1;
+		f_unlink(index_path);
+		const FRESULT res = f_rename(temp_path, index_path);
+		if (res != FR_OK)
+		{
+			LogLine("Library: f_rename %s (%d)", FresultName(res), (int)res);
+			ok = false;
+		}
+		OpenLibraryIndex();
+	}
+	if (!ok || !changed)
+	{
+		f_unlink(temp_path);
+	}
+	library_synced = ok;
+	request_library_redraw = true;
+	LogLine("Library: %lu entries, %lu new, %lu removed, %lu skipped in %lums",
+			static_cast<unsigned long>(library_sync_count),
+			static_cast<unsigned long>(library_sync_new),
+			static_cast<unsigned long>(library_sync_removed),
+			static_cast<unsigned long>(library_sync_skipped),
+			static_cast<unsigned long>(System::GetNow() - library_sync_start_ms));
+}
+
+// Walks the card for up to kLibrarySyncBudgetMs per call. Each folder is
+// read twice, subfolders first and then WAVs, so its block lists them in
+// that order.
+static void StepLibrarySync()
+{
+	if (!library_sync_active)
+	{
+		return;
+	}
+	const uint32_t start_ms = System::GetNow();
+	FILINFO fno;
+	while (library_sync_dir_open)
+	{
+		const FRESULT res = f_readdir(&library_sync_dir, &fno);
+		if (res != FR_OK || fno.fname[0] == 0)
+		{
+			if (res == FR_OK && !library_sync_files_pass)
+			{
+				library_sync_files_pass = true;
+				f_rewinddir(&library_sync_dir);
+				continue;
+			}
+			f_closedir(&library_sync_dir);
+			library_sync_dir_open = false;
+			if (!LibrarySyncNextDir())
+			{
+				break;
+			}
+			continue;
+		}
+		if ((fno.fattrib & (AM_HID | AM_SYS)) || fno.fname[0] == '.')
+		{
+			continue;
+		}
+		const bool folder = (fno.fattrib & AM_DIR) != 0;
+		if (folder && !library_sync_files_pass)
+		{
+			const char* dir_path = (library_sync_parent < 0) ? "" : library_sync_parent_rec.path;
+			if (LibraryPathDepth(dir_path) < kLibraryMaxDepth)
+			{
+				LibrarySyncAddEntry(fno, true);
+			}
+		}
+		else if (!folder && library_sync_files_pass && HasWavExtension(fno.fname))
+		{
+			LibrarySyncAddEntry(fno, false);
+		}
+		if ((System::GetNow() - start_ms) >= kLibrarySyncBudgetMs)
+		{
+			return;
+		}
+	}
+	FinishLibrarySync();
+}
+
+static void OpenSampleLibrary()
+{
+	LogLine("Opening sample library...");
+	bool detected = BSP_SD_IsDetected();
+	if (!detected)
+	{
+		SdmmcHandler::Config sd_cfg;
+		sd_cfg.Defaults();
+		sdcard.Init(sd_cfg);
+		fsi.Init(FatFSInterface::Config::MEDIA_SD);
+		const uint8_t init_res = BSP_SD_Init();
+		LogLine("SD init (detect): %u", static_cast<unsigned>(init_res));
+		detected = BSP_SD_IsDetected();
+		if (!detected)
+		{
+			sd_mounted = false;
+			sd_need_reinit = true;
+			sd_detected_last = false;
+			ResetLibraryState();
+			wav_file_count = 0;
+			load_selected = 0;
+			load_scroll = 0;
+			LogLine("Library aborted: SD not detected");
+			return;
+		}
+	}
+	if (BSP_SD_GetCardState() != SD_TRANSFER_OK)
+	{
+		sd_mounted = false;
+		sd_need_reinit = true;
+		wav_file_count = 0;
+		load_selected = 0;
+		load_scroll = 0;
+		LogLine("Library aborted: SD not ready");
+		return;
+	}
+	if (detected && !sd_detected_last)
+	{
+		sd_need_reinit = true;
+	}
+	sd_detected_last = true;
+
+	if (sd_need_reinit)
+	{
+		f_mount(0, fsi.GetSDPath(), 0);
+		sd_mounted = false;
+		SdmmcHandler::Config sd_cfg;
+		sd_cfg.Defaults();
 		sdcard.Init(sd_cfg);
 		fsi.Init(FatFSInterface::Config::MEDIA_SD);
 		const uint8_t init_res = BSP_SD_Init();
@@ -2016,254 +3466,1093 @@ static void ScanSdFiles(bool wav_only)
 		sd_need_reinit = !sd_mounted;
 	}
 
-	if (!sd_mounted)
+	if (!sd_mounted)
+	{
+		MountSd();
+	}
+	if (!sd_mounted)
+	{
+		wav_file_count = 0;
+		load_selected = 0;
+		load_scroll = 0;
+		LogLine("Library aborted: SD not mounted");
+		return;
+	}
+
+	if (!library_open)
+	{
+		OpenLibraryIndex();
+	}
+	if (!library_synced && !library_sync_active)
+	{
+		BeginLibrarySync();
+	}
+	LogLine("Library: %ld files%s", static_cast<long>(wav_file_count), library_sync_active ? ", syncing" : "");
+	ClampLoadSelection();
+}
+
+static size_t SampleResidentFrames()
+{
+	if (sample_streaming && sample_head_frames < sample_length)
+	{
+		return sample_head_frames;
+	}
+	return sample_length;
+}
+
+static VoiceSampleSource CurrentVoiceSampleSource()
+{
+	VoiceSampleSource src;
+	src.sample.l = sample_buffer_l;
+	src.sample.r = sample_buffer_r;
+	src.sample.resident = SampleResidentFrames();
+	src.sample.stereo = (sample_channels == 2);
+	src.length = sample_length;
+	src.rate = sample_rate;
+	src.channels = sample_channels;
+	src.streaming = sample_streaming;
+	src.data_offset = sample_stream_data_offset;
+	src.path = sample_stream_path;
+	return src;
+}
+
+static VoiceSampleSource StoredVoiceSampleSource(const SampleState& state)
+{
+	VoiceSampleSource src;
+	const int16_t* l = sample_pool.Ptr(state.pool_l);
+	const int16_t* r = sample_pool.Ptr(state.pool_r);
+	src.sample.l = (l != nullptr) ? l : sample_silence;
+	src.sample.r = (r != nullptr) ? r : src.sample.l;
+	src.sample.resident = (state.streaming && state.head_frames < state.length)
+		? state.head_frames
+		: state.length;
+	src.sample.stereo = (state.channels == 2);
+	src.length = state.length;
+	src.rate = state.rate;
+	src.channels = state.channels;
+	src.streaming = state.streaming;
+	src.data_offset = state.data_offset;
+	src.path = state.path;
+	return src;
+}
+
+// Reads the sample's waveform pyramid when it has one, so a redraw costs
+// 128 lookups instead of a pass over the whole buffer.
+static void ComputeWaveform()
+{
+	const int32_t width = 128;
+	if (!sample_loaded || sample_length == 0)
+	{
+		for (int32_t i = 0; i < width; ++i)
+		{
+			waveform_min[i] = 0;
+			waveform_max[i] = 0;
+		}
+		return;
+	}
+
+	const size_t frames = sample_length;
+	if (frames < 2)
+	{
+		return;
+	}
+
+	const size_t columns = 128;
+	size_t step = frames / columns;
+	if (step == 0)
+	{
+		step = 1;
+	}
+	const size_t resident = SampleResidentFrames();
+
+	const float scale = 28.0f;
+
+	for (size_t col = 0; col < columns; ++col)
+	{
+		float minv = 1.0f;
+		float maxv = -1.0f;
+
+		const size_t start = col * step;
+		size_t end = (col == columns - 1) ? frames : (start + step);
+		if (end > resident)
+		{
+			end = resident;
+		}
+		if (start >= end)
+		{
+			// Streamed tail: filled by the waveform probe after the load.
+			continue;
+		}
+
+		int16_t lo = 0;
+		int16_t hi = 0;
+		if (WavePyramidRange(*sample_pyramid, sample_buffer_l, start, end, lo, hi))
+		{
+			waveform_min[col] = static_cast<int16_t>(static_cast<float>(lo) * kSampleScale * scale);
+			waveform_max[col] = static_cast<int16_t>(static_cast<float>(hi) * kSampleScale * scale);
+			continue;
+		}
+
+		for (size_t i = start; i < end; ++i)
+		{
+			const float s = static_cast<float>(sample_buffer_l[i]) * kSampleScale;
+			if (s < minv)
+			{
+				minv = s;
+			}
+			if (s > maxv)
+			{
+				maxv = s;
+			}
+		}
+
+		waveform_min[col] = static_cast<int16_t>(minv * scale);
+		waveform_max[col] = static_cast<int16_t>(maxv * scale);
+	}
+}
+
+static void UpdateTrimFrames()
+{
+	if(sample_length < 2)
+	{
+		sample_play_start = 0;
+		sample_play_end   = sample_length;
+		return;
+	}
+
+	if(trim_start < 0.0f) trim_start = 0.0f;
+	if(trim_end   > 1.0f) trim_end   = 1.0f;
+
+	const float min_norm = 2.0f / (float)sample_length;
+	if(trim_end - trim_start < min_norm)
+	{
+		trim_end = trim_start + min_norm;
+		if(trim_end > 1.0f)
+		{
+			trim_end = 1.0f;
+			trim_start = trim_end - min_norm;
+		}
+	}
+
+	snap_start_frame = (uint32_t)(trim_start * sample_length);
+	snap_end_frame   = (uint32_t)(trim_end   * sample_length);
+
+	if(snap_end_frame <= snap_start_frame)
+		snap_end_frame = snap_start_frame + 2;
+
+	sample_play_start = snap_start_frame;
+	sample_play_end   = snap_end_frame;
+}
+
+// span is the visible fraction of the sample, so steps stay the same on
+// screen when EDT is zoomed in.
+static void AdjustTrimNormalized(int32_t start_delta, int32_t end_delta, bool fine = false, float span = 1.0f)
+{
+	if(sample_length < 2)
+		return;
+
+	const float base_step = (fine ? (1.0f / 64.0f) : (1.0f / 32.0f)) * span;
+
+	auto step = [&](int d)
 	{
-		MountSd();
+		int mag = abs(d);
+		if(mag < 1) mag = 1;
+		int log2 = 0;
+		while(mag > 1) { mag >>= 1; ++log2; }
+		return base_step * (1 << log2);
+	};
+
+	if(start_delta != 0)
+		trim_start += start_delta * step(start_delta);
+
+	if(end_delta != 0)
+		trim_end   += end_delta   * step(end_delta);
+
+	UpdateTrimFrames();
+	waveform_dirty = true;
+	request_length_redraw = true;
+}
+
+static size_t EdtViewFrames()
+{
+	const size_t frames = sample_length >> edt_zoom;
+	return (frames > 0) ? frames : 1;
+}
+
+static void EdtCenterView(size_t focus)
+{
+	const size_t view = EdtViewFrames();
+	edt_view_start = (focus > view / 2) ? (focus - view / 2) : 0;
+	if (edt_view_start + view > sample_length)
+	{
+		edt_view_start = (sample_length > view) ? (sample_length - view) : 0;
 	}
-	if (!sd_mounted)
+}
+
+// Keeps the trim edge that moved last inside the zoomed view.
+static void EdtFollowTrim()
+{
+	if (edt_zoom <= 0)
 	{
-		wav_file_count = 0;
-		load_selected = 0;
-		load_scroll = 0;
-		LogLine("Scan aborted: SD not mounted");
+		edt_view_start = 0;
 		return;
 	}
+	const size_t focus = edt_focus_end ? sample_play_end : sample_play_start;
+	if (focus < edt_view_start || focus >= edt_view_start + EdtViewFrames())
+	{
+		EdtCenterView(focus);
+	}
+}
 
-	DIR dir;
-	FILINFO fno;
-	FRESULT res = f_opendir(&dir, fsi.GetSDPath());
-	if (res != FR_OK)
+// Zooms in or out by powers of two around the focused trim edge, down to
+// one frame per column.
+static void EdtZoom(int32_t delta)
+{
+	int32_t zoom = edt_zoom + delta;
+	while (zoom > 0 && (sample_length >> zoom) < static_cast<size_t>(kDisplayW))
+	{
+		--zoom;
+	}
+	if (zoom < 0)
+	{
+		zoom = 0;
+	}
+	if (zoom == edt_zoom)
 	{
-		wav_file_count = 0;
-		load_selected = 0;
-		load_scroll = 0;
-		LogLine("Scan failed: f_opendir error %d", static_cast<int>(res));
 		return;
 	}
+	edt_zoom = zoom;
+	EdtCenterView(edt_focus_end ? sample_play_end : sample_play_start);
+	waveform_dirty = true;
+	request_length_redraw = true;
+}
 
-	int32_t count = 0;
-	for (;;)
+static bool IsPlayUiMode(UiMode mode)
+{
+	return (mode == UiMode::Play || mode == UiMode::PlayTrack);
+}
+
+static bool IsPerformUiMode(UiMode mode)
+{
+	return (mode == UiMode::Perform || mode == UiMode::PlayTrack);
+}
+
+static bool AnyPerformVoiceActive()
+{
+	for (int v = 0; v < kPerformVoiceCount; ++v)
 	{
-		res = f_readdir(&dir, &fno);
-		if (res != FR_OK || fno.fname[0] == 0)
-		{
-			break;
-		}
-		if (fno.fattrib & (AM_DIR | AM_HID))
+		if (perform_voices[v].active || perform_voices[v].steal_pending)
 		{
-			continue;
+			return true;
 		}
-		if (wav_only && !HasWavExtension(fno.fname))
+	}
+	return false;
+}
+
+static void VoiceListRemove(int idx)
+{
+	const int list = static_cast<int>(voice_alloc.list[idx]);
+	const int8_t prev = voice_alloc.prev[idx];
+	const int8_t next = voice_alloc.next[idx];
+	if (prev >= 0)
+	{
+		voice_alloc.next[prev] = next;
+	}
+	else
+	{
+		voice_alloc.head[list] = next;
+	}
+	if (next >= 0)
+	{
+		voice_alloc.prev[next] = prev;
+	}
+	else
+	{
+		voice_alloc.tail[list] = prev;
+	}
+	voice_alloc.prev[idx] = -1;
+	voice_alloc.next[idx] = -1;
+}
+
+static void VoiceListPushBack(VoiceList list, int idx)
+{
+	const int l = static_cast<int>(list);
+	voice_alloc.list[idx] = list;
+	voice_alloc.prev[idx] = voice_alloc.tail[l];
+	voice_alloc.next[idx] = -1;
+	if (voice_alloc.tail[l] >= 0)
+	{
+		voice_alloc.next[voice_alloc.tail[l]] = static_cast<int8_t>(idx);
+	}
+	else
+	{
+		voice_alloc.head[l] = static_cast<int8_t>(idx);
+	}
+	voice_alloc.tail[l] = static_cast<int8_t>(idx);
+}
+
+static void VoiceListMove(VoiceList list, int idx)
+{
+	VoiceListRemove(idx);
+	VoiceListPushBack(list, idx);
+}
+
+static void ReleaseVoiceNote(int idx)
+{
+	const int8_t note = voice_alloc.note[idx];
+	if (note >= 0 && voice_alloc.note_voice[note] == idx)
+	{
+		voice_alloc.note_voice[note] = -1;
+	}
+	voice_alloc.note[idx] = -1;
+}
+
+static void ResetVoiceAllocator()
+{
+	for (int l = 0; l < static_cast<int>(VoiceList::Count); ++l)
+	{
+		voice_alloc.head[l] = -1;
+		voice_alloc.tail[l] = -1;
+	}
+	for (int n = 0; n < 128; ++n)
+	{
+		voice_alloc.note_voice[n] = -1;
+	}
+	for (int i = 0; i < kPerformVoiceCount; ++i)
+	{
+		voice_alloc.note[i] = -1;
+		VoiceListPushBack(VoiceList::Free, i);
+	}
+	voice_retire_read = voice_retire_write;
+}
+
+// Audio callback side: report a voice that finished on its own.
+static inline void PushRetiredVoice(int idx, uint32_t generation)
+{
+	const uint32_t w = voice_retire_write;
+	if ((w - voice_retire_read) >= kVoiceRetireQueueSize)
+	{
+		return;
+	}
+	voice_retire_queue[w & (kVoiceRetireQueueSize - 1)]
+		= (generation << 8) | static_cast<uint32_t>(idx);
+	std::atomic_signal_fence(std::memory_order_release);
+	voice_retire_write = w + 1;
+}
+
+static void DrainRetiredVoices()
+{
+	uint32_t r = voice_retire_read;
+	const uint32_t w = voice_retire_write;
+	std::atomic_signal_fence(std::memory_order_acquire);
+	while (r != w)
+	{
+		const uint32_t entry = voice_retire_queue[r & (kVoiceRetireQueueSize - 1)];
+		++r;
+		const int idx = static_cast<int>(entry & 0xFFU);
+		if (idx >= kPerformVoiceCount
+			|| (voice_alloc.generation[idx] & 0xFFFFFFU) != (entry >> 8)
+			|| voice_alloc.list[idx] == VoiceList::Free)
 		{
 			continue;
 		}
-		if (count >= kMaxWavFiles)
+		ReleaseVoiceNote(idx);
+		VoiceListMove(VoiceList::Free, idx);
+	}
+	voice_retire_read = r;
+}
+
+// Picks a voice for a note-on: the voice already holding this note, then a
+// free voice, then the voice that has been releasing longest (usually, but
+// not always, the quietest), and finally the oldest held voice.
+static int AcquirePerformVoice(int32_t note)
+{
+	DrainRetiredVoices();
+	int idx = -1;
+	if (note >= 0 && note < 128)
+	{
+		idx = voice_alloc.note_voice[note];
+	}
+	if (idx < 0)
+	{
+		idx = voice_alloc.head[static_cast<int>(VoiceList::Free)];
+	}
+	if (idx < 0)
+	{
+		idx = voice_alloc.head[static_cast<int>(VoiceList::Releasing)];
+	}
+	if (idx < 0)
+	{
+		idx = voice_alloc.head[static_cast<int>(VoiceList::Held)];
+	}
+	if (idx < 0)
+	{
+		return -1;
+	}
+	if (voice_alloc.note[idx] != note)
+	{
+		ReleaseVoiceNote(idx);
+		if (note >= 0 && note < 128)
 		{
-			break;
+			voice_alloc.note[idx] = static_cast<int8_t>(note);
+			voice_alloc.note_voice[note] = static_cast<int8_t>(idx);
 		}
-		CopyString(wav_files[count], fno.fname, kMaxWavNameLen);
-		++count;
 	}
-	f_closedir(&dir);
-	wav_file_count = count;
-	LogLine("Scan complete: %ld files", static_cast<long>(wav_file_count));
-	if (wav_file_count <= 0)
+	VoiceListMove(VoiceList::Held, idx);
+	return idx;
+}
+
+static void FillStreamSlot(StreamSlot& slot, int idx)
+{
+	const size_t buffered = slot.write_frame - slot.read_frame;
+	if (buffered + 2 >= kStreamRingFrames || slot.write_frame >= slot.end_frame)
 	{
-		load_selected = 0;
-		load_scroll = 0;
 		return;
 	}
-	if (load_selected >= wav_file_count)
+	size_t frames_to_read = (kStreamRingFrames - 2) - buffered;
+	if (frames_to_read > kStreamReadFrames)
 	{
-		load_selected = wav_file_count - 1;
+		frames_to_read = kStreamReadFrames;
 	}
-	if (load_selected < load_scroll)
+	if (frames_to_read > slot.end_frame - slot.write_frame)
 	{
-		load_scroll = load_selected;
+		frames_to_read = slot.end_frame - slot.write_frame;
 	}
-	else if (load_selected >= load_scroll + LoadVisibleLines())
+	const size_t frame_bytes = slot.channels * sizeof(int16_t);
+	UINT bytes_read = 0;
+	const FRESULT res = f_read(&slot.file, stream_read_buf, frames_to_read * frame_bytes, &bytes_read);
+	if (res != FR_OK || bytes_read == 0)
 	{
-		load_scroll = load_selected - (LoadVisibleLines() - 1);
+		LogLine("Stream read failed: %s (%d)", FresultName(res), (int)res);
+		slot.failed = true;
+		return;
 	}
-	if (load_scroll < 0)
+	const size_t frames_read = bytes_read / frame_bytes;
+	const size_t fade_start = (slot.length > slot.fade_len) ? (slot.length - slot.fade_len) : 0;
+	const float fade_denom = (slot.fade_len > 1) ? static_cast<float>(slot.fade_len - 1) : 1.0f;
+	int16_t* ring_l = stream_ring_l[idx];
+	int16_t* ring_r = stream_ring_r[idx];
+	size_t frame = slot.write_frame;
+	for (size_t i = 0; i < frames_read; ++i, ++frame)
 	{
-		load_scroll = 0;
+		int16_t l = stream_read_buf[i * slot.channels];
+		int16_t r = (slot.channels == 2) ? stream_read_buf[i * 2 + 1] : l;
+		if (slot.fade_len > 0 && frame >= fade_start)
+		{
+			const float fade_out = static_cast<float>(slot.length - 1 - frame) / fade_denom;
+			l = static_cast<int16_t>(static_cast<float>(l) * fade_out);
+			r = static_cast<int16_t>(static_cast<float>(r) * fade_out);
+		}
+		const size_t w = frame & (kStreamRingFrames - 1);
+		ring_l[w] = l;
+		ring_r[w] = r;
 	}
-	const int32_t max_top = wav_file_count - LoadVisibleLines();
-	if (max_top < 0)
+	std::atomic_signal_fence(std::memory_order_release);
+	slot.write_frame = frame;
+}
+
+static void CloseStreamFile(StreamSlot& slot)
+{
+	if (slot.file_open)
 	{
-		load_scroll = 0;
+		f_close(&slot.file);
+		slot.file_open = false;
 	}
-	else if (load_scroll > max_top)
+	slot.path[0] = '\0';
+}
+
+static void CloseStreamSlot(StreamSlot& slot)
+{
+	if (slot.failed)
 	{
-		load_scroll = max_top;
+		CloseStreamFile(slot);
 	}
+	slot.failed = false;
+	slot.state = StreamSlotState::Free;
 }
 
-static void ComputeWaveform()
+// Main loop: closes the files idle slots keep open, before a delete or
+// after a remount.
+static void CloseIdleStreamFiles()
 {
-	const int32_t width = 128;
-	if (!sample_loaded || sample_length == 0)
+	for (auto& slot : stream_slots)
 	{
-		for (int32_t i = 0; i < width; ++i)
+		if (slot.state != StreamSlotState::Active)
 		{
-			waveform_min[i] = 0;
-			waveform_max[i] = 0;
+			CloseStreamFile(slot);
 		}
-		return;
 	}
+}
 
-	const size_t frames = sample_length;
-	if (frames < 2)
+// Opens a refill ring for frames [start_frame, end_frame) of a streamed
+// sample and reads prime_frames into it before handing it out. Free slots
+// already open on the same file are preferred.
+static int ClaimStreamSlot(const VoiceSampleSource& src, size_t start_frame, size_t end_frame, size_t prime_frames)
+{
+	int idx = -1;
+	for (int i = 0; i < kStreamSlotCount; ++i)
 	{
-		return;
+		StreamSlot& candidate = stream_slots[i];
+		if (candidate.state == StreamSlotState::Released)
+		{
+			CloseStreamSlot(candidate);
+		}
+		if (candidate.state != StreamSlotState::Free)
+		{
+			continue;
+		}
+		if (idx < 0 || (candidate.file_open && std::strcmp(candidate.path, src.path) == 0))
+		{
+			idx = i;
+		}
 	}
-
-	const size_t columns = 128;
-	size_t step = frames / columns;
-	if (step == 0)
+	if (idx < 0)
 	{
-		step = 1;
+		return -1;
 	}
+	StreamSlot& slot = stream_slots[idx];
+	FRESULT res = FR_OK;
+	if (!slot.file_open || std::strcmp(slot.path, src.path) != 0)
+	{
+		CloseStreamFile(slot);
+		res = f_open(&slot.file, src.path, FA_READ);
+		if (res != FR_OK)
+		{
+			LogLine("Stream open failed: %s (%d)", FresultName(res), (int)res);
+			return -1;
+		}
+		slot.file_open = true;
+		CopyString(slot.path, src.path, kSamplePathLen);
+	}
+	slot.channels = src.channels;
+	slot.data_offset = src.data_offset;
+	res = f_lseek(&slot.file, slot.data_offset + start_frame * slot.channels * sizeof(int16_t));
+	if (res != FR_OK)
+	{
+		LogLine("Stream seek failed: %s (%d)", FresultName(res), (int)res);
+		CloseStreamFile(slot);
+		return -1;
+	}
+	slot.length = src.length;
+	slot.fade_len = static_cast<size_t>(static_cast<float>(src.rate) * 0.005f + 0.5f);
+	if (slot.fade_len > slot.length / 2)
+	{
+		slot.fade_len = slot.length / 2;
+	}
+	slot.end_frame = end_frame;
+	slot.read_frame = start_frame;
+	slot.write_frame = start_frame;
+	slot.failed = false;
+	const size_t prime_end = (end_frame - start_frame > prime_frames) ? (start_frame + prime_frames) : end_frame;
+	while (slot.write_frame < prime_end && !slot.failed)
+	{
+		FillStreamSlot(slot, idx);
+	}
+	if (slot.failed)
+	{
+		CloseStreamSlot(slot);
+		return -1;
+	}
+	slot.state = StreamSlotState::Active;
+	return idx;
+}
 
-	const float scale = 28.0f;
-
-	for (size_t col = 0; col < columns; ++col)
+// Decides how a voice window is fed: resident windows need no slot, windows
+// that run past the head get a refill ring or, if none is free, are cut at
+// the head. Returns false if the window cannot be played at all.
+static bool PrepareVoiceStream(const VoiceSampleSource& src,
+							   size_t window_start,
+							   size_t& window_end,
+							   int& stream_slot)
+{
+	stream_slot = -1;
+	const size_t resident = src.sample.resident;
+	if (window_end <= resident)
 	{
-		float minv = 1.0f;
-		float maxv = -1.0f;
+		return true;
+	}
+	const size_t ring_start = (window_start > resident) ? window_start : resident;
+	// The resident head plays while the ring fills, so only the shortfall
+	// against one main-loop stall is read up front.
+	const size_t head_ahead = (window_start < resident) ? (resident - window_start) : 0;
+	const size_t prime = (head_ahead + kStreamReadFrames >= kStreamPrimeFrames)
+		? kStreamReadFrames
+		: (kStreamPrimeFrames - head_ahead);
+	stream_slot = ClaimStreamSlot(src, ring_start, window_end, prime);
+	if (stream_slot >= 0)
+	{
+		return true;
+	}
+	if (window_start + 1 >= resident)
+	{
+		return false;
+	}
+	window_end = resident;
+	return true;
+}
 
-		const size_t start = col * step;
-		const size_t end = (col == columns - 1) ? frames : (start + step);
+// Main loop: reclaims rings the audio callback is done with and tops up
+// the active ones within kStreamFillBudgetMs.
+static void FillStreamBuffers()
+{
+	const uint32_t start_ms = System::GetNow();
+	bool progress = true;
+	while (progress)
+	{
+		progress = false;
+		for (int i = 0; i < kStreamSlotCount; ++i)
+		{
+			StreamSlot& slot = stream_slots[i];
+			if (slot.state == StreamSlotState::Released)
+			{
+				CloseStreamSlot(slot);
+				continue;
+			}
+			if (slot.state != StreamSlotState::Active || slot.failed)
+			{
+				continue;
+			}
+			const size_t before = slot.write_frame;
+			FillStreamSlot(slot, i);
+			if (slot.write_frame != before)
+			{
+				progress = true;
+			}
+		}
+		if ((System::GetNow() - start_ms) >= kStreamFillBudgetMs)
+		{
+			break;
+		}
+	}
+}
 
-		for (size_t i = start; i < end; ++i)
+// Safe from the audio callback: only flags the rings, the main loop closes
+// the files.
+static void ReleaseAllStreamSlots()
+{
+	for (auto& slot : stream_slots)
+	{
+		if (slot.state == StreamSlotState::Active)
 		{
-			const float s = static_cast<float>(sample_buffer_l[i]) * kSampleScale;
-			if (s < minv)
-			{
-				minv = s;
-			}
-			if (s > maxv)
-			{
-				maxv = s;
-			}
+			slot.state = StreamSlotState::Released;
 		}
+	}
+}
 
-		waveform_min[col] = static_cast<int16_t>(minv * scale);
-		waveform_max[col] = static_cast<int16_t>(maxv * scale);
+static inline void ReleaseStreamSlot(int8_t idx)
+{
+	if (idx >= 0 && idx < kStreamSlotCount)
+	{
+		stream_slots[idx].state = StreamSlotState::Released;
 	}
 }
 
-static void UpdateTrimFrames()
+// The last slot is kept for Reset, so a reset always gets through; if
+// even that is taken, the Reset already in it clears the voices.
+static bool PushVoiceEvent(const VoiceEvent& event)
 {
-	if(sample_length < 2)
+	const uint32_t w = voice_event_write;
+	const uint32_t limit = (event.type == VoiceEventType::Reset) ? kVoiceEventQueueSize : kVoiceEventQueueSize - 1;
+	if ((w - voice_event_read) >= limit)
 	{
-		sample_play_start = 0;
-		sample_play_end   = sample_length;
-		return;
+		return false;
 	}
+	voice_event_queue[w & (kVoiceEventQueueSize - 1)] = event;
+	std::atomic_signal_fence(std::memory_order_release);
+	voice_event_write = w + 1;
+	return true;
+}
 
-	if(trim_start < 0.0f) trim_start = 0.0f;
-	if(trim_end   > 1.0f) trim_end   = 1.0f;
+// Main loop: hands a voice picked by AcquirePerformVoice to the audio
+// callback, which starts it on start_clock.
+static void ArmPerformVoice(int idx,
+							int32_t note,
+							float rate,
+							size_t offset,
+							size_t length,
+							const VoiceSample& sample,
+							int stream_slot,
+							uint32_t start_clock)
+{
+	VoiceEvent event;
+	event.type = VoiceEventType::Start;
+	event.voice = static_cast<int8_t>(idx);
+	event.stream_slot = static_cast<int8_t>(stream_slot);
+	event.generation = ++voice_alloc.generation[idx];
+	event.epoch = voice_event_epoch;
+	event.clock = start_clock;
+	event.note = note;
+	event.rate = rate;
+	event.offset = offset;
+	event.length = length;
+	event.sample = sample;
+	if (!PushVoiceEvent(event))
+	{
+		ReleaseStreamSlot(static_cast<int8_t>(stream_slot));
+		ReleaseVoiceNote(idx);
+		VoiceListMove(VoiceList::Free, idx);
+	}
+}
 
-	const float min_norm = 2.0f / (float)sample_length;
-	if(trim_end - trim_start < min_norm)
+// Audio callback side of a Start event. A voice that is still sounding
+// gets a de-click fade before the new note takes over.
+static void StartVoiceFromEvent(const VoiceEvent& event)
+{
+	const int idx = event.voice;
+	PerformVoice& voice = perform_voices[idx];
+	if (voice.active || voice.steal_pending)
 	{
-		trim_end = trim_start + min_norm;
-		if(trim_end > 1.0f)
+		if (voice.steal_pending)
 		{
-			trim_end = 1.0f;
-			trim_start = trim_end - min_norm;
+			ReleaseStreamSlot(voice.pending_stream_slot);
 		}
+		else
+		{
+			voice.steal_fade_left = kVoiceStealFadeFrames;
+		}
+		voice.pending_stream_slot = event.stream_slot;
+		voice.pending_sample = event.sample;
+		voice.pending_scheduled = true;
+		voice.pending_start_clock = event.clock;
+		voice.pending_generation = event.generation;
+		voice.pending_note = event.note;
+		voice.pending_rate = event.rate;
+		voice.pending_offset = event.offset;
+		voice.pending_length = event.length;
+		voice.pending_release = false;
+		voice.steal_pending = true;
+		return;
 	}
-
-	snap_start_frame = (uint32_t)(trim_start * sample_length);
-	snap_end_frame   = (uint32_t)(trim_end   * sample_length);
-
-	if(snap_end_frame <= snap_start_frame)
-		snap_end_frame = snap_start_frame + 2;
-
-	sample_play_start = snap_start_frame;
-	sample_play_end   = snap_end_frame;
+	voice.generation = event.generation;
+	voice.releasing = false;
+	voice.note = event.note;
+	voice.phase = 0.0f;
+	voice.rate = event.rate;
+	voice.amp = 1.0f;
+	voice.env = 0.0f;
+	voice.release_start = 0.0f;
+	voice.release_pos = 0.0f;
+	voice.env_samples = 0;
+	voice.offset = event.offset;
+	voice.length = event.length;
+	voice.sample = event.sample;
+	voice.scheduled = true;
+	voice.start_clock = event.clock;
+	voice.release_scheduled = false;
+	voice.stream_slot = event.stream_slot;
+	perform_lpf[idx].Reset();
+	voice.active = true;
 }
 
-static void AdjustTrimNormalized(int32_t start_delta, int32_t end_delta, bool fine = false)
+// Audio callback side of a Release event; stale generations are ignored.
+static void ReleaseVoiceFromEvent(const VoiceEvent& event)
 {
-	if(sample_length < 2)
+	PerformVoice& voice = perform_voices[event.voice];
+	if (voice.steal_pending && voice.pending_generation == event.generation)
+	{
+		voice.pending_release = true;
+		voice.pending_release_clock = event.clock;
 		return;
-
-	const float base_step = fine ? (1.0f / 64.0f) : (1.0f / 32.0f);
-
-	auto step = [&](int d)
+	}
+	if (voice.generation != event.generation || !voice.active || voice.releasing)
 	{
-		int mag = abs(d);
-		if(mag < 1) mag = 1;
-		int log2 = 0;
-		while(mag > 1) { mag >>= 1; ++log2; }
-		return base_step * (1 << log2);
-	};
-
-	if(start_delta != 0)
-		trim_start += start_delta * step(start_delta);
-
-	if(end_delta != 0)
-		trim_end   += end_delta   * step(end_delta);
-
-	UpdateTrimFrames();
-	waveform_dirty = true;
-	request_length_redraw = true;
+		return;
+	}
+	voice.release_scheduled = true;
+	voice.release_clock = event.clock;
 }
 
-static bool IsPlayUiMode(UiMode mode)
+// Audio callback only: drops every voice and its filter state.
+static void ClearPerformVoices()
 {
-	return (mode == UiMode::Play || mode == UiMode::PlayTrack);
+	for (auto &voice : perform_voices)
+	{
+		voice.active = false;
+		voice.releasing = false;
+		voice.phase = 0.0f;
+		voice.rate = 1.0f;
+		voice.amp = 1.0f;
+		voice.env = 0.0f;
+		voice.release_start = 0.0f;
+		voice.release_pos = 0.0f;
+		voice.note = -1;
+		voice.offset = 0;
+		voice.length = 0;
+		voice.env_samples = 0;
+		voice.steal_pending = false;
+		voice.steal_fade_left = 0;
+		voice.pending_release = false;
+		voice.stream_slot = -1;
+		voice.pending_stream_slot = -1;
+		voice.sample = VoiceSample();
+		voice.pending_sample = VoiceSample();
+		voice.scheduled = false;
+		voice.release_scheduled = false;
+		voice.pending_scheduled = false;
+	}
+	for (int i = 0; i < kPerformVoiceCount; ++i)
+	{
+		perform_lpf[i].Reset();
+	}
 }
 
-static bool IsPerformUiMode(UiMode mode)
+static void ApplyVoiceEvents()
 {
-	return (mode == UiMode::Perform || mode == UiMode::PlayTrack);
+	uint32_t r = voice_event_read;
+	const uint32_t w = voice_event_write;
+	std::atomic_signal_fence(std::memory_order_acquire);
+	const uint32_t epoch = voice_event_epoch;
+	while (r != w)
+	{
+		const VoiceEvent& event = voice_event_queue[r & (kVoiceEventQueueSize - 1)];
+		++r;
+		if (event.type == VoiceEventType::Reset)
+		{
+			ClearPerformVoices();
+			continue;
+		}
+		if (event.epoch != epoch || event.voice < 0 || event.voice >= kPerformVoiceCount)
+		{
+			if (event.type == VoiceEventType::Start)
+			{
+				ReleaseStreamSlot(event.stream_slot);
+			}
+			continue;
+		}
+		if (event.type == VoiceEventType::Start)
+		{
+			StartVoiceFromEvent(event);
+		}
+		else
+		{
+			ReleaseVoiceFromEvent(event);
+		}
+	}
+	std::atomic_signal_fence(std::memory_order_release);
+	voice_event_read = r;
 }
 
-static bool AnyPerformVoiceActive()
+// Audio callback side: the steal fade has finished, start the pending note.
+// A note-off that arrived during the fade releases from the level the attack
+// would have reached by then; returns false when that level is silent.
+static bool BeginPendingPerformVoice(PerformVoice& voice, int idx, const VoiceRenderParams& p)
 {
-	for (int v = 0; v < kPerformVoiceCount; ++v)
-	{
-		if (perform_voices[v].active)
-		{
-			return true;
+	voice.generation = voice.pending_generation;
+	voice.releasing = false;
+	voice.note = voice.pending_note;
+	voice.phase = 0.0f;
+	voice.rate = voice.pending_rate;
+	voice.amp = 1.0f;
+	voice.env = 0.0f;
+	voice.release_start = 0.0f;
+	voice.release_pos = 0.0f;
+	voice.env_samples = 0;
+	voice.offset = voice.pending_offset;
+	voice.length = voice.pending_length;
+	voice.sample = voice.pending_sample;
+	voice.scheduled = voice.pending_scheduled;
+	voice.start_clock = voice.pending_start_clock;
+	voice.release_scheduled = false;
+	ReleaseStreamSlot(voice.stream_slot);
+	voice.stream_slot = voice.pending_stream_slot;
+	voice.pending_stream_slot = -1;
+	perform_lpf[idx].Reset();
+	voice.steal_pending = false;
+	if (voice.pending_release)
+	{
+		const int32_t held = voice.pending_scheduled
+			? static_cast<int32_t>(voice.pending_release_clock - voice.pending_start_clock)
+			: 0;
+		const bool attack_ramp = p.env_active && (p.inv_attack_samples > 0.0f);
+		if (attack_ramp && held <= 0)
+		{
+			RetirePerformVoice(voice);
+			return false;
 		}
+		voice.env_samples = attack_ramp ? static_cast<uint32_t>(held) : 0;
+		voice.env = attack_ramp ? static_cast<float>(held) * p.inv_attack_samples : 1.0f;
+		BeginVoiceRelease(voice);
 	}
-	return false;
+	voice.active = true;
+	return true;
 }
 
-static SampleState& SampleStateForContext(SampleContext ctx)
+static SampleState& SampleStateForContext(SampleContext ctx, int32_t track)
 {
+	if (ctx == SampleContext::Track)
+	{
+		return track_samples[track];
+	}
 	return (ctx == SampleContext::Perform) ? perform_sample_state : play_sample_state;
 }
 
-static WaveformCache& WaveformCacheForContext(SampleContext ctx)
+static WaveformCache& WaveformCacheForContext(SampleContext ctx, int32_t track)
 {
+	if (ctx == SampleContext::Track)
+	{
+		return track_waveform_cache[track];
+	}
 	return (ctx == SampleContext::Perform) ? perform_waveform_cache : play_waveform_cache;
 }
 
-static void SaveWaveformCache(SampleContext ctx)
+static WavePyramid& WavePyramidForContext(SampleContext ctx, int32_t track)
+{
+	if (ctx == SampleContext::Track)
+	{
+		return track_wave_pyramid[track];
+	}
+	return (ctx == SampleContext::Perform) ? perform_wave_pyramid : play_wave_pyramid;
+}
+
+static void InitWavePyramids()
+{
+	WavePyramidInit(perform_wave_pyramid, wave_pyramid_lo[0], wave_pyramid_hi[0], kWavePyramidCapacity);
+	WavePyramidInit(play_wave_pyramid, wave_pyramid_lo[1], wave_pyramid_hi[1], kWavePyramidCapacity);
+	for (int t = 0; t < kPlayTrackCount; ++t)
+	{
+		WavePyramidInit(track_wave_pyramid[t], wave_pyramid_lo[2 + t], wave_pyramid_hi[2 + t], kWavePyramidCapacity);
+	}
+	sample_pyramid = &WavePyramidForContext(current_sample_context, current_sample_track);
+}
+
+static void SaveWaveformCache(SampleContext ctx, int32_t track)
 {
-	WaveformCache& cache = WaveformCacheForContext(ctx);
+	WaveformCache& cache = WaveformCacheForContext(ctx, track);
 	std::memcpy(cache.min, waveform_min, sizeof(waveform_min));
 	std::memcpy(cache.max, waveform_max, sizeof(waveform_max));
 	cache.ready = waveform_ready;
 	cache.dirty = waveform_dirty;
 }
 
-static void LoadWaveformCache(SampleContext ctx)
+static void LoadWaveformCache(SampleContext ctx, int32_t track)
 {
-	WaveformCache& cache = WaveformCacheForContext(ctx);
+	WaveformCache& cache = WaveformCacheForContext(ctx, track);
 	std::memcpy(waveform_min, cache.min, sizeof(waveform_min));
 	std::memcpy(waveform_max, cache.max, sizeof(waveform_max));
 	waveform_ready = cache.ready;
 	waveform_dirty = cache.dirty;
 }
 
+static void CancelWaveformProbe()
+{
+	if (probe_job_active)
+	{
+		f_close(&probe_job_file);
+		probe_job_active = false;
+	}
+}
+
+// Starts the tail probe for the sample that just finished loading into the
+// current context.
+static void BeginWaveformProbe()
+{
+	CancelWaveformProbe();
+	if (f_open(&probe_job_file, sample_stream_path, FA_READ) != FR_OK)
+	{
+		LogLine("Waveform probe: open failed");
+		return;
+	}
+	CopyString(probe_job_path, sample_stream_path, kSamplePathLen);
+	probe_job_context = current_sample_context;
+	probe_job_track = current_sample_track;
+	probe_job_frames = sample_length;
+	probe_job_resident = SampleResidentFrames();
+	probe_job_data_offset = sample_stream_data_offset;
+	probe_job_channels = sample_channels;
+	probe_job_col = 0;
+	probe_job_active = true;
+}
+
+// Fills the overview columns past the resident head of a streamed sample
+// by reading one chunk at the start of each column, a few columns per call
+// within kWaveformProbeBudgetMs. The columns go to the waveform cache when
+// the sample's context is not the current one.
+static void StepWaveformProbe()
+{
+	if (!probe_job_active)
+	{
+		return;
+	}
+	const bool current = (current_sample_context == probe_job_context && current_sample_track == probe_job_track);
+	const SampleState& state = SampleStateForContext(probe_job_context, probe_job_track);
+	const bool streaming = current ? sample_streaming : state.streaming;
+	const size_t length = current ? sample_length : state.length;
+	const char* path = current ? sample_stream_path : state.path;
+	if (!streaming || length != probe_job_frames || std::strcmp(path, probe_job_path) != 0)
+	{
+		CancelWaveformProbe();
+		return;
+	}
+	WaveformCache& cache = WaveformCacheForContext(probe_job_context, probe_job_track);
+	int16_t* out_min = current ? waveform_min : cache.min;
+	int16_t* out_max = current ? waveform_max : cache.max;
+	const size_t columns = 128;
+	const size_t step = (probe_job_frames / columns > 0) ? (probe_job_frames / columns) : 1;
+	const size_t frame_bytes = probe_job_channels * sizeof(int16_t);
+	const float scale = 28.0f;
+	const uint32_t start_ms = System::GetNow();
+	while (probe_job_col < columns)
+	{
+		const size_t col = probe_job_col++;
+		const size_t start = col * step;
+		if (start < probe_job_resident || start >= probe_job_frames)
+		{
+			continue;
+		}
+		size_t count = probe_job_frames - start;
+		if (count > kSampleChunkFrames)
+		{
+			count = kSampleChunkFrames;
+		}
+		UINT bytes_read = 0;
+		if (f_lseek(&probe_job_file, probe_job_data_offset + start * frame_bytes) != FR_OK
+			|| f_read(&probe_job_file, wav_read, count * frame_bytes, &bytes_read) != FR_OK)
+		{
+			LogLine("Waveform probe failed at col %u", static_cast<unsigned>(col));
+			CancelWaveformProbe();
+			return;
+		}
+		const size_t got = bytes_read / frame_bytes;
+		float minv = 1.0f;
+		float maxv = -1.0f;
+		for (size_t i = 0; i < got; ++i)
+		{
+			const float v = static_cast<float>(wav_read[i * probe_job_channels]) * kSampleScale;
+			if (v < minv)
+			{
+				minv = v;
+			}
+			if (v > maxv)
+			{
+				maxv = v;
+			}
+		}
+		if (got == 0)
+		{
+			minv = 0.0f;
+			maxv = 0.0f;
+		}
+		out_min[col] = static_cast<int16_t>(minv * scale);
+		out_max[col] = static_cast<int16_t>(maxv * scale);
+		if ((System::GetNow() - start_ms) >= kWaveformProbeBudgetMs)
+		{
+			break;
+		}
+	}
+	if (current)
+	{
+		waveform_dirty = true;
+	}
+	else
+	{
+		cache.dirty = true;
+	}
+	if (probe_job_col >= columns)
+	{
+		CancelWaveformProbe();
+	}
+}
+
 static void SaveSampleState(SampleState& state)
 {
 	CopyString(state.name, loaded_sample_name, kMaxWavNameLen);
@@ -2276,6 +4565,12 @@ static void SaveSampleState(SampleState& state)
 	state.trim_start = trim_start;
 	state.trim_end = trim_end;
 	state.from_recording = waveform_from_recording;
+	state.streaming = sample_streaming;
+	state.head_frames = sample_head_frames;
+	state.data_offset = sample_stream_data_offset;
+	CopyString(state.path, sample_stream_path, kSamplePathLen);
+	state.pool_l = sample_pool_l;
+	state.pool_r = sample_pool_r;
 }
 
 static void LoadSampleState(const SampleState& state)
@@ -2290,29 +4585,86 @@ static void LoadSampleState(const SampleState& state)
 	trim_start = state.trim_start;
 	trim_end = state.trim_end;
 	waveform_from_recording = state.from_recording;
+	sample_streaming = state.streaming;
+	sample_head_frames = state.head_frames;
+	sample_stream_data_offset = state.data_offset;
+	CopyString(sample_stream_path, state.path, kSamplePathLen);
+	sample_pool_l = state.pool_l;
+	sample_pool_r = state.pool_r;
+}
+
+static void RefreshSampleBufferPointers()
+{
+	int16_t* l = sample_pool.Ptr(sample_pool_l);
+	int16_t* r = sample_pool.Ptr(sample_pool_r);
+	sample_buffer_l = (l != nullptr) ? l : sample_silence;
+	sample_buffer_r = (r != nullptr) ? r : sample_buffer_l;
+}
+
+static void LogSamplePool(const char* tag)
+{
+	LogLine("%s: pool used=%luK free=%luK largest=%luK blocks=%ld",
+			tag,
+			static_cast<unsigned long>(sample_pool.UsedBytes() / 1024U),
+			static_cast<unsigned long>(sample_pool.FreeBytes() / 1024U),
+			static_cast<unsigned long>(sample_pool.LargestFreeBytes() / 1024U),
+			static_cast<long>(sample_pool.BlockCount()));
 }
 
-static void SetSampleContext(SampleContext ctx)
+// Allocates a block, compacting the pool first if the free space is too
+// fragmented and nothing is reading or writing sample memory. Queued Start
+// events and sequencer plans carry raw pool pointers, so both must be idle.
+static int32_t AllocateSampleBlock(size_t bytes)
 {
-	if (current_sample_context == ctx)
+	int32_t handle = sample_pool.Allocate(bytes);
+	const bool quiescent = !AnyPerformVoiceActive()
+		&& voice_event_read == voice_event_write
+		&& SequencerPlansIdle()
+		&& !playback_active
+		&& record_state != RecordState::Recording;
+	if (handle < 0 && quiescent && sample_pool.FreeBytes() >= bytes && sample_pool.Defragment())
 	{
-		return;
+		LogSamplePool("Defragmented");
+		RefreshSampleBufferPointers();
+		if (record_buffer != nullptr)
+		{
+			record_buffer = sample_pool.Ptr(record_pool_handle);
+		}
+		handle = sample_pool.Allocate(bytes);
 	}
-	SaveWaveformCache(current_sample_context);
-	SaveSampleState(SampleStateForContext(current_sample_context));
-	current_sample_context = ctx;
-	if (ctx == SampleContext::Perform)
+	return handle;
+}
+
+// Track contexts default to the track whose FX context is open.
+static void SetSampleContext(SampleContext ctx, int32_t track = -1)
+{
+	if (ctx == SampleContext::Track)
 	{
-		sample_buffer_l = perform_sample_buffer_l;
-		sample_buffer_r = perform_sample_buffer_r;
+		if (track < 0)
+		{
+			track = perform_context_track;
+		}
+		if (track < 0 || track >= kPlayTrackCount)
+		{
+			return;
+		}
 	}
 	else
 	{
-		sample_buffer_l = play_sample_buffer_l;
-		sample_buffer_r = play_sample_buffer_r;
+		track = 0;
+	}
+	if (current_sample_context == ctx && current_sample_track == track)
+	{
+		return;
 	}
-	LoadSampleState(SampleStateForContext(ctx));
-	LoadWaveformCache(ctx);
+	SaveWaveformCache(current_sample_context, current_sample_track);
+	SaveSampleState(SampleStateForContext(current_sample_context, current_sample_track));
+	current_sample_context = ctx;
+	current_sample_track = track;
+	LoadSampleState(SampleStateForContext(ctx, track));
+	RefreshSampleBufferPointers();
+	sample_pyramid = &WavePyramidForContext(ctx, track);
+	LoadWaveformCache(ctx, track);
 	if (!waveform_ready && sample_loaded)
 	{
 		ComputeWaveform();
@@ -2321,7 +4673,7 @@ static void SetSampleContext(SampleContext ctx)
 	}
 }
 
-static void UpdatePlayStepMs()
+static void ClampPlayBpm()
 {
 	if (play_bpm < kPlayBpmMin)
 	{
@@ -2331,12 +4683,11 @@ static void UpdatePlayStepMs()
 	{
 		play_bpm = kPlayBpmMax;
 	}
-	const uint32_t bpm = static_cast<uint32_t>(play_bpm);
-	play_step_ms = (bpm > 0) ? (60000U / (bpm * 4U)) : 0;
-	if (play_step_ms == 0)
-	{
-		play_step_ms = 1;
-	}
+}
+
+static bool IsCurrentTrackContext(int32_t track)
+{
+	return current_sample_context == SampleContext::Track && current_sample_track == track;
 }
 
 static bool TrackHasSampleState(int32_t track)
@@ -2345,20 +4696,38 @@ static bool TrackHasSampleState(int32_t track)
 	{
 		return false;
 	}
+	if (IsCurrentTrackContext(track))
+	{
+		return sample_loaded && loaded_sample_name[0] != '\0';
+	}
 	return track_samples[track].loaded && track_samples[track].name[0] != '\0';
 }
 
-static bool TrackSampleMatchesLoaded(int32_t track)
+// Fills src and the trim window for a track's resident sample. The current
+// track reads the working globals, which are newer than its stored state.
+static bool TrackVoiceSampleSource(int32_t track,
+								   VoiceSampleSource& src,
+								   float& track_trim_start,
+								   float& track_trim_end)
 {
 	if (!TrackHasSampleState(track))
 	{
 		return false;
 	}
-	if (!sample_loaded || sample_length < 1)
+	if (IsCurrentTrackContext(track))
 	{
-		return false;
+		src = CurrentVoiceSampleSource();
+		track_trim_start = trim_start;
+		track_trim_end = trim_end;
+	}
+	else
+	{
+		const SampleState& state = track_samples[track];
+		src = StoredVoiceSampleSource(state);
+		track_trim_start = state.trim_start;
+		track_trim_end = state.trim_end;
 	}
-	return strcmp(loaded_sample_name, track_samples[track].name) == 0;
+	return src.length > 0;
 }
 
 static bool ComputeTrimWindowFrames(float trim_start_in,
@@ -2413,91 +4782,269 @@ static bool ComputeTrimWindowFrames(float trim_start_in,
 	return (out_end > out_start);
 }
 
-static void StartSequencerVoiceWindow(size_t window_start, size_t window_end)
+static void PublishSequencerPlan(int32_t track, const SeqTrackPlan& plan)
 {
-	if (!sample_loaded || sample_length < 1)
+	const uint8_t next = seq_plan_live[track] ^ 1U;
+	seq_plans[track][next] = plan;
+	seq_plan_fired[track][next] = 0;
+	std::atomic_signal_fence(std::memory_order_release);
+	seq_plan_live[track] = next;
+}
+
+// Main loop, after the plan has been replaced: a plan that never fired
+// still owns its ring and its reserved voice.
+static void ReleaseSequencerPlan(const SeqTrackPlan& plan, bool fired, bool keep_voice)
+{
+	if (!plan.valid || fired)
 	{
 		return;
 	}
-	if (window_end > sample_length || window_end == 0)
-	{
-		window_end = sample_length;
-	}
-	if (window_end <= window_start)
+	ReleaseStreamSlot(plan.stream_slot);
+	if (!keep_voice && plan.voice >= 0 && voice_alloc.generation[plan.voice] == plan.generation)
 	{
-		window_start = 0;
-		window_end = sample_length;
+		ReleaseVoiceNote(plan.voice);
+		VoiceListMove(VoiceList::Free, plan.voice);
 	}
-	if (window_end <= window_start)
+}
+
+// Withdraws every plan. ResetPerformVoices passes release=false because it
+// resets the allocator and the rings itself.
+static void DropSequencerPlans(bool release)
+{
+	for (int32_t track = 0; track < kPlayTrackCount; ++track)
 	{
-		return;
+		const uint8_t live = seq_plan_live[track];
+		if (!seq_plans[track][live].valid)
+		{
+			continue;
+		}
+		const SeqTrackPlan old = seq_plans[track][live];
+		PublishSequencerPlan(track, SeqTrackPlan());
+		if (release)
+		{
+			ReleaseSequencerPlan(old, seq_plan_fired[track][live] > 0, false);
+		}
 	}
+}
 
-	int voice_index = -1;
-	for (int i = 0; i < kPerformVoiceCount; ++i)
+static bool SequencerPlansIdle()
+{
+	for (int32_t track = 0; track < kPlayTrackCount; ++track)
 	{
-		if (!perform_voices[i].active)
+		if (seq_plans[track][seq_plan_live[track]].valid)
 		{
-			voice_index = i;
-			break;
+			return false;
 		}
 	}
-	if (voice_index < 0)
+	return true;
+}
+
+// Main loop: keeps each track's plan in step with its sample, trim and
+// steps, and re-arms a track with a fresh voice once its plan has fired.
+static void ArmSequencerPlans()
+{
+	for (int32_t track = 0; track < kPlayTrackCount; ++track)
 	{
-		voice_index = 0;
+		const uint8_t live = seq_plan_live[track];
+		const SeqTrackPlan& cur = seq_plans[track][live];
+		const bool fired = seq_plan_fired[track][live] > 0;
+		bool has_step = false;
+		for (int step = 0; step < kPlayStepCount; ++step)
+		{
+			has_step = has_step || play_steps[track][step];
+		}
+		VoiceSampleSource src;
+		float track_trim_start = 0.0f;
+		float track_trim_end = 1.0f;
+		size_t window_start = 0;
+		size_t window_end = 0;
+		const bool playable = has_step
+			&& TrackVoiceSampleSource(track, src, track_trim_start, track_trim_end)
+			&& ComputeTrimWindowFrames(track_trim_start, track_trim_end, src.length, window_start, window_end)
+			&& window_end > window_start;
+		if (!playable)
+		{
+			if (cur.valid)
+			{
+				const SeqTrackPlan old = cur;
+				PublishSequencerPlan(track, SeqTrackPlan());
+				ReleaseSequencerPlan(old, seq_plan_fired[track][live] > 0, false);
+			}
+			continue;
+		}
+		const float sr = (src.rate == 0) ? 48000.0f : static_cast<float>(src.rate);
+		const float rate = sr / hw.AudioSampleRate();
+		// A note-on may have taken the reserved voice since the plan was armed.
+		const bool stolen = cur.valid && voice_alloc.generation[cur.voice] != cur.generation;
+		const bool same = cur.valid
+			&& cur.sample.l == src.sample.l
+			&& cur.sample.r == src.sample.r
+			&& cur.sample.stereo == src.sample.stereo
+			&& cur.offset == window_start
+			&& cur.window_end == window_end
+			&& cur.rate == rate;
+		if (same && !fired && !stolen)
+		{
+			continue;
+		}
+		SeqTrackPlan plan;
+		plan.valid = true;
+		plan.rate = rate;
+		plan.offset = window_start;
+		plan.window_end = window_end;
+		plan.sample = src.sample;
+		const bool new_voice = !cur.valid || fired || stolen;
+		int stream_slot = -1;
+		if (!PrepareVoiceStream(src, window_start, window_end, stream_slot))
+		{
+			continue;
+		}
+		// Reservations only take a free voice, so a step never cuts off a
+		// sounding note; with none free the track sits out until one is.
+		const int idx = new_voice ? voice_alloc.head[static_cast<int>(VoiceList::Free)] : cur.voice;
+		if (idx < 0)
+		{
+			ReleaseStreamSlot(static_cast<int8_t>(stream_slot));
+			if (cur.valid)
+			{
+				const SeqTrackPlan old = cur;
+				PublishSequencerPlan(track, SeqTrackPlan());
+				ReleaseSequencerPlan(old, seq_plan_fired[track][live] > 0, false);
+			}
+			continue;
+		}
+		plan.voice = static_cast<int8_t>(idx);
+		if (new_voice)
+		{
+			VoiceListMove(VoiceList::Held, idx);
+			plan.generation = ++voice_alloc.generation[idx];
+		}
+		else
+		{
+			plan.generation = cur.generation;
+		}
+		plan.stream_slot = static_cast<int8_t>(stream_slot);
+		plan.length = window_end - window_start;
+		const SeqTrackPlan old = cur;
+		PublishSequencerPlan(track, plan);
+		// Read after the flip: the callback can no longer start the old plan.
+		ReleaseSequencerPlan(old, seq_plan_fired[track][live] > 0, !new_voice);
 	}
+}
 
-	PerformVoice& voice = perform_voices[voice_index];
-	voice.active = true;
-	voice.releasing = false;
-	voice.note = -1;
-	voice.phase = 0.0f;
-	voice.amp = 1.0f;
-	voice.env = 0.0f;
-	voice.release_start = 0.0f;
-	voice.release_pos = 0.0f;
-	voice.env_samples = 0;
-	perform_lpf_l1[voice_index].Reset();
-	perform_lpf_l2[voice_index].Reset();
-	perform_lpf_r1[voice_index].Reset();
-	perform_lpf_r2[voice_index].Reset();
+// Audio frame of the step that lies steps after the tempo anchor.
+static uint32_t SeqStepFrame(uint32_t steps)
+{
+	const uint64_t sr = static_cast<uint64_t>(hw.AudioSampleRate());
+	const uint64_t frames = static_cast<uint64_t>(steps) * sr * 15U / static_cast<uint64_t>(seq_bpm);
+	return seq_anchor_frame + static_cast<uint32_t>(frames);
+}
 
-	const float sr = (sample_rate == 0) ? 48000.0f : static_cast<float>(sample_rate);
-	voice.rate = sr / hw.AudioSampleRate();
-	voice.offset = window_start;
-	voice.length = window_end - window_start;
+static void StartSequencer()
+{
+	playhead_step = 0;
+	seq_bpm = play_bpm;
+	seq_anchor_frame = audio_frame_clock;
+	seq_anchor_steps = 0;
+	seq_next_step = 0;
+	seq_next_frame = seq_anchor_frame;
+	ArmSequencerPlans();
+	std::atomic_signal_fence(std::memory_order_release);
+	playhead_running = true;
 }
 
-static void TriggerSequencerStep(int32_t step)
+static void StopSequencer()
+{
+	playhead_running = false;
+	DropSequencerPlans(true);
+}
+
+// Audio callback: starts every track whose step is on from its published
+// plan, on the step's frame.
+static void FireSequencerStep(int32_t step, uint32_t clock)
 {
-	if (step < 0 || step >= kPlayStepCount)
-	{
-		return;
-	}
 	for (int track = 0; track < kPlayTrackCount; ++track)
 	{
 		if (!play_steps[track][step])
 		{
 			continue;
 		}
-		if (!TrackSampleMatchesLoaded(track))
+		const uint8_t live = seq_plan_live[track];
+		std::atomic_signal_fence(std::memory_order_acquire);
+		const SeqTrackPlan& plan = seq_plans[track][live];
+		// A note-on that took the reserved voice bumped its generation.
+		if (!plan.valid || voice_alloc.generation[plan.voice] != plan.generation)
 		{
 			continue;
 		}
-		size_t window_start = 0;
-		size_t window_end = 0;
-		if (!ComputeTrimWindowFrames(track_samples[track].trim_start,
-									 track_samples[track].trim_end,
-									 sample_length,
-									 window_start,
-									 window_end))
+		VoiceEvent event;
+		event.type = VoiceEventType::Start;
+		event.voice = plan.voice;
+		event.stream_slot = plan.stream_slot;
+		event.generation = plan.generation;
+		event.epoch = voice_event_epoch;
+		event.clock = clock;
+		event.note = -1;
+		event.rate = plan.rate;
+		event.offset = plan.offset;
+		event.length = plan.length;
+		event.sample = plan.sample;
+		if (seq_plan_fired[track][live] > 0 && plan.stream_slot >= 0)
 		{
-			continue;
+			const size_t resident = plan.sample.resident;
+			event.stream_slot = -1;
+			event.length = (resident > plan.offset) ? (resident - plan.offset) : 0;
+		}
+		seq_plan_fired[track][live] = seq_plan_fired[track][live] + 1;
+		if (event.length > 0)
+		{
+			StartVoiceFromEvent(event);
 		}
-		StartSequencerVoiceWindow(window_start, window_end);
 	}
 }
 
+// Audio callback: fires the steps that fall inside this block and moves the
+// playhead. Steps never depend on main-loop timing; one that is already due
+// when the sequencer starts plays at the start of the block.
+static void AdvanceSequencer(uint32_t block_clock, size_t frames)
+{
+	if (play_bpm != seq_bpm)
+	{
+		seq_anchor_frame = seq_next_frame;
+		seq_anchor_steps = 0;
+		seq_bpm = play_bpm;
+	}
+	const uint32_t block_end = block_clock + static_cast<uint32_t>(frames);
+	while (static_cast<int32_t>(seq_next_frame - block_end) < 0)
+	{
+		const uint32_t clock = (static_cast<int32_t>(seq_next_frame - block_clock) > 0)
+			? seq_next_frame
+			: block_clock;
+		FireSequencerStep(seq_next_step, clock);
+		playhead_step = seq_next_step;
+		play_screen_dirty = true;
+		request_playhead_redraw = true;
+		seq_next_step = (seq_next_step + 1) % kPlayStepCount;
+		++seq_anchor_steps;
+		seq_next_frame = SeqStepFrame(seq_anchor_steps);
+	}
+}
+
+static void MarkFxStageDirty(FxStage stage)
+{
+	fx_stage_dirty[static_cast<int>(stage)] = true;
+	fx_params_dirty = true;
+}
+
+static void MarkAllFxStagesDirty()
+{
+	for (int i = 0; i < kFxStageCount; ++i)
+	{
+		fx_stage_dirty[i] = true;
+	}
+	fx_params_dirty = true;
+}
+
 static void CapturePerformState(PerformState& state)
 {
 	state.perform_index = perform_index;
@@ -2513,32 +5060,7 @@ static void CapturePerformState(PerformState& state)
 	{
 		state.fx_chain_order[i] = fx_chain_order[i];
 	}
-	state.amp_attack = amp_attack;
-	state.amp_decay = amp_decay;
-	state.amp_sustain = amp_sustain;
-	state.amp_release = amp_release;
-	state.flt_cutoff = flt_cutoff;
-	state.flt_res = flt_res;
-	state.fx_s_wet = fx_s_wet;
-	state.sat_tape_bump = sat_tape_bump;
-	state.sat_bit_reso = sat_bit_reso;
-	state.sat_bit_smpl = sat_bit_smpl;
-	state.sat_mode = sat_mode;
-	state.fx_c_wet = fx_c_wet;
-	state.chorus_rate = chorus_rate;
-	state.chorus_wow = chorus_wow;
-	state.tape_rate = tape_rate;
-	state.chorus_mode = chorus_mode;
-	state.delay_wet = delay_wet;
-	state.delay_time = delay_time;
-	state.delay_feedback = delay_feedback;
-	state.delay_spread = delay_spread;
-	state.delay_freeze = delay_freeze;
-	state.reverb_wet = reverb_wet;
-	state.reverb_pre = reverb_pre;
-	state.reverb_damp = reverb_damp;
-	state.reverb_decay = reverb_decay;
-	state.reverb_shimmer = reverb_shimmer;
+	state.params = fx_params;
 	state.sat_params_initialized = sat_params_initialized;
 	state.reverb_params_initialized = reverb_params_initialized;
 	state.delay_params_initialized = delay_params_initialized;
@@ -2547,6 +5069,9 @@ static void CapturePerformState(PerformState& state)
 
 static void ApplyPerformState(const PerformState& state)
 {
+	const bool was_busy = fx_params_busy;
+	fx_params_busy = true;
+	std::atomic_signal_fence(std::memory_order_seq_cst);
 	perform_index = state.perform_index;
 	fx_fader_index = state.fx_fader_index;
 	amp_fader_index = state.amp_fader_index;
@@ -2560,37 +5085,57 @@ static void ApplyPerformState(const PerformState& state)
 	{
 		fx_chain_order[i] = state.fx_chain_order[i];
 	}
-	amp_attack = state.amp_attack;
-	amp_decay = state.amp_decay;
-	amp_sustain = state.amp_sustain;
-	amp_release = state.amp_release;
-	flt_cutoff = state.flt_cutoff;
-	flt_res = state.flt_res;
-	fx_s_wet = state.fx_s_wet;
-	sat_tape_bump = state.sat_tape_bump;
-	sat_bit_reso = state.sat_bit_reso;
-	sat_bit_smpl = state.sat_bit_smpl;
-	sat_mode = state.sat_mode;
-	fx_c_wet = state.fx_c_wet;
-	chorus_rate = state.chorus_rate;
-	chorus_wow = state.chorus_wow;
-	tape_rate = state.tape_rate;
-	chorus_mode = state.chorus_mode;
-	delay_wet = state.delay_wet;
-	delay_time = state.delay_time;
-	delay_feedback = state.delay_feedback;
-	delay_spread = state.delay_spread;
-	delay_freeze = state.delay_freeze;
-	reverb_wet = state.reverb_wet;
-	reverb_pre = state.reverb_pre;
-	reverb_damp = state.reverb_damp;
-	reverb_decay = state.reverb_decay;
-	reverb_shimmer = state.reverb_shimmer;
+	fx_params = state.params;
 	sat_params_initialized = state.sat_params_initialized;
 	reverb_params_initialized = state.reverb_params_initialized;
 	delay_params_initialized = state.delay_params_initialized;
 	mod_params_initialized = state.mod_params_initialized;
-	fx_params_dirty = true;
+	MarkAllFxStagesDirty();
+	std::atomic_signal_fence(std::memory_order_seq_cst);
+	fx_params_busy = was_busy;
+}
+
+// Main loop: recompiles only the FX stages the UI touched, so sweeping one
+// encoder costs the audio callback a handful of setter calls.
+static void CompileFxStages()
+{
+	FxParamBlock fx;
+	bool have_params = false;
+	const float sr = hw.AudioSampleRate();
+	for (int i = 0; i < kFxStageCount; ++i)
+	{
+		if (!fx_stage_dirty[i] || fx_stage_ready[i] || fx_params_busy)
+		{
+			continue;
+		}
+		fx_stage_dirty[i] = false;
+		std::atomic_signal_fence(std::memory_order_seq_cst);
+		if (!have_params)
+		{
+			fx = fx_params;
+			ClampFxParams(fx);
+			have_params = true;
+		}
+		switch (static_cast<FxStage>(i))
+		{
+			case FxStage::Sat:
+				CompileSatCoeffs(fx, fx_coeffs_mailbox.sat);
+				break;
+			case FxStage::Mod:
+				CompileModCoeffs(fx, fx_coeffs_mailbox.mod);
+				break;
+			case FxStage::Delay:
+				CompileDelayCoeffs(fx, fx_coeffs_mailbox.delay, sr);
+				break;
+			case FxStage::Reverb:
+				CompileReverbCoeffs(fx, fx_coeffs_mailbox.reverb, sr);
+				break;
+			default:
+				break;
+		}
+		std::atomic_signal_fence(std::memory_order_release);
+		fx_stage_ready[i] = true;
+	}
 }
 
 enum class FxContext : int32_t
@@ -2662,10 +5207,10 @@ static void StoreTrackSampleState(int32_t track)
 	{
 		return;
 	}
-	track_samples[track].loaded = sample_loaded;
-	CopyString(track_samples[track].name, loaded_sample_name, kMaxWavNameLen);
-	track_samples[track].trim_start = trim_start;
-	track_samples[track].trim_end = trim_end;
+	if (IsCurrentTrackContext(track))
+	{
+		SaveSampleState(track_samples[track]);
+	}
 }
 
 static void InitTrackStates()
@@ -2675,10 +5220,8 @@ static void InitTrackStates()
 	for (int t = 0; t < kPlayTrackCount; ++t)
 	{
 		track_perform_state[t] = main_perform_state;
-		track_samples[t].loaded = false;
-		track_samples[t].name[0] = '\0';
-		track_samples[t].trim_start = 0.0f;
-		track_samples[t].trim_end = 1.0f;
+		track_samples[t] = SampleState();
+		track_waveform_cache[t] = WaveformCache();
 	}
 }
 
@@ -2688,10 +5231,8 @@ static void EnterPlayTrack(int32_t track)
 	{
 		return;
 	}
-	SetSampleContext(SampleContext::Play);
+	SetSampleContext(SampleContext::Track, track);
 	SetFxContext(FxContext::Track, track);
-	request_track_sample_load = true;
-	request_track_sample_index = track;
 	ui_mode = UiMode::PlayTrack;
 	request_perform_redraw = true;
 }
@@ -2709,33 +5250,25 @@ static void ExitPlayTrack()
 	request_playhead_redraw = true;
 }
 
+// Main loop: silences every voice and rebuilds the allocator, the refill
+// rings and the sequencer plans. The voices themselves are cleared by the
+// audio callback when it reaches the Reset event; the epoch bump drops
+// anything queued before it.
 static void ResetPerformVoices()
 {
-	for (auto &voice : perform_voices)
-	{
-		voice.active = false;
-		voice.releasing = false;
-		voice.phase = 0.0f;
-		voice.rate = 1.0f;
-		voice.amp = 1.0f;
-		voice.env = 0.0f;
-		voice.release_start = 0.0f;
-		voice.release_pos = 0.0f;
-		voice.note = -1;
-		voice.offset = 0;
-		voice.length = 0;
-		voice.env_samples = 0;
-	}
-	for (int i = 0; i < kPerformVoiceCount; ++i)
-	{
-		perform_lpf_l1[i].Reset();
-		perform_lpf_l2[i].Reset();
-		perform_lpf_r1[i].Reset();
-		perform_lpf_r2[i].Reset();
-	}
+	DropSequencerPlans(false);
+	++voice_event_epoch;
+	VoiceEvent event;
+	event.type = VoiceEventType::Reset;
+	event.epoch = voice_event_epoch;
+	PushVoiceEvent(event);
+	ReleaseAllStreamSlots();
+	ResetVoiceAllocator();
 }
 
-static void ApplyLoadedSampleFade(size_t length, uint32_t rate)
+// Fallback for loads that end short of the expected length: the fused
+// load pass could not place the fade-out, so it is applied here.
+static void ApplyLoadedSampleTailFade(size_t length, uint32_t rate)
 {
 	if (length == 0 || rate == 0)
 	{
@@ -2750,10 +5283,10 @@ static void ApplyLoadedSampleFade(size_t length, uint32_t rate)
 	{
 		return;
 	}
+	// Mono samples share one block for both channels.
+	const bool has_r = (sample_buffer_r != sample_buffer_l);
 	if (fade_len == 1)
 	{
-		sample_buffer_l[0] = 0;
-		sample_buffer_r[0] = 0;
 		sample_buffer_l[length - 1] = 0;
 		sample_buffer_r[length - 1] = 0;
 		return;
@@ -2761,21 +5294,33 @@ static void ApplyLoadedSampleFade(size_t length, uint32_t rate)
 	const float denom = static_cast<float>(fade_len - 1);
 	for (size_t i = 0; i < fade_len; ++i)
 	{
-		const float fade_in = static_cast<float>(i) / denom;
 		const float fade_out = static_cast<float>(fade_len - 1 - i) / denom;
 		const size_t tail_idx = length - fade_len + i;
-		sample_buffer_l[i] = static_cast<int16_t>(static_cast<float>(sample_buffer_l[i]) * fade_in);
-		sample_buffer_r[i] = static_cast<int16_t>(static_cast<float>(sample_buffer_r[i]) * fade_in);
 		sample_buffer_l[tail_idx] = static_cast<int16_t>(static_cast<float>(sample_buffer_l[tail_idx]) * fade_out);
-		sample_buffer_r[tail_idx] = static_cast<int16_t>(static_cast<float>(sample_buffer_r[tail_idx]) * fade_out);
+		if (has_r)
+		{
+			sample_buffer_r[tail_idx] = static_cast<int16_t>(static_cast<float>(sample_buffer_r[tail_idx]) * fade_out);
+		}
+	}
+}
+
+static void CloseSampleLoad()
+{
+	if (load_file_open)
+	{
+		f_close(&wav_file);
+		load_file_open = false;
 	}
 }
 
-static bool LoadSampleFromPath(const char* path)
+// Opens the file and claims the pool blocks. Until the load finishes the
+// sample is published as a streamed one whose head is the part read so
+// far, so voices started early refill the rest from SD.
+static bool BeginSampleLoad(const char* path)
 {
 	FIL* file = &wav_file;
-	UINT bytes_read = 0;
 
+	CloseSampleLoad();
 	playback_active = false;
 	playback_phase = 0.0f;
 	sample_loaded = false;
@@ -2784,6 +5329,8 @@ static bool LoadSampleFromPath(const char* path)
 	ResetPerformVoices();
 	sample_length = 0;
 	sample_channels = 1;
+	sample_streaming = false;
+	sample_head_frames = 0;
 	trim_start = 0.0f;
 	trim_end = 1.0f;
 
@@ -2810,6 +5357,7 @@ static bool LoadSampleFromPath(const char* path)
 		LogLine("Load failed: f_open %s (%d)", FresultName(res), static_cast<int>(res));
 		return false;
 	}
+	load_file_open = true;
 	LogLine("f_open ok: size=%lu tell=%lu",
 			static_cast<unsigned long>(f_size(file)),
 			static_cast<unsigned long>(f_tell(file)));
@@ -2817,21 +5365,21 @@ static bool LoadSampleFromPath(const char* path)
 	WavInfo wav;
 	if (!ParseWavHeader(file, wav))
 	{
-		f_close(file);
+		CloseSampleLoad();
 		return false;
 	}
 
 	if (wav.bits_per_sample != 16)
 	{
 		LogLine("Load failed: unsupported bit depth %u", (unsigned)wav.bits_per_sample);
-		f_close(file);
+		CloseSampleLoad();
 		return false;
 	}
 
 	if (wav.num_channels < 1 || wav.num_channels > 2)
 	{
 		LogLine("Load failed: unsupported channel count %u", (unsigned)wav.num_channels);
-		f_close(file);
+		CloseSampleLoad();
 		return false;
 	}
 	sample_channels = wav.num_channels;
@@ -2846,15 +5394,41 @@ static bool LoadSampleFromPath(const char* path)
 	if (total_frames == 0)
 	{
 		LogLine("Load failed: no data frames");
-		f_close(file);
+		CloseSampleLoad();
 		return false;
 	}
-	if (total_frames > kMaxSampleSamples)
+	const bool streaming = (total_frames > kMaxSampleSamples);
+	const size_t resident_frames = streaming ? kStreamHeadFrames : total_frames;
+	if (streaming)
 	{
-		LogLine("Truncating to %lu frames", static_cast<unsigned long>(kMaxSampleSamples));
-		total_frames = kMaxSampleSamples;
+		LogLine("Streaming: head=%lu frames, rest from SD",
+				static_cast<unsigned long>(resident_frames));
 	}
 
+	sample_pool.Free(sample_pool_l);
+	sample_pool.Free(sample_pool_r);
+	sample_pool_l = -1;
+	sample_pool_r = -1;
+	RefreshSampleBufferPointers();
+	const size_t channel_bytes = resident_frames * sizeof(int16_t);
+	sample_pool_l = AllocateSampleBlock(channel_bytes);
+	if (sample_pool_l >= 0 && wav.num_channels == 2)
+	{
+		sample_pool_r = AllocateSampleBlock(channel_bytes);
+	}
+	if (sample_pool_l < 0 || (wav.num_channels == 2 && sample_pool_r < 0))
+	{
+		LogLine("Load failed: sample pool full (%luK needed)",
+				static_cast<unsigned long>((channel_bytes * wav.num_channels) / 1024U));
+		LogSamplePool("Load");
+		sample_pool.Free(sample_pool_l);
+		sample_pool_l = -1;
+		RefreshSampleBufferPointers();
+		CloseSampleLoad();
+		return false;
+	}
+	RefreshSampleBufferPointers();
+
 	const uint32_t data_offset = wav.data_offset;
 	res = f_lseek(file, data_offset);
 	if (res != FR_OK)
@@ -2862,99 +5436,199 @@ static bool LoadSampleFromPath(const char* path)
 		LogLine("Load failed: f_lseek %s (%d)", FresultName(res), static_cast<int>(res));
 		LogLine("f_error=%u f_eof=%u", static_cast<unsigned>(f_error(file)), static_cast<unsigned>(f_eof(file)));
 		LogSdCardStatus();
-		f_close(file);
+		CloseSampleLoad();
 		return false;
 	}
 
-	size_t dest_index = 0;
-	int32_t last_percent = 0;
+	// The first read stops at a cluster boundary, so every later one is
+	// cluster-aligned and goes to the card as whole multi-block reads.
+	load_cluster_bytes = (file->obj.fs != nullptr && file->obj.fs->csize > 0)
+		? (static_cast<size_t>(file->obj.fs->csize) * kSdSectorBytes)
+		: kSdSectorBytes;
+	load_next_read_bytes = load_cluster_bytes - (data_offset % load_cluster_bytes);
+	if (load_next_read_bytes == load_cluster_bytes || load_next_read_bytes > kLoadChunkBytes)
+	{
+		load_next_read_bytes = kLoadChunkBytes;
+	}
+	load_streaming = streaming;
+	load_channels = wav.num_channels;
+	load_frame_bytes = frame_bytes;
+	load_total_frames = total_frames;
+	load_resident_frames = resident_frames;
+	load_dest_index = 0;
+	load_carry = 0;
+	load_last_percent = 0;
+	load_read_us = 0;
+	// Streamed samples fade their tail as it is streamed in.
+	PcmLoadScanInit(load_scan, total_frames, wav.sample_rate, !streaming, waveform_min, waveform_max, sample_pyramid);
+
+	sample_rate = wav.sample_rate;
+	sample_stream_data_offset = data_offset;
+	CopyString(sample_stream_path, path, kSamplePathLen);
+	sample_length = total_frames;
+	std::atomic_signal_fence(std::memory_order_release);
+	sample_streaming = true;
+	UpdateTrimFrames();
 	LogLine("Load progress: 0%%");
-	while (dest_index < total_frames)
-	{
-		size_t frames_to_read = total_frames - dest_index;
-		if (frames_to_read > kSampleChunkFrames)
-		{
-			frames_to_read = kSampleChunkFrames;
-		}
-		const size_t bytes_to_read = frames_to_read * wav.num_channels * sizeof(int16_t);
-		bytes_read = 0;
-		res = f_read(file, wav_read, bytes_to_read, &bytes_read);
-		if (res != FR_OK
-			|| bytes_read == 0)
-		{
-			LogLine("Load read error %s (%d) at %lu frames",
-					FresultName(res),
-					static_cast<int>(res),
-					static_cast<unsigned long>(dest_index));
-			LogLine("f_error=%u f_eof=%u", static_cast<unsigned>(f_error(file)), static_cast<unsigned>(f_eof(file)));
-			LogSdCardStatus();
-			break;
-		}
-		const size_t frames_read = bytes_read / (wav.num_channels * sizeof(int16_t));
-		for (size_t i = 0; i < frames_read; ++i)
-		{
-			if (wav.num_channels == 1)
-			{
-				const int16_t samp = wav_read[i];
-				sample_buffer_l[dest_index] = samp;
-				sample_buffer_r[dest_index] = samp;
-				dest_index++;
-			}
-			else
-			{
-				sample_buffer_l[dest_index] = wav_read[i * 2];
-				sample_buffer_r[dest_index] = wav_read[i * 2 + 1];
-				dest_index++;
-			}
-			if (dest_index >= kMaxSampleSamples)
-			{
-				break;
-			}
-		}
-		if (total_frames > 0)
-		{
-			const int32_t percent = static_cast<int32_t>(
-				(dest_index * 100U) / total_frames);
-			if (percent >= last_percent + kLoadProgressStep || percent == 100)
-			{
-				LogLine("Load progress: %ld%%", static_cast<long>(percent));
-				last_percent = percent;
-			}
-		}
-		if (frames_read < frames_to_read)
-		{
-			break;
-		}
-	}
-	f_close(file);
+	return true;
+}
 
-	if (dest_index < total_frames)
+static bool FinishSampleLoad()
+{
+	const size_t dest_index = load_dest_index;
+	const size_t loaded_bytes = dest_index * load_frame_bytes;
+	LogLine("Load read: %luK in %lums (%.2f MB/s, cluster %luK)",
+			static_cast<unsigned long>(loaded_bytes / 1024U),
+			static_cast<unsigned long>(load_read_us / 1000U),
+			(load_read_us > 0) ? (static_cast<double>(loaded_bytes) / static_cast<double>(load_read_us)) : 0.0,
+			static_cast<unsigned long>(load_cluster_bytes / 1024U));
+	LogLine("SD cache: %lu hits, %lu misses",
+			static_cast<unsigned long>(sd_cache_hits),
+			static_cast<unsigned long>(sd_cache_misses));
+	if (dest_index < load_resident_frames)
 	{
 		LogLine("Load finished early: %lu/%lu frames",
 				static_cast<unsigned long>(dest_index),
-				static_cast<unsigned long>(total_frames));
+				static_cast<unsigned long>(load_resident_frames));
+		sample_pool.Shrink(sample_pool_l, dest_index * sizeof(int16_t));
+		sample_pool.Shrink(sample_pool_r, dest_index * sizeof(int16_t));
 	}
-	sample_length = dest_index;
-	sample_rate = wav.sample_rate;
-	sample_loaded = (sample_length > 0);
-	if (!sample_loaded)
+	const bool streaming = load_streaming && (dest_index == load_resident_frames);
+	sample_length = streaming ? load_total_frames : dest_index;
+	sample_head_frames = dest_index;
+	std::atomic_signal_fence(std::memory_order_release);
+	sample_streaming = streaming;
+	if (sample_length == 0)
 	{
+		sample_loaded = false;
+		CloseSampleLoad();
 		LogLine("Load failed: no audio data read");
 		return false;
 	}
-	ApplyLoadedSampleFade(sample_length, sample_rate);
+	const bool scan_complete = (dest_index == load_resident_frames);
+	if (!scan_complete && !sample_streaming)
+	{
+		ApplyLoadedSampleTailFade(sample_length, sample_rate);
+	}
+	WavePyramidFinish(*sample_pyramid, dest_index);
+	sample_loaded = true;
 	trim_start = 0.0f;
 	trim_end = 1.0f;
 	LogLine("Load complete: %lu frames", static_cast<unsigned long>(sample_length));
+	const float peak = PcmLoadScanPeak(load_scan);
+	const float rms = PcmLoadScanRms(load_scan);
+	LogLine("Load levels%s: peak %.1f dBFS, rms %.1f dBFS, dc %+.4f",
+			load_streaming ? " (head)" : "",
+			(peak > 0.0f) ? static_cast<double>(20.0f * log10f(peak)) : -120.0,
+			(rms > 0.0f) ? static_cast<double>(20.0f * log10f(rms)) : -120.0,
+			static_cast<double>(PcmLoadScanDc(load_scan)));
+	LogSamplePool("Load");
 	waveform_from_recording = false;
-	ComputeWaveform();
+	if (scan_complete)
+	{
+		PcmLoadScanFinish(load_scan);
+	}
+	else
+	{
+		ComputeWaveform();
+	}
+	CloseSampleLoad();
+	if (sample_streaming)
+	{
+		BeginWaveformProbe();
+	}
+	if (scan_complete && !load_streaming)
+	{
+		const int32_t level = (-load_scan.level_min > load_scan.level_max) ? -load_scan.level_min : load_scan.level_max;
+		WriteOverviewFromSample(load_file_index, static_cast<uint16_t>((level > 32767) ? 32767 : level));
+	}
 	waveform_ready = true;
 	waveform_dirty = true;
 	UpdateTrimFrames();
 	return true;
 }
 
-static bool LoadSampleAtIndex(int32_t index)
+// Reads chunks for up to kLoadStepBudgetMs, publishing each one to the
+// voices, and finishes the load once the resident part is in.
+static bool StepSampleLoad(bool& done)
+{
+	done = false;
+	if (!load_file_open)
+	{
+		return false;
+	}
+	FIL* file = &wav_file;
+	uint8_t* const read_area = load_chunk_buf + kLoadCarryBytes;
+	const uint32_t start_ms = System::GetNow();
+	bool finished = false;
+	while (!finished)
+	{
+		const size_t bytes_needed = (load_resident_frames - load_dest_index) * load_frame_bytes - load_carry;
+		const size_t bytes_to_read = (load_next_read_bytes < bytes_needed) ? load_next_read_bytes : bytes_needed;
+		load_next_read_bytes = kLoadChunkBytes;
+		UINT bytes_read = 0;
+		const uint32_t read_start_us = System::GetUs();
+		const FRESULT res = SdCachedRead(file, read_area, bytes_to_read, &bytes_read);
+		load_read_us += System::GetUs() - read_start_us;
+		if (res != FR_OK
+			|| bytes_read == 0)
+		{
+			LogLine("Load read error %s (%d) at %lu frames",
+					FresultName(res),
+					static_cast<int>(res),
+					static_cast<unsigned long>(load_dest_index));
+			LogLine("f_error=%u f_eof=%u", static_cast<unsigned>(f_error(file)), static_cast<unsigned>(f_eof(file)));
+			LogSdCardStatus();
+			finished = true;
+			break;
+		}
+		const uint8_t* chunk = read_area - load_carry;
+		const size_t chunk_bytes = load_carry + bytes_read;
+		const size_t frames_read = chunk_bytes / load_frame_bytes;
+		const size_t frames_kept = (frames_read < load_resident_frames - load_dest_index)
+			? frames_read
+			: (load_resident_frames - load_dest_index);
+		PcmLoadScanFrames(load_scan,
+						  reinterpret_cast<const int16_t*>(chunk),
+						  load_dest_index,
+						  frames_kept,
+						  load_channels,
+						  sample_buffer_l + load_dest_index,
+						  sample_buffer_r + load_dest_index);
+		load_dest_index += frames_kept;
+		load_carry = chunk_bytes - (frames_read * load_frame_bytes);
+		if (load_carry > 0)
+		{
+			std::memmove(read_area - load_carry, chunk + (frames_read * load_frame_bytes), load_carry);
+		}
+		finished = (load_dest_index >= load_resident_frames) || (bytes_read < bytes_to_read);
+		if (load_dest_index >= kLoadPlayableFrames)
+		{
+			std::atomic_signal_fence(std::memory_order_release);
+			sample_head_frames = load_dest_index;
+			sample_loaded = true;
+		}
+		const int32_t percent = static_cast<int32_t>(
+			(load_dest_index * 100U) / load_resident_frames);
+		if (percent >= load_last_percent + kLoadProgressStep || percent == 100)
+		{
+			LogLine("Load progress: %ld%%", static_cast<long>(percent));
+			load_last_percent = percent;
+		}
+		if ((System::GetNow() - start_ms) >= kLoadStepBudgetMs)
+		{
+			break;
+		}
+	}
+	if (!finished)
+	{
+		return true;
+	}
+	done = true;
+	return FinishSampleLoad();
+}
+
+static bool BeginLoadSampleAtIndex(int32_t index)
 {
 	if (!BSP_SD_IsDetected())
 	{
@@ -2973,73 +5647,159 @@ static bool LoadSampleAtIndex(int32_t index)
 		LogLine("SD init: %u", static_cast<unsigned>(init_res));
 		MountSd();
 	}
-	if (!sd_mounted)
+	if (!sd_mounted)
+	{
+		LogLine("Load failed: SD not mounted");
+		return false;
+	}
+	if (BSP_SD_GetCardState() != SD_TRANSFER_OK)
+	{
+		LogLine("Load failed: SD not ready");
+		return false;
+	}
+	if (BrowseFileRecord(index) < 0)
+	{
+		LogLine("Load failed: invalid index %ld", static_cast<long>(index));
+		return false;
+	}
+	const int32_t record = BrowseFileRecord(index);
+	const char* rel_path = LibraryPath(record);
+	char path[kSamplePathLen];
+	BuildFilePath(rel_path, path, sizeof(path));
+	CopyString(loaded_sample_name, LibraryBaseName(rel_path), kMaxWavNameLen);
+	LogLine("Load request: %s", rel_path);
+	CancelOverviewJob();
+	load_file_index = record;
+	return BeginSampleLoad(path);
+}
+
+static void StopPreview()
+{
+	preview_active = false;
+	preview_hold = false;
+	preview_index = -1;
+	preview_read_frac = 0.0f;
+	preview_read_index = 0;
+	preview_write_index = 0;
+	if (preview_file_open)
+	{
+		f_close(&preview_file);
+		preview_file_open = false;
+	}
+}
+
+// Opens a WAV for preview and seeks to the offset for step.
+static bool OpenPreviewWav(FIL* file, const char* path, int32_t step, PreviewHead& info)
+{
+	const FRESULT open_res = f_open(file, path, FA_READ);
+	if (open_res != FR_OK)
+	{
+		LogLine("Preview failed: f_open %s (%d)", FresultName(open_res), (int)open_res);
+		return false;
+	}
+	WavInfo wav;
+	bool ok = ParseWavHeader(file, wav);
+	if (ok && wav.bits_per_sample != 16)
+	{
+		LogLine("Preview failed: unsupported bit depth %u", (unsigned)wav.bits_per_sample);
+		ok = false;
+	}
+	else if (ok && (wav.num_channels < 1 || wav.num_channels > 2))
 	{
-		LogLine("Load failed: SD not mounted");
-		return false;
+		LogLine("Preview failed: unsupported channel count %u", (unsigned)wav.num_channels);
+		ok = false;
 	}
-	if (BSP_SD_GetCardState() != SD_TRANSFER_OK)
+	uint32_t frames = 0;
+	const uint32_t frame_bytes = wav.num_channels * sizeof(int16_t);
+	if (ok)
 	{
-		LogLine("Load failed: SD not ready");
-		return false;
+		uint32_t data_size = wav.data_size;
+		if (static_cast<FSIZE_t>(data_size) > f_size(file) - wav.data_offset)
+		{
+			data_size = static_cast<uint32_t>(f_size(file) - wav.data_offset);
+		}
+		frames = data_size / frame_bytes;
+		if (frames == 0)
+		{
+			LogLine("Preview failed: no data frames");
+			ok = false;
+		}
 	}
-	if (index < 0 || index >= wav_file_count)
+	if (ok)
 	{
-		LogLine("Load failed: invalid index %ld", static_cast<long>(index));
-		return false;
+		const uint32_t start = static_cast<uint32_t>(
+			(static_cast<uint64_t>(frames) * static_cast<uint32_t>(step)) / kPreviewOffsetSteps);
+		info.step = step;
+		info.sample_rate = wav.sample_rate;
+		info.channels = wav.num_channels;
+		info.loop_pos = wav.data_offset + start * frame_bytes;
+		info.data_end = wav.data_offset + frames * frame_bytes;
+		const FRESULT seek_res = f_lseek(file, info.loop_pos);
+		if (seek_res != FR_OK)
+		{
+			LogLine("Preview failed: f_lseek %s (%d)", FresultName(seek_res), (int)seek_res);
+			ok = false;
+		}
 	}
-	char path[64];
-	BuildFilePath(wav_files[index], path, sizeof(path));
-	CopyString(loaded_sample_name, wav_files[index], kMaxWavNameLen);
-	LogLine("Load request: %s", loaded_sample_name);
-	return LoadSampleFromPath(path);
+	if (!ok)
+	{
+		f_close(file);
+	}
+	return ok;
 }
 
-static bool ApplyTrackSampleState(int32_t track)
+// Reads up to max_frames interleaved frames into preview_read_buf, wrapping
+// to the loop position at the end of the data chunk.
+static bool ReadPreviewChunk(FIL* file, const PreviewHead& info, size_t max_frames, size_t& frames_read)
 {
-	if (track < 0 || track >= kPlayTrackCount)
+	frames_read = 0;
+	const size_t frame_bytes = info.channels * sizeof(int16_t);
+	FSIZE_t pos = f_tell(file);
+	if (pos >= info.data_end)
 	{
-		return false;
+		const FRESULT seek_res = f_lseek(file, info.loop_pos);
+		if (seek_res != FR_OK)
+		{
+			LogLine("Preview loop seek failed %s (%d)", FresultName(seek_res), (int)seek_res);
+			return false;
+		}
+		pos = info.loop_pos;
 	}
-	const TrackSampleState& state = track_samples[track];
-	if (!state.loaded || state.name[0] == '\0')
+	size_t frames = static_cast<size_t>(info.data_end - pos) / frame_bytes;
+	if (frames > max_frames)
 	{
-		sample_loaded = false;
-		sample_length = 0;
-		loaded_sample_name[0] = '\0';
-		waveform_ready = false;
-		waveform_dirty = true;
-		request_length_redraw = true;
-		return false;
+		frames = max_frames;
 	}
-	char path[64];
-	BuildFilePath(state.name, path, sizeof(path));
-	CopyString(loaded_sample_name, state.name, kMaxWavNameLen);
-	if (!LoadSampleFromPath(path))
+	UINT bytes_read = 0;
+	const FRESULT res = SdCachedRead(file, preview_read_buf, frames * frame_bytes, &bytes_read);
+	if (res != FR_OK || bytes_read < frame_bytes)
 	{
+		LogLine("Preview read error %s (%d)", FresultName(res), (int)res);
 		return false;
 	}
-	trim_start = state.trim_start;
-	trim_end = state.trim_end;
-	UpdateTrimFrames();
-	waveform_dirty = true;
-	request_length_redraw = true;
+	frames_read = bytes_read / frame_bytes;
 	return true;
 }
 
-static void StopPreview()
+static int32_t FindPreviewHead(int32_t record, int32_t step)
 {
-	preview_active = false;
-	preview_hold = false;
-	preview_index = -1;
-	preview_read_frac = 0.0f;
-	preview_read_index = 0;
-	preview_write_index = 0;
-	if (preview_file_open)
+	for (int32_t i = 0; i < kPreviewHeadCount; ++i)
 	{
-		f_close(&preview_file);
-		preview_file_open = false;
+		if (preview_heads[i].record == record && preview_heads[i].step == step)
+		{
+			return i;
+		}
 	}
+	return -1;
+}
+
+static void ApplyPreviewInfo(const PreviewHead& info)
+{
+	preview_info = info;
+	preview_sample_rate = info.sample_rate;
+	preview_channels = info.channels;
+	const uint32_t rate = (info.sample_rate == 0) ? 48000 : info.sample_rate;
+	preview_rate = static_cast<float>(rate) / hw.AudioSampleRate();
 }
 
 static bool BeginPreviewAtIndex(int32_t index)
@@ -3071,66 +5831,66 @@ static bool BeginPreviewAtIndex(int32_t index)
 		LogLine("Preview failed: SD not ready");
 		return false;
 	}
-	if (index < 0 || index >= wav_file_count)
+	const int32_t record = BrowseFileRecord(index);
+	if (record < 0)
 	{
 		LogLine("Preview failed: invalid index %ld", static_cast<long>(index));
 		return false;
 	}
-	char path[64];
-	BuildFilePath(wav_files[index], path, sizeof(path));
-	LogLine("Preview request: %s", wav_files[index]);
+	const char* rel_path = LibraryPath(record);
+	char path[kSamplePathLen];
+	BuildFilePath(rel_path, path, sizeof(path));
+	LogLine("Preview request: %s", rel_path);
 
+	preview_active = false;
 	if (preview_file_open)
 	{
 		f_close(&preview_file);
 		preview_file_open = false;
 	}
-	const FRESULT open_res = f_open(&preview_file, path, FA_READ);
-	if (open_res != FR_OK)
-	{
-		LogLine("Preview failed: f_open %s (%d)", FresultName(open_res), (int)open_res);
-		return false;
-	}
-	preview_file_open = true;
-
-	WavInfo wav;
-	if (!ParseWavHeader(&preview_file, wav))
-	{
-		f_close(&preview_file);
-		preview_file_open = false;
-		return false;
+	const int32_t step = preview_offset_step;
+	const int32_t slot = FindPreviewHead(record, step);
+	size_t head_frames = 0;
+	preview_read_frac = 0.0f;
+	preview_read_index = 0;
+	if (slot >= 0 && preview_heads[slot].frames > 0)
+	{
+		// The cached head starts playing while the file is reopened.
+		head_frames = preview_heads[slot].frames;
+		std::memcpy(preview_buffer_l, preview_head_l[slot], head_frames * sizeof(int16_t));
+		std::memcpy(preview_buffer_r, preview_head_r[slot], head_frames * sizeof(int16_t));
+		ApplyPreviewInfo(preview_heads[slot]);
+		std::atomic_signal_fence(std::memory_order_release);
+		preview_write_index = head_frames;
+		preview_index = index;
+		preview_active = true;
 	}
-	if (wav.bits_per_sample != 16)
+	else
 	{
-		LogLine("Preview failed: unsupported bit depth %u", (unsigned)wav.bits_per_sample);
-		f_close(&preview_file);
-		preview_file_open = false;
-		return false;
+		preview_write_index = 0;
 	}
-	if (wav.num_channels < 1 || wav.num_channels > 2)
+
+	PreviewHead info;
+	if (!OpenPreviewWav(&preview_file, path, step, info))
 	{
-		LogLine("Preview failed: unsupported channel count %u", (unsigned)wav.num_channels);
-		f_close(&preview_file);
-		preview_file_open = false;
 		return false;
 	}
-	preview_sample_rate = wav.sample_rate;
-	preview_channels = wav.num_channels;
-	const uint32_t rate = (preview_sample_rate == 0) ? 48000 : preview_sample_rate;
-	preview_rate = static_cast<float>(rate) / hw.AudioSampleRate();
-	preview_data_offset = wav.data_offset;
-	FRESULT seek_res = f_lseek(&preview_file, preview_data_offset);
-	if (seek_res != FR_OK)
+	preview_file_open = true;
+	if (head_frames > 0)
 	{
-		LogLine("Preview failed: f_lseek %s (%d)", FresultName(seek_res), (int)seek_res);
-		f_close(&preview_file);
-		preview_file_open = false;
-		return false;
+		// Heads wrap on files shorter than the head, so resume modulo the loop.
+		const uint32_t frame_bytes = info.channels * sizeof(int16_t);
+		const uint32_t loop_bytes = info.data_end - info.loop_pos;
+		const uint32_t resume = info.loop_pos
+			+ static_cast<uint32_t>((head_frames * frame_bytes) % loop_bytes);
+		const FRESULT seek_res = f_lseek(&preview_file, resume);
+		if (seek_res != FR_OK)
+		{
+			LogLine("Preview failed: f_lseek %s (%d)", FresultName(seek_res), (int)seek_res);
+			return false;
+		}
 	}
-
-	preview_read_frac = 0.0f;
-	preview_read_index = 0;
-	preview_write_index = 0;
+	ApplyPreviewInfo(info);
 	preview_index = index;
 	preview_active = true;
 	return true;
@@ -3162,6 +5922,7 @@ static void FillPreviewBuffer()
 		return;
 	}
 	const uint32_t start_ms = System::GetNow();
+	const uint16_t channels = preview_info.channels;
 	while (true)
 	{
 		const size_t read_idx = preview_read_index;
@@ -3172,44 +5933,21 @@ static void FillPreviewBuffer()
 			break;
 		}
 		const size_t frames_to_read = (free_frames > kPreviewReadFrames) ? kPreviewReadFrames : free_frames;
-		const size_t bytes_to_read = frames_to_read * preview_channels * sizeof(int16_t);
-		UINT bytes_read = 0;
-		FRESULT res = f_read(&preview_file, preview_read_buf, bytes_to_read, &bytes_read);
-		if (res != FR_OK)
+		size_t frames_read = 0;
+		if (!ReadPreviewChunk(&preview_file, preview_info, frames_to_read, frames_read))
 		{
-			LogLine("Preview read error %s (%d)", FresultName(res), (int)res);
 			StopPreview();
 			return;
 		}
-		if (bytes_read == 0)
-		{
-			FRESULT seek_res = f_lseek(&preview_file, preview_data_offset);
-			if (seek_res != FR_OK)
-			{
-				LogLine("Preview loop seek failed %s (%d)", FresultName(seek_res), (int)seek_res);
-				StopPreview();
-				return;
-			}
-			continue;
-		}
-		const size_t frames_read = bytes_read / (preview_channels * sizeof(int16_t));
 		size_t w = write_idx;
 		for (size_t i = 0; i < frames_read; ++i)
 		{
-			int32_t mono = 0;
-			if (preview_channels == 1)
-			{
-				mono = preview_read_buf[i];
-			}
-			else
-			{
-				const int16_t l = preview_read_buf[i * 2];
-				const int16_t r = preview_read_buf[i * 2 + 1];
-				mono = (static_cast<int32_t>(l) + static_cast<int32_t>(r)) / 2;
-			}
-			preview_buffer[w] = static_cast<int16_t>(mono);
+			const int16_t l = preview_read_buf[i * channels];
+			preview_buffer_l[w] = l;
+			preview_buffer_r[w] = (channels == 2) ? preview_read_buf[i * 2 + 1] : l;
 			w = (w + 1) % kPreviewBufferFrames;
 		}
+		std::atomic_signal_fence(std::memory_order_release);
 		preview_write_index = w;
 		if ((System::GetNow() - start_ms) >= kPreviewReadBudgetMs)
 		{
@@ -3218,7 +5956,93 @@ static void FillPreviewBuffer()
 	}
 }
 
-static bool DeleteFileAtIndex(int32_t index)
+// Reads the head of record at step into slot. Failures are cached as empty
+// heads so a bad file is not retried on every pass.
+static void FetchPreviewHead(int32_t slot, int32_t record, int32_t step)
+{
+	PreviewHead& head = preview_heads[slot];
+	head.record = record;
+	head.step = step;
+	head.frames = 0;
+	char path[kSamplePathLen];
+	BuildFilePath(LibraryPath(record), path, sizeof(path));
+	if (!OpenPreviewWav(&preview_file, path, step, head))
+	{
+		return;
+	}
+	size_t frames = 0;
+	while (frames < kPreviewHeadFrames)
+	{
+		const size_t want = kPreviewHeadFrames - frames;
+		size_t frames_read = 0;
+		if (!ReadPreviewChunk(&preview_file, head, (want > kPreviewReadFrames) ? kPreviewReadFrames : want, frames_read))
+		{
+			f_close(&preview_file);
+			return;
+		}
+		for (size_t i = 0; i < frames_read; ++i, ++frames)
+		{
+			const int16_t l = preview_read_buf[i * head.channels];
+			preview_head_l[slot][frames] = l;
+			preview_head_r[slot][frames] = (head.channels == 2) ? preview_read_buf[i * 2 + 1] : l;
+		}
+	}
+	f_close(&preview_file);
+	head.frames = frames;
+}
+
+// Prefetches one missing head per pass once the cursor has rested: the
+// selected entry first, then the entries below and above it.
+static void UpdatePreviewHeads(int32_t selected)
+{
+	const uint32_t now = System::GetNow();
+	const int32_t step = preview_offset_step;
+	if (selected != preview_hover_selected || step != preview_hover_step)
+	{
+		preview_hover_selected = selected;
+		preview_hover_step = step;
+		preview_hover_since_ms = now;
+		return;
+	}
+	const int32_t count = wav_file_count;
+	if ((now - preview_hover_since_ms) < kPreviewHoverMs || count <= 0 || preview_file_open)
+	{
+		return;
+	}
+	int32_t wanted[kPreviewHeadCount];
+	for (int32_t i = 0; i < kPreviewHeadCount; ++i)
+	{
+		const int32_t delta = ((i + 1) / 2) * ((i & 1) ? 1 : -1);
+		int32_t list = (selected + delta) % count;
+		list = (list < 0) ? list + count : list;
+		wanted[i] = BrowseFileRecord(list);
+	}
+	for (int32_t i = 0; i < kPreviewHeadCount; ++i)
+	{
+		if (wanted[i] < 0 || FindPreviewHead(wanted[i], step) >= 0)
+		{
+			continue;
+		}
+		int32_t slot = 0;
+		for (int32_t s = 0; s < kPreviewHeadCount; ++s)
+		{
+			bool keep = false;
+			for (int32_t j = 0; j < kPreviewHeadCount; ++j)
+			{
+				keep = keep || (preview_heads[s].record == wanted[j] && preview_heads[s].step == step);
+			}
+			if (!keep)
+			{
+				slot = s;
+				break;
+			}
+		}
+		FetchPreviewHead(slot, wanted[i], step);
+		return;
+	}
+}
+
+static bool DeleteFileAtIndex(int32_t index, const char* expected_path)
 {
 	if (!BSP_SD_IsDetected())
 	{
@@ -3247,21 +6071,42 @@ static bool DeleteFileAtIndex(int32_t index)
 		LogLine("Delete failed: SD not ready");
 		return false;
 	}
-	if (index < 0 || index >= wav_file_count)
+	if (BrowseFileRecord(index) < 0)
 	{
 		LogLine("Delete failed: invalid index %ld", static_cast<long>(index));
 		return false;
 	}
-	char path[64];
-	BuildFilePath(wav_files[index], path, sizeof(path));
-	LogLine("Delete request: %s", wav_files[index]);
+	const int32_t record = BrowseFileRecord(index);
+	char rel_path[kLibraryPathLen];
+	CopyString(rel_path, LibraryPath(record), sizeof(rel_path));
+	if (expected_path[0] == '\0' || std::strcmp(rel_path, expected_path) != 0)
+	{
+		LogLine("Delete failed: list changed, expected %s", expected_path);
+		return false;
+	}
+	char path[kSamplePathLen];
+	BuildFilePath(rel_path, path, sizeof(path));
+	LogLine("Delete request: %s", rel_path);
+	CancelOverviewJob();
+	if (library_sync_active)
+	{
+		CancelLibrarySync();
+		library_synced = false;
+	}
+	CancelWaveformProbe();
+	CloseIdleStreamFiles();
 	const FRESULT res = f_unlink(path);
 	if (res != FR_OK)
 	{
 		LogLine("Delete failed: f_unlink %s (%d)", FresultName(res), (int)res);
 		return false;
 	}
-	LogLine("Delete OK: %s", wav_files[index]);
+	LogLine("Delete OK: %s", rel_path);
+	SdCacheInvalidate();
+	BuildOverviewPath(rel_path, path, sizeof(path));
+	f_unlink(path);
+	LibraryRemoveAt(record);
+	ClampLoadSelection();
 	return true;
 }
 
@@ -3470,10 +6315,10 @@ static float FxWetValue(int32_t fx_index)
 {
 	switch (fx_index)
 	{
-		case kFxSatIndex: return fx_s_wet;
-		case kFxChorusIndex: return fx_c_wet;
-		case kFxDelayIndex: return delay_wet;
-		case kFxReverbIndex: return reverb_wet;
+		case kFxSatIndex: return fx_params.fx_s_wet;
+		case kFxChorusIndex: return fx_params.fx_c_wet;
+		case kFxDelayIndex: return fx_params.delay_wet;
+		case kFxReverbIndex: return fx_params.reverb_wet;
 		default: return 0.0f;
 	}
 }
@@ -3490,15 +6335,15 @@ static float FxWetStep(int32_t fx_index)
 	}
 }
 
-static volatile float* FxWetTarget(int32_t fx_index)
+static float* FxWetTarget(int32_t fx_index)
 {
 	switch (fx_index)
 	{
-		case kFxSatIndex: return &fx_s_wet;
-		case kFxChorusIndex: return &fx_c_wet;
-		case kFxDelayIndex: return &delay_wet;
-		case kFxReverbIndex: return &reverb_wet;
-		default: return &fx_s_wet;
+		case kFxSatIndex: return &fx_params.fx_s_wet;
+		case kFxChorusIndex: return &fx_params.fx_c_wet;
+		case kFxDelayIndex: return &fx_params.delay_wet;
+		case kFxReverbIndex: return &fx_params.reverb_wet;
+		default: return &fx_params.fx_s_wet;
 	}
 }
 
@@ -3721,7 +6566,8 @@ static void DrawPerformScreen(int32_t selected,
 				for (int v = 0; v < kPerformVoiceCount; ++v)
 				{
 					const auto& voice = perform_voices[v];
-					if (voice.active && voice.length > 0)
+					// Other PLAY tracks' voices do not belong on this waveform.
+					if (voice.active && voice.length > 0 && voice.sample.l == sample_buffer_l)
 					{
 						const float pos = static_cast<float>(voice.offset) + voice.phase;
 						norm = pos / static_cast<float>(sample_length - 1);
@@ -3790,7 +6636,7 @@ static void DrawPerformScreen(int32_t selected,
 		if (i == kPerformAmpIndex)
 		{
 			const char* labels[kPerformFaderCount] = {"A", "D", "S", "R"};
-			const float values[kPerformFaderCount] = {amp_attack, amp_decay, amp_sustain, amp_release};
+			const float values[kPerformFaderCount] = {fx_params.amp_attack, fx_params.amp_decay, fx_params.amp_sustain, fx_params.amp_release};
 			draw_faders(box,
 						is_selected,
 						labels,
@@ -3803,7 +6649,7 @@ static void DrawPerformScreen(int32_t selected,
 		if (i == kPerformFltIndex)
 		{
 			const char* labels[kPerformFltFaderCount] = {"C", "R"};
-			const float values[kPerformFltFaderCount] = {flt_cutoff, flt_res};
+			const float values[kPerformFltFaderCount] = {fx_params.flt_cutoff, fx_params.flt_res};
 			draw_faders(box,
 						is_selected,
 						labels,
@@ -3884,6 +6730,68 @@ static void DrawLoadMessage(const char* line1, const char* line2)
 	display.Update();
 }
 
+// Selected file's sidecar overview below the list; a dotted midline
+// until one is available.
+// Dashed column at the preview start offset, so it shows over the waveform.
+static void DrawLoadOffsetMarker(int top, int bottom)
+{
+	const int32_t step = preview_offset_step;
+	if (step <= 0)
+	{
+		return;
+	}
+	const int x = (step * static_cast<int>(display.Width())) / kPreviewOffsetSteps;
+	for (int y = top; y <= bottom; ++y)
+	{
+		const bool on = ((y - top) & 1) == 0;
+		display.DrawPixel(x, y, on);
+	}
+}
+
+static void DrawLoadOverviewStrip(int y0, int32_t selected)
+{
+	const int width = static_cast<int>(display.Width());
+	const int y1 = static_cast<int>(display.Height()) - 1;
+	display.DrawLine(0, y0, width - 1, y0, true);
+	const int top = y0 + 2;
+	const int height = y1 - top + 1;
+	const int mid = top + height / 2;
+	if (height < 2)
+	{
+		return;
+	}
+	// Folders have no overview; the strip reports what the index left out.
+	if (selected < 0 && library_header.skipped > 0)
+	{
+		char note[24];
+		snprintf(note, sizeof(note), "%lu NOT INDEXED", static_cast<unsigned long>(library_header.skipped));
+		DrawTinyString(note, 0, mid - Font5x7::H / 2, true);
+		return;
+	}
+	if (load_overview_index != selected)
+	{
+		for (int x = 0; x < width; x += 4)
+		{
+			display.DrawPixel(x, mid, true);
+		}
+		DrawLoadOffsetMarker(top, y1);
+		return;
+	}
+	constexpr int32_t kStripLevel = 1;
+	const size_t bins = kWaveOverviewBins >> kStripLevel;
+	const size_t offset = WaveOverviewLevelOffset(kStripLevel);
+	for (int x = 0; x < width; ++x)
+	{
+		const size_t bin = offset + (static_cast<size_t>(x) * bins) / static_cast<size_t>(width);
+		int ya = mid - (static_cast<int>(load_overview.hi[bin]) * (height / 2)) / 32768;
+		int yb = mid - (static_cast<int>(load_overview.lo[bin]) * (height / 2)) / 32768;
+		ya = (ya < top) ? top : ya;
+		yb = (yb > y1) ? y1 : yb;
+		display.DrawLine(x, ya, x, yb, true);
+	}
+	DrawLoadOffsetMarker(top, y1);
+}
+
 static void DrawLoadMenu(int32_t top_index, int32_t selected)
 {
 	const FontDef font = Font_6x8;
@@ -3907,7 +6815,15 @@ static void DrawLoadMenu(int32_t top_index, int32_t selected)
 	 }
 	if (wav_file_count == 0)
 	{
-		if (delete_mode)
+		if (library_sync_active)
+		{
+			DrawLoadMessage("INDEXING", "CARD");
+		}
+		else if (library_header.skipped > 0)
+		{
+			DrawLoadMessage("PATHS TOO", "LONG");
+		}
+		else if (delete_mode)
 		{
 			DrawLoadMessage("NO", "FILES");
 		}
@@ -3922,7 +6838,8 @@ static void DrawLoadMenu(int32_t top_index, int32_t selected)
 	{
 		top_index = 0;
 	}
-	int32_t max_top = wav_file_count - load_lines;
+	const int32_t visible_lines = LoadVisibleLines();
+	int32_t max_top = wav_file_count - visible_lines;
 	if (max_top < 0)
 	{
 		max_top = 0;
@@ -3932,7 +6849,6 @@ static void DrawLoadMenu(int32_t top_index, int32_t selected)
 		top_index = max_top;
 	}
 
-	const int32_t visible_lines = LoadVisibleLines();
 	for (int32_t i = 0; i < visible_lines; ++i)
 	{
 		const int32_t idx = top_index + i;
@@ -3951,7 +6867,18 @@ static void DrawLoadMenu(int32_t top_index, int32_t selected)
 							 true,
 							 true);
 		}
-		DrawScaledString(wav_files[idx],
+		// "< NAME" leads back out of folder NAME; folders end in '/'.
+		char label[kLibraryPathLen + 2];
+		const int32_t record = BrowseRecord(idx);
+		if (record < 0)
+		{
+			snprintf(label, sizeof(label), "< %s", LibraryBaseName(LibraryPath(BrowseFolder())));
+		}
+		else
+		{
+			snprintf(label, sizeof(label), "%s%s", LibraryBaseName(LibraryPath(record)), (idx < browse_folder_entries) ? "/" : "");
+		}
+		DrawScaledString(label,
 						 0,
 						 y,
 						 font,
@@ -3959,6 +6886,10 @@ static void DrawLoadMenu(int32_t top_index, int32_t selected)
 						 !is_selected,
 						 load_chars_per_line);
 	}
+	if (!delete_mode && visible_lines < load_lines)
+	{
+		DrawLoadOverviewStrip(visible_lines * load_line_height, BrowseFileRecord(selected));
+	}
 	display.Update();
 }
 
@@ -4449,23 +7380,6 @@ static void DrawRecordArmed()
 	DrawRecordReadyScreen();
 }
 
-static inline int ClampI(int v, int lo, int hi);
-
-static int BitResoIndexFromValue(float value)
-{
-	if (value < 0.0f)
-	{
-		value = 0.0f;
-	}
-	else if (value > 1.0f)
-	{
-		value = 1.0f;
-	}
-	const int max_idx = kBitResoStepCount - 1;
-	const int idx = static_cast<int>(value * static_cast<float>(max_idx) + 0.5f);
-	return ClampI(idx, 0, max_idx);
-}
-
 static float BitResoValueFromIndex(int idx)
 {
 	const int max_idx = kBitResoStepCount - 1;
@@ -4474,12 +7388,33 @@ static float BitResoValueFromIndex(int idx)
 
 static void StartRecording()
 {
+	if (record_buffer == nullptr)
+	{
+		LogLine("Record: no sample memory");
+		record_state = RecordState::Armed;
+		return;
+	}
+	record_replaced_l = sample_pool_l;
+	record_replaced_r = sample_pool_r;
+	sample_pool_l = record_pool_handle;
+	sample_pool_r = -1;
+	record_pool_handle = -1;
+	sample_buffer_l = record_buffer;
+	sample_buffer_r = record_buffer;
+	record_buffer = nullptr;
+	record_buffer_swapped = true;
+	record_trim_pending = true;
 	record_pos = 0;
 	sample_length = 0;
 	sample_loaded = false;
+	sample_streaming = false;
+	sample_head_frames = 0;
 	perform_attack_norm = 0.0f;
 	perform_release_norm = 0.0f;
-	ResetPerformVoices();
+	// Called from the audio callback: clear the voices here and leave the
+	// allocator and the rings to the main loop.
+	ClearPerformVoices();
+	request_voice_reset = true;
 	playback_active = false;
 	sample_channels = 1;
 	sample_rate = 48000;
@@ -4494,10 +7429,55 @@ static void StartRecording()
 	live_wave_last_col = -1;
 	live_wave_peak = 1;
 	live_wave_dirty = true;
+	WavePyramidBegin(*sample_pyramid);
 	record_state = RecordState::Recording;
 	LogLine("Record: start (monitor ON)");
 }
 
+// Main loop side of the record buffer handoff.
+static void UpdateRecordBuffer()
+{
+	if (record_buffer_swapped)
+	{
+		record_buffer_swapped = false;
+		sample_pool.Free(record_replaced_l);
+		sample_pool.Free(record_replaced_r);
+		record_replaced_l = -1;
+		record_replaced_r = -1;
+	}
+	if (record_trim_pending && record_state != RecordState::Recording)
+	{
+		record_trim_pending = false;
+		const int32_t handle = (current_sample_context == SampleContext::Play)
+			? sample_pool_l
+			: play_sample_state.pool_l;
+		if (record_pos > 0)
+		{
+			sample_pool.Shrink(handle, record_pos * sizeof(int16_t));
+		}
+		LogSamplePool("Record");
+	}
+	if (ui_mode == UiMode::Record)
+	{
+		if (record_pool_handle < 0 && record_state != RecordState::Recording)
+		{
+			const int32_t handle = AllocateSampleBlock(kRecordMaxFrames * sizeof(int16_t));
+			if (handle >= 0)
+			{
+				record_pool_handle = handle;
+				std::atomic_signal_fence(std::memory_order_release);
+				record_buffer = sample_pool.Ptr(handle);
+			}
+		}
+	}
+	else if (record_pool_handle >= 0)
+	{
+		record_buffer = nullptr;
+		sample_pool.Free(record_pool_handle);
+		record_pool_handle = -1;
+	}
+}
+
 static void DrawRecordCountdown()
 {
 	const FontDef font = Font_6x8;
@@ -4666,6 +7646,84 @@ static void DrawShiftMenu(int32_t selected)
 	display.Update();
 }
 
+// Load per callback stage as a percentage of the block deadline, from the
+// last finished profile window.
+static void DrawCpuLoadScreen()
+{
+	const FontDef font = Font_6x8;
+	const int line_h = 7;
+	display.Fill(false);
+#if WAVECONT_PROFILE
+	char buf[24];
+	display.SetCursor(0, 0);
+	display.WriteString("CPU%  AVG P99 MAX", font, true);
+	if (profile_shown_valid)
+	{
+		for (int i = 0; i < kProfileStageCount; ++i)
+		{
+			float min_pct = 0.0f;
+			float avg_pct = 0.0f;
+			float p99_pct = 0.0f;
+			float max_pct = 0.0f;
+			ProfileStageLoads(profile_shown, static_cast<ProfileStage>(i), min_pct, avg_pct, p99_pct, max_pct);
+			snprintf(buf,
+					 sizeof(buf),
+					 "%s  %4d%4d%4d",
+					 kProfileStageNames[i],
+					 static_cast<int>(avg_pct + 0.5f),
+					 static_cast<int>(p99_pct + 0.5f),
+					 static_cast<int>(max_pct + 0.5f));
+			display.SetCursor(0, (i + 1) * line_h);
+			display.WriteString(buf, font, true);
+		}
+		snprintf(buf,
+				 sizeof(buf),
+				 "OVR %lu/%lu",
+				 static_cast<unsigned long>(profile_shown.overruns),
+				 static_cast<unsigned long>(profile_shown.blocks));
+		display.SetCursor(0, (kProfileStageCount + 1) * line_h);
+		display.WriteString(buf, font, true);
+	}
+#else
+	display.SetCursor(0, 0);
+	display.WriteString("PROFILER OFF", font, true);
+	(void)line_h;
+#endif
+	display.Update();
+}
+
+static void LogProfileReport()
+{
+#if WAVECONT_PROFILE
+	if (!profile_shown_valid)
+	{
+		LogLine("Profile: no window yet");
+		return;
+	}
+	const float us_per_tick = 1e6f / ProfileTicksPerSecond();
+	LogLine("Profile: blocks=%lu overruns=%lu budget=%.1fus",
+			static_cast<unsigned long>(profile_shown.blocks),
+			static_cast<unsigned long>(profile_shown.overruns),
+			static_cast<float>(profile_shown.budget_ticks) * us_per_tick);
+	for (int i = 0; i < kProfileStageCount; ++i)
+	{
+		float min_pct = 0.0f;
+		float avg_pct = 0.0f;
+		float p99_pct = 0.0f;
+		float max_pct = 0.0f;
+		ProfileStageLoads(profile_shown, static_cast<ProfileStage>(i), min_pct, avg_pct, p99_pct, max_pct);
+		LogLine("Profile: %s min=%.1f%% avg=%.1f%% p99=%.1f%% max=%.1f%%",
+				kProfileStageNames[i],
+				min_pct,
+				avg_pct,
+				p99_pct,
+				max_pct);
+	}
+#else
+	LogLine("Profile: built with WAVECONT_PROFILE=0");
+#endif
+}
+
 static void DrawSdInitScreen()
 {
 	const FontDef font = Font_6x8;
@@ -4729,81 +7787,75 @@ static void DrawSaveScreen()
 		}
 		DrawProgressBar(bar_x, bar_y, bar_w, bar_h, percent);
 	}
-	display.Update();
-}
-
-static inline int ClampI(int v, int lo, int hi)
-{
-	return (v < lo) ? lo : (v > hi ? hi : v);
-}
-
-static float AmpEnvMsFromFader(float value)
-{
-	if (value < 0.0f)
-	{
-		value = 0.0f;
-	}
-	else if (value > 1.0f)
-	{
-		value = 1.0f;
-	}
-	int steps = static_cast<int>(value / kAmpEnvStep + 0.5f);
-	if (steps < 0)
-	{
-		steps = 0;
-	}
-	const int max_steps = static_cast<int>(
-		((kAmpEnvMaxMs - kAmpEnvMinMs) / kAmpEnvStepMs) + 0.5f);
-	if (steps > max_steps)
-	{
-		steps = max_steps;
-	}
-	float ms = kAmpEnvMinMs + (static_cast<float>(steps) * kAmpEnvStepMs);
-	if (ms > kAmpEnvMaxMs)
-	{
-		ms = kAmpEnvMaxMs;
-	}
-	return ms;
-}
-
-static float FltCutoffFromFader(float value, float sample_rate)
-{
-	if (value < 0.0f)
-	{
-		value = 0.0f;
-	}
-	else if (value > 1.0f)
-	{
-		value = 1.0f;
-	}
-	const float min_hz = 20.0f;
-	const float max_hz = 20000.0f;
-	const float shaped = sqrtf(value);
-	float hz = min_hz * powf(max_hz / min_hz, shaped);
-	const float nyq = sample_rate * 0.49f;
-	if (hz > nyq)
-	{
-		hz = nyq;
-	}
-	return hz;
+	display.Update();
 }
 
-static float FltQFromFader(float value)
+static void DrawLoadScreen()
 {
-	if (value < 0.0f)
-	{
-		value = 0.0f;
-	}
-	else if (value > 1.0f)
+	const FontDef font = Font_6x8;
+	display.Fill(false);
+	display.SetCursor(0, 0);
+	display.WriteString("LOADING", font, true);
+	display.SetCursor(0, font.FontHeight + 2);
+	display.WriteString(loaded_sample_name, font, true);
+	const int bar_y = font.FontHeight * 2 + 16;
+	const int bar_w = 96;
+	const int bar_h = 6;
+	const int bar_x = (kDisplayW - bar_w) / 2;
+	int32_t percent = 0;
+	if (load_resident_frames > 0)
+	{
+		percent = static_cast<int32_t>(
+			(load_dest_index * 100U) / load_resident_frames);
+	}
+	DrawProgressBar(bar_x, bar_y, bar_w, bar_h, percent);
+	display.Update();
+}
+
+static void CompleteLoadRequest(bool success, LoadDestination dest)
+{
+	if (success)
 	{
-		value = 1.0f;
+		if (load_context == LoadContext::Track)
+		{
+			StoreTrackSampleState(load_context_track);
+			LogLine("Load success, entering TRACK menu");
+			ui_mode = UiMode::PlayTrack;
+			request_perform_redraw = true;
+		}
+		else if (load_context == LoadContext::Edt)
+		{
+			LogLine("Load success, returning to EDT");
+			ui_mode = UiMode::Edt;
+			if (sample_loaded && sample_length > 0)
+			{
+				waveform_ready = true;
+			}
+			waveform_dirty = true;
+			request_length_redraw = true;
+		}
+		else if (dest == LoadDestination::Perform)
+		{
+			LogLine("Load success, entering PERFORM menu");
+			ui_mode = UiMode::Perform;
+			menu_index = 2;
+		}
+		else
+		{
+			LogLine("Load success, entering PLAY menu");
+			ui_mode = UiMode::Play;
+		}
+		load_context = LoadContext::Main;
 	}
-	float q = value * 5.0f;
-	if (q < 0.001f)
+	else
 	{
-		q = 0.001f;
+		LogLine("Load failed");
+		ui_mode = UiMode::Load;
+		if (load_context != LoadContext::Track)
+		{
+			load_context = LoadContext::Main;
+		}
 	}
-	return q;
 }
 
 static constexpr int kPlayTinyW = 3;
@@ -5212,11 +8264,23 @@ static void DrawWaveform()
 	const int text_h = Font_6x8.FontHeight + 1;
 	const int mid = text_h + (H - text_h) / 2;
 
-	int start_x = (int)(trim_start * (W - 1));
-	int end_x   = (int)(trim_end   * (W - 1));
+	// Zoomed EDT views are drawn from the pyramid; everything else uses the
+	// 128-column overview.
+	const bool zoomed = (ui_mode == UiMode::Edt && edt_zoom > 0 && sample_length >= static_cast<size_t>(W));
+	const size_t view_start = zoomed ? edt_view_start : 0;
+	const size_t view_frames = zoomed ? EdtViewFrames() : 0;
+	auto frame_x = [&](float norm)
+	{
+		if(!zoomed)
+			return (int)(norm * (W - 1));
+		const float frame = norm * (float)sample_length - (float)view_start;
+		return (int)(frame * (float)(W - 1) / (float)view_frames);
+	};
 
-	start_x = ClampI(start_x, 0, W - 1);
-	end_x   = ClampI(end_x,   0, W - 1);
+	const int raw_start_x = frame_x(trim_start);
+	const int raw_end_x   = frame_x(trim_end);
+	int start_x = ClampI(raw_start_x, 0, W - 1);
+	int end_x   = ClampI(raw_end_x,   0, W - 1);
 	if(end_x < start_x)
 	{
 		const int tmp = start_x;
@@ -5228,6 +8292,27 @@ static void DrawWaveform()
 	{
 		int top    = mid + waveform_min[x];
 		int bottom = mid + waveform_max[x];
+		if(zoomed)
+		{
+			const size_t f0 = view_start + (view_frames * (size_t)x) / W;
+			size_t f1 = view_start + (view_frames * (size_t)(x + 1)) / W;
+			if(f1 <= f0)
+				f1 = f0 + 1;
+			int16_t lo = 0;
+			int16_t hi = 0;
+			if(WavePyramidRange(*sample_pyramid, sample_buffer_l, f0, f1, lo, hi))
+			{
+				top    = mid + (int)((float)lo * kSampleScale * 28.0f);
+				bottom = mid + (int)((float)hi * kSampleScale * 28.0f);
+			}
+			else
+			{
+				// Past a streamed sample's head: fall back to the overview.
+				const size_t col = (f0 * 128U) / sample_length;
+				top    = mid + waveform_min[(col < 128U) ? col : 127U];
+				bottom = mid + waveform_max[(col < 128U) ? col : 127U];
+			}
+		}
 
 		if(top > bottom)
 		{
@@ -5239,7 +8324,7 @@ static void DrawWaveform()
 		top    = ClampI(top,    text_h, H - 1);
 		bottom = ClampI(bottom, text_h, H - 1);
 
-		const bool inside = (x >= start_x && x <= end_x);
+		const bool inside = (x >= raw_start_x && x <= raw_end_x);
 
 		if(inside)
 		{
@@ -5274,8 +8359,10 @@ static void DrawWaveform()
 		}
 	};
 
-	DrawBracket(start_x, true);
-	DrawBracket(end_x,   false);
+	if(raw_start_x >= 0 && raw_start_x < W)
+		DrawBracket(start_x, true);
+	if(raw_end_x >= 0 && raw_end_x < W)
+		DrawBracket(end_x,   false);
 
 	if (ui_mode == UiMode::Edt && playback_active && sample_length > 1)
 	{
@@ -5289,12 +8376,26 @@ static void DrawWaveform()
 		{
 			norm = 1.0f;
 		}
-		const int play_x = ClampI(static_cast<int>(norm * static_cast<float>(W - 1) + 0.5f), 0, W - 1);
-		display.DrawLine(play_x, text_h, play_x, H - 1, true);
+		const int play_x = zoomed
+			? frame_x(norm)
+			: static_cast<int>(norm * static_cast<float>(W - 1) + 0.5f);
+		if (play_x >= 0 && play_x < W)
+		{
+			display.DrawLine(play_x, text_h, play_x, H - 1, true);
+		}
 	}
 
 	display.SetCursor(0, 0);
 	display.WriteString(waveform_title ? waveform_title : loaded_sample_name, Font_6x8, true);
+	if (zoomed)
+	{
+		char zoom_label[8];
+		snprintf(zoom_label, sizeof(zoom_label), "x%ld", static_cast<long>(1L << edt_zoom));
+		const int label_w = static_cast<int>(StrLen(zoom_label)) * Font_6x8.FontWidth;
+		display.DrawRect(W - label_w - 2, 0, W - 1, Font_6x8.FontHeight - 1, false, true);
+		display.SetCursor(W - label_w, 0);
+		display.WriteString(zoom_label, Font_6x8, true);
+	}
 
 	display.Update();
 }
@@ -5558,8 +8659,8 @@ static void DrawFxDetailScreen(int32_t index)
 			block_h = 3;
 		}
 		const int box_h = (block_h - kGap) / 2;
-		const bool tape_selected = (sat_mode == 0);
-		const bool bit_selected = (sat_mode == 1);
+		const bool tape_selected = (fx_params.sat_mode == 0);
+		const bool bit_selected = (fx_params.sat_mode == 1);
 		const bool mode_select_active = (fx_detail_param_index == 3);
 		if (mode_select_active)
 		{
@@ -5605,13 +8706,13 @@ static void DrawFxDetailScreen(int32_t index)
 		if (fader_w > 4)
 		{
 			const char* fader_labels[3]
-				= {(sat_mode == 1) ? "RESO" : "SAT",
-				   (sat_mode == 1) ? "SMPL" : "BUMP",
+				= {(fx_params.sat_mode == 1) ? "RESO" : "SAT",
+				   (fx_params.sat_mode == 1) ? "SMPL" : "BUMP",
 				   "MIX"};
 			const float fader_values[3]
-				= {(sat_mode == 1) ? sat_bit_reso : sat_drive,
-				   (sat_mode == 1) ? sat_bit_smpl : sat_tape_bump,
-				   fx_s_wet};
+				= {(fx_params.sat_mode == 1) ? fx_params.sat_bit_reso : fx_params.sat_drive,
+				   (fx_params.sat_mode == 1) ? fx_params.sat_bit_smpl : fx_params.sat_tape_bump,
+				   fx_params.fx_s_wet};
 			int param_index = fx_detail_param_index;
 			const bool fader_select_active = (param_index >= 0 && param_index < 3);
 			if (!fader_select_active && !mode_select_active)
@@ -5620,8 +8721,8 @@ static void DrawFxDetailScreen(int32_t index)
 			}
 			const int fader_offsets[3] = {0, 0, 0};
 			const bool circle_handles[3] = {false, false, false};
-			const bool hide_rails[3] = {sat_mode == 1, false, false};
-			const bool hide_handles[3] = {sat_mode == 1, false, false};
+			const bool hide_rails[3] = {fx_params.sat_mode == 1, false, false};
+			const bool hide_handles[3] = {fx_params.sat_mode == 1, false, false};
 			DrawVerticalFadersInRect(fader_x,
 									 block_y,
 									 fader_w,
@@ -5635,7 +8736,7 @@ static void DrawFxDetailScreen(int32_t index)
 									 circle_handles,
 									 hide_rails,
 									 hide_handles);
-			if (sat_mode == 1)
+			if (fx_params.sat_mode == 1)
 			{
 				const int label_y = block_y + block_h - Font5x7::H - 1;
 				int line_top = block_y + 2;
@@ -5663,7 +8764,7 @@ static void DrawFxDetailScreen(int32_t index)
 					}
 					line_x = label_x + (label_w / 2);
 
-					const int cur_idx = BitResoIndexFromValue(sat_bit_reso);
+					const int cur_idx = BitResoIndexFromValue(fx_params.sat_bit_reso);
 					const int label_top = line_top + 1;
 					const int label_gap = 3;
 					int label_y0 = label_top;
@@ -5708,8 +8809,8 @@ static void DrawFxDetailScreen(int32_t index)
 		{
 			block_h = 3;
 		}
-		const bool chorus_selected = (chorus_mode == 0);
-		const bool tape_selected = (chorus_mode == 1);
+		const bool chorus_selected = (fx_params.chorus_mode == 0);
+		const bool tape_selected = (fx_params.chorus_mode == 1);
 		const bool algo_selected = (fx_detail_param_index == 3);
 		const int algo_x0 = block_x;
 		const int algo_y0 = block_y;
@@ -5769,13 +8870,13 @@ static void DrawFxDetailScreen(int32_t index)
 		if (fader_w > 4)
 		{
 			const char* fader_labels[3]
-				= {(chorus_mode == 1) ? "DROP" : "DPTH",
-				   (chorus_mode == 1) ? "RATE" : "SPD",
+				= {(fx_params.chorus_mode == 1) ? "DROP" : "DPTH",
+				   (fx_params.chorus_mode == 1) ? "RATE" : "SPD",
 				   "MIX"};
 			const float fader_values[3]
-				= {(chorus_mode == 1) ? chorus_wow : mod_depth,
-				   (chorus_mode == 1) ? tape_rate : chorus_rate,
-				   fx_c_wet};
+				= {(fx_params.chorus_mode == 1) ? fx_params.chorus_wow : fx_params.mod_depth,
+				   (fx_params.chorus_mode == 1) ? fx_params.tape_rate : fx_params.chorus_rate,
+				   fx_params.fx_c_wet};
 			int param_index = fx_detail_param_index;
 			const bool fader_select_active = (param_index >= 0 && param_index < 3);
 			if (!fader_select_active && !algo_selected)
@@ -5813,7 +8914,7 @@ static void DrawFxDetailScreen(int32_t index)
 		{
 			const char* fader_labels[kDelayFaderCount] = {"TIM", "FBK", "SPRD", "FRZ", "MIX"};
 			const float fader_values[kDelayFaderCount]
-				= {delay_time, delay_feedback, delay_spread, 0.0f, delay_wet};
+				= {fx_params.delay_time, fx_params.delay_feedback, fx_params.delay_spread, 0.0f, fx_params.delay_wet};
 			int param_index = fx_detail_param_index;
 			const bool fader_select_active
 				= (param_index >= 0 && param_index < kDelayFaderCount);
@@ -5861,7 +8962,7 @@ static void DrawFxDetailScreen(int32_t index)
 				label_x = fader_x + fader_w - 2 - label_w;
 			}
 			line_x = label_x + (label_w / 2);
-			const bool freeze_on = (delay_freeze >= 0.5f);
+			const bool freeze_on = (fx_params.delay_freeze >= 0.5f);
 			const char* on_label = "ON";
 			const char* off_label = "OFF";
 			const int on_w = TinyStringWidth(on_label);
@@ -5957,7 +9058,7 @@ static void DrawFxDetailScreen(int32_t index)
 		{
 			const char* fader_labels[kReverbFaderCount] = {"Pre", "Dmp", "Dcy", "Wet", "Shm"};
 			const float fader_values[kReverbFaderCount]
-				= {reverb_pre, reverb_damp, reverb_decay, reverb_wet, reverb_shimmer};
+				= {fx_params.reverb_pre, fx_params.reverb_damp, fx_params.reverb_decay, fx_params.reverb_wet, fx_params.reverb_shimmer};
 			int param_index = fx_detail_param_index;
 			const bool fader_select_active
 				= (param_index >= 0 && param_index < kReverbFaderCount);
@@ -6186,7 +9287,7 @@ static void StopPlayback(uint8_t note)
 	}
 }
 
-static void StartPerformVoice(int32_t note)
+static void StartPerformVoice(int32_t note, uint32_t start_clock)
 {
 	size_t window_start = 0;
 	size_t window_end = 0;
@@ -6210,78 +9311,120 @@ static void StartPerformVoice(int32_t note)
 		return;
 	}
 
-	int voice_index = -1;
-	for (int i = 0; i < kPerformVoiceCount; ++i)
-	{
-		if (perform_voices[i].active && perform_voices[i].note == note)
-		{
-			voice_index = i;
-			break;
-		}
-	}
-	if (voice_index < 0)
+	const VoiceSampleSource src = CurrentVoiceSampleSource();
+	int stream_slot = -1;
+	if (!PrepareVoiceStream(src, window_start, window_end, stream_slot))
 	{
-		for (int i = 0; i < kPerformVoiceCount; ++i)
-		{
-			if (!perform_voices[i].active)
-			{
-				voice_index = i;
-				break;
-			}
-		}
+		return;
 	}
+	const int voice_index = AcquirePerformVoice(note);
 	if (voice_index < 0)
 	{
-		voice_index = 0;
+		ReleaseStreamSlot(static_cast<int8_t>(stream_slot));
+		return;
 	}
-
-	PerformVoice& voice = perform_voices[voice_index];
-	voice.active = true;
-	voice.releasing = false;
-	voice.note = note;
-	voice.phase = 0.0f;
-	voice.amp = 1.0f;
-	voice.env = 0.0f;
-	voice.release_start = 0.0f;
-	voice.release_pos = 0.0f;
-	voice.env_samples = 0;
-	perform_lpf_l1[voice_index].Reset();
-	perform_lpf_l2[voice_index].Reset();
-	perform_lpf_r1[voice_index].Reset();
-	perform_lpf_r2[voice_index].Reset();
 	const float sr = (sample_rate == 0) ? 48000.0f : static_cast<float>(sample_rate);
 	const float semis = static_cast<float>(note - kBaseMidiNote);
 	const float pitch = powf(2.0f, semis / 12.0f);
-	voice.rate = pitch * (sr / hw.AudioSampleRate());
-	voice.offset = window_start;
-	voice.length = window_end - window_start;
+	ArmPerformVoice(voice_index,
+					note,
+					pitch * (sr / hw.AudioSampleRate()),
+					window_start,
+					window_end - window_start,
+					src.sample,
+					stream_slot,
+					start_clock);
 }
 
-static void StopPerformVoice(int32_t note)
+static void StopPerformVoice(int32_t note, uint32_t release_clock)
 {
-	for (auto &voice : perform_voices)
+	if (note < 0 || note >= 128)
+	{
+		return;
+	}
+	DrainRetiredVoices();
+	const int idx = voice_alloc.note_voice[note];
+	if (idx < 0)
+	{
+		return;
+	}
+	VoiceEvent event;
+	event.type = VoiceEventType::Release;
+	event.voice = static_cast<int8_t>(idx);
+	event.generation = voice_alloc.generation[idx];
+	event.epoch = voice_event_epoch;
+	event.clock = release_clock;
+	if (!PushVoiceEvent(event))
+	{
+		return;
+	}
+	if (voice_alloc.list[idx] == VoiceList::Held)
+	{
+		VoiceListMove(VoiceList::Releasing, idx);
+	}
+}
+
+// Current position on audio_frame_clock, interpolated inside the block
+// from the time the last callback finished.
+static uint32_t AudioFrameNow()
+{
+	uint32_t clock = 0;
+	uint32_t block_us = 0;
+	do
+	{
+		clock = audio_frame_clock;
+		block_us = audio_block_us;
+	} while (clock != audio_frame_clock);
+	const uint64_t elapsed_us = System::GetUs() - block_us;
+	uint64_t elapsed = elapsed_us * static_cast<uint64_t>(hw.AudioSampleRate()) / 1000000U;
+	if (elapsed >= audio_block_frames)
+	{
+		elapsed = audio_block_frames - 1;
+	}
+	return clock + static_cast<uint32_t>(elapsed);
+}
+
+// Main-loop pacing. While the engine is idle the core sleeps until the
+// next interrupt (audio DMA, SysTick, MIDI UART) instead of spinning.
+static void MainLoopWait(uint32_t ms)
+{
+	if (!engine_idle)
+	{
+		hw.DelayMs(ms);
+		return;
+	}
+	const uint32_t start_ms = System::GetNow();
+	while ((System::GetNow() - start_ms) < ms)
+	{
+		__WFI();
+	}
+}
+
+// Audio callback: pulls parsed MIDI off the UART handler and stamps it
+// here rather than in the main loop, so the stamp does not move with
+// main-loop stalls. Events that do not fit are dropped.
+static void PollMidiInput()
+{
+	hw.midi.Listen();
+	while (hw.midi.HasEvents())
 	{
-		if (voice.active && voice.note == note)
+		const MidiEvent msg = hw.midi.PopEvent();
+		const uint32_t w = midi_in_write;
+		if ((w - midi_in_read) >= kMidiInQueueSize)
 		{
-			if (!voice.releasing)
-			{
-				voice.releasing = true;
-				voice.release_pos = 0.0f;
-				voice.release_start = voice.env;
-				if (voice.release_start < 0.0f)
-				{
-					voice.release_start = 0.0f;
-				}
-				else if (voice.release_start > 1.0f)
-				{
-					voice.release_start = 1.0f;
-				}
-			}
+			continue;
 		}
+		MidiInEvent& slot = midi_in_queue[w & (kMidiInQueueSize - 1)];
+		slot.msg = msg;
+		slot.stamp = audio_frame_clock;
+		std::atomic_signal_fence(std::memory_order_release);
+		midi_in_write = w + 1;
 	}
 }
 
-static void HandleMidiMessage(MidiEvent msg)
+// stamp is the arrival frame on audio_frame_clock; perform voices start
+// at that offset once the audio callback picks the event up.
+static void HandleMidiMessage(MidiEvent msg, uint32_t stamp)
 {
 	if (ui_mode == UiMode::Record && record_state == RecordState::Recording)
 	{
@@ -6301,18 +9444,18 @@ static void HandleMidiMessage(MidiEvent msg)
 				}
 				if (note.velocity == 0)
 				{
-					StopPerformVoice(note.note);
+					StopPerformVoice(note.note, stamp);
 				}
 				else
 				{
-					StartPerformVoice(note.note);
+					StartPerformVoice(note.note, stamp);
 				}
 			}
 			break;
 			case NoteOff:
 			{
 				const NoteOffEvent note = msg.AsNoteOff();
-				StopPerformVoice(note.note);
+				StopPerformVoice(note.note, stamp);
 			}
 			break;
 			default:
@@ -6346,9 +9489,182 @@ static void HandleMidiMessage(MidiEvent msg)
 	}
 }
 
+constexpr size_t kVoiceMixMaxFrames = 256;
+static float voice_mix_l[kVoiceMixMaxFrames];
+static float voice_mix_r[kVoiceMixMaxFrames];
+
+// Streamed window: frames below head come from SDRAM, the rest from the
+// voice's refill ring. ready is the number of window frames filled so far.
+struct StreamVoiceSource
+{
+	const int16_t* head_l;
+	const int16_t* head_r;
+	const int16_t* ring_l;
+	const int16_t* ring_r;
+	size_t head;
+	size_t base;
+	size_t ready;
+	bool failed;
+
+	bool Available(size_t count) const { return count <= ready; }
+	bool Failed() const { return failed; }
+	float L(size_t i) const
+	{
+		return static_cast<float>((i < head) ? head_l[i] : ring_l[(base + i) & (kStreamRingFrames - 1)]);
+	}
+	float R(size_t i) const
+	{
+		return static_cast<float>((i < head) ? head_r[i] : ring_r[(base + i) & (kStreamRingFrames - 1)]);
+	}
+};
+
+static void RenderPerformVoiceSpan(PerformVoice& voice,
+								   int v,
+								   const VoiceRenderParams& p,
+								   bool filter,
+								   size_t start,
+								   size_t frames,
+								   float gain,
+								   float gain_step)
+{
+	float* mix_l = voice_mix_l + start;
+	float* mix_r = voice_mix_r + start;
+	const VoiceSample& sample = voice.sample;
+	const bool stereo = sample.stereo;
+	const int slot_idx = voice.stream_slot;
+	if (slot_idx < 0)
+	{
+		ResidentVoiceSource src;
+		src.l = sample.l + voice.offset;
+		src.r = (stereo ? sample.r : sample.l) + voice.offset;
+		DispatchPerformVoiceBlock(voice, perform_lpf[v], src, p, stereo, filter, mix_l, mix_r, frames, gain, gain_step);
+		return;
+	}
+	StreamSlot& slot = stream_slots[slot_idx];
+	const size_t resident = sample.resident;
+	const size_t write_frame = slot.write_frame;
+	std::atomic_signal_fence(std::memory_order_acquire);
+	const size_t head_offset = (resident > voice.offset) ? voice.offset : 0;
+	StreamVoiceSource src;
+	src.head_l = sample.l + head_offset;
+	src.head_r = (stereo ? sample.r : sample.l) + head_offset;
+	src.ring_l = stream_ring_l[slot_idx];
+	src.ring_r = stereo ? stream_ring_r[slot_idx] : stream_ring_l[slot_idx];
+	src.head = (resident > voice.offset) ? (resident - voice.offset) : 0;
+	src.base = voice.offset;
+	src.ready = (write_frame > voice.offset) ? (write_frame - voice.offset) : 0;
+	if (src.ready < src.head)
+	{
+		src.ready = src.head;
+	}
+	src.failed = slot.failed;
+	if (DispatchPerformVoiceBlock(voice, perform_lpf[v], src, p, stereo, filter, mix_l, mix_r, frames, gain, gain_step))
+	{
+		++stream_underruns;
+	}
+	if (voice.active)
+	{
+		const size_t consumed = voice.offset + static_cast<size_t>(voice.phase);
+		if (consumed > slot.read_frame)
+		{
+			slot.read_frame = consumed;
+		}
+	}
+}
+
+static void RenderPerformVoices(const VoiceRenderParams& p,
+								bool filter,
+								size_t frames,
+								uint32_t block_clock)
+{
+	for (size_t i = 0; i < frames; ++i)
+	{
+		voice_mix_l[i] = 0.0f;
+		voice_mix_r[i] = 0.0f;
+	}
+	constexpr float kStealFadeStep = 1.0f / static_cast<float>(kVoiceStealFadeFrames);
+	for (int v = 0; v < kPerformVoiceCount; ++v)
+	{
+		PerformVoice& voice = perform_voices[v];
+		size_t start = 0;
+		if (voice.steal_pending)
+		{
+			const size_t fade = (voice.steal_fade_left < frames) ? voice.steal_fade_left : frames;
+			if (voice.active && voice.length > 0 && fade > 0)
+			{
+				const float gain = static_cast<float>(voice.steal_fade_left) * kStealFadeStep;
+				RenderPerformVoiceSpan(voice, v, p, filter, 0, fade, gain, -kStealFadeStep);
+			}
+			voice.steal_fade_left -= fade;
+			if (voice.steal_fade_left > 0)
+			{
+				continue;
+			}
+			start = fade;
+			if (!BeginPendingPerformVoice(voice, v, p))
+			{
+				ReleaseStreamSlot(voice.stream_slot);
+				voice.stream_slot = -1;
+				PushRetiredVoice(v, voice.generation);
+				continue;
+			}
+		}
+		if (!voice.active || voice.length == 0 || start >= frames)
+		{
+			continue;
+		}
+		if (voice.scheduled)
+		{
+			const int32_t delay = static_cast<int32_t>(voice.start_clock - block_clock);
+			if (delay >= static_cast<int32_t>(frames))
+			{
+				continue;
+			}
+			if (delay > static_cast<int32_t>(start))
+			{
+				start = static_cast<size_t>(delay);
+			}
+			voice.scheduled = false;
+		}
+		if (voice.release_scheduled)
+		{
+			// Note-off inside this block: render up to it, then release.
+			const int32_t delay = static_cast<int32_t>(voice.release_clock - block_clock);
+			if (delay < static_cast<int32_t>(frames))
+			{
+				const size_t split = (delay > static_cast<int32_t>(start)) ? static_cast<size_t>(delay) : start;
+				if (split > start)
+				{
+					RenderPerformVoiceSpan(voice, v, p, filter, start, split - start, 1.0f, 0.0f);
+				}
+				voice.release_scheduled = false;
+				if (voice.active && !voice.releasing)
+				{
+					BeginVoiceRelease(voice);
+				}
+				start = split;
+			}
+		}
+		if (voice.active && start < frames)
+		{
+			RenderPerformVoiceSpan(voice, v, p, filter, start, frames - start, 1.0f, 0.0f);
+		}
+		if (!voice.active)
+		{
+			ReleaseStreamSlot(voice.stream_slot);
+			voice.stream_slot = -1;
+			PushRetiredVoice(v, voice.generation);
+		}
+	}
+}
+
 void AudioCallback(AudioHandle::InputBuffer in, AudioHandle::OutputBuffer out, size_t size)
 {
+#if WAVECONT_PROFILE
+	const uint32_t profile_start = ProfileNow();
+#endif
 	hw.ProcessAllControls();
+	PollMidiInput();
 	const int32_t encoder_l_inc = hw.encoder.Increment();
 	const bool encoder_l_pressed = hw.encoder.RisingEdge();
 	encoder_r.Debounce();
@@ -6371,10 +9687,10 @@ void AudioCallback(AudioHandle::InputBuffer in, AudioHandle::OutputBuffer out, s
 	static uint32_t fx_chain_last_move_ms = 0;
 	const float out_sr = hw.AudioSampleRate();
 	const uint32_t now_ms = System::GetNow();
-	const bool ui_blocked = (sd_init_in_progress || save_in_progress);
+	const bool ui_blocked = (sd_init_in_progress || save_in_progress || load_in_progress);
 	if (ui_mode == UiMode::FxDetail
 		&& fx_detail_index == kFxDelayIndex
-		&& delay_freeze >= 0.5f)
+		&& fx_params.delay_freeze >= 0.5f)
 	{
 		const uint32_t now = System::GetNow();
 		if (now >= delay_snow_next_ms)
@@ -6443,6 +9759,11 @@ void AudioCallback(AudioHandle::InputBuffer in, AudioHandle::OutputBuffer out, s
 				request_delete_scan = true;
 				request_delete_redraw = true;
 			}
+			else if (shift_menu_index == 2)
+			{
+				ui_mode = UiMode::CpuLoad;
+				request_cpu_load_redraw = true;
+			}
 		}
 		if (encoder_l_pressed)
 		{
@@ -6560,12 +9881,22 @@ void AudioCallback(AudioHandle::InputBuffer in, AudioHandle::OutputBuffer out, s
 					load_scroll = max_top;
 				}
 			}
+				if (encoder_r_inc != 0 && !delete_mode)
+				{
+					preview_offset_step = ClampI(preview_offset_step + encoder_r_inc, 0, kPreviewOffsetSteps - 1);
+				}
 				if (encoder_r_pressed && wav_file_count > 0)
 				{
-					if (delete_mode)
+					if (load_selected < browse_folder_entries)
+					{
+						request_browse_open = true;
+						request_browse_index = load_selected;
+					}
+					else if (delete_mode)
 					{
+						// The name is paged in by the main loop.
+						delete_confirm_name[0] = '\0';
 						delete_confirm = true;
-						CopyString(delete_confirm_name, wav_files[load_selected], kMaxWavNameLen);
 						request_delete_redraw = true;
 					}
 					else if (load_context == LoadContext::Edt)
@@ -6643,6 +9974,18 @@ void AudioCallback(AudioHandle::InputBuffer in, AudioHandle::OutputBuffer out, s
 			request_shift_redraw = true;
 		}
 	}
+	else if (!ui_blocked && ui_mode == UiMode::CpuLoad)
+	{
+		if (encoder_r_pressed)
+		{
+			request_profile_dump = true;
+		}
+		if (encoder_l_pressed)
+		{
+			ui_mode = UiMode::Shift;
+			request_shift_redraw = true;
+		}
+	}
 	else if (!ui_blocked && ui_mode == UiMode::LoadTarget)
 	{
 		if (encoder_l_inc != 0)
@@ -6732,15 +10075,13 @@ void AudioCallback(AudioHandle::InputBuffer in, AudioHandle::OutputBuffer out, s
 				waveform_from_recording = true;
 				record_state = RecordState::Review;
 				record_waveform_pending = true;
+				record_stop_auto = false;
+				request_record_stop_log = true;
 				if (sample_loaded)
 				{
-					ComputeWaveform();
-					waveform_ready = true;
-					waveform_dirty = true;
 					UpdateTrimFrames();
 					request_length_redraw = true;
 				}
-				LogLine("Record: stop, frames=%lu", static_cast<unsigned long>(sample_length));
 			}
 			else if (record_state == RecordState::Review && sample_loaded)
 			{
@@ -6917,50 +10258,50 @@ void AudioCallback(AudioHandle::InputBuffer in, AudioHandle::OutputBuffer out, s
 					{
 						if (!sat_params_initialized)
 						{
-							sat_drive = 0.5f;
-							sat_tape_bump = 0.5f;
-							sat_bit_reso = 0.5f;
-							sat_bit_smpl = 0.5f;
-							sat_mode = 0;
+							fx_params.sat_drive = 0.5f;
+							fx_params.sat_tape_bump = 0.5f;
+							fx_params.sat_bit_reso = 0.5f;
+							fx_params.sat_bit_smpl = 0.5f;
+							fx_params.sat_mode = 0;
 							sat_params_initialized = true;
-							fx_params_dirty = true;
+							MarkFxStageDirty(FxStage::Sat);
 						}
 					}
 					else if (fx_detail_index == kFxReverbIndex)
 					{
 						if (!reverb_params_initialized)
 						{
-							reverb_pre = 0.5f;
-							reverb_damp = 0.5f;
-							reverb_decay = 0.5f;
-							reverb_shimmer = 0.5f;
+							fx_params.reverb_pre = 0.5f;
+							fx_params.reverb_damp = 0.5f;
+							fx_params.reverb_decay = 0.5f;
+							fx_params.reverb_shimmer = 0.5f;
 							reverb_params_initialized = true;
-							fx_params_dirty = true;
+							MarkFxStageDirty(FxStage::Reverb);
 						}
 					}
 					else if (fx_detail_index == kFxDelayIndex)
 					{
 						if (!delay_params_initialized)
 						{
-							delay_time = 0.5f;
-							delay_feedback = 0.5f;
-							delay_spread = 0.5f;
-							delay_freeze = 0.0f;
+							fx_params.delay_time = 0.5f;
+							fx_params.delay_feedback = 0.5f;
+							fx_params.delay_spread = 0.5f;
+							fx_params.delay_freeze = 0.0f;
 							delay_params_initialized = true;
-							fx_params_dirty = true;
+							MarkFxStageDirty(FxStage::Delay);
 						}
 					}
 					else if (fx_detail_index == kFxChorusIndex)
 					{
 						if (!mod_params_initialized)
 						{
-							mod_depth = 0.5f;
-							chorus_rate = 0.5f;
-							chorus_wow = 0.5f;
-							tape_rate = 0.5f;
-							chorus_mode = 0;
+							fx_params.mod_depth = 0.5f;
+							fx_params.chorus_rate = 0.5f;
+							fx_params.chorus_wow = 0.5f;
+							fx_params.tape_rate = 0.5f;
+							fx_params.chorus_mode = 0;
 							mod_params_initialized = true;
-							fx_params_dirty = true;
+							MarkFxStageDirty(FxStage::Mod);
 						}
 					}
 						fx_detail_prev_mode = ui_mode;
@@ -7016,7 +10357,9 @@ void AudioCallback(AudioHandle::InputBuffer in, AudioHandle::OutputBuffer out, s
 				else
 				{
 					edt_prev_mode = ui_mode;
-					edt_sample_context = IsPlayUiMode(ui_mode) ? SampleContext::Play : SampleContext::Perform;
+					edt_sample_context = (ui_mode == UiMode::PlayTrack)
+						? SampleContext::Track
+						: (IsPlayUiMode(ui_mode) ? SampleContext::Play : SampleContext::Perform);
 					ui_mode = UiMode::Edt;
 					waveform_ready = true;
 					waveform_dirty = true;
@@ -7060,7 +10403,7 @@ void AudioCallback(AudioHandle::InputBuffer in, AudioHandle::OutputBuffer out, s
 		{
 			const int32_t fx_id = fx_chain_order[fx_fader_index];
 			const float step = FxWetStep(fx_id);
-			volatile float* target = FxWetTarget(fx_id);
+			float* target = FxWetTarget(fx_id);
 			const float current = *target;
 			float next = current + (static_cast<float>(encoder_r_inc) * step);
 			if (next < 0.0f)
@@ -7081,10 +10424,10 @@ void AudioCallback(AudioHandle::InputBuffer in, AudioHandle::OutputBuffer out, s
 		else if (amp_select_active && encoder_r_inc != 0)
 		{
 			const float step = kAmpEnvStep;
-			volatile float* targets[kPerformFaderCount]
-				= {&amp_attack, &amp_decay, &amp_sustain, &amp_release};
+			float* targets[kPerformFaderCount]
+				= {&fx_params.amp_attack, &fx_params.amp_decay, &fx_params.amp_sustain, &fx_params.amp_release};
 			const int idx = amp_fader_index;
-			volatile float* target = targets[idx];
+			float* target = targets[idx];
 			const float current = *target;
 			float next = current + (static_cast<float>(encoder_r_inc) * step);
 			if (next < 0.0f)
@@ -7099,14 +10442,15 @@ void AudioCallback(AudioHandle::InputBuffer in, AudioHandle::OutputBuffer out, s
 			{
 				*target = next;
 				request_perform_redraw = true;
+				fx_params_dirty = true;
 			}
 		}
 		else if (flt_select_active && encoder_r_inc != 0)
 		{
 			const float step = kFltParamStep;
-			volatile float* targets[kPerformFltFaderCount] = {&flt_cutoff, &flt_res};
+			float* targets[kPerformFltFaderCount] = {&fx_params.flt_cutoff, &fx_params.flt_res};
 			const int idx = flt_fader_index;
-			volatile float* target = targets[idx];
+			float* target = targets[idx];
 			const float current = *target;
 			float next = current + (static_cast<float>(encoder_r_inc) * step);
 			if (next < 0.0f)
@@ -7121,6 +10465,7 @@ void AudioCallback(AudioHandle::InputBuffer in, AudioHandle::OutputBuffer out, s
 			{
 				*target = next;
 				request_perform_redraw = true;
+				fx_params_dirty = true;
 			}
 		}
 			if (encoder_l_pressed)
@@ -7155,13 +10500,24 @@ void AudioCallback(AudioHandle::InputBuffer in, AudioHandle::OutputBuffer out, s
 				if (dr > 0) dr = 1;
 				else if (dr < 0) dr = -1;
 			}
-			AdjustTrimNormalized(dl, dr, shift_button.Pressed());
+			if (dl != 0 || dr != 0)
+			{
+				edt_focus_end = (dr != 0);
+			}
+			const float span = static_cast<float>(EdtViewFrames()) / static_cast<float>((sample_length > 0) ? sample_length : 1);
+			AdjustTrimNormalized(dl, dr, shift_button.Pressed(), span);
+			EdtFollowTrim();
 			if (perform_context == PerformContext::Track)
 			{
 				StoreTrackSampleState(perform_context_track);
 			}
 		}
-		if (encoder_r_pressed)
+		// Shift + encoder press zooms: right in, left out.
+		if (shift_button.Pressed() && (encoder_l_pressed || encoder_r_pressed))
+		{
+			EdtZoom(encoder_r_pressed ? 1 : -1);
+		}
+		else if (encoder_r_pressed)
 		{
 			delete_mode = false;
 			delete_confirm = false;
@@ -7173,7 +10529,7 @@ void AudioCallback(AudioHandle::InputBuffer in, AudioHandle::OutputBuffer out, s
 			load_scroll = 0;
 			request_load_scan = true;
 		}
-		if (encoder_l_pressed)
+		else if (encoder_l_pressed)
 		{
 			ui_mode = edt_prev_mode;
 			if (ui_mode == UiMode::Perform)
@@ -7208,23 +10564,23 @@ void AudioCallback(AudioHandle::InputBuffer in, AudioHandle::OutputBuffer out, s
 			if (encoder_r_inc != 0)
 			{
 				const float steps[3] = {kReverbWetStep, kReverbWetStep, kReverbWetStep};
-				volatile float* targets[3]
-					= {(sat_mode == 1) ? &sat_bit_reso : &sat_drive,
-					   (sat_mode == 1) ? &sat_bit_smpl : &sat_tape_bump,
-					   &fx_s_wet};
+				float* targets[3]
+					= {(fx_params.sat_mode == 1) ? &fx_params.sat_bit_reso : &fx_params.sat_drive,
+					   (fx_params.sat_mode == 1) ? &fx_params.sat_bit_smpl : &fx_params.sat_tape_bump,
+					   &fx_params.fx_s_wet};
 				const int idx = fx_detail_param_index;
 				if (idx == 3)
 				{
-					sat_mode = (sat_mode == 0) ? 1 : 0;
+					fx_params.sat_mode = (fx_params.sat_mode == 0) ? 1 : 0;
 					request_fx_detail_redraw = true;
-					fx_params_dirty = true;
+					MarkFxStageDirty(FxStage::Sat);
 				}
 				if (idx >= 0 && idx < 3)
 				{
-					volatile float* target = targets[idx];
+					float* target = targets[idx];
 					const float current = *target;
 					float next = current;
-					if (sat_mode == 1 && idx == 0)
+					if (fx_params.sat_mode == 1 && idx == 0)
 					{
 						const int cur_idx = BitResoIndexFromValue(current);
 						const int next_idx = ClampI(cur_idx + encoder_r_inc, 0, kBitResoStepCount - 1);
@@ -7247,7 +10603,7 @@ void AudioCallback(AudioHandle::InputBuffer in, AudioHandle::OutputBuffer out, s
 					{
 						*target = next;
 						request_fx_detail_redraw = true;
-						fx_params_dirty = true;
+						MarkFxStageDirty(FxStage::Sat);
 					}
 				}
 			}
@@ -7256,9 +10612,9 @@ void AudioCallback(AudioHandle::InputBuffer in, AudioHandle::OutputBuffer out, s
 		{
 			if (encoder_r_pressed)
 			{
-				chorus_mode = (chorus_mode == 0) ? 1 : 0;
+				fx_params.chorus_mode = (fx_params.chorus_mode == 0) ? 1 : 0;
 				request_fx_detail_redraw = true;
-				fx_params_dirty = true;
+				MarkFxStageDirty(FxStage::Mod);
 			}
 			if (encoder_l_inc != 0)
 			{
@@ -7282,7 +10638,7 @@ void AudioCallback(AudioHandle::InputBuffer in, AudioHandle::OutputBuffer out, s
 			{
 				if (fx_detail_param_index == 3)
 				{
-					int32_t next = chorus_mode + encoder_r_inc;
+					int32_t next = fx_params.chorus_mode + encoder_r_inc;
 					while (next < 0)
 					{
 						next += 2;
@@ -7291,26 +10647,26 @@ void AudioCallback(AudioHandle::InputBuffer in, AudioHandle::OutputBuffer out, s
 					{
 						next -= 2;
 					}
-					if (next != chorus_mode)
+					if (next != fx_params.chorus_mode)
 					{
-						chorus_mode = next;
+						fx_params.chorus_mode = next;
 						request_fx_detail_redraw = true;
-						fx_params_dirty = true;
+						MarkFxStageDirty(FxStage::Mod);
 					}
 				}
 				else
 				{
 					const float steps[3]
 						= {kReverbWetStep, kChorusRateStep, kReverbWetStep};
-					volatile float* targets[3]
-						= {(chorus_mode == 1) ? &chorus_wow : &mod_depth,
-						   (chorus_mode == 1) ? &tape_rate : &chorus_rate,
-						   &fx_c_wet};
+					float* targets[3]
+						= {(fx_params.chorus_mode == 1) ? &fx_params.chorus_wow : &fx_params.mod_depth,
+						   (fx_params.chorus_mode == 1) ? &fx_params.tape_rate : &fx_params.chorus_rate,
+						   &fx_params.fx_c_wet};
 					const int idx = fx_detail_param_index;
 					if (idx >= 0 && idx < 3)
 					{
 						const float step = steps[idx];
-						volatile float* target = targets[idx];
+						float* target = targets[idx];
 						const float current = *target;
 						float next = current + (static_cast<float>(encoder_r_inc) * step);
 						if (next < 0.0f)
@@ -7325,7 +10681,7 @@ void AudioCallback(AudioHandle::InputBuffer in, AudioHandle::OutputBuffer out, s
 						{
 							*target = next;
 							request_fx_detail_redraw = true;
-							fx_params_dirty = true;
+							MarkFxStageDirty(FxStage::Mod);
 						}
 					}
 				}
@@ -7359,12 +10715,12 @@ void AudioCallback(AudioHandle::InputBuffer in, AudioHandle::OutputBuffer out, s
 					   kDelayParamStep,
 					   kDelayParamStep,
 					   kDelayWetStep};
-				volatile float* targets[kDelayFaderCount]
-					= {&delay_time, &delay_feedback, &delay_spread, &delay_freeze, &delay_wet};
+				float* targets[kDelayFaderCount]
+					= {&fx_params.delay_time, &fx_params.delay_feedback, &fx_params.delay_spread, &fx_params.delay_freeze, &fx_params.delay_wet};
 				const int idx = fx_detail_param_index;
 				if (idx >= 0 && idx < kDelayFaderCount)
 				{
-					volatile float* target = targets[idx];
+					float* target = targets[idx];
 					const float current = *target;
 					float next = current;
 					if (idx == 3)
@@ -7389,7 +10745,7 @@ void AudioCallback(AudioHandle::InputBuffer in, AudioHandle::OutputBuffer out, s
 					{
 						*target = next;
 						request_fx_detail_redraw = true;
-						fx_params_dirty = true;
+						MarkFxStageDirty(FxStage::Delay);
 					}
 				}
 			}
@@ -7422,13 +10778,13 @@ void AudioCallback(AudioHandle::InputBuffer in, AudioHandle::OutputBuffer out, s
 					   kReverbParamStep,
 					   kReverbWetStep,
 					   kReverbShimmerStep};
-				volatile float* targets[kReverbFaderCount]
-					= {&reverb_pre, &reverb_damp, &reverb_decay, &reverb_wet, &reverb_shimmer};
+				float* targets[kReverbFaderCount]
+					= {&fx_params.reverb_pre, &fx_params.reverb_damp, &fx_params.reverb_decay, &fx_params.reverb_wet, &fx_params.reverb_shimmer};
 				const int idx = fx_detail_param_index;
 				if (idx >= 0 && idx < kReverbFaderCount)
 				{
 					const float step = steps[idx];
-					volatile float* target = targets[idx];
+					float* target = targets[idx];
 					const float current = *target;
 					float next = current + (static_cast<float>(encoder_r_inc) * step);
 					if (next < 0.0f)
@@ -7443,7 +10799,7 @@ void AudioCallback(AudioHandle::InputBuffer in, AudioHandle::OutputBuffer out, s
 					{
 						*target = next;
 						request_fx_detail_redraw = true;
-						fx_params_dirty = true;
+						MarkFxStageDirty(FxStage::Reverb);
 					}
 				}
 			}
@@ -7525,7 +10881,7 @@ void AudioCallback(AudioHandle::InputBuffer in, AudioHandle::OutputBuffer out, s
 			if (next_bpm != play_bpm)
 			{
 				play_bpm = next_bpm;
-				UpdatePlayStepMs();
+				ClampPlayBpm();
 				play_screen_dirty = true;
 			}
 		}
@@ -7626,332 +10982,61 @@ void AudioCallback(AudioHandle::InputBuffer in, AudioHandle::OutputBuffer out, s
 		window_start = 0;
 		window_end = sample_length;
 	}
+	if (window_end > SampleResidentFrames())
+	{
+		window_end = SampleResidentFrames();
+	}
 	const bool window_valid = (window_end > 0 && window_end > window_start);
 	if (playback_active && !window_valid)
 	{
 		playback_active = false;
 		playback_env_samples = 0;
-		playback_release_active = false;
-		playback_release_pos = 0.0f;
-		playback_release_start = 0.0f;
-	}
-static float cached_sat_drive = 0.0f;
-static float cached_sat_mix = 0.0f;
-static float cached_sat_bump = 0.0f;
-static float cached_sat_smpl = 0.0f;
-static float cached_sat_reso = 0.0f;
-static int32_t cached_sat_mode = 0;
-static float cached_chorus_depth = 0.0f;
-static float cached_chorus_mix = 0.0f;
-static float cached_chorus_rate = 0.0f;
-static int32_t cached_chorus_mode = 0;
-static float cached_chorus_wow = 0.0f;
-static float cached_tape_rate = 0.0f;
-	static float cached_delay_wet = 0.0f;
-	static float cached_delay_time = 0.0f;
-	static float cached_delay_feedback = 0.0f;
-	static float cached_delay_spread = 0.0f;
-	static float cached_delay_freeze = 0.0f;
-	static float delay_time_smoothed = -1.0f;
-	static float delay_feedback_smoothed = -1.0f;
-	static float delay_spread_smoothed = -1.0f;
-	static float cached_reverb_wet = 0.0f;
-	static float cached_reverb_pre = 0.0f;
-	static float cached_reverb_damp = 0.0f;
-	static float cached_reverb_decay = 0.0f;
-	static float cached_reverb_shimmer = 0.0f;
-	static float cached_reverb_gain = 1.0f;
-	static float cached_reverb_release = 1.0f;
-	static float cached_reverb_predelay_samples = 0.0f;
-static float last_sat_drive = -1.0f;
-static float last_sat_bump = -1.0f;
-static int32_t last_sat_mode = -1;
-static float last_chorus_depth = -1.0f;
-static float last_chorus_rate = -1.0f;
-static float last_chorus_wow = -1.0f;
-	static float last_delay_wet = -1.0f;
-	static float last_delay_time = -1.0f;
-	static float last_delay_feedback = -1.0f;
-	static float last_delay_spread = -1.0f;
-	static float last_delay_freeze = -1.0f;
-	static float last_rev_feedback = -1.0f;
-	static float last_rev_lp = -1.0f;
-	static float last_rev_predelay = -1.0f;
-
-	if (fx_params_dirty)
-	{
-		fx_params_dirty = false;
-
-		cached_sat_drive = sat_drive;
-		cached_sat_mix = fx_s_wet;
-		cached_sat_bump = sat_tape_bump;
-		cached_sat_smpl = sat_bit_smpl;
-		cached_sat_reso = sat_bit_reso;
-		cached_sat_mode = sat_mode;
-		cached_chorus_depth = mod_depth;
-		cached_chorus_mix = fx_c_wet;
-		cached_chorus_rate = chorus_rate;
-		cached_chorus_mode = chorus_mode;
-		cached_chorus_wow = chorus_wow;
-		cached_tape_rate = tape_rate;
-		cached_delay_wet = delay_wet;
-		cached_delay_time = delay_time;
-		cached_delay_feedback = delay_feedback;
-		cached_delay_spread = delay_spread;
-		cached_delay_freeze = delay_freeze;
-		cached_reverb_wet = reverb_wet;
-		cached_reverb_pre = reverb_pre;
-		cached_reverb_damp = reverb_damp;
-		cached_reverb_decay = reverb_decay;
-		cached_reverb_shimmer = reverb_shimmer;
-
-		if (cached_sat_drive < 0.0f) cached_sat_drive = 0.0f;
-		if (cached_sat_drive > 1.0f) cached_sat_drive = 1.0f;
-		if (cached_sat_mix < 0.0f) cached_sat_mix = 0.0f;
-		if (cached_sat_mix > 1.0f) cached_sat_mix = 1.0f;
-		if (cached_sat_bump < 0.0f) cached_sat_bump = 0.0f;
-		if (cached_sat_bump > 1.0f) cached_sat_bump = 1.0f;
-		if (cached_sat_smpl < 0.0f) cached_sat_smpl = 0.0f;
-		if (cached_sat_smpl > 1.0f) cached_sat_smpl = 1.0f;
-		if (cached_sat_reso < 0.0f) cached_sat_reso = 0.0f;
-		if (cached_sat_reso > 1.0f) cached_sat_reso = 1.0f;
-		if (cached_chorus_depth < 0.0f) cached_chorus_depth = 0.0f;
-		if (cached_chorus_depth > 1.0f) cached_chorus_depth = 1.0f;
-		if (cached_chorus_mix < 0.0f) cached_chorus_mix = 0.0f;
-		if (cached_chorus_mix > 1.0f) cached_chorus_mix = 1.0f;
-		if (cached_chorus_rate < 0.0f) cached_chorus_rate = 0.0f;
-		if (cached_chorus_rate > 1.0f) cached_chorus_rate = 1.0f;
-		if (cached_chorus_wow < 0.0f) cached_chorus_wow = 0.0f;
-		if (cached_chorus_wow > 1.0f) cached_chorus_wow = 1.0f;
-		if (cached_tape_rate < 0.0f) cached_tape_rate = 0.0f;
-		if (cached_tape_rate > 1.0f) cached_tape_rate = 1.0f;
-		if (cached_delay_wet < 0.0f) cached_delay_wet = 0.0f;
-		if (cached_delay_wet > 1.0f) cached_delay_wet = 1.0f;
-		if (cached_delay_time < 0.0f) cached_delay_time = 0.0f;
-		if (cached_delay_time > 1.0f) cached_delay_time = 1.0f;
-		if (cached_delay_feedback < 0.0f) cached_delay_feedback = 0.0f;
-		if (cached_delay_feedback > 1.0f) cached_delay_feedback = 1.0f;
-		if (cached_delay_spread < 0.0f) cached_delay_spread = 0.0f;
-		if (cached_delay_spread > 1.0f) cached_delay_spread = 1.0f;
-		if (cached_delay_freeze < 0.0f) cached_delay_freeze = 0.0f;
-		if (cached_delay_freeze > 1.0f) cached_delay_freeze = 1.0f;
-		if (cached_reverb_wet < 0.0f) cached_reverb_wet = 0.0f;
-		if (cached_reverb_wet > 1.0f) cached_reverb_wet = 1.0f;
-		if (cached_reverb_pre < 0.0f) cached_reverb_pre = 0.0f;
-		if (cached_reverb_pre > 1.0f) cached_reverb_pre = 1.0f;
-		if (cached_reverb_damp < 0.0f) cached_reverb_damp = 0.0f;
-		if (cached_reverb_damp > 1.0f) cached_reverb_damp = 1.0f;
-		if (cached_reverb_decay < 0.0f) cached_reverb_decay = 0.0f;
-		if (cached_reverb_decay > 1.0f) cached_reverb_decay = 1.0f;
-		if (cached_reverb_shimmer < 0.0f) cached_reverb_shimmer = 0.0f;
-		if (cached_reverb_shimmer > 1.0f) cached_reverb_shimmer = 1.0f;
-
-		cached_reverb_gain = 1.0f;
-		const float decay_ms = kReverbDecayMinMs
-			+ cached_reverb_decay * cached_reverb_decay * (kReverbDecayMaxMs - kReverbDecayMinMs);
-		const float decay_samples = decay_ms * 0.001f * out_sr;
-		if (cached_reverb_decay >= 0.999f)
-		{
-			cached_reverb_release = 1.0f;
-		}
-		else if (decay_samples > 1.0f)
-		{
-			cached_reverb_release = expf(-1.0f / decay_samples);
-		}
-		else
-		{
-			cached_reverb_release = 0.0f;
-		}
-
-		if (cached_sat_mode != last_sat_mode)
-		{
-			last_sat_mode = cached_sat_mode;
-		}
-		if (cached_sat_mode == 0)
-		{
-			const float sat_drive_amt = powf(cached_sat_drive, 0.7f);
-			if (fabsf(sat_drive_amt - last_sat_drive) > kFxParamEpsilon)
-			{
-				sat_l.SetDrive(sat_drive_amt);
-				sat_r.SetDrive(sat_drive_amt);
-				last_sat_drive = sat_drive_amt;
-			}
-			if (fabsf(cached_sat_bump - last_sat_bump) > kFxParamEpsilon)
-			{
-				sat_l.SetBump(cached_sat_bump);
-				sat_r.SetBump(cached_sat_bump);
-				last_sat_bump = cached_sat_bump;
-			}
-		}
-		if (fabsf(cached_chorus_depth - last_chorus_depth) > kFxParamEpsilon)
-		{
-			if (cached_chorus_mode == 0)
-			{
-				const float depth_curve = cached_chorus_depth * cached_chorus_depth;
-				const float depth_scale = kChorusMaxDepth * 1.2f;
-				const float depth = depth_curve * depth_scale;
-				chorus_l.SetLfoDepth(depth);
-				chorus_r.SetLfoDepth(depth);
-			}
-			last_chorus_depth = cached_chorus_depth;
-		}
-		if (fabsf(cached_chorus_rate - last_chorus_rate) > kFxParamEpsilon)
-		{
-			const float rate_curve = cached_chorus_rate * cached_chorus_rate;
-			const float rate_hz = kChorusRateMinHz
-				+ rate_curve * (kChorusRateMaxHz - kChorusRateMinHz);
-			chorus_l.SetLfoFreq(rate_hz);
-			chorus_r.SetLfoFreq(-rate_hz);
-			last_chorus_rate = cached_chorus_rate;
-		}
-		if (fabsf(cached_chorus_wow - last_chorus_wow) > kFxParamEpsilon)
-		{
-			last_chorus_wow = cached_chorus_wow;
-		}
-		if (fabsf(cached_delay_wet - last_delay_wet) > kFxParamEpsilon)
-		{
-			last_delay_wet = cached_delay_wet;
-		}
-		if (fabsf(cached_delay_feedback - last_delay_feedback) > kFxParamEpsilon)
-		{
-			last_delay_feedback = cached_delay_feedback;
-		}
-		if (fabsf(cached_delay_spread - last_delay_spread) > kFxParamEpsilon)
-		{
-			last_delay_spread = cached_delay_spread;
-		}
-		if (fabsf(cached_delay_freeze - last_delay_freeze) > kFxParamEpsilon)
-		{
-			last_delay_freeze = cached_delay_freeze;
-		}
-
-		float rev_feedback = kReverbFeedback;
-		if (cached_reverb_decay >= 0.999f)
-		{
-			rev_feedback = 0.99f;
-		}
-		const float damp_curve = cached_reverb_damp * 1.6f;
-		float rev_lp = kReverbDampMaxHz
-			* powf(kReverbDampMinHz / kReverbDampMaxHz, damp_curve);
-		const float rev_lp_max = out_sr * 0.49f;
-		if (rev_lp > rev_lp_max)
-		{
-			rev_lp = rev_lp_max;
-		}
-		if (rev_lp < kReverbDampMinHz)
-		{
-			rev_lp = kReverbDampMinHz;
-		}
-		const float pre_curve = powf(cached_reverb_pre, 3.0f);
-		float rev_predelay_samples
-			= pre_curve * (kReverbPreDelayMaxMs * 0.001f * out_sr);
-		const float rev_predelay_max = static_cast<float>(kReverbPreDelayMaxSamples - 1);
-		if (rev_predelay_samples > rev_predelay_max)
-		{
-			rev_predelay_samples = rev_predelay_max;
-		}
-		cached_reverb_predelay_samples = rev_predelay_samples;
-		if (fabsf(rev_feedback - last_rev_feedback) > kFxParamEpsilon)
-		{
-			reverb.SetFeedback(rev_feedback);
-			last_rev_feedback = rev_feedback;
-		}
-		if (fabsf(rev_lp - last_rev_lp) > kFxParamEpsilon)
-		{
-			reverb.SetLpFreq(rev_lp);
-			last_rev_lp = rev_lp;
-		}
-		if (fabsf(rev_predelay_samples - last_rev_predelay) >= 0.5f)
-		{
-			reverb_predelay_l.SetDelay(rev_predelay_samples);
-			reverb_predelay_r.SetDelay(rev_predelay_samples);
-			last_rev_predelay = rev_predelay_samples;
-		}
-	}
-
-	static float drop_phase = 0.0f;
-	static float trem_phase = 0.0f;
-	static float drop_gain = 1.0f;
-	static float drop_target = 1.0f;
-	static int drop_hold = 0;
-	static uint32_t drop_rng = 0x12345678;
-	static int bit_hold = 0;
-	static float bit_hold_l = 0.0f;
-	static float bit_hold_r = 0.0f;
-	static float reverb_tail_gain = 0.0f;
-
-	const int32_t sat_mode_local = cached_sat_mode;
-	const float sat_mix = cached_sat_mix;
-	const float bit_reso = cached_sat_reso;
-	const float bit_smpl = cached_sat_smpl;
-	const int32_t chorus_mode_local = cached_chorus_mode;
-	const float chorus_mix = cached_chorus_mix;
-	const float delay_mix = cached_delay_wet;
-	const float rev_shimmer = cached_reverb_shimmer;
-	const float dt = static_cast<float>(size) / out_sr;
-	const float time_tau = kDelayTimeSlewMs * 0.001f;
-	const float time_alpha = (time_tau > 0.0f) ? (1.0f - expf(-dt / time_tau)) : 1.0f;
-	const float param_tau = kDelayParamSlewMs * 0.001f;
-	const float param_alpha = (param_tau > 0.0f) ? (1.0f - expf(-dt / param_tau)) : 1.0f;
-	const float time_curve = cached_delay_time * cached_delay_time;
-	float delay_ms = kDelayTimeMinMs
-		+ (time_curve * (kDelayTimeMaxMs - kDelayTimeMinMs));
-	const float delay_samples = delay_ms * 0.001f * out_sr;
-	const float max_delay = static_cast<float>(kDelayMaxSamples - 1);
-	float delay_target = delay_samples;
-	if (delay_target > max_delay)
-	{
-		delay_target = max_delay;
-	}
-	if (delay_target < 1.0f)
-	{
-		delay_target = 1.0f;
-	}
-	if (delay_time_smoothed < 0.0f)
-	{
-		delay_time_smoothed = delay_target;
-	}
-	delay_time_smoothed += (delay_target - delay_time_smoothed) * time_alpha;
-	if (delay_feedback_smoothed < 0.0f)
-	{
-		delay_feedback_smoothed = cached_delay_feedback;
+		playback_release_active = false;
+		playback_release_pos = 0.0f;
+		playback_release_start = 0.0f;
 	}
-	delay_feedback_smoothed += (cached_delay_feedback - delay_feedback_smoothed) * param_alpha;
-	if (delay_spread_smoothed < 0.0f)
+	// Per-block copy of fx_params; the DSP below reads only this.
+	static FxParamBlock fx_snapshot;
+	if (fx_params_dirty && !fx_params_busy)
 	{
-		delay_spread_smoothed = cached_delay_spread;
+		fx_params_dirty = false;
+		fx_snapshot = fx_params;
+		ClampFxParams(fx_snapshot);
+		fx_chain.SetParams(fx_snapshot);
 	}
-	delay_spread_smoothed += (cached_delay_spread - delay_spread_smoothed) * param_alpha;
-	if (fabsf(delay_time_smoothed - last_delay_time) > kFxParamEpsilon)
+	for (int stage = 0; stage < kFxStageCount; ++stage)
 	{
-		delay_line_l.SetDelay(delay_time_smoothed);
-		delay_line_r.SetDelay(delay_time_smoothed);
-		last_delay_time = delay_time_smoothed;
+		if (fx_stage_ready[stage])
+		{
+			std::atomic_signal_fence(std::memory_order_acquire);
+			fx_chain.ApplyStage(static_cast<FxStage>(stage), fx_coeffs_mailbox);
+			std::atomic_signal_fence(std::memory_order_release);
+			fx_stage_ready[stage] = false;
+		}
 	}
+	fx_chain.BeginBlock(size);
 	const bool perform_mode = IsPerformUiMode(ui_mode);
 	const bool main_mode = (ui_mode == UiMode::Main);
 	const bool fx_allowed = perform_mode || IsPlayUiMode(ui_mode) || ui_mode == UiMode::FxDetail;
 	const bool amp_env_active = perform_mode;
-	const float amp_attack_ms = AmpEnvMsFromFader(amp_attack);
-	const float amp_release_ms = AmpEnvMsFromFader(amp_release);
+	const float amp_attack_ms = AmpEnvMsFromFader(fx_snapshot.amp_attack);
+	const float amp_release_ms = AmpEnvMsFromFader(fx_snapshot.amp_release);
 	const float amp_attack_samples = amp_attack_ms * 0.001f * out_sr;
 	const float amp_release_samples = amp_release_ms * 0.001f * out_sr;
-	const bool play_seq_mode = IsPlayUiMode(ui_mode) && sample_loaded;
+	// PLAY tracks bring their own samples, so the sequencer does not depend
+	// on the current context having one loaded.
+	const bool play_seq_mode = IsPlayUiMode(ui_mode);
 	const bool use_poly = (record_state != RecordState::Recording)
 		&& ((perform_mode && sample_loaded) || play_seq_mode);
-	const bool sample_stereo = (sample_channels == 2);
-	const float flt_cutoff_hz = FltCutoffFromFader(flt_cutoff, out_sr);
-	const float flt_q = FltQFromFader(flt_res);
+	const float flt_cutoff_hz = FltCutoffFromFader(fx_snapshot.flt_cutoff, out_sr);
+	const float flt_q = FltQFromFader(fx_snapshot.flt_res);
 	static float last_flt_cutoff = -1.0f;
 	static float last_flt_q = -1.0f;
 	if (flt_cutoff_hz != last_flt_cutoff || flt_q != last_flt_q)
 	{
 		for (int v = 0; v < kPerformVoiceCount; ++v)
 		{
-			perform_lpf_l1[v].Set(out_sr, flt_cutoff_hz, flt_q);
-			perform_lpf_l2[v].Set(out_sr, flt_cutoff_hz, flt_q);
-			perform_lpf_r1[v].Set(out_sr, flt_cutoff_hz, flt_q);
-			perform_lpf_r2[v].Set(out_sr, flt_cutoff_hz, flt_q);
+			perform_lpf[v].Set(out_sr, flt_cutoff_hz, flt_q);
 		}
 		last_flt_cutoff = flt_cutoff_hz;
 		last_flt_q = flt_q;
@@ -7962,307 +11047,38 @@ static float last_chorus_wow = -1.0f;
 		fx_order[i] = fx_chain_order[i];
 	}
 
-	auto apply_saturation = [&](float &l, float &r)
+	const size_t voice_frames = (size < kVoiceMixMaxFrames) ? size : kVoiceMixMaxFrames;
+#if WAVECONT_PROFILE
+	static size_t profile_block_size = 0;
+	if (size != profile_block_size)
 	{
-		const float dry_l = l;
-		const float dry_r = r;
-		float wet_l = l;
-		float wet_r = r;
-		if (sat_mode_local == 0)
-		{
-			wet_l = sat_l.Process(l);
-			wet_r = sat_r.Process(r);
-		}
-		else
-		{
-			int hold_samples = 1 + static_cast<int>(bit_smpl * static_cast<float>(kBitcrushMaxHold - 1));
-			if (hold_samples < 1)
-			{
-				hold_samples = 1;
-			}
-			if (bit_hold <= 0)
-			{
-				bit_hold = hold_samples;
-				bit_hold_l = l;
-				bit_hold_r = r;
-			}
-			else
-			{
-				--bit_hold;
-			}
-			const int bits_idx = BitResoIndexFromValue(bit_reso);
-			const int bits = kBitResoSteps[bits_idx];
-			const float step = 1.0f / powf(2.0f, static_cast<float>(bits - 1));
-			wet_l = roundf(bit_hold_l / step) * step;
-			wet_r = roundf(bit_hold_r / step) * step;
-			if (wet_l > 1.0f) wet_l = 1.0f;
-			if (wet_l < -1.0f) wet_l = -1.0f;
-			if (wet_r > 1.0f) wet_r = 1.0f;
-			if (wet_r < -1.0f) wet_r = -1.0f;
-		}
-		l = (dry_l * (1.0f - sat_mix)) + (wet_l * sat_mix);
-		r = (dry_r * (1.0f - sat_mix)) + (wet_r * sat_mix);
-	};
-
-	auto apply_chorus = [&](float &l, float &r)
+		profile_block_size = size;
+		const float budget = ProfileTicksPerSecond() * static_cast<float>(size) / out_sr;
+		ProfileWindowReset(profile_live, static_cast<uint32_t>(budget));
+	}
+	const uint32_t profile_voices_start = ProfileNow();
+	ProfileRecord(profile_live, ProfileStage::Control, profile_voices_start - profile_start);
+#endif
+	ApplyVoiceEvents();
+	if (playhead_running)
 	{
-		const float dry_l = l;
-		const float dry_r = r;
-		float chorus_proc_l = chorus_l.Process(l);
-		float chorus_proc_r = chorus_r.Process(r);
-		float tape_drop = 1.0f;
-		if (chorus_mode_local == 1)
-		{
-			const float drop_amt = cached_chorus_wow;
-			if (drop_amt > 0.0f)
-			{
-				const float drop_amt_mapped = powf(drop_amt, 0.6f);
-				const float drop_curve = drop_amt_mapped * drop_amt_mapped;
-				const float rate_curve = cached_tape_rate * cached_tape_rate;
-				const float rate_scale = 0.2f + (rate_curve * 6.0f);
-				const float drop_rate = (0.2f + (drop_curve * 12.0f)) * rate_scale;
-				const float drop_step = drop_rate / out_sr;
-				drop_phase += drop_step;
-				bool new_step = false;
-				if (drop_phase >= 1.0f)
-				{
-					drop_phase -= 1.0f;
-					new_step = true;
-				}
-				drop_rng = (drop_rng * 1664525u) + 1013904223u;
-				const float r = static_cast<float>((drop_rng >> 8) & 0xFFFF) / 65535.0f;
-				if (drop_hold > 0)
-				{
-					drop_hold--;
-					drop_target = 0.0f;
-				}
-				else if (new_step)
-				{
-					const float drop_prob = 0.05f + (drop_curve * 0.9f);
-					if (r < drop_prob)
-					{
-						const float hold_scale = 1.0f / (0.5f + rate_curve * 2.0f);
-						drop_hold = 10 + static_cast<int>(r * 1200.0f * drop_curve * hold_scale);
-						drop_target = 0.0f;
-					}
-					else
-					{
-						drop_target = 1.0f - (drop_curve * 0.9f) + (r * drop_curve * 0.9f);
-					}
-				}
-				const float drop_slew = 0.08f + (drop_curve * 0.8f);
-				drop_gain += (drop_target - drop_gain) * drop_slew;
-				trem_phase += (1.0f + drop_curve * 20.0f) * rate_scale / out_sr;
-				if (trem_phase >= 1.0f)
-				{
-					trem_phase -= 1.0f;
-				}
-				const float trem = 0.5f * (1.0f + sinf(trem_phase * kTwoPi));
-				const float trem_depth = drop_curve * 0.85f;
-				tape_drop = drop_gain * (1.0f - trem_depth + (trem_depth * trem));
-			}
-		}
-		float wet_l = chorus_proc_l * tape_drop;
-		float wet_r = chorus_proc_r * tape_drop;
-		if (chorus_mode_local == 0)
-		{
-			float width = 1.0f + (cached_chorus_depth * (kChorusWidthMax - 1.0f));
-			if (width < 1.0f)
-			{
-				width = 1.0f;
-			}
-			if (width > kChorusWidthMax)
-			{
-				width = kChorusWidthMax;
-			}
-			const float mid = 0.5f * (wet_l + wet_r);
-			const float side = 0.5f * (wet_l - wet_r);
-			wet_l = mid + (side * width);
-			wet_r = mid - (side * width);
-		}
-		l = (dry_l * (1.0f - chorus_mix)) + (wet_l * chorus_mix);
-		r = (dry_r * (1.0f - chorus_mix)) + (wet_r * chorus_mix);
-	};
-
-	auto apply_delay = [&](float &l, float &r)
-	{
-		const float freeze = (cached_delay_freeze >= 0.5f) ? 1.0f : 0.0f;
-		float feedback = delay_feedback_smoothed;
-		if (feedback > kDelayFeedbackMax)
-		{
-			feedback = kDelayFeedbackMax;
-		}
-		if (feedback < 0.0f)
-		{
-			feedback = 0.0f;
-		}
-		const float freeze_mix = (freeze > 0.0f) ? freeze : 0.0f;
-		const float feedback_mix = feedback + (freeze_mix * (1.0f - feedback));
-		const float input_gain = 1.0f - freeze_mix;
-		const float delay_in = 0.5f * (l + r);
-		const float pingpong = feedback;
-		const float input_l = delay_in * input_gain;
-		const float input_r = delay_in * input_gain * (1.0f - pingpong);
-		const float delay_out_l = delay_line_l.Read();
-		const float delay_out_r = delay_line_r.Read();
-		// Ping-pong delay with spread.
-		float fb_l = delay_out_r * feedback_mix;
-		float fb_r = delay_out_l * feedback_mix;
-		delay_line_l.Write(input_l + fb_l);
-		delay_line_r.Write(input_r + fb_r);
-		const float spread = delay_spread_smoothed;
-		float delay_l = delay_out_l;
-		float delay_r = delay_out_r;
-		if (spread > 0.0f)
-		{
-			const float width = 1.0f + (spread * spread * 2.5f);
-			const float mid = 0.5f * (delay_l + delay_r);
-			const float side = 0.5f * (delay_l - delay_r);
-			delay_l = mid + (side * width);
-			delay_r = mid - (side * width);
-		}
-		const float mix = delay_mix;
-		const float delay_mix_l = (l * (1.0f - mix)) + (delay_l * mix);
-		const float delay_mix_r = (r * (1.0f - mix)) + (delay_r * mix);
-		l = delay_mix_l;
-		r = delay_mix_r;
-	};
-
-	auto apply_reverb = [&](float &l, float &r)
+		AdvanceSequencer(audio_frame_clock, size);
+	}
+	if (use_poly)
 	{
-		float rev_in_l = 0.0f;
-		float rev_in_r = 0.0f;
-		const bool predelay_active = (cached_reverb_predelay_samples >= 1.0f);
-		if (predelay_active)
-		{
-			rev_in_l = reverb_predelay_l.Read();
-			rev_in_r = reverb_predelay_r.Read();
-			reverb_predelay_l.Write(l);
-			reverb_predelay_r.Write(r);
-		}
-		else
-		{
-			reverb_predelay_l.Write(l);
-			reverb_predelay_r.Write(r);
-			rev_in_l = l;
-			rev_in_r = r;
-		}
-		const float rev_in_level = fabsf(l) + fabsf(r);
-		if (rev_in_level > 1e-4f)
-		{
-			reverb_tail_gain = 1.0f;
-		}
-		else
-		{
-			reverb_tail_gain *= cached_reverb_release;
-		}
-		// Shimmer: pitch-shifted octave layer around midpoint (0.5 = no shimmer).
-		float shimmer_amount = 0.0f;
-		float shimmer_rate = 1.0f;
-		int next_mode = 0;
-		if (rev_shimmer > 0.0f)
-		{
-			shimmer_amount = rev_shimmer;
-			if (shimmer_amount > 1.0f)
-			{
-				shimmer_amount = 1.0f;
-			}
-			if (shimmer_amount < 0.25f)
-			{
-				shimmer_amount *= 2.0f;
-			}
-			else
-			{
-				shimmer_amount = 0.5f + (shimmer_amount - 0.25f) * (0.5f / 0.75f);
-			}
-			if (shimmer_amount > 1.0f)
-			{
-				shimmer_amount = 1.0f;
-			}
-			shimmer_rate = kShimmerRateUp;
-			next_mode = 1;
-		}
-		else
-		{
-			shimmer_amount = 0.0f;
-			shimmer_rate = kShimmerRateUp;
-			next_mode = 0;
-		}
-
-		if (next_mode != shimmer_mode)
-		{
-			shimmer_mode = next_mode;
-			shimmer_read_idx = static_cast<float>(
-				(shimmer_write_idx + kShimmerBufferSize - kShimmerDelaySamples)
-				% kShimmerBufferSize);
-		}
-
-		float shimmer_fb_l = 0.0f;
-		float shimmer_fb_r = 0.0f;
-		if (shimmer_amount > 0.0f)
-		{
-			const size_t read_i0 = static_cast<size_t>(shimmer_read_idx) % kShimmerBufferSize;
-			const size_t read_i1 = (read_i0 + 1) % kShimmerBufferSize;
-			const float frac = shimmer_read_idx - static_cast<float>(read_i0);
-			const float sh_l = shimmer_buf_l[read_i0]
-				+ (shimmer_buf_l[read_i1] - shimmer_buf_l[read_i0]) * frac;
-			const float sh_r = shimmer_buf_r[read_i0]
-				+ (shimmer_buf_r[read_i1] - shimmer_buf_r[read_i0]) * frac;
-			shimmer_fb_l = shimmer_amount * kShimmerFeedback * shimmer_hp_l.Process(sh_l);
-			shimmer_fb_r = shimmer_amount * kShimmerFeedback * shimmer_hp_r.Process(sh_r);
-
-			shimmer_read_idx += shimmer_rate;
-			while (shimmer_read_idx >= static_cast<float>(kShimmerBufferSize))
-			{
-				shimmer_read_idx -= static_cast<float>(kShimmerBufferSize);
-			}
-			const size_t read_int = static_cast<size_t>(shimmer_read_idx);
-			size_t dist = (shimmer_write_idx >= read_int)
-				? (shimmer_write_idx - read_int)
-				: (shimmer_write_idx + kShimmerBufferSize - read_int);
-			if (dist < 4)
-			{
-				shimmer_read_idx = static_cast<float>(
-					(shimmer_write_idx + kShimmerBufferSize - kShimmerDelaySamples)
-					% kShimmerBufferSize);
-			}
-		}
-
-		float rev_l = 0.0f;
-		float rev_r = 0.0f;
-		reverb.Process(rev_in_l + shimmer_fb_l, rev_in_r + shimmer_fb_r, &rev_l, &rev_r);
-		rev_l *= cached_reverb_gain * reverb_tail_gain;
-		rev_r *= cached_reverb_gain * reverb_tail_gain;
-
-		shimmer_buf_l[shimmer_write_idx] = rev_l;
-		shimmer_buf_r[shimmer_write_idx] = rev_r;
-		shimmer_write_idx = (shimmer_write_idx + 1) % kShimmerBufferSize;
-		const float wet = cached_reverb_wet;
-		float wet_mix = wet;
-		float dry_mix = 1.0f - wet;
-		if (wet < 0.5f)
-		{
-			wet_mix = 2.0f * wet * wet;
-			dry_mix = 1.0f - wet_mix;
-		}
-		else
-		{
-			dry_mix = 2.0f * (1.0f - wet) * (1.0f - wet);
-			wet_mix = 1.0f - dry_mix;
-		}
-		wet_mix *= 1.12f;
-		if (wet_mix > 1.0f)
-		{
-			wet_mix = 1.0f;
-		}
-		if (wet >= 0.999f)
-		{
-			wet_mix = 1.0f;
-			dry_mix = 0.0f;
-		}
-		l = (l * dry_mix) + (rev_l * wet_mix);
-		r = (r * dry_mix) + (rev_r * wet_mix);
-	};
+		VoiceRenderParams voice_params;
+		voice_params.env_active = amp_env_active;
+		voice_params.inv_attack_samples = (amp_attack_samples > 1.0f) ? (1.0f / amp_attack_samples) : 0.0f;
+		voice_params.release_samples = amp_release_samples;
+		voice_params.inv_release_samples = (amp_release_samples > 1.0f) ? (1.0f / amp_release_samples) : 0.0f;
+		RenderPerformVoices(voice_params, perform_mode, voice_frames, audio_frame_clock);
+	}
+#if WAVECONT_PROFILE
+	ProfileRecord(profile_live, ProfileStage::Voices, ProfileNow() - profile_voices_start);
+#endif
+	audio_frame_clock += static_cast<uint32_t>(size);
+	audio_block_us = System::GetUs();
+	audio_block_frames = static_cast<uint32_t>(size);
 
 	float fx_gain = fx_chain_fade_gain;
 	int32_t fade_samples_left = fx_chain_fade_samples_left;
@@ -8270,16 +11086,51 @@ static float last_chorus_wow = -1.0f;
 		? (fx_chain_fade_target - fx_gain) / static_cast<float>(fade_samples_left)
 		: 0.0f;
 
-	for (size_t i = 0; i < size; i++)
+	const bool monitor_active =
+		(ui_mode == UiMode::Record
+			&& record_state != RecordState::Review
+			&& record_state != RecordState::SourceSelect
+			&& record_state != RecordState::BackConfirm
+			&& record_state != RecordState::TargetSelect);
+	// Idle: no source can produce a sample and every FX tail the output
+	// still passes through has gone to sleep. The block is then silence.
+	const bool sources_idle = !monitor_active
+		&& record_state != RecordState::Recording
+		&& !(sample_loaded && playback_active && window_valid)
+		&& !preview_active
+		&& !(use_poly && AnyPerformVoiceActive());
+	const uint32_t idle_hold_frames = static_cast<uint32_t>(out_sr * (kEngineIdleHoldMs * 0.001f));
+	if (!sources_idle)
+	{
+		engine_quiet_frames = 0;
+	}
+	else if (engine_quiet_frames < idle_hold_frames)
+	{
+		engine_quiet_frames += static_cast<uint32_t>(size);
+	}
+	const bool fx_tails_idle = main_mode
+		|| fx_chain_paused
+		|| !fx_allowed
+		|| (!fx_chain.StageAwake(FxStage::Delay) && !fx_chain.StageAwake(FxStage::Reverb));
+	const bool idle = sources_idle
+		&& engine_quiet_frames >= idle_hold_frames
+		&& fade_samples_left == 0
+		&& fx_tails_idle;
+	engine_idle = idle;
+	if (idle)
+	{
+		for (size_t i = 0; i < size; i++)
+		{
+			out[0][i] = 0.0f;
+			out[1][i] = 0.0f;
+		}
+	}
+	const size_t render_frames = idle ? 0 : size;
+
+	for (size_t i = 0; i < render_frames; i++)
 	{
 		float sig_l = 0.0f;
 		float sig_r = 0.0f;
-		const bool monitor_active =
-			(ui_mode == UiMode::Record
-				&& record_state != RecordState::Review
-				&& record_state != RecordState::SourceSelect
-				&& record_state != RecordState::BackConfirm
-				&& record_state != RecordState::TargetSelect);
 		float monitor_l = 0.0f;
 		float monitor_r = 0.0f;
 		if (monitor_active)
@@ -8305,6 +11156,7 @@ static float last_chorus_wow = -1.0f;
 				const int16_t samp = static_cast<int16_t>(s);
 				sample_buffer_l[record_pos] = samp;
 				sample_buffer_r[record_pos] = samp;
+				WavePyramidAddSample(*sample_pyramid, record_pos, samp);
 				int16_t abs_s = samp < 0 ? static_cast<int16_t>(-samp) : samp;
 				if (abs_s > live_wave_peak)
 				{
@@ -8347,16 +11199,13 @@ static float last_chorus_wow = -1.0f;
 				waveform_from_recording = true;
 				record_state = RecordState::Review;
 				record_waveform_pending = true;
+				record_stop_auto = true;
+				request_record_stop_log = true;
 				if (sample_loaded)
 				{
-					ComputeWaveform();
-					waveform_ready = true;
-					waveform_dirty = true;
 					UpdateTrimFrames();
 					request_length_redraw = true;
 				}
-				LogLine("Record: auto-stop at max frames=%lu",
-						static_cast<unsigned long>(sample_length));
 			}
 		}
 		if (sample_loaded && playback_active && record_state != RecordState::Recording && window_valid)
@@ -8475,133 +11324,10 @@ static float last_chorus_wow = -1.0f;
 				}
 			}
 		}
-		if (use_poly)
+		if (use_poly && i < voice_frames)
 		{
-			for (int v = 0; v < kPerformVoiceCount; ++v)
-			{
-				auto &voice = perform_voices[v];
-				if (!voice.active || voice.length == 0)
-				{
-					continue;
-				}
-				float env = 1.0f;
-				if (amp_env_active)
-				{
-					if (amp_attack_samples > 1.0f)
-					{
-						env = static_cast<float>(voice.env_samples) / amp_attack_samples;
-					}
-				}
-				if (env > 1.0f)
-				{
-					env = 1.0f;
-				}
-				if (voice.releasing)
-				{
-					float noteoff_env = voice.release_start;
-					if (amp_release_samples > 1.0f)
-					{
-						noteoff_env *= (1.0f - (voice.release_pos / amp_release_samples));
-					}
-					if (noteoff_env < 0.0f)
-					{
-						noteoff_env = 0.0f;
-					}
-					if (noteoff_env < env)
-					{
-						env = noteoff_env;
-					}
-				}
-				if (env < 0.0f)
-				{
-					env = 0.0f;
-				}
-				voice.env = env;
-				if (voice.length == 1)
-				{
-					const size_t idx = voice.offset;
-					const float amp = voice.amp * env;
-					float samp_l = 0.0f;
-					float samp_r = 0.0f;
-					samp_l = static_cast<float>(sample_buffer_l[idx]) * kSampleScale * amp;
-					const float r = sample_stereo
-						? static_cast<float>(sample_buffer_r[idx])
-						: static_cast<float>(sample_buffer_l[idx]);
-					samp_r = r * kSampleScale * amp;
-					if (perform_mode)
-					{
-						samp_l = perform_lpf_l2[v].Process(perform_lpf_l1[v].Process(samp_l));
-						samp_r = perform_lpf_r2[v].Process(perform_lpf_r1[v].Process(samp_r));
-					}
-					sig_l += samp_l;
-					sig_r += samp_r;
-					voice.active = false;
-					voice.releasing = false;
-					voice.release_pos = 0.0f;
-					voice.env_samples = 0;
-					continue;
-				}
-				const size_t idx_rel = static_cast<size_t>(voice.phase);
-				if (idx_rel + 1 >= voice.length)
-				{
-					voice.active = false;
-					voice.releasing = false;
-					voice.release_pos = 0.0f;
-					voice.env_samples = 0;
-					continue;
-				}
-				const float frac = voice.phase - static_cast<float>(idx_rel);
-				const size_t idx = voice.offset + idx_rel;
-				float l0 = 0.0f;
-				float l1 = 0.0f;
-				float r0 = 0.0f;
-				float r1 = 0.0f;
-				l0 = static_cast<float>(sample_buffer_l[idx]);
-				l1 = static_cast<float>(sample_buffer_l[idx + 1]);
-				if (sample_stereo)
-				{
-					r0 = static_cast<float>(sample_buffer_r[idx]);
-					r1 = static_cast<float>(sample_buffer_r[idx + 1]);
-				}
-				else
-				{
-					r0 = l0;
-					r1 = l1;
-				}
-				const float amp = voice.amp * env;
-				float samp_l = (l0 + (l1 - l0) * frac) * kSampleScale * amp;
-				float samp_r = (r0 + (r1 - r0) * frac) * kSampleScale * amp;
-				if (perform_mode)
-				{
-					samp_l = perform_lpf_l2[v].Process(perform_lpf_l1[v].Process(samp_l));
-					samp_r = perform_lpf_r2[v].Process(perform_lpf_r1[v].Process(samp_r));
-				}
-				sig_l += samp_l;
-				sig_r += samp_r;
-				voice.phase += voice.rate;
-				if (!voice.releasing)
-				{
-					++voice.env_samples;
-				}
-				else
-				{
-					voice.release_pos += 1.0f;
-					if (amp_release_samples > 1.0f && voice.release_pos >= amp_release_samples)
-					{
-						voice.active = false;
-						voice.releasing = false;
-						voice.release_pos = 0.0f;
-						voice.env_samples = 0;
-					}
-				}
-				if (voice.phase >= static_cast<float>(voice.length - 1))
-				{
-					voice.active = false;
-					voice.releasing = false;
-					voice.release_pos = 0.0f;
-					voice.env_samples = 0;
-				}
-			}
+			sig_l += voice_mix_l[i];
+			sig_r += voice_mix_r[i];
 		}
 		if (preview_active)
 		{
@@ -8613,11 +11339,12 @@ static float last_chorus_wow = -1.0f;
 				const size_t idx0 = read_idx;
 				const size_t idx1 = (idx0 + 1) % kPreviewBufferFrames;
 				const float frac = preview_read_frac;
-				const float s0 = static_cast<float>(preview_buffer[idx0]);
-				const float s1 = static_cast<float>(preview_buffer[idx1]);
-				const float samp = (s0 + (s1 - s0) * frac) * kSampleScale;
-				sig_l += samp;
-				sig_r += samp;
+				const float l0 = static_cast<float>(preview_buffer_l[idx0]);
+				const float l1 = static_cast<float>(preview_buffer_l[idx1]);
+				const float r0 = static_cast<float>(preview_buffer_r[idx0]);
+				const float r1 = static_cast<float>(preview_buffer_r[idx1]);
+				sig_l += (l0 + (l1 - l0) * frac) * kSampleScale;
+				sig_r += (r0 + (r1 - r0) * frac) * kSampleScale;
 
 				float next_frac = preview_read_frac + preview_rate;
 				while (next_frac >= 1.0f && available > 0)
@@ -8664,17 +11391,7 @@ static float last_chorus_wow = -1.0f;
 		}
 		float fx_l = sig_l;
 		float fx_r = sig_r;
-		for (int stage = 0; stage < kPerformFaderCount; ++stage)
-		{
-			switch (fx_order[stage])
-			{
-				case kFxSatIndex: apply_saturation(fx_l, fx_r); break;
-				case kFxChorusIndex: apply_chorus(fx_l, fx_r); break;
-				case kFxDelayIndex: apply_delay(fx_l, fx_r); break;
-				case kFxReverbIndex: apply_reverb(fx_l, fx_r); break;
-				default: break;
-			}
-		}
+		fx_chain.Process(fx_order, kPerformFaderCount, fx_l, fx_r);
 		out[0][i] = fx_l * fx_gain;
 		out[1][i] = fx_r * fx_gain;
 	}
@@ -8689,6 +11406,21 @@ static float last_chorus_wow = -1.0f;
 		fx_chain_fade_gain = 0.0f;
 	}
 	request_playhead_redraw = true;
+#if WAVECONT_PROFILE
+	ProfileRecord(profile_live, ProfileStage::Sat, fx_chain.StageTicks(FxStage::Sat));
+	ProfileRecord(profile_live, ProfileStage::Mod, fx_chain.StageTicks(FxStage::Mod));
+	ProfileRecord(profile_live, ProfileStage::Delay, fx_chain.StageTicks(FxStage::Delay));
+	ProfileRecord(profile_live, ProfileStage::Reverb, fx_chain.StageTicks(FxStage::Reverb));
+	ProfileEndBlock(profile_live, ProfileNow() - profile_start);
+	if (!profile_report_ready
+		&& profile_live.blocks * size >= static_cast<size_t>(out_sr * (kProfileWindowMs * 0.001f)))
+	{
+		profile_report = profile_live;
+		std::atomic_signal_fence(std::memory_order_release);
+		profile_report_ready = true;
+		ProfileWindowReset(profile_live, profile_live.budget_ticks);
+	}
+#endif
 }
 
 int main(void)
@@ -8699,72 +11431,17 @@ int main(void)
 	hw.seed.StartLog(false);
 	LogLine("Logger started");
 
-	reverb.Init(hw.AudioSampleRate());
-	reverb.SetFeedback(kReverbFeedback);
-	reverb.SetLpFreq(kReverbLpFreq);
-	shimmer_hp_l.Init(hw.AudioSampleRate(), kShimmerHpHz);
-	shimmer_hp_r.Init(hw.AudioSampleRate(), kShimmerHpHz);
-	for (size_t i = 0; i < kShimmerBufferSize; ++i)
-	{
-		shimmer_buf_l[i] = 0.0f;
-		shimmer_buf_r[i] = 0.0f;
-	}
-	shimmer_write_idx = 0;
-	shimmer_read_idx = static_cast<float>(kShimmerBufferSize - kShimmerDelaySamples);
-	shimmer_mode = 0;
-
-	sat_l.Init(hw.AudioSampleRate());
-	sat_r.Init(hw.AudioSampleRate());
-	sat_l.SetTone(0.5f);
-	sat_r.SetTone(0.5f);
-	sat_l.SetBias(0.0f);
-	sat_r.SetBias(0.0f);
-	sat_l.SetOutput(0.666f);
-	sat_r.SetOutput(0.666f);
-	sat_l.SetDrive(0.0f);
-	sat_r.SetDrive(0.0f);
-	sat_l.SetMix(1.0f);
-	sat_r.SetMix(1.0f);
-	sat_l.SetBump(0.0f);
-	sat_r.SetBump(0.0f);
-
-	chorus_l.Init(hw.AudioSampleRate());
-	chorus_r.Init(hw.AudioSampleRate());
-	chorus_l.SetLfoFreq(kChorusRateHz);
-	chorus_r.SetLfoFreq(-kChorusRateHz);
-	chorus_l.SetDelayMs(kChorusDelayMs);
-	chorus_r.SetDelayMs(kChorusDelayMs);
-	chorus_l.SetFeedback(kChorusFeedback);
-	chorus_r.SetFeedback(kChorusFeedback);
-	chorus_l.SetLfoDepth(0.0f);
-	chorus_r.SetLfoDepth(0.0f);
-	chorus_rate = 0.5f;
-	chorus_wow = 0.5f;
-	tape_rate = 0.5f;
-
-	delay_line_l.Init();
-	delay_line_r.Init();
-	const float delay_init_ms = kDelayTimeMinMs;
-	float delay_samples = delay_init_ms * 0.001f * hw.AudioSampleRate();
-	const float max_delay = static_cast<float>(kDelayMaxSamples - 1);
-	if (delay_samples > max_delay)
-	{
-		delay_samples = max_delay;
-	}
-	if (delay_samples < 1.0f)
-	{
-		delay_samples = 1.0f;
-	}
-	delay_line_l.SetDelay(delay_samples);
-	delay_line_r.SetDelay(delay_samples);
-
-	reverb_predelay_l.Init();
-	reverb_predelay_r.Init();
-	reverb_predelay_l.SetDelay(0.0f);
-	reverb_predelay_r.SetDelay(0.0f);
-
-	UpdatePlayStepMs();
+	fx_chain.Init(hw.AudioSampleRate(), &fx_memory);
+#if WAVECONT_PROFILE
+	ProfileClockInit();
+#endif
+	fx_params.chorus_rate = 0.5f;
+	fx_params.chorus_wow = 0.5f;
+	fx_params.tape_rate = 0.5f;
+
+	ClampPlayBpm();
 	InitTrackStates();
+	InitWavePyramids();
 
 	encoder_r.Init(seed::D7, seed::D8, seed::D22, hw.AudioSampleRate());
 	shift_button.Init(seed::D9, 1000);
@@ -8786,7 +11463,10 @@ int main(void)
 
 	DrawMenu(menu_index);
 
+	ResetVoiceAllocator();
+	sample_pool.Init(sample_pool_mem, kSamplePoolBytes);
 	hw.StartAdc();
+	CompileFxStages();
 	hw.StartAudio(AudioCallback);
 	hw.midi.StartReceive();
 	UiMode last_mode = UiMode::Main;
@@ -8798,6 +11478,7 @@ int main(void)
 	int32_t last_scroll = -1;
 	int32_t last_selected = -1;
 	int32_t last_file_count = -1;
+	int32_t last_preview_offset = -1;
 	bool last_sd_mounted = false;
 	RecordState last_record_state = RecordState::Armed;
 	bool last_playback_active = false;
@@ -8808,10 +11489,12 @@ int main(void)
 	LoadDestination last_load_target = LoadDestination::Play;
 	while(1)
 	{
-		hw.midi.Listen();
-		while(hw.midi.HasEvents())
+		while (midi_in_read != midi_in_write)
 		{
-			HandleMidiMessage(hw.midi.PopEvent());
+			std::atomic_signal_fence(std::memory_order_acquire);
+			const MidiInEvent& event = midi_in_queue[midi_in_read & (kMidiInQueueSize - 1)];
+			HandleMidiMessage(event.msg, event.stamp + kMidiLatencyFrames);
+			midi_in_read = midi_in_read + 1;
 		}
 		int32_t aux_delta = 0;
 		if (encoder_r_accum != 0)
@@ -8831,7 +11514,7 @@ int main(void)
 			LogLine("Encoder R button pressed");
 		}
 	}
-	const bool ui_blocked = (sd_init_in_progress || save_in_progress);
+	const bool ui_blocked = (sd_init_in_progress || save_in_progress || load_in_progress);
 	if (button2_press)
 	{
 		button2_press = false;
@@ -8850,17 +11533,13 @@ int main(void)
 				{
 					if (!playhead_running)
 					{
-						playhead_running = true;
-						playhead_step = 0;
-						playhead_last_step_ms = System::GetNow();
+						StartSequencer();
 						play_screen_dirty = true;
 						request_playhead_redraw = true;
-						TriggerSequencerStep(playhead_step);
 					}
 					else
 					{
-						playhead_running = false;
-						playhead_last_step_ms = 0;
+						StopSequencer();
 					play_screen_dirty = true;
 					request_playhead_redraw = true;
 				}
@@ -8876,7 +11555,7 @@ int main(void)
 				}
 				if (IsPerformUiMode(ui_mode))
 				{
-					StartPerformVoice(kBaseMidiNote);
+					StartPerformVoice(kBaseMidiNote, AudioFrameNow() + kMidiLatencyFrames);
 				}
 				else
 				{
@@ -8885,31 +11564,9 @@ int main(void)
 				request_playhead_redraw = true;
 			}
 		}
-			if (!ui_blocked && IsPlayUiMode(ui_mode) && playhead_running)
+		if (playhead_running && !sd_init_in_progress)
 		{
-		const uint32_t now = System::GetNow();
-			if (playhead_last_step_ms == 0)
-			{
-				playhead_last_step_ms = now;
-			}
-			if (play_step_ms > 0)
-			{
-				const uint32_t elapsed = now - playhead_last_step_ms;
-				if (elapsed >= play_step_ms)
-				{
-					const uint32_t steps = elapsed / play_step_ms;
-					playhead_last_step_ms += steps * play_step_ms;
-					const int32_t start_step = playhead_step;
-					for (uint32_t s = 0; s < steps; ++s)
-					{
-						const int32_t step = (start_step + static_cast<int32_t>(s) + 1) % kPlayStepCount;
-						TriggerSequencerStep(step);
-					}
-					playhead_step = (start_step + static_cast<int32_t>(steps)) % kPlayStepCount;
-					play_screen_dirty = true;
-					request_playhead_redraw = true;
-				}
-			}
+			ArmSequencerPlans();
 		}
 		if (request_load_scan)
 		{
@@ -8923,19 +11580,40 @@ int main(void)
 				{
 					request_load_scan = false;
 					LogLine("Load menu: scan requested");
-					ScanSdFiles(true);
+					OpenSampleLibrary();
 				}
 			}
 		}
+		if (request_voice_reset)
+		{
+			request_voice_reset = false;
+			ResetPerformVoices();
+		}
 		if (request_delete_scan)
 		{
 			if (!ui_blocked)
 			{
 				request_delete_scan = false;
 				LogLine("Delete menu: scan requested");
-				ScanSdFiles(false);
+				OpenSampleLibrary();
 			}
 		}
+		if (request_browse_open && !ui_blocked)
+		{
+			request_browse_open = false;
+			BrowseOpen(request_browse_index);
+		}
+		// The sync waits while a delete is being confirmed so it cannot
+		// renumber the list under the dialog.
+		if (library_sync_active && !ui_blocked && !delete_confirm && !request_delete_file)
+		{
+			StepLibrarySync();
+		}
+		if (delete_confirm && delete_confirm_name[0] == '\0' && !ui_blocked)
+		{
+			CopyString(delete_confirm_path, LibraryPath(BrowseFileRecord(load_selected)), sizeof(delete_confirm_path));
+			CopyString(delete_confirm_name, LibraryBaseName(delete_confirm_path), kMaxWavNameLen);
+		}
 		if (request_load_sample)
 		{
 			if (ui_blocked)
@@ -8957,98 +11635,41 @@ int main(void)
 				request_load_index = -1;
 				const LoadDestination dest = request_load_destination;
 				SampleContext target_ctx = SampleContext::Play;
+				int32_t target_track = -1;
 				if (load_context == LoadContext::Edt)
 				{
 					target_ctx = edt_sample_context;
 				}
 				else if (load_context == LoadContext::Track)
 				{
-					target_ctx = SampleContext::Play;
+					target_ctx = SampleContext::Track;
+					target_track = load_context_track;
 				}
 				else if (dest == LoadDestination::Perform)
 				{
 					target_ctx = SampleContext::Perform;
 				}
-				SetSampleContext(target_ctx);
+				SetSampleContext(target_ctx, target_track);
 				LogLine("Load menu: sample request index=%ld target=%s",
 						static_cast<long>(index),
 						LoadDestinationName(dest));
 				if (index >= 0 && index < wav_file_count)
 				{
-					LogLine("Load menu: sample name=%s", wav_files[index]);
+					LogLine("Load menu: sample name=%s", LibraryPath(BrowseFileRecord(index)));
 				}
 				else
 				{
 					LogLine("Load menu: sample name unavailable (count=%ld)", static_cast<long>(wav_file_count));
 				}
-				if (LoadSampleAtIndex(index))
+				if (BeginLoadSampleAtIndex(index))
 				{
-					if (load_context == LoadContext::Track)
-					{
-						const int32_t track = load_context_track;
-						if (track >= 0 && track < kPlayTrackCount)
-						{
-							track_samples[track].loaded = sample_loaded;
-							CopyString(track_samples[track].name, loaded_sample_name, kMaxWavNameLen);
-							track_samples[track].trim_start = trim_start;
-							track_samples[track].trim_end = trim_end;
-						}
-						LogLine("Load success, entering TRACK menu");
-						ui_mode = UiMode::PlayTrack;
-						request_perform_redraw = true;
-					}
-					else if (load_context == LoadContext::Edt)
-					{
-						LogLine("Load success, returning to EDT");
-						ui_mode = UiMode::Edt;
-						if (sample_loaded && sample_length > 0)
-						{
-							waveform_ready = true;
-						}
-						waveform_dirty = true;
-						request_length_redraw = true;
-					}
-					else if (dest == LoadDestination::Perform)
-					{
-						LogLine("Load success, entering PERFORM menu");
-						ui_mode = UiMode::Perform;
-						menu_index = 2;
-					}
-					else
-					{
-						LogLine("Load success, entering PLAY menu");
-						ui_mode = UiMode::Play;
-					}
-					load_context = LoadContext::Main;
+					load_in_progress = true;
+					load_job_destination = dest;
+					load_draw_next_ms = 0;
 				}
 				else
 				{
-					LogLine("Load failed");
-					ui_mode = UiMode::Load;
-					if (load_context != LoadContext::Track)
-					{
-						load_context = LoadContext::Main;
-					}
-				}
-			}
-		}
-		if (request_track_sample_load)
-		{
-			if (ui_blocked)
-			{
-				request_track_sample_load = false;
-				request_track_sample_index = -1;
-				LogLine("Track sample load ignored during UI block");
-			}
-			else
-			{
-				request_track_sample_load = false;
-				const int32_t track = request_track_sample_index;
-				request_track_sample_index = -1;
-				if (perform_context == PerformContext::Track && track == perform_context_track)
-				{
-					ApplyTrackSampleState(track);
-					request_perform_redraw = true;
+					CompleteLoadRequest(false, dest);
 				}
 			}
 		}
@@ -9058,9 +11679,10 @@ int main(void)
 			const bool preview_allowed = (ui_mode == UiMode::Load
 				&& !(kLoadPresetsPlaceholder && load_context == LoadContext::Main && !delete_mode)
 				&& wav_file_count > 0);
-			if (preview_hold && preview_allowed)
+			if (preview_hold && preview_allowed && BrowseFileRecord(load_selected) >= 0)
 			{
-				if (!preview_active || preview_index != load_selected)
+				if (!preview_active || preview_index != load_selected
+					|| preview_info.step != preview_offset_step)
 				{
 					if (!BeginPreviewAtIndex(load_selected))
 					{
@@ -9075,11 +11697,26 @@ int main(void)
 					StopPreview();
 				}
 			}
+			if (preview_allowed && !delete_mode)
+			{
+				UpdateLoadOverviews(!preview_active);
+				if (!preview_active)
+				{
+					UpdatePreviewHeads(load_selected);
+				}
+			}
 		}
 		if (preview_active)
 		{
 			FillPreviewBuffer();
 		}
+		FillStreamBuffers();
+		if (!ui_blocked)
+		{
+			StepWaveformProbe();
+		}
+		CompileFxStages();
+		UpdateRecordBuffer();
 		if (request_delete_file)
 		{
 			if (ui_blocked)
@@ -9096,13 +11733,15 @@ int main(void)
 				LogLine("Delete menu: request index=%ld", static_cast<long>(index));
 				if (index >= 0 && index < wav_file_count)
 				{
-					LogLine("Delete menu: file name=%s", wav_files[index]);
+					LogLine("Delete menu: file name=%s", LibraryPath(BrowseFileRecord(index)));
 				}
 				else
 				{
 					LogLine("Delete menu: file name unavailable (count=%ld)", static_cast<long>(wav_file_count));
 				}
-				if (DeleteFileAtIndex(index))
+				const bool deleted = DeleteFileAtIndex(index, delete_confirm_path);
+				delete_confirm_path[0] = '\0';
+				if (deleted)
 				{
 					LogLine("Delete success");
 					request_delete_scan = true;
@@ -9214,11 +11853,44 @@ int main(void)
 			}
 		}
 
+		if (load_in_progress)
+		{
+			bool step_done = false;
+			const bool load_ok = StepSampleLoad(step_done);
+			if (!load_ok || step_done)
+			{
+				load_in_progress = false;
+				CompleteLoadRequest(load_ok, load_job_destination);
+				last_mode = UiMode::Shift;
+			}
+			else
+			{
+				const uint32_t now = System::GetNow();
+				if (now >= load_draw_next_ms)
+				{
+					DrawLoadScreen();
+					load_draw_next_ms = now + 100;
+				}
+			}
+		}
+
 		if (record_waveform_pending)
 		{
 			record_waveform_pending = false;
+			if (request_record_stop_log)
+			{
+				request_record_stop_log = false;
+				LogLine(record_stop_auto ? "Record: auto-stop at max frames=%lu" : "Record: stop, frames=%lu",
+						static_cast<unsigned long>(sample_length));
+			}
 			if (sample_loaded && sample_length > 0)
 			{
+				// The callback fed the level-0 bins while recording; only the
+				// upper levels are left to build here.
+				if (!sample_pyramid->ready)
+				{
+					WavePyramidFinish(*sample_pyramid, sample_length);
+				}
 				ComputeWaveform();
 				waveform_ready = true;
 				waveform_dirty = true;
@@ -9253,6 +11925,27 @@ int main(void)
 			DrawShiftMenu(shift_menu_index);
 			last_shift_menu = shift_menu_index;
 		}
+#if WAVECONT_PROFILE
+		if (profile_report_ready)
+		{
+			std::atomic_signal_fence(std::memory_order_acquire);
+			profile_shown = profile_report;
+			profile_shown_valid = true;
+			std::atomic_signal_fence(std::memory_order_release);
+			profile_report_ready = false;
+			request_cpu_load_redraw = true;
+		}
+#endif
+		if (request_profile_dump)
+		{
+			request_profile_dump = false;
+			LogProfileReport();
+		}
+		if (!ui_blocked && request_cpu_load_redraw && ui_mode == UiMode::CpuLoad)
+		{
+			request_cpu_load_redraw = false;
+			DrawCpuLoadScreen();
+		}
 
 		const UiMode mode = ui_mode;
 		if (mode != last_mode)
@@ -9261,24 +11954,21 @@ int main(void)
 			const bool is_play = IsPlayUiMode(mode);
 			if (was_play && !is_play)
 			{
-				playhead_running = false;
+				StopSequencer();
 				playhead_step = 0;
-				playhead_last_step_ms = 0;
 				play_screen_dirty = true;
 			}
 			if (mode == UiMode::FxDetail)
 			{
-				if (IsPlayUiMode(fx_detail_prev_mode))
+				if (fx_detail_prev_mode == UiMode::PlayTrack)
+				{
+					SetSampleContext(SampleContext::Track, perform_context_track);
+					SetFxContext(FxContext::Track, perform_context_track);
+				}
+				else if (fx_detail_prev_mode == UiMode::Play)
 				{
 					SetSampleContext(SampleContext::Play);
-					if (fx_detail_prev_mode == UiMode::PlayTrack)
-					{
-						SetFxContext(FxContext::Track, perform_context_track);
-					}
-					else
-					{
-						SetFxContext(FxContext::Play);
-					}
+					SetFxContext(FxContext::Play);
 				}
 				else
 				{
@@ -9289,9 +11979,18 @@ int main(void)
 			else if (mode == UiMode::Edt)
 			{
 				SetSampleContext(edt_sample_context);
-				SetFxContext((edt_sample_context == SampleContext::Play)
-					? FxContext::Play
-					: FxContext::Perform);
+				edt_zoom = 0;
+				edt_view_start = 0;
+				if (edt_sample_context == SampleContext::Track)
+				{
+					SetFxContext(FxContext::Track, perform_context_track);
+				}
+				else
+				{
+					SetFxContext((edt_sample_context == SampleContext::Play)
+						? FxContext::Play
+						: FxContext::Perform);
+				}
 			}
 			else if (mode == UiMode::Perform)
 			{
@@ -9305,7 +12004,7 @@ int main(void)
 			}
 			else if (mode == UiMode::PlayTrack)
 			{
-				SetSampleContext(SampleContext::Play);
+				SetSampleContext(SampleContext::Track, perform_context_track);
 				SetFxContext(FxContext::Track, perform_context_track);
 			}
 			if (IsPerformUiMode(last_mode) && !IsPerformUiMode(mode))
@@ -9333,6 +12032,10 @@ int main(void)
 			{
 				DrawSaveScreen();
 			}
+			else if (load_in_progress)
+			{
+				DrawLoadScreen();
+			}
 			else if (mode == UiMode::Main)
 			{
 				DrawMenu(menu_index);
@@ -9349,7 +12052,7 @@ int main(void)
 					LogLine("Load menu: selected=%ld name=%s",
 							static_cast<long>(load_selected),
 							(load_selected >= 0 && load_selected < wav_file_count)
-								? wav_files[load_selected]
+								? LibraryPath(BrowseRecord(load_selected))
 								: "UNKNOWN");
 				}
 			}
@@ -9411,6 +12114,10 @@ int main(void)
 			{
 				DrawPresetSaveStub();
 			}
+			else if (mode == UiMode::CpuLoad)
+			{
+				DrawCpuLoadScreen();
+			}
 			else
 			{
 				if (record_state == RecordState::BackConfirm)
@@ -9532,24 +12239,31 @@ int main(void)
 				const int32_t current_scroll = load_scroll;
 				const int32_t current_count = wav_file_count;
 				const int32_t current_selected = load_selected;
+				const int32_t current_offset = preview_offset_step;
 				if (request_delete_redraw
+					|| request_load_overview_redraw
+					|| current_offset != last_preview_offset
+					|| request_library_redraw
 					|| current_scroll != last_scroll
 					|| current_selected != last_selected
 					|| current_count != last_file_count
 					|| sd_mounted != last_sd_mounted)
 				{
 					request_delete_redraw = false;
+					request_load_overview_redraw = false;
+					request_library_redraw = false;
 					DrawLoadMenu(current_scroll, current_selected);
 					if (current_selected != last_selected || current_count != last_file_count)
 					{
 						LogLine("Load menu: selected=%ld name=%s",
 								static_cast<long>(current_selected),
 								(current_selected >= 0 && current_selected < current_count)
-									? wav_files[current_selected]
+									? LibraryPath(BrowseRecord(current_selected))
 									: "UNKNOWN");
 					}
 					last_scroll = current_scroll;
 					last_selected = current_selected;
+					last_preview_offset = current_offset;
 					last_file_count = current_count;
 					last_sd_mounted = sd_mounted;
 				}
@@ -9755,6 +12469,10 @@ int main(void)
 			hw.led1.Set(0.0f, led1_level, 0.0f);
 		}
 		hw.UpdateLeds();
-		hw.DelayMs(10);
+		// A running load paces itself with kLoadStepBudgetMs.
+		if (!load_in_progress)
+		{
+			MainLoopWait(kMainLoopPeriodMs);
+		}
 	}
 }
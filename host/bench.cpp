@@ -0,0 +1,410 @@
+// Microbenchmarks for the WaveCont DSP core. Times each kernel alone and
+// the full voice + FX engine across block sizes, voice counts and sample
+// layouts, and prints one CSV row per configuration:
+//
+//   kernel,block,voices,channels,ns_per_frame,rt_load_pct
+//
+// rt_load_pct is the share of a 48 kHz real-time budget on this machine.
+// Compare runs with diff or a spreadsheet; the row set is stable.
+//
+//   wavecont_bench [--frames N] [--reps N] [--only KERNEL]
+#include "WaveContCore.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+constexpr float kBenchSampleRate = 48000.0f;
+constexpr size_t kBenchBlocks[] = {4, 8, 16, 32, 64, 128, 256};
+constexpr int kBenchVoiceCounts[] = {1, 2, 4, 8, 16, 32};
+constexpr int kBenchMaxVoices = 32;
+constexpr size_t kBenchMaxBlock = 256;
+constexpr size_t kBenchInputFrames = 4096;
+constexpr size_t kBenchSampleFrames = 10 * 48000;
+
+struct BenchConfig
+{
+	size_t frames = 48000;
+	int reps = 3;
+	std::string only;
+};
+
+// Keeps the optimizer from discarding the work being timed.
+volatile float bench_sink = 0.0f;
+
+float bench_in_l[kBenchInputFrames];
+float bench_in_r[kBenchInputFrames];
+std::vector<int16_t> bench_sample_l;
+std::vector<int16_t> bench_sample_r;
+
+void InitBenchInputs()
+{
+	uint32_t rng = 0x2468ACE1u;
+	for (size_t i = 0; i < kBenchInputFrames; ++i)
+	{
+		rng = rng * 1664525u + 1013904223u;
+		const float noise = static_cast<float>(rng >> 8) * (1.0f / 8388608.0f) - 1.0f;
+		const float tone = sinf(kTwoPi * 220.0f * static_cast<float>(i) / kBenchSampleRate);
+		bench_in_l[i] = 0.5f * tone + 0.1f * noise;
+		bench_in_r[i] = 0.5f * tone - 0.1f * noise;
+	}
+	bench_sample_l.resize(kBenchSampleFrames);
+	bench_sample_r.resize(kBenchSampleFrames);
+	for (size_t i = 0; i < kBenchSampleFrames; ++i)
+	{
+		const float t = static_cast<float>(i) / kBenchSampleRate;
+		bench_sample_l[i] = static_cast<int16_t>(12000.0f * sinf(kTwoPi * 110.0f * t));
+		bench_sample_r[i] = static_cast<int16_t>(12000.0f * sinf(kTwoPi * 165.0f * t));
+	}
+}
+
+// Best-of-reps wall time per frame. setup() runs untimed before each rep,
+// run(offset, frames) once per block.
+template <typename Setup, typename Run>
+double TimeBlocks(const BenchConfig& cfg, size_t block, Setup&& setup, Run&& run)
+{
+	const size_t blocks = (cfg.frames + block - 1) / block;
+	double best = 0.0;
+	for (int rep = 0; rep < cfg.reps; ++rep)
+	{
+		setup();
+		const auto t0 = std::chrono::steady_clock::now();
+		size_t offset = 0;
+		for (size_t b = 0; b < blocks; ++b)
+		{
+			run(offset, block);
+			offset = (offset + block) % kBenchInputFrames;
+		}
+		const auto t1 = std::chrono::steady_clock::now();
+		const double ns = std::chrono::duration<double, std::nano>(t1 - t0).count()
+			/ static_cast<double>(blocks * block);
+		if (rep == 0 || ns < best)
+		{
+			best = ns;
+		}
+	}
+	return best;
+}
+
+void PrintRow(const char* kernel, size_t block, int voices, const char* channels, double ns_per_frame)
+{
+	const double budget_ns = 1e9 / static_cast<double>(kBenchSampleRate);
+	std::printf("%s,%zu,%d,%s,%.2f,%.3f\n",
+				kernel,
+				block,
+				voices,
+				channels,
+				ns_per_frame,
+				100.0 * ns_per_frame / budget_ns);
+	std::fflush(stdout);
+}
+
+bool Selected(const BenchConfig& cfg, const char* kernel)
+{
+	return cfg.only.empty() || cfg.only == kernel;
+}
+
+void BenchTapeSaturator(const BenchConfig& cfg)
+{
+	if (!Selected(cfg, "tape_sat"))
+	{
+		return;
+	}
+	TapeSaturator sat_l;
+	TapeSaturator sat_r;
+	for (size_t block : kBenchBlocks)
+	{
+		auto setup = [&]() {
+			for (TapeSaturator* sat : {&sat_l, &sat_r})
+			{
+				sat->Init(kBenchSampleRate);
+				sat->SetDrive(0.7f);
+				sat->SetTone(0.5f);
+				sat->SetBump(0.5f);
+				sat->SetMix(1.0f);
+			}
+		};
+		auto run = [&](size_t offset, size_t frames) {
+			sat_l.Advance(frames);
+			sat_r.Advance(frames);
+			float acc = 0.0f;
+			for (size_t i = 0; i < frames; ++i)
+			{
+				acc += sat_l.Process(bench_in_l[offset + i]);
+				acc += sat_r.Process(bench_in_r[offset + i]);
+			}
+			bench_sink = bench_sink + acc;
+		};
+		PrintRow("tape_sat", block, 0, "stereo", TimeBlocks(cfg, block, setup, run));
+	}
+}
+
+struct FxKernel
+{
+	const char* name;
+	int32_t order[kPerformFaderCount];
+	void (*configure)(FxParamBlock& p);
+};
+
+const FxKernel kFxKernels[] = {
+	{"fx_sat", {kFxSatIndex, -1, -1, -1}, [](FxParamBlock& p) {
+		 p.fx_s_wet = 1.0f;
+		 p.sat_mode = 0;
+		 p.sat_drive = 0.7f;
+	 }},
+	{"fx_bitcrush", {kFxSatIndex, -1, -1, -1}, [](FxParamBlock& p) {
+		 p.fx_s_wet = 1.0f;
+		 p.sat_mode = 1;
+	 }},
+	{"fx_chorus", {kFxChorusIndex, -1, -1, -1}, [](FxParamBlock& p) {
+		 p.fx_c_wet = 1.0f;
+		 p.chorus_mode = 0;
+	 }},
+	{"fx_tape", {kFxChorusIndex, -1, -1, -1}, [](FxParamBlock& p) {
+		 p.fx_c_wet = 1.0f;
+		 p.chorus_mode = 1;
+		 p.chorus_wow = 0.7f;
+	 }},
+	{"fx_delay", {kFxDelayIndex, -1, -1, -1}, [](FxParamBlock& p) {
+		 p.delay_wet = 0.5f;
+		 p.delay_feedback = 0.6f;
+	 }},
+	{"fx_reverb", {kFxReverbIndex, -1, -1, -1}, [](FxParamBlock& p) {
+		 p.reverb_wet = 0.5f;
+		 p.reverb_shimmer = 0.0f;
+	 }},
+	{"fx_reverb_shimmer", {kFxReverbIndex, -1, -1, -1}, [](FxParamBlock& p) {
+		 p.reverb_wet = 0.5f;
+		 p.reverb_shimmer = 0.8f;
+	 }},
+	{"fx_chain", {kFxSatIndex, kFxChorusIndex, kFxDelayIndex, kFxReverbIndex}, [](FxParamBlock& p) {
+		 p.fx_s_wet = 0.5f;
+		 p.fx_c_wet = 0.5f;
+		 p.delay_wet = 0.4f;
+		 p.reverb_wet = 0.4f;
+		 p.reverb_shimmer = 0.8f;
+	 }},
+};
+
+void PrepareFxChain(FxChain& chain, FxChainMemory* mem, const FxParamBlock& raw)
+{
+	FxParamBlock params = raw;
+	ClampFxParams(params);
+	FxCoeffs coeffs;
+	CompileSatCoeffs(params, coeffs.sat);
+	CompileModCoeffs(params, coeffs.mod);
+	CompileDelayCoeffs(params, coeffs.delay, kBenchSampleRate);
+	CompileReverbCoeffs(params, coeffs.reverb, kBenchSampleRate);
+	chain.Init(kBenchSampleRate, mem);
+	chain.SetParams(params);
+	for (int stage = 0; stage < kFxStageCount; ++stage)
+	{
+		chain.ApplyStage(static_cast<FxStage>(stage), coeffs);
+	}
+}
+
+void BenchFxStages(const BenchConfig& cfg, FxChainMemory* mem)
+{
+	FxChain chain;
+	for (const FxKernel& kernel : kFxKernels)
+	{
+		if (!Selected(cfg, kernel.name))
+		{
+			continue;
+		}
+		FxParamBlock params;
+		kernel.configure(params);
+		for (size_t block : kBenchBlocks)
+		{
+			auto setup = [&]() { PrepareFxChain(chain, mem, params); };
+			auto run = [&](size_t offset, size_t frames) {
+				chain.BeginBlock(frames);
+				float acc = 0.0f;
+				for (size_t i = 0; i < frames; ++i)
+				{
+					float l = bench_in_l[offset + i];
+					float r = bench_in_r[offset + i];
+					chain.Process(kernel.order, kPerformFaderCount, l, r);
+					acc += l + r;
+				}
+				bench_sink = bench_sink + acc;
+			};
+			PrintRow(kernel.name, block, 0, "stereo", TimeBlocks(cfg, block, setup, run));
+		}
+	}
+}
+
+struct VoiceBench
+{
+	PerformVoice voices[kBenchMaxVoices];
+	VoiceFilter filters[kBenchMaxVoices];
+	VoiceRenderParams params;
+	float mix_l[kBenchMaxBlock];
+	float mix_r[kBenchMaxBlock];
+
+	// Voices at spread pitches with the four-pole filter and envelope on,
+	// as in PERFORM.
+	void Start(int count, bool stereo)
+	{
+		VoiceSample sample;
+		sample.l = bench_sample_l.data();
+		sample.r = stereo ? bench_sample_r.data() : bench_sample_l.data();
+		sample.stereo = stereo;
+		sample.resident = kBenchSampleFrames;
+		for (int v = 0; v < count; ++v)
+		{
+			voices[v] = PerformVoice();
+			voices[v].active = true;
+			voices[v].note = kBaseMidiNote + v;
+			voices[v].rate = 1.0f + 0.01f * static_cast<float>(v);
+			voices[v].length = kBenchSampleFrames;
+			voices[v].sample = sample;
+			filters[v].Reset();
+			filters[v].Set(kBenchSampleRate, 2000.0f, 0.9f);
+		}
+		params.env_active = true;
+		params.inv_attack_samples = 1.0f / (0.005f * kBenchSampleRate);
+		params.release_samples = 0.2f * kBenchSampleRate;
+		params.inv_release_samples = 1.0f / params.release_samples;
+	}
+
+	void Render(int count, size_t frames)
+	{
+		for (size_t i = 0; i < frames; ++i)
+		{
+			mix_l[i] = 0.0f;
+			mix_r[i] = 0.0f;
+		}
+		for (int v = 0; v < count; ++v)
+		{
+			PerformVoice& voice = voices[v];
+			if (!voice.active)
+			{
+				continue;
+			}
+			ResidentVoiceSource src;
+			src.l = voice.sample.l + voice.offset;
+			src.r = voice.sample.r + voice.offset;
+			DispatchPerformVoiceBlock(voice,
+									  filters[v],
+									  src,
+									  params,
+									  voice.sample.stereo,
+									  true,
+									  mix_l,
+									  mix_r,
+									  frames,
+									  1.0f,
+									  0.0f);
+		}
+	}
+};
+
+void BenchVoices(const BenchConfig& cfg, FxChainMemory* mem)
+{
+	const bool voice_selected = Selected(cfg, "voice");
+	const bool engine_selected = Selected(cfg, "engine");
+	if (!voice_selected && !engine_selected)
+	{
+		return;
+	}
+	static VoiceBench bench;
+	FxChain chain;
+	FxParamBlock fx_params;
+	kFxKernels[sizeof(kFxKernels) / sizeof(kFxKernels[0]) - 1].configure(fx_params);
+	const int32_t* chain_order = kFxKernels[sizeof(kFxKernels) / sizeof(kFxKernels[0]) - 1].order;
+	for (int stereo = 0; stereo < 2; ++stereo)
+	{
+		const char* channels = stereo ? "stereo" : "mono";
+		for (int count : kBenchVoiceCounts)
+		{
+			for (size_t block : kBenchBlocks)
+			{
+				if (voice_selected)
+				{
+					auto setup = [&]() { bench.Start(count, stereo != 0); };
+					auto run = [&](size_t, size_t frames) {
+						bench.Render(count, frames);
+						bench_sink = bench_sink + bench.mix_l[0] + bench.mix_r[frames - 1];
+					};
+					PrintRow("voice", block, count, channels, TimeBlocks(cfg, block, setup, run));
+				}
+				if (engine_selected)
+				{
+					auto setup = [&]() {
+						bench.Start(count, stereo != 0);
+						PrepareFxChain(chain, mem, fx_params);
+					};
+					auto run = [&](size_t, size_t frames) {
+						bench.Render(count, frames);
+						chain.BeginBlock(frames);
+						float acc = 0.0f;
+						for (size_t i = 0; i < frames; ++i)
+						{
+							float l = bench.mix_l[i];
+							float r = bench.mix_r[i];
+							chain.Process(chain_order, kPerformFaderCount, l, r);
+							acc += l + r;
+						}
+						bench_sink = bench_sink + acc;
+					};
+					PrintRow("engine", block, count, channels, TimeBlocks(cfg, block, setup, run));
+				}
+			}
+		}
+	}
+}
+
+int Usage()
+{
+	std::fprintf(stderr,
+				 "usage: wavecont_bench [--frames N] [--reps N] [--only KERNEL]\n"
+				 "kernels: tape_sat fx_sat fx_bitcrush fx_chorus fx_tape fx_delay\n"
+				 "         fx_reverb fx_reverb_shimmer fx_chain voice engine\n");
+	return 2;
+}
+
+}  // namespace
+
+int main(int argc, char** argv)
+{
+	BenchConfig cfg;
+	for (int i = 1; i < argc; ++i)
+	{
+		const std::string arg = argv[i];
+		const bool has_value = (i + 1 < argc);
+		if (arg == "--frames" && has_value)
+		{
+			cfg.frames = static_cast<size_t>(std::atol(argv[++i]));
+		}
+		else if (arg == "--reps" && has_value)
+		{
+			cfg.reps = std::atoi(argv[++i]);
+		}
+		else if (arg == "--only" && has_value)
+		{
+			cfg.only = argv[++i];
+		}
+		else
+		{
+			return Usage();
+		}
+	}
+	if (cfg.frames < kBenchMaxBlock || cfg.frames > kBenchSampleFrames / 2 || cfg.reps < 1)
+	{
+		return Usage();
+	}
+
+	InitBenchInputs();
+	std::vector<FxChainMemory> fx_memory(1);
+	std::printf("kernel,block,voices,channels,ns_per_frame,rt_load_pct\n");
+	BenchTapeSaturator(cfg);
+	BenchFxStages(cfg, fx_memory.data());
+	BenchVoices(cfg, fx_memory.data());
+	return 0;
+}
@@ -0,0 +1,725 @@
+// Offline renderer for the WaveCont DSP core. Plays a sample through the
+// PERFORM voice engine and FX chain from a MIDI file or event script and
+// writes the result to a WAV file, as fast as the host allows.
+//
+//   wavecont_render [options] <sample.wav> <events.mid|events.txt> <out.wav>
+//
+// Event scripts hold one "<seconds> on|off <note>" per line; '#' starts a
+// comment. Options:
+//   --set NAME=VALUE  set an FxParamBlock field (0..1), e.g. --set reverb_wet=0.4
+//   --order LIST      FX order as letters from s,m,d,r (default smdr)
+//   --block N         frames per block (default 16, as on the Pod)
+//   --tail SECONDS    render past the last event (default 2)
+//   --voices N        polyphony (default 16)
+//
+// Built with PROFILE=1 it also prints the callback profile per stage.
+#include "WaveContCore.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+constexpr float kHostSampleRate = 48000.0f;
+constexpr int kHostMaxVoices = 32;
+constexpr size_t kHostMaxBlock = 256;
+
+struct HostEvent
+{
+	uint64_t frame = 0;
+	bool on = false;
+	int32_t note = -1;
+};
+
+struct FxParamField
+{
+	const char* name;
+	float FxParamBlock::*member;
+};
+
+const FxParamField kFxParamFields[] = {
+	{"amp_attack", &FxParamBlock::amp_attack},
+	{"amp_decay", &FxParamBlock::amp_decay},
+	{"amp_sustain", &FxParamBlock::amp_sustain},
+	{"amp_release", &FxParamBlock::amp_release},
+	{"flt_cutoff", &FxParamBlock::flt_cutoff},
+	{"flt_res", &FxParamBlock::flt_res},
+	{"fx_s_wet", &FxParamBlock::fx_s_wet},
+	{"sat_drive", &FxParamBlock::sat_drive},
+	{"sat_tape_bump", &FxParamBlock::sat_tape_bump},
+	{"sat_bit_reso", &FxParamBlock::sat_bit_reso},
+	{"sat_bit_smpl", &FxParamBlock::sat_bit_smpl},
+	{"fx_c_wet", &FxParamBlock::fx_c_wet},
+	{"mod_depth", &FxParamBlock::mod_depth},
+	{"chorus_rate", &FxParamBlock::chorus_rate},
+	{"chorus_wow", &FxParamBlock::chorus_wow},
+	{"tape_rate", &FxParamBlock::tape_rate},
+	{"delay_wet", &FxParamBlock::delay_wet},
+	{"delay_time", &FxParamBlock::delay_time},
+	{"delay_feedback", &FxParamBlock::delay_feedback},
+	{"delay_spread", &FxParamBlock::delay_spread},
+	{"delay_freeze", &FxParamBlock::delay_freeze},
+	{"reverb_wet", &FxParamBlock::reverb_wet},
+	{"reverb_pre", &FxParamBlock::reverb_pre},
+	{"reverb_damp", &FxParamBlock::reverb_damp},
+	{"reverb_decay", &FxParamBlock::reverb_decay},
+	{"reverb_shimmer", &FxParamBlock::reverb_shimmer},
+};
+
+bool ReadFile(const char* path, std::vector<uint8_t>& data)
+{
+	FILE* f = std::fopen(path, "rb");
+	if (f == nullptr)
+	{
+		std::fprintf(stderr, "Cannot open %s\n", path);
+		return false;
+	}
+	std::fseek(f, 0, SEEK_END);
+	const long size = std::ftell(f);
+	std::fseek(f, 0, SEEK_SET);
+	data.resize(size > 0 ? static_cast<size_t>(size) : 0);
+	const size_t got = data.empty() ? 0 : std::fread(data.data(), 1, data.size(), f);
+	std::fclose(f);
+	if (got != data.size())
+	{
+		std::fprintf(stderr, "Short read on %s\n", path);
+		return false;
+	}
+	return true;
+}
+
+// Same restrictions as the Pod loader: 16-bit PCM, mono or stereo.
+bool LoadWav(const char* path, std::vector<int16_t>& l, std::vector<int16_t>& r, WavInfo& info)
+{
+	std::vector<uint8_t> data;
+	if (!ReadFile(path, data))
+	{
+		return false;
+	}
+	if (data.size() < 12
+		|| std::memcmp(data.data(), "RIFF", 4) != 0
+		|| std::memcmp(data.data() + 8, "WAVE", 4) != 0)
+	{
+		std::fprintf(stderr, "%s: not a RIFF/WAVE file\n", path);
+		return false;
+	}
+	info = WavInfo();
+	uint16_t format = 0;
+	bool fmt_found = false;
+	size_t pos = 12;
+	while (pos + 8 <= data.size())
+	{
+		const uint8_t* chunk = data.data() + pos;
+		const uint32_t chunk_size = WavReadLe32(chunk + 4);
+		const size_t body = pos + 8;
+		const size_t avail = (chunk_size <= data.size() - body) ? chunk_size : (data.size() - body);
+		if (std::memcmp(chunk, "fmt ", 4) == 0)
+		{
+			format = ParseWavFmtChunk(data.data() + body, avail, info);
+			fmt_found = true;
+		}
+		else if (std::memcmp(chunk, "data", 4) == 0)
+		{
+			info.data_offset = static_cast<uint32_t>(body);
+			info.data_size = static_cast<uint32_t>(avail);
+			break;
+		}
+		pos = body + chunk_size + (chunk_size & 1U);
+	}
+	if (!fmt_found || info.data_offset == 0)
+	{
+		std::fprintf(stderr, "%s: missing fmt or data chunk\n", path);
+		return false;
+	}
+	if (format != 1 || info.bits_per_sample != 16 || info.num_channels < 1 || info.num_channels > 2)
+	{
+		std::fprintf(stderr,
+					 "%s: need 16-bit PCM mono/stereo (fmt=%u bits=%u ch=%u)\n",
+					 path,
+					 static_cast<unsigned>(format),
+					 static_cast<unsigned>(info.bits_per_sample),
+					 static_cast<unsigned>(info.num_channels));
+		return false;
+	}
+	const size_t frames = info.data_size / (2U * info.num_channels);
+	std::vector<int16_t> pcm(frames * info.num_channels);
+	std::memcpy(pcm.data(), data.data() + info.data_offset, pcm.size() * sizeof(int16_t));
+	l.assign(frames, 0);
+	r.assign(info.num_channels == 2 ? frames : 0, 0);
+	DeinterleavePcm16(pcm.data(), frames, info.num_channels, l.data(), r.empty() ? nullptr : r.data());
+	return frames > 0;
+}
+
+uint32_t ReadBe32(const uint8_t* p)
+{
+	return (static_cast<uint32_t>(p[0]) << 24)
+		| (static_cast<uint32_t>(p[1]) << 16)
+		| (static_cast<uint32_t>(p[2]) << 8)
+		| static_cast<uint32_t>(p[3]);
+}
+
+bool ReadVarLen(const std::vector<uint8_t>& d, size_t& pos, size_t end, uint32_t& value)
+{
+	value = 0;
+	for (int i = 0; i < 4; ++i)
+	{
+		if (pos >= end)
+		{
+			return false;
+		}
+		const uint8_t b = d[pos++];
+		value = (value << 7) | (b & 0x7F);
+		if ((b & 0x80) == 0)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+// Standard MIDI file, format 0 or 1. Note on/off from every track, with the
+// tempo map applied; channels are merged like the Pod's MIDI input.
+bool LoadMidiFile(const char* path, std::vector<HostEvent>& events)
+{
+	std::vector<uint8_t> d;
+	if (!ReadFile(path, d))
+	{
+		return false;
+	}
+	if (d.size() < 14 || std::memcmp(d.data(), "MThd", 4) != 0)
+	{
+		std::fprintf(stderr, "%s: not a MIDI file\n", path);
+		return false;
+	}
+	const uint16_t track_count = static_cast<uint16_t>((d[10] << 8) | d[11]);
+	const uint16_t division = static_cast<uint16_t>((d[12] << 8) | d[13]);
+	if (division & 0x8000)
+	{
+		std::fprintf(stderr, "%s: SMPTE time division not supported\n", path);
+		return false;
+	}
+
+	struct TickEvent
+	{
+		uint64_t tick;
+		int kind;  // 0 = note off, 1 = note on, 2 = tempo
+		uint32_t value;
+	};
+	std::vector<TickEvent> ticks;
+	size_t pos = 8 + ReadBe32(d.data() + 4);
+	for (uint16_t t = 0; t < track_count && pos + 8 <= d.size(); ++t)
+	{
+		if (std::memcmp(d.data() + pos, "MTrk", 4) != 0)
+		{
+			std::fprintf(stderr, "%s: bad track header\n", path);
+			return false;
+		}
+		const size_t end = std::min(d.size(), pos + 8 + ReadBe32(d.data() + pos + 4));
+		pos += 8;
+		uint64_t tick = 0;
+		uint8_t status = 0;
+		while (pos < end)
+		{
+			uint32_t delta = 0;
+			if (!ReadVarLen(d, pos, end, delta) || pos >= end)
+			{
+				break;
+			}
+			tick += delta;
+			uint8_t b = d[pos];
+			if (b & 0x80)
+			{
+				status = b;
+				++pos;
+			}
+			if (status == 0xFF)
+			{
+				if (pos >= end)
+				{
+					break;
+				}
+				const uint8_t type = d[pos++];
+				uint32_t len = 0;
+				if (!ReadVarLen(d, pos, end, len) || pos + len > end)
+				{
+					break;
+				}
+				if (type == 0x51 && len == 3)
+				{
+					const uint32_t us = (d[pos] << 16) | (d[pos + 1] << 8) | d[pos + 2];
+					ticks.push_back({tick, 2, us});
+				}
+				pos += len;
+				status = 0;
+				continue;
+			}
+			if (status == 0xF0 || status == 0xF7)
+			{
+				uint32_t len = 0;
+				if (!ReadVarLen(d, pos, end, len))
+				{
+					break;
+				}
+				pos += len;
+				status = 0;
+				continue;
+			}
+			const uint8_t kind = status & 0xF0;
+			const int data_len = (kind == 0xC0 || kind == 0xD0) ? 1 : 2;
+			if (status == 0 || pos + data_len > end)
+			{
+				break;
+			}
+			if (kind == 0x90 || kind == 0x80)
+			{
+				const uint8_t note = d[pos];
+				const uint8_t vel = d[pos + 1];
+				const bool on = (kind == 0x90) && (vel > 0);
+				ticks.push_back({tick, on ? 1 : 0, note});
+			}
+			pos += data_len;
+		}
+		pos = end;
+	}
+	std::stable_sort(ticks.begin(), ticks.end(), [](const TickEvent& a, const TickEvent& b) {
+		return a.tick < b.tick;
+	});
+
+	double us_per_quarter = 500000.0;
+	double seconds = 0.0;
+	uint64_t last_tick = 0;
+	for (const TickEvent& e : ticks)
+	{
+		seconds += static_cast<double>(e.tick - last_tick) * us_per_quarter / (1e6 * division);
+		last_tick = e.tick;
+		if (e.kind == 2)
+		{
+			us_per_quarter = static_cast<double>(e.value);
+			continue;
+		}
+		HostEvent ev;
+		ev.frame = static_cast<uint64_t>(seconds * kHostSampleRate + 0.5);
+		ev.on = (e.kind == 1);
+		ev.note = static_cast<int32_t>(e.value);
+		events.push_back(ev);
+	}
+	return true;
+}
+
+bool LoadEventScript(const char* path, std::vector<HostEvent>& events)
+{
+	FILE* f = std::fopen(path, "r");
+	if (f == nullptr)
+	{
+		std::fprintf(stderr, "Cannot open %s\n", path);
+		return false;
+	}
+	char line[256];
+	int line_no = 0;
+	while (std::fgets(line, sizeof(line), f) != nullptr)
+	{
+		++line_no;
+		char* hash = std::strchr(line, '#');
+		if (hash != nullptr)
+		{
+			*hash = '\0';
+		}
+		double seconds = 0.0;
+		char kind[8] = {};
+		int note = -1;
+		const int n = std::sscanf(line, "%lf %7s %d", &seconds, kind, &note);
+		if (n <= 0)
+		{
+			continue;
+		}
+		const bool on = (std::strcmp(kind, "on") == 0);
+		if (n != 3 || seconds < 0.0 || note < 0 || note > 127 || (!on && std::strcmp(kind, "off") != 0))
+		{
+			std::fprintf(stderr, "%s:%d: expected \"<seconds> on|off <note>\"\n", path, line_no);
+			std::fclose(f);
+			return false;
+		}
+		HostEvent ev;
+		ev.frame = static_cast<uint64_t>(seconds * kHostSampleRate + 0.5);
+		ev.on = on;
+		ev.note = note;
+		events.push_back(ev);
+	}
+	std::fclose(f);
+	std::stable_sort(events.begin(), events.end(), [](const HostEvent& a, const HostEvent& b) {
+		return a.frame < b.frame;
+	});
+	return true;
+}
+
+bool WriteWav(const char* path, const std::vector<int16_t>& interleaved)
+{
+	FILE* f = std::fopen(path, "wb");
+	if (f == nullptr)
+	{
+		std::fprintf(stderr, "Cannot create %s\n", path);
+		return false;
+	}
+	const uint32_t data_bytes = static_cast<uint32_t>(interleaved.size() * sizeof(int16_t));
+	const uint32_t rate = static_cast<uint32_t>(kHostSampleRate);
+	uint8_t hdr[44];
+	auto put16 = [&](int at, uint16_t v) {
+		hdr[at] = static_cast<uint8_t>(v);
+		hdr[at + 1] = static_cast<uint8_t>(v >> 8);
+	};
+	auto put32 = [&](int at, uint32_t v) {
+		put16(at, static_cast<uint16_t>(v));
+		put16(at + 2, static_cast<uint16_t>(v >> 16));
+	};
+	std::memcpy(hdr, "RIFF", 4);
+	put32(4, 36 + data_bytes);
+	std::memcpy(hdr + 8, "WAVEfmt ", 8);
+	put32(16, 16);
+	put16(20, 1);
+	put16(22, 2);
+	put32(24, rate);
+	put32(28, rate * 4);
+	put16(32, 4);
+	put16(34, 16);
+	std::memcpy(hdr + 36, "data", 4);
+	put32(40, data_bytes);
+	bool ok = std::fwrite(hdr, 1, sizeof(hdr), f) == sizeof(hdr);
+	ok = ok && std::fwrite(interleaved.data(), 1, data_bytes, f) == data_bytes;
+	ok = (std::fclose(f) == 0) && ok;
+	if (!ok)
+	{
+		std::fprintf(stderr, "Write failed on %s\n", path);
+	}
+	return ok;
+}
+
+int16_t ToPcm16(float v)
+{
+	int32_t s = static_cast<int32_t>(v * 32767.0f);
+	if (s > 32767)
+	{
+		s = 32767;
+	}
+	else if (s < -32768)
+	{
+		s = -32768;
+	}
+	return static_cast<int16_t>(s);
+}
+
+bool EndsWith(const std::string& s, const char* suffix)
+{
+	const size_t n = std::strlen(suffix);
+	return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+int Usage()
+{
+	std::fprintf(stderr,
+				 "usage: wavecont_render [--set NAME=VALUE]... [--order smdr] [--block N]\n"
+				 "                       [--tail SECONDS] [--voices N]\n"
+				 "                       <sample.wav> <events.mid|events.txt> <out.wav>\n");
+	return 2;
+}
+
+}  // namespace
+
+int main(int argc, char** argv)
+{
+	FxParamBlock params;
+	int32_t order[kPerformFaderCount] = {kFxSatIndex, kFxChorusIndex, kFxDelayIndex, kFxReverbIndex};
+	size_t block = 16;
+	double tail_seconds = 2.0;
+	int voice_count = 16;
+	std::vector<const char*> paths;
+	for (int i = 1; i < argc; ++i)
+	{
+		const std::string arg = argv[i];
+		const bool has_value = (i + 1 < argc);
+		if (arg == "--set" && has_value)
+		{
+			const std::string kv = argv[++i];
+			const size_t eq = kv.find('=');
+			if (eq == std::string::npos)
+			{
+				return Usage();
+			}
+			bool found = false;
+			for (const FxParamField& field : kFxParamFields)
+			{
+				if (kv.compare(0, eq, field.name) == 0)
+				{
+					params.*field.member = std::strtof(kv.c_str() + eq + 1, nullptr);
+					found = true;
+				}
+			}
+			if (kv.compare(0, eq, "sat_mode") == 0 || kv.compare(0, eq, "chorus_mode") == 0)
+			{
+				int32_t& mode = (kv[0] == 's') ? params.sat_mode : params.chorus_mode;
+				mode = std::atoi(kv.c_str() + eq + 1);
+				found = true;
+			}
+			if (!found)
+			{
+				std::fprintf(stderr, "Unknown parameter: %s\n", kv.c_str());
+				return 2;
+			}
+		}
+		else if (arg == "--order" && has_value)
+		{
+			const std::string list = argv[++i];
+			if (list.size() != kPerformFaderCount)
+			{
+				return Usage();
+			}
+			for (int s = 0; s < kPerformFaderCount; ++s)
+			{
+				const char c = list[s];
+				order[s] = (c == 's') ? kFxSatIndex
+					: (c == 'm') ? kFxChorusIndex
+					: (c == 'd') ? kFxDelayIndex
+					: (c == 'r') ? kFxReverbIndex
+					: -1;
+			}
+		}
+		else if (arg == "--block" && has_value)
+		{
+			block = static_cast<size_t>(std::atoi(argv[++i]));
+		}
+		else if (arg == "--tail" && has_value)
+		{
+			tail_seconds = std::atof(argv[++i]);
+		}
+		else if (arg == "--voices" && has_value)
+		{
+			voice_count = std::atoi(argv[++i]);
+		}
+		else if (!arg.empty() && arg[0] == '-')
+		{
+			return Usage();
+		}
+		else
+		{
+			paths.push_back(argv[i]);
+		}
+	}
+	if (paths.size() != 3 || block < 1 || block > kHostMaxBlock || voice_count < 1
+		|| voice_count > kHostMaxVoices)
+	{
+		return Usage();
+	}
+
+	std::vector<int16_t> sample_l;
+	std::vector<int16_t> sample_r;
+	WavInfo wav;
+	if (!LoadWav(paths[0], sample_l, sample_r, wav))
+	{
+		return 1;
+	}
+	std::vector<HostEvent> events;
+	const std::string event_path = paths[1];
+	const bool midi = EndsWith(event_path, ".mid") || EndsWith(event_path, ".midi");
+	if (!(midi ? LoadMidiFile(paths[1], events) : LoadEventScript(paths[1], events)))
+	{
+		return 1;
+	}
+
+	// Same preparation the Pod does: clamp, compile every stage, apply.
+	ClampFxParams(params);
+	FxCoeffs coeffs;
+	CompileSatCoeffs(params, coeffs.sat);
+	CompileModCoeffs(params, coeffs.mod);
+	CompileDelayCoeffs(params, coeffs.delay, kHostSampleRate);
+	CompileReverbCoeffs(params, coeffs.reverb, kHostSampleRate);
+	std::vector<FxChainMemory> fx_memory(1);
+	FxChain fx_chain;
+	fx_chain.Init(kHostSampleRate, fx_memory.data());
+	fx_chain.SetParams(params);
+	for (int stage = 0; stage < kFxStageCount; ++stage)
+	{
+		fx_chain.ApplyStage(static_cast<FxStage>(stage), coeffs);
+	}
+
+	PerformVoice voices[kHostMaxVoices];
+	VoiceFilter filters[kHostMaxVoices];
+	uint64_t voice_started[kHostMaxVoices] = {};
+	const float flt_hz = FltCutoffFromFader(params.flt_cutoff, kHostSampleRate);
+	const float flt_q = FltQFromFader(params.flt_res);
+	for (int v = 0; v < voice_count; ++v)
+	{
+		filters[v].Set(kHostSampleRate, flt_hz, flt_q);
+	}
+	VoiceRenderParams vp;
+	vp.env_active = true;
+	const float attack_samples = AmpEnvMsFromFader(params.amp_attack) * 0.001f * kHostSampleRate;
+	const float release_samples = AmpEnvMsFromFader(params.amp_release) * 0.001f * kHostSampleRate;
+	vp.inv_attack_samples = (attack_samples > 1.0f) ? (1.0f / attack_samples) : 0.0f;
+	vp.release_samples = release_samples;
+	vp.inv_release_samples = (release_samples > 1.0f) ? (1.0f / release_samples) : 0.0f;
+
+	VoiceSample sample;
+	sample.l = sample_l.data();
+	sample.stereo = !sample_r.empty();
+	sample.r = sample.stereo ? sample_r.data() : sample_l.data();
+	sample.resident = sample_l.size();
+	const float rate_scale = static_cast<float>(wav.sample_rate) / kHostSampleRate;
+
+	auto note_on = [&](int32_t note, uint64_t now) {
+		int idx = -1;
+		for (int v = 0; v < voice_count && idx < 0; ++v)
+		{
+			if (!voices[v].active)
+			{
+				idx = v;
+			}
+		}
+		if (idx < 0)
+		{
+			// No steal fade here: the oldest voice is cut.
+			idx = 0;
+			for (int v = 1; v < voice_count; ++v)
+			{
+				if (voice_started[v] < voice_started[idx])
+				{
+					idx = v;
+				}
+			}
+		}
+		PerformVoice& voice = voices[idx];
+		voice = PerformVoice();
+		voice.note = note;
+		voice.rate = powf(2.0f, static_cast<float>(note - kBaseMidiNote) / 12.0f) * rate_scale;
+		voice.length = sample_l.size();
+		voice.sample = sample;
+		voice.active = true;
+		filters[idx].Reset();
+		voice_started[idx] = now;
+	};
+	auto note_off = [&](int32_t note) {
+		for (int v = 0; v < voice_count; ++v)
+		{
+			if (voices[v].active && !voices[v].releasing && voices[v].note == note)
+			{
+				BeginVoiceRelease(voices[v]);
+			}
+		}
+	};
+
+	const uint64_t last_event = events.empty() ? 0 : events.back().frame;
+	const uint64_t total_frames = last_event + static_cast<uint64_t>(tail_seconds * kHostSampleRate);
+	std::vector<int16_t> out;
+	out.reserve(total_frames * 2);
+	float mix_l[kHostMaxBlock];
+	float mix_r[kHostMaxBlock];
+	size_t next_event = 0;
+#if WAVECONT_PROFILE
+	ProfileWindow profile;
+	ProfileWindowReset(profile,
+					   static_cast<uint32_t>(ProfileTicksPerSecond() * static_cast<float>(block) / kHostSampleRate));
+#endif
+
+	const auto t0 = std::chrono::steady_clock::now();
+	for (uint64_t frame = 0; frame < total_frames; frame += block)
+	{
+		const size_t frames = static_cast<size_t>(std::min<uint64_t>(block, total_frames - frame));
+#if WAVECONT_PROFILE
+		const uint32_t profile_start = ProfileNow();
+#endif
+		std::fill(mix_l, mix_l + frames, 0.0f);
+		std::fill(mix_r, mix_r + frames, 0.0f);
+		// Events land on their exact frame: render up to each one, apply it.
+		size_t start = 0;
+		while (start < frames)
+		{
+			while (next_event < events.size() && events[next_event].frame <= frame + start)
+			{
+				const HostEvent& e = events[next_event++];
+				if (e.on)
+				{
+					note_on(e.note, frame + start);
+				}
+				else
+				{
+					note_off(e.note);
+				}
+			}
+			size_t span = frames - start;
+			if (next_event < events.size() && events[next_event].frame < frame + frames)
+			{
+				span = static_cast<size_t>(events[next_event].frame - frame) - start;
+			}
+			for (int v = 0; v < voice_count; ++v)
+			{
+				PerformVoice& voice = voices[v];
+				if (!voice.active)
+				{
+					continue;
+				}
+				ResidentVoiceSource src;
+				src.l = voice.sample.l + voice.offset;
+				src.r = voice.sample.r + voice.offset;
+				DispatchPerformVoiceBlock(voice,
+										  filters[v],
+										  src,
+										  vp,
+										  voice.sample.stereo,
+										  true,
+										  mix_l + start,
+										  mix_r + start,
+										  span,
+										  1.0f,
+										  0.0f);
+			}
+			start += span;
+		}
+#if WAVECONT_PROFILE
+		ProfileRecord(profile, ProfileStage::Voices, ProfileNow() - profile_start);
+#endif
+		fx_chain.BeginBlock(frames);
+		for (size_t i = 0; i < frames; ++i)
+		{
+			float l = mix_l[i];
+			float r = mix_r[i];
+			fx_chain.Process(order, kPerformFaderCount, l, r);
+			out.push_back(ToPcm16(l));
+			out.push_back(ToPcm16(r));
+		}
+#if WAVECONT_PROFILE
+		ProfileRecord(profile, ProfileStage::Sat, fx_chain.StageTicks(FxStage::Sat));
+		ProfileRecord(profile, ProfileStage::Mod, fx_chain.StageTicks(FxStage::Mod));
+		ProfileRecord(profile, ProfileStage::Delay, fx_chain.StageTicks(FxStage::Delay));
+		ProfileRecord(profile, ProfileStage::Reverb, fx_chain.StageTicks(FxStage::Reverb));
+		ProfileEndBlock(profile, ProfileNow() - profile_start);
+#endif
+	}
+	const auto t1 = std::chrono::steady_clock::now();
+
+	const double wall = std::chrono::duration<double>(t1 - t0).count();
+	const double audio = static_cast<double>(total_frames) / kHostSampleRate;
+	std::printf("Rendered %.2f s of audio in %.3f s (%.1fx real time, %.1f ns/frame)\n",
+				audio,
+				wall,
+				(wall > 0.0) ? audio / wall : 0.0,
+				(total_frames > 0) ? wall * 1e9 / static_cast<double>(total_frames) : 0.0);
+#if WAVECONT_PROFILE
+	// Percentages are of the 48 kHz block deadline, as on the Pod screen.
+	std::printf("stage   min%%   avg%%   p99%%   max%%   (overruns %lu/%lu)\n",
+				static_cast<unsigned long>(profile.overruns),
+				static_cast<unsigned long>(profile.blocks));
+	for (int i = 0; i < kProfileStageCount; ++i)
+	{
+		float min_pct = 0.0f;
+		float avg_pct = 0.0f;
+		float p99_pct = 0.0f;
+		float max_pct = 0.0f;
+		ProfileStageLoads(profile, static_cast<ProfileStage>(i), min_pct, avg_pct, p99_pct, max_pct);
+		std::printf("%-5s %6.2f %6.2f %6.2f %6.2f\n", kProfileStageNames[i], min_pct, avg_pct, p99_pct, max_pct);
+	}
+#endif
+	return WriteWav(paths[2], out) ? 0 : 1;
+}